@@ -106,6 +106,67 @@ typedef struct {
     uint32_t    mvFlags;
 } mvsharedEntity_t;
 
+// one request for trap_MVAPI_TraceBatch, same parameters as trap_Trace
+typedef struct {
+    float       start[3];
+    float       mins[3];
+    float       maxs[3];
+    float       end[3];
+    int32_t     passEntityNum;
+    int32_t     contentmask;
+    int32_t     capsule;
+    int32_t     traceFlags;
+    int32_t     useLod;
+} mvtrace_t;
+
+// request types for trap_MVAPI_BotAIBatch
+#define MVBOTAI_MOVE_TO_GOAL        1   // trap_BotMoveToGoal(&moveresult, handle, &goal, travelflags)
+#define MVBOTAI_CHOOSE_LTG_ITEM     2   // result = trap_BotChooseLTGItem(handle, origin, inventory, travelflags)
+#define MVBOTAI_CHOOSE_NBG_ITEM     3   // result = trap_BotChooseNBGItem(handle, origin, inventory, travelflags, &goal, maxtime)
+
+#define MVBOTAI_INVENTORY           256
+
+// same layout as bot_goal_t
+typedef struct {
+    float       origin[3];
+    int32_t     areanum;
+    float       mins[3];
+    float       maxs[3];
+    int32_t     entitynum;
+    int32_t     number;
+    int32_t     flags;
+    int32_t     iteminfo;
+} mvbotgoal_t;
+
+// same layout as bot_moveresult_t
+typedef struct {
+    int32_t     failure;
+    int32_t     type;
+    int32_t     blocked;
+    int32_t     blockentity;
+    int32_t     traveltype;
+    int32_t     flags;
+    int32_t     weapon;
+    float       movedir[3];
+    float       ideal_viewangles[3];
+} mvbotmoveresult_t;
+
+// one request for trap_MVAPI_BotAIBatch, the requests of a batch have to be
+// independent of each other
+typedef struct {
+    int32_t             type;                           // MVBOTAI_*
+    int32_t             handle;                         // move state or goal state
+    int32_t             travelflags;
+    float               maxtime;                        // MVBOTAI_CHOOSE_NBG_ITEM
+    float               origin[3];                      // item choices
+    int32_t             inventory[MVBOTAI_INVENTORY];   // item choices
+    mvbotgoal_t         goal;                           // goal to move to or long term goal
+
+    // results
+    int32_t             result;                         // item choices
+    mvbotmoveresult_t   moveresult;                     // MVBOTAI_MOVE_TO_GOAL
+} mvbotai_t;
+
 // ------------------------------------------ UI ------------------------------------------- //
 
 #define MVSORT_CLIENTS_NOBOTS 5
@@ -166,6 +227,12 @@ typedef enum
 
     // -714: void trap_MVAPI_Print( int flags, const char *string );
     MVAPI_PRINT,                                                                // SHARED
+
+    // -715: void trap_MVAPI_TraceBatch(trace_t *results, const mvtrace_t *traces, int numTraces);
+    G_MVAPI_TRACE_BATCH,                                                        // GAME
+
+    // -716: void trap_MVAPI_BotAIBatch(mvbotai_t *requests, int numRequests);
+    G_MVAPI_BOTAI_BATCH,                                                        // GAME
 } mvSyscall_t;
 // ----------------------------------------------------------------------------------------- //
 
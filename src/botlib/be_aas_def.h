@@ -128,6 +128,7 @@ typedef struct aas_settings_s
 typedef struct aas_routingcache_s
 {
 	byte type;									//portal or area cache
+	byte mapped;								//cache lives in the route cache file
 	float time;									//last time accessed or updated
 	int size;									//size of the routing cache
 	int cluster;								//cluster the cache is for
@@ -138,7 +139,7 @@ typedef struct aas_routingcache_s
 	struct aas_routingcache_s *prev, *next;
 	struct aas_routingcache_s *time_prev, *time_next;
 	unsigned char *reachabilities;				//reachabilities used for routing
-	unsigned short int traveltimes[1];			//travel time for every area (variable sized)
+	unsigned short int *traveltimes;			//travel time for every area
 } aas_routingcache_t;
 
 //fields for the routing algorithm
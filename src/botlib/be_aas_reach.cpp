@@ -45,25 +45,28 @@ extern botlib_import_t botimport;
 //area flag used for weapon jumping
 #define AREA_WEAPONJUMP						8192	//valid area to weapon jump to
 //number of reachabilities of each type
-int reach_swim;			//swim
-int reach_equalfloor;	//walk on floors with equal height
-int reach_step;			//step up
-int reach_walk;			//walk of step
-int reach_barrier;		//jump up to a barrier
-int reach_waterjump;	//jump out of water
-int reach_walkoffledge;	//walk of a ledge
-int reach_jump;			//jump
-int reach_ladder;		//climb or descent a ladder
-int reach_teleport;		//teleport
-int reach_elevator;		//use an elevator
-int reach_funcbob;		//use a func bob
-int reach_grapple;		//grapple hook
-int reach_doublejump;	//double jump
-int reach_rampjump;		//ramp jump
-int reach_strafejump;	//strafe jump (just normal jump but further)
-int reach_rocketjump;	//rocket jump
-int reach_bfgjump;		//bfg jump
-int reach_jumppad;		//jump pads
+typedef struct aas_reachcount_s
+{
+	int swim;			//swim
+	int equalfloor;		//walk on floors with equal height
+	int step;			//step up
+	int walk;			//walk of step
+	int barrier;		//jump up to a barrier
+	int waterjump;		//jump out of water
+	int walkoffledge;	//walk of a ledge
+	int jump;			//jump
+	int ladder;			//climb or descent a ladder
+	int teleport;		//teleport
+	int elevator;		//use an elevator
+	int funcbob;		//use a func bob
+	int grapple;		//grapple hook
+	int doublejump;		//double jump
+	int rampjump;		//ramp jump
+	int strafejump;		//strafe jump (just normal jump but further)
+	int rocketjump;		//rocket jump
+	int bfgjump;		//bfg jump
+	int jumppad;		//jump pads
+} aas_reachcount_t;
 //if true grapple reachabilities are skipped
 int calcgrapplereach;
 //linked reachability
@@ -84,6 +87,51 @@ aas_lreachability_t *reachabilityheap;	//heap with reachabilities
 aas_lreachability_t *nextreachability;	//next free reachability from the heap
 aas_lreachability_t **areareachability;	//reachability links for every area
 int numlreachabilities;
+//reachability counters of the calling thread, a job counts for its area first
+aas_reachcount_t reachcounts;
+static thread_local aas_reachcount_t *reachcount = &reachcounts;
+//areas are calculated in batches on the job threads and the links are added
+//in area order on the main thread, as if the areas were calculated one by one
+#define REACHABILITY_BATCHAREAS				16		//areas per job thread in a batch
+#define REACHABILITY_THREADLINKS			4096	//links a job thread can hold per batch
+#define REACHABILITY_THREADREADS			1024	//looked up lists a job thread can hold per batch
+//reachability of an area calculated on a job thread
+typedef struct aas_reacharea_s
+{
+	int areanum;					//area the reachabilities are calculated for
+	int threadnum;					//job thread that calculated the area
+	int firstalloc, numallocs;		//links allocated in the thread buffer
+	int firstlink, numlinks;		//links added to reachability lists
+	int firstread, numreads;		//areas of which the reachability list was looked at
+	int overflow;					//the thread buffer was too small
+	aas_reachcount_t count;			//reachability counters of the area
+} aas_reacharea_t;
+//links and list lookups of a job thread
+typedef struct aas_reachthread_s
+{
+	aas_lreachability_t *allocs;	//links allocated by the jobs
+	int numallocs;
+	int *linkallocs;				//allocated link added to a list
+	int *linkareas;					//area of the list the link was added to
+	int numlinks;
+	int *reads;						//areas of which the reachability list was looked at
+	int numreads;
+	aas_lreachability_t spare;		//returned when the allocated links don't fit
+	aas_reacharea_t *area;			//area being calculated
+} aas_reachthread_t;
+//batch of areas
+typedef struct aas_reachbatch_s
+{
+	aas_reacharea_t *areas;
+	int numareas;
+	aas_reachthread_t *threads;
+	int numthreads;
+} aas_reachbatch_t;
+//job thread buffer of the calling thread, NULL on the main thread outside a batch
+static thread_local aas_reachthread_t *reachthread;
+//batch in which the reachability list of an area was last changed
+int *areareachabilitybatch;
+int reachabilitybatch;
 
 //===========================================================================
 // returns the surface area of the given face
@@ -472,6 +520,21 @@ aas_lreachability_t *AAS_AllocReachability(void)
 {
 	aas_lreachability_t *r;
 
+	//on a job thread the link goes in the thread buffer
+	if (reachthread)
+	{
+		if (reachthread->numallocs >= REACHABILITY_THREADLINKS)
+		{
+			reachthread->area->overflow = qtrue;
+			r = &reachthread->spare;
+		} //end if
+		else
+		{
+			r = &reachthread->allocs[reachthread->numallocs++];
+		} //end else
+		Com_Memset(r, 0, sizeof(aas_lreachability_t));
+		return r;
+	} //end if
 	if (!nextreachability) return NULL;
 	//make sure the error message only shows up once
 	if (!nextreachability->next) AAS_Error("AAS_MAX_REACHABILITYSIZE");
@@ -497,6 +560,28 @@ void AAS_FreeReachability(aas_lreachability_t *lreach)
 	numlreachabilities--;
 } //end of the function AAS_FreeReachability
 //===========================================================================
+// adds a reachability link to the reachability list of the given area
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void AAS_LinkReachability(int areanum, aas_lreachability_t *lreach)
+{
+	//on a job thread the link is added when the batch is committed
+	if (reachthread)
+	{
+		if (lreach == &reachthread->spare) return;
+		reachthread->linkallocs[reachthread->numlinks] = lreach - reachthread->allocs;
+		reachthread->linkareas[reachthread->numlinks] = areanum;
+		reachthread->numlinks++;
+		return;
+	} //end if
+	lreach->next = areareachability[areanum];
+	areareachability[areanum] = lreach;
+	areareachabilitybatch[areanum] = reachabilitybatch;
+} //end of the function AAS_LinkReachability
+//===========================================================================
 // returns qtrue if the area has reachability links
 //
 // Parameter:				-
@@ -769,7 +854,28 @@ unsigned short int AAS_BarrierJumpTravelTime(void)
 qboolean AAS_ReachabilityExists(int area1num, int area2num)
 {
 	aas_lreachability_t *r;
+	aas_reacharea_t *area;
+	int i;
 
+	//on a job thread also look at the links of the area not yet added to the lists
+	if (reachthread)
+	{
+		area = reachthread->area;
+		for (i = area->firstread; i < reachthread->numreads; i++)
+		{
+			if (reachthread->reads[i] == area1num) break;
+		} //end for
+		if (i >= reachthread->numreads)
+		{
+			if (reachthread->numreads >= REACHABILITY_THREADREADS) area->overflow = qtrue;
+			else reachthread->reads[reachthread->numreads++] = area1num;
+		} //end if
+		for (i = area->firstlink; i < reachthread->numlinks; i++)
+		{
+			if (reachthread->linkareas[i] == area1num &&
+				reachthread->allocs[reachthread->linkallocs[i]].areanum == area2num) return qtrue;
+		} //end for
+	} //end if
 	for (r = areareachability[area1num]; r; r = r->next)
 	{
 		if (r->areanum == area2num) return qtrue;
@@ -875,9 +981,8 @@ int AAS_Reachability_Swim(int area1num, int area2num)
 						lreach->traveltime += 200;
 					//if (!(AAS_PointContents(start) & MASK_WATER)) lreach->traveltime += 500;
 					//link the reachability
-					lreach->next = areareachability[area1num];
-					areareachability[area1num] = lreach;
-					reach_swim++;
+					AAS_LinkReachability(area1num, lreach);
+					reachcount->swim++;
 					return qtrue;
 				} //end if
 			} //end if
@@ -1010,8 +1115,7 @@ int AAS_Reachability_EqualFloorHeight(int area1num, int area2num)
 		VectorCopy(lr.end, lreach->end);
 		lreach->traveltype = lr.traveltype;
 		lreach->traveltime = lr.traveltime;
-		lreach->next = areareachability[area1num];
-		areareachability[area1num] = lreach;
+		AAS_LinkReachability(area1num, lreach);
 		//if going into a crouch area
 		if (!AAS_AreaCrouch(area1num) && AAS_AreaCrouch(area2num))
 		{
@@ -1027,7 +1131,7 @@ int AAS_Reachability_EqualFloorHeight(int area1num, int area2num)
 		//avoid rather small areas
 		//if (AAS_AreaGroundFaceArea(lreach->areanum) < 500) lreach->traveltime += 100;
 		//
-		reach_equalfloor++;
+		reachcount->equalfloor++;
 		return qtrue;
 	} //end if
 	return qfalse;
@@ -1360,8 +1464,7 @@ int AAS_Reachability_Step_Barrier_WaterJump_WalkOffLedge(int area1num, int area2
 			{
 				lreach->traveltime += aassettings.rs_startcrouch;
 			} //end if
-			lreach->next = areareachability[area1num];
-			areareachability[area1num] = lreach;
+			AAS_LinkReachability(area1num, lreach);
 			//NOTE: if there's nearby solid or a gap area after this area
 			/*
 			if (!AAS_NearbySolidOrGap(lreach->start, lreach->end))
@@ -1372,7 +1475,7 @@ int AAS_Reachability_Step_Barrier_WaterJump_WalkOffLedge(int area1num, int area2
 			//avoid rather small areas
 			//if (AAS_AreaGroundFaceArea(lreach->areanum) < 500) lreach->traveltime += 100;
 			//
-			reach_step++;
+			reachcount->step++;
 			return qtrue;
 		} //end if
 	} //end if
@@ -1422,10 +1525,9 @@ int AAS_Reachability_Step_Barrier_WaterJump_WalkOffLedge(int area1num, int area2
 					VectorMA(water_bestend, INSIDEUNITS_WATERJUMP, water_bestnormal, lreach->end);
 					lreach->traveltype = TRAVEL_WATERJUMP;
 					lreach->traveltime = aassettings.rs_waterjump;
-					lreach->next = areareachability[area1num];
-					areareachability[area1num] = lreach;
+					AAS_LinkReachability(area1num, lreach);
 					//we've got another waterjump reachability
-					reach_waterjump++;
+					reachcount->waterjump++;
 					return qtrue;
 				} //end if
 			} //end if
@@ -1470,10 +1572,9 @@ int AAS_Reachability_Step_Barrier_WaterJump_WalkOffLedge(int area1num, int area2
 					VectorMA(ground_bestend, INSIDEUNITS_WALKEND, ground_bestnormal, lreach->end);
 					lreach->traveltype = TRAVEL_BARRIERJUMP;
 					lreach->traveltime = aassettings.rs_barrierjump;//AAS_BarrierJumpTravelTime();
-					lreach->next = areareachability[area1num];
-					areareachability[area1num] = lreach;
+					AAS_LinkReachability(area1num, lreach);
 					//we've got another barrierjump reachability
-					reach_barrier++;
+					reachcount->barrier++;
 					return qtrue;
 				} //end if
 			} //end if
@@ -1517,10 +1618,9 @@ int AAS_Reachability_Step_Barrier_WaterJump_WalkOffLedge(int area1num, int area2
 				VectorMA(ground_bestend, INSIDEUNITS_WALKEND, ground_bestnormal, lreach->end);
 				lreach->traveltype = TRAVEL_WALK;
 				lreach->traveltime = 1;
-				lreach->next = areareachability[area1num];
-				areareachability[area1num] = lreach;
+				AAS_LinkReachability(area1num, lreach);
 				//we've got another walk reachability
-				reach_walk++;
+				reachcount->walk++;
 				return qtrue;
 			} //end if
 			// if no maximum fall height set or less than the max
@@ -1568,10 +1668,9 @@ int AAS_Reachability_Step_Barrier_WaterJump_WalkOffLedge(int area1num, int area2
 									lreach->traveltime += aassettings.rs_falldamage10;
 								} //end if
 							} //end if
-							lreach->next = areareachability[area1num];
-							areareachability[area1num] = lreach;
+							AAS_LinkReachability(area1num, lreach);
 							//
-							reach_walkoffledge++;
+							reachcount->walkoffledge++;
 							//NOTE: don't create a weapon (rl, bfg) jump reachability here
 							//because it interferes with other reachabilities
 							//like the ladder reachability
@@ -2344,13 +2443,12 @@ int AAS_Reachability_Jump(int area1num, int area2num)
 				lreach->traveltime += aassettings.rs_falldamage10;
 			} //end if
 		} //end if
-		lreach->next = areareachability[area1num];
-		areareachability[area1num] = lreach;
+		AAS_LinkReachability(area1num, lreach);
 		//
 		if ((traveltype & TRAVELTYPE_MASK) == TRAVEL_JUMP)
-			reach_jump++;
+			reachcount->jump++;
 		else
-			reach_walkoffledge++;
+			reachcount->walkoffledge++;
 	} //end if
 	return qfalse;
 } //end of the function AAS_Reachability_Jump
@@ -2484,10 +2582,9 @@ int AAS_Reachability_Ladder(int area1num, int area2num)
 			VectorMA(area2point, -3, plane1->normal, lreach->end);
 			lreach->traveltype = TRAVEL_LADDER;
 			lreach->traveltime = 10;
-			lreach->next = areareachability[area1num];
-			areareachability[area1num] = lreach;
+			AAS_LinkReachability(area1num, lreach);
 			//
-			reach_ladder++;
+			reachcount->ladder++;
 			//create a new reachability link
 			lreach = AAS_AllocReachability();
 			if (!lreach) return qfalse;
@@ -2499,10 +2596,9 @@ int AAS_Reachability_Ladder(int area1num, int area2num)
 			VectorMA(area1point, -3, plane1->normal, lreach->end);
 			lreach->traveltype = TRAVEL_LADDER;
 			lreach->traveltime = 10;
-			lreach->next = areareachability[area2num];
-			areareachability[area2num] = lreach;
+			AAS_LinkReachability(area2num, lreach);
 			//
-			reach_ladder++;
+			reachcount->ladder++;
 			//
 			return qtrue;
 		} //end if
@@ -2523,10 +2619,9 @@ int AAS_Reachability_Ladder(int area1num, int area2num)
 			VectorMA(lreach->end, -15, plane1->normal, lreach->end);
 			lreach->traveltype = TRAVEL_LADDER;
 			lreach->traveltime = 10;
-			lreach->next = areareachability[area1num];
-			areareachability[area1num] = lreach;
+			AAS_LinkReachability(area1num, lreach);
 			//
-			reach_ladder++;
+			reachcount->ladder++;
 			//create a new reachability link
 			lreach = AAS_AllocReachability();
 			if (!lreach) return qfalse;
@@ -2537,10 +2632,9 @@ int AAS_Reachability_Ladder(int area1num, int area2num)
 			VectorCopy(area1point, lreach->end);
 			lreach->traveltype = TRAVEL_WALKOFFLEDGE;
 			lreach->traveltime = 10;
-			lreach->next = areareachability[area2num];
-			areareachability[area2num] = lreach;
+			AAS_LinkReachability(area2num, lreach);
 			//
-			reach_walkoffledge++;
+			reachcount->walkoffledge++;
 			//
 			return qtrue;
 		} //end if
@@ -2619,10 +2713,9 @@ int AAS_Reachability_Ladder(int area1num, int area2num)
 					VectorCopy(trace.endpos, lreach->end);
 					lreach->traveltype = TRAVEL_LADDER;
 					lreach->traveltime = 10;
-					lreach->next = areareachability[area1num];
-					areareachability[area1num] = lreach;
+					AAS_LinkReachability(area1num, lreach);
 					//
-					reach_ladder++;
+					reachcount->ladder++;
 					//create a new reachability link
 					lreach = AAS_AllocReachability();
 					if (!lreach) return qfalse;
@@ -2636,10 +2729,9 @@ int AAS_Reachability_Ladder(int area1num, int area2num)
 					lreach->end[2] += 10;
 					lreach->traveltype = TRAVEL_JUMP;
 					lreach->traveltime = 10;
-					lreach->next = areareachability[area2num];
-					areareachability[area2num] = lreach;
+					AAS_LinkReachability(area2num, lreach);
 					//
-					reach_jump++;
+					reachcount->jump++;
 					//
 					return qtrue;
 #ifdef REACH_DEBUG
@@ -2685,10 +2777,9 @@ int AAS_Reachability_Ladder(int area1num, int area2num)
 					lreach->end[2] += 5;
 					lreach->traveltype = TRAVEL_JUMP;
 					lreach->traveltime = 10;
-					lreach->next = areareachability[area2num];
-					areareachability[area2num] = lreach;
+					AAS_LinkReachability(area2num, lreach);
 					//
-					reach_jump++;
+					reachcount->jump++;
 					//
 					Log_Write("jump far to ladder reach between %d and %d\r\n", area2num, area1num);
 					//
@@ -2912,10 +3003,9 @@ void AAS_Reachability_Teleport(void)
 			lreach->traveltype = TRAVEL_TELEPORT;
 			lreach->traveltype |= AAS_TravelFlagsForTeam(ent);
 			lreach->traveltime = aassettings.rs_teleport;
-			lreach->next = areareachability[area1num];
-			areareachability[area1num] = lreach;
+			AAS_LinkReachability(area1num, lreach);
 			//
-			reach_teleport++;
+			reachcount->teleport++;
 		} //end for
 		//unlink the invalid entity
 		AAS_UnlinkFromAreas(areas);
@@ -3122,8 +3212,7 @@ void AAS_Reachability_Elevator(void)
 						lreach->traveltype = TRAVEL_ELEVATOR;
 						lreach->traveltype |= AAS_TravelFlagsForTeam(ent);
 						lreach->traveltime = aassettings.rs_startelevator + height * 100 / speed;
-						lreach->next = areareachability[area1num];
-						areareachability[area1num] = lreach;
+						AAS_LinkReachability(area1num, lreach);
 						//don't go any further to the outside
 						n = 9999;
 						//
@@ -3131,7 +3220,7 @@ void AAS_Reachability_Elevator(void)
 						Log_Write("elevator reach from %d to %d\r\n", area1num, area2num);
 #endif //REACH_DEBUG
 						//
-						reach_elevator++;
+						reachcount->elevator++;
 					} //end for
 				} //end for
 			} //end for
@@ -3456,9 +3545,8 @@ void AAS_Reachability_FuncBobbing(void)
 					lreach->traveltype = TRAVEL_FUNCBOB;
 					lreach->traveltype |= AAS_TravelFlagsForTeam(ent);
 					lreach->traveltime = aassettings.rs_funcbob;
-					reach_funcbob++;
-					lreach->next = areareachability[startreach->areanum];
-					areareachability[startreach->areanum] = lreach;
+					reachcount->funcbob++;
+					AAS_LinkReachability(startreach->areanum, lreach);
 					//
 				} //end for
 			} //end for
@@ -3652,10 +3740,9 @@ void AAS_Reachability_JumpPad(void)
 					lreach->traveltype = TRAVEL_JUMPPAD;
 					lreach->traveltype |= AAS_TravelFlagsForTeam(ent);
 					lreach->traveltime = aassettings.rs_jumppad;
-					lreach->next = areareachability[link->areanum];
-					areareachability[link->areanum] = lreach;
+					AAS_LinkReachability(link->areanum, lreach);
 					//
-					reach_jumppad++;
+					reachcount->jumppad++;
 				} //end for
 			} //end if
 		} //end if
@@ -3755,10 +3842,9 @@ void AAS_Reachability_JumpPad(void)
 									lreach->traveltype = TRAVEL_JUMPPAD;
 									lreach->traveltype |= AAS_TravelFlagsForTeam(ent);
 									lreach->traveltime = aassettings.rs_aircontrolledjumppad;
-									lreach->next = areareachability[link->areanum];
-									areareachability[link->areanum] = lreach;
+									AAS_LinkReachability(link->areanum, lreach);
 									//
-									reach_jumppad++;
+									reachcount->jumppad++;
 								} //end for
 							}
 						} //end if
@@ -3905,10 +3991,9 @@ int AAS_Reachability_Grapple(int area1num, int area2num)
 		lreach->traveltype = TRAVEL_GRAPPLEHOOK;
 		VectorSubtract(lreach->end, lreach->start, dir);
 		lreach->traveltime = aassettings.rs_startgrapple + VectorLength(dir) * 0.25;
-		lreach->next = areareachability[area1num];
-		areareachability[area1num] = lreach;
+		AAS_LinkReachability(area1num, lreach);
 		//
-		reach_grapple++;
+		reachcount->grapple++;
 	} //end for
 	//
 	return qfalse;
@@ -4091,10 +4176,9 @@ int AAS_Reachability_WeaponJump(int area1num, int area2num)
 							lreach->traveltype = TRAVEL_ROCKETJUMP;
 							lreach->traveltime = aassettings.rs_rocketjump;
 						} //end else
-						lreach->next = areareachability[area1num];
-						areareachability[area1num] = lreach;
+						AAS_LinkReachability(area1num, lreach);
 						//
-						reach_rocketjump++;
+						reachcount->rocketjump++;
 						return qtrue;
 					} //end if
 				} //end if
@@ -4276,10 +4360,9 @@ void AAS_Reachability_WalkOffLedge(int areanum)
 								lreach->traveltime += aassettings.rs_falldamage10;
 							} //end if
 						} //end if
-						lreach->next = areareachability[areanum];
-						areareachability[areanum] = lreach;
+						AAS_LinkReachability(areanum, lreach);
 						//we've got another walk off ledge reachability
-						reach_walkoffledge++;
+						reachcount->walkoffledge++;
 					} //end if
 				} //end for
 			} //end for
@@ -4325,6 +4408,216 @@ void AAS_StoreReachability(void)
 	} //end for
 } //end of the function AAS_StoreReachability
 //===========================================================================
+// calculates the reachabilities from the given area to all other areas
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void AAS_CalculateAreaReachability(int area1num)
+{
+	int area2num;
+
+	//only create jumppad reachabilities from jumppad areas
+	if (aasworld.areasettings[area1num].contents & AREACONTENTS_JUMPPAD)
+	{
+		return;
+	} //end if
+	//loop over the areas
+	for (area2num = 1; area2num < aasworld.numareas; area2num++)
+	{
+		if (area1num == area2num) continue;
+		//never create reachabilities from teleporter or jumppad areas to regular areas
+		if (aasworld.areasettings[area1num].contents & (AREACONTENTS_TELEPORTER|AREACONTENTS_JUMPPAD))
+		{
+			if (!(aasworld.areasettings[area2num].contents & (AREACONTENTS_TELEPORTER|AREACONTENTS_JUMPPAD)))
+			{
+				continue;
+			} //end if
+		} //end if
+		//if there already is a reachability link from area 1 to 2
+		if (AAS_ReachabilityExists(area1num, area2num)) continue;
+		//check for a swim reachability
+		if (AAS_Reachability_Swim(area1num, area2num)) continue;
+		//check for a simple walk on equal floor height reachability
+		if (AAS_Reachability_EqualFloorHeight(area1num, area2num)) continue;
+		//check for step, barrier, waterjump and walk off ledge reachabilities
+		if (AAS_Reachability_Step_Barrier_WaterJump_WalkOffLedge(area1num, area2num)) continue;
+		//check for ladder reachabilities
+		if (AAS_Reachability_Ladder(area1num, area2num)) continue;
+		//check for a jump reachability
+		if (AAS_Reachability_Jump(area1num, area2num)) continue;
+	} //end for
+	//never create these reachabilities from teleporter or jumppad areas
+	if (aasworld.areasettings[area1num].contents & (AREACONTENTS_TELEPORTER|AREACONTENTS_JUMPPAD))
+	{
+		return;
+	} //end if
+	//loop over the areas
+	for (area2num = 1; area2num < aasworld.numareas; area2num++)
+	{
+		if (area1num == area2num) continue;
+		//
+		if (AAS_ReachabilityExists(area1num, area2num)) continue;
+		//check for a grapple hook reachability
+		if (calcgrapplereach) AAS_Reachability_Grapple(area1num, area2num);
+		//check for a weapon jump reachability
+		AAS_Reachability_WeaponJump(area1num, area2num);
+	} //end for
+} //end of the function AAS_CalculateAreaReachability
+//===========================================================================
+// calculates the reachabilities of one area of a batch on a job thread,
+// the links are kept in the thread buffer
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_ReachabilityAreaJob(void *data, int index, int threadNum)
+{
+	aas_reachbatch_t *batch = (aas_reachbatch_t *) data;
+	aas_reachthread_t *thread = &batch->threads[threadNum];
+	aas_reacharea_t *area = &batch->areas[index];
+
+	area->threadnum = threadNum;
+	area->firstalloc = thread->numallocs;
+	area->firstlink = thread->numlinks;
+	area->firstread = thread->numreads;
+	thread->area = area;
+	reachthread = thread;
+	reachcount = &area->count;
+	AAS_CalculateAreaReachability(area->areanum);
+	reachthread = NULL;
+	reachcount = &reachcounts;
+	area->numallocs = thread->numallocs - area->firstalloc;
+	area->numlinks = thread->numlinks - area->firstlink;
+	area->numreads = thread->numreads - area->firstread;
+} //end of the function AAS_ReachabilityAreaJob
+//===========================================================================
+// adds the links of an area calculated on a job thread to the reachability
+// lists, the area is calculated again if an earlier area in the batch
+// changed one of the lists the job looked at
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_CommitReachabilityArea(aas_reachbatch_t *batch, aas_reacharea_t *area)
+{
+	aas_reachthread_t *thread = &batch->threads[area->threadnum];
+	aas_lreachability_t *lreach;
+	int i, *count;
+
+	//calculate again on the main thread if the thread buffer overflowed or the heap could run out
+	if (area->overflow || numlreachabilities + area->numallocs >= AAS_MAX_REACHABILITYSIZE - 1)
+	{
+		AAS_CalculateAreaReachability(area->areanum);
+		return;
+	} //end if
+	for (i = 0; i < area->numreads; i++)
+	{
+		if (areareachabilitybatch[thread->reads[area->firstread + i]] == reachabilitybatch)
+		{
+			AAS_CalculateAreaReachability(area->areanum);
+			return;
+		} //end if
+	} //end for
+	//add the links in the order the job added them
+	for (i = area->firstlink; i < area->firstlink + area->numlinks; i++)
+	{
+		lreach = AAS_AllocReachability();
+		Com_Memcpy(lreach, &thread->allocs[thread->linkallocs[i]], sizeof(aas_lreachability_t));
+		AAS_LinkReachability(thread->linkareas[i], lreach);
+	} //end for
+	//links allocated but never added still take room on the heap
+	for (i = area->numlinks; i < area->numallocs; i++)
+	{
+		AAS_AllocReachability();
+	} //end for
+	count = (int *) &area->count;
+	for (i = 0; i < (int) (sizeof(aas_reachcount_t) / sizeof(int)); i++)
+	{
+		((int *) &reachcounts)[i] += count[i];
+	} //end for
+} //end of the function AAS_CommitReachabilityArea
+//===========================================================================
+// calculates the reachabilities of the next areas on the job threads
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_ReachabilityBatch(aas_reachbatch_t *batch, int numareas)
+{
+	int i;
+
+	for (i = 0; i < numareas; i++)
+	{
+		Com_Memset(&batch->areas[i], 0, sizeof(aas_reacharea_t));
+		batch->areas[i].areanum = aasworld.numreachabilityareas + i;
+	} //end for
+	batch->numareas = numareas;
+	for (i = 0; i < batch->numthreads; i++)
+	{
+		batch->threads[i].numallocs = 0;
+		batch->threads[i].numlinks = 0;
+		batch->threads[i].numreads = 0;
+	} //end for
+	//the reachability lists are only read while the jobs run
+	botimport.ParallelFor(numareas, batch->numthreads, AAS_ReachabilityAreaJob, batch);
+	//add the links in area order
+	reachabilitybatch++;
+	for (i = 0; i < numareas; i++)
+	{
+		AAS_CommitReachabilityArea(batch, &batch->areas[i]);
+	} //end for
+	aasworld.numreachabilityareas += numareas;
+} //end of the function AAS_ReachabilityBatch
+//===========================================================================
+// sets up the thread buffers for calculating batches of areas
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_SetupReachabilityBatch(aas_reachbatch_t *batch, int numthreads)
+{
+	aas_reachthread_t *thread;
+	int i;
+
+	batch->numthreads = numthreads;
+	batch->areas = (aas_reacharea_t *) GetMemory(numthreads * REACHABILITY_BATCHAREAS * sizeof(aas_reacharea_t));
+	batch->threads = (aas_reachthread_t *) GetClearedMemory(numthreads * sizeof(aas_reachthread_t));
+	for (i = 0; i < numthreads; i++)
+	{
+		thread = &batch->threads[i];
+		thread->allocs = (aas_lreachability_t *) GetMemory(REACHABILITY_THREADLINKS * sizeof(aas_lreachability_t));
+		thread->linkallocs = (int *) GetMemory(REACHABILITY_THREADLINKS * sizeof(int));
+		thread->linkareas = (int *) GetMemory(REACHABILITY_THREADLINKS * sizeof(int));
+		thread->reads = (int *) GetMemory(REACHABILITY_THREADREADS * sizeof(int));
+	} //end for
+} //end of the function AAS_SetupReachabilityBatch
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_FreeReachabilityBatch(aas_reachbatch_t *batch)
+{
+	int i;
+
+	for (i = 0; i < batch->numthreads; i++)
+	{
+		FreeMemory(batch->threads[i].allocs);
+		FreeMemory(batch->threads[i].linkallocs);
+		FreeMemory(batch->threads[i].linkareas);
+		FreeMemory(batch->threads[i].reads);
+	} //end for
+	FreeMemory(batch->threads);
+	FreeMemory(batch->areas);
+} //end of the function AAS_FreeReachabilityBatch
+//===========================================================================
 //
 // TRAVEL_WALK					100%	equal floor height + steps
 // TRAVEL_CROUCH				100%
@@ -4351,9 +4644,10 @@ void AAS_StoreReachability(void)
 //===========================================================================
 int AAS_ContinueInitReachability(float time)
 {
-	int i, j, todo, start_time;
+	int i, todo, start_time, numthreads, numareas;
+	aas_reachbatch_t batch;
 	static float framereachability, reachability_delay;
-	static int lastpercentage;
+	static int lastpercentage, reachability_time;
 
 	if (!aasworld.loaded) return qfalse;
 	//if reachability is calculated for all areas
@@ -4365,70 +4659,42 @@ int AAS_ContinueInitReachability(float time)
 		lastpercentage = 0;
 		framereachability = 2000;
 		reachability_delay = 1000;
+		reachability_time = Sys_MilliSeconds();
 	} //end if
 	//number of areas to calculate reachability for this cycle
 	todo = aasworld.numreachabilityareas + (int) framereachability;
 	start_time = Sys_MilliSeconds();
+	//spread the areas over the job threads
+	numthreads = botimport.MaxJobThreads();
+	if (numthreads > 1) AAS_SetupReachabilityBatch(&batch, numthreads);
 	//loop over the areas
-	for (i = aasworld.numreachabilityareas; i < aasworld.numareas && i < todo; i++)
+	while (aasworld.numreachabilityareas < aasworld.numareas && aasworld.numreachabilityareas < todo)
 	{
-		aasworld.numreachabilityareas++;
-		//only create jumppad reachabilities from jumppad areas
-		if (aasworld.areasettings[i].contents & AREACONTENTS_JUMPPAD)
+		if (numthreads > 1)
 		{
-			continue;
+			numareas = numthreads * REACHABILITY_BATCHAREAS;
+			if (numareas > aasworld.numareas - aasworld.numreachabilityareas)
+				numareas = aasworld.numareas - aasworld.numreachabilityareas;
+			if (numareas > todo - aasworld.numreachabilityareas)
+				numareas = todo - aasworld.numreachabilityareas;
+			AAS_ReachabilityBatch(&batch, numareas);
 		} //end if
-		//loop over the areas
-		for (j = 1; j < aasworld.numareas; j++)
-		{
-			if (i == j) continue;
-			//never create reachabilities from teleporter or jumppad areas to regular areas
-			if (aasworld.areasettings[i].contents & (AREACONTENTS_TELEPORTER|AREACONTENTS_JUMPPAD))
-			{
-				if (!(aasworld.areasettings[j].contents & (AREACONTENTS_TELEPORTER|AREACONTENTS_JUMPPAD)))
-				{
-					continue;
-				} //end if
-			} //end if
-			//if there already is a reachability link from area i to j
-			if (AAS_ReachabilityExists(i, j)) continue;
-			//check for a swim reachability
-			if (AAS_Reachability_Swim(i, j)) continue;
-			//check for a simple walk on equal floor height reachability
-			if (AAS_Reachability_EqualFloorHeight(i, j)) continue;
-			//check for step, barrier, waterjump and walk off ledge reachabilities
-			if (AAS_Reachability_Step_Barrier_WaterJump_WalkOffLedge(i, j)) continue;
-			//check for ladder reachabilities
-			if (AAS_Reachability_Ladder(i, j)) continue;
-			//check for a jump reachability
-			if (AAS_Reachability_Jump(i, j)) continue;
-		} //end for
-		//never create these reachabilities from teleporter or jumppad areas
-		if (aasworld.areasettings[i].contents & (AREACONTENTS_TELEPORTER|AREACONTENTS_JUMPPAD))
-		{
-			continue;
-		} //end if
-		//loop over the areas
-		for (j = 1; j < aasworld.numareas; j++)
+		else
 		{
-			if (i == j) continue;
-			//
-			if (AAS_ReachabilityExists(i, j)) continue;
-			//check for a grapple hook reachability
-			if (calcgrapplereach) AAS_Reachability_Grapple(i, j);
-			//check for a weapon jump reachability
-			AAS_Reachability_WeaponJump(i, j);
-		} //end for
+			AAS_CalculateAreaReachability(aasworld.numreachabilityareas++);
+		} //end else
 		//if the calculation took more time than the max reachability delay
 		if (Sys_MilliSeconds() - start_time > (int) reachability_delay) break;
 		//
 		if (aasworld.numreachabilityareas * 1000 / aasworld.numareas > lastpercentage) break;
-	} //end for
+	} //end while
+	if (numthreads > 1) AAS_FreeReachabilityBatch(&batch);
 	//
 	if (aasworld.numreachabilityareas == aasworld.numareas)
 	{
 		botimport.Print(PRT_MESSAGE, "\r%6.1f%%", (float) 100.0);
-		botimport.Print(PRT_MESSAGE, "\nplease wait while storing reachability...\n");
+		botimport.Print(PRT_MESSAGE, "\nreachability calculated in %d msec\n", Sys_MilliSeconds() - reachability_time);
+		botimport.Print(PRT_MESSAGE, "please wait while storing reachability...\n");
 		aasworld.numreachabilityareas++;
 	} //end if
 	//if this is the last step in the reachability calculations
@@ -4454,21 +4720,21 @@ int AAS_ContinueInitReachability(float time)
 		AAS_Reachability_FuncBobbing();
 		//
 #ifdef DEBUG
-		botimport.Print(PRT_MESSAGE, "%6d reach swim\n", reach_swim);
-		botimport.Print(PRT_MESSAGE, "%6d reach equal floor\n", reach_equalfloor);
-		botimport.Print(PRT_MESSAGE, "%6d reach step\n", reach_step);
-		botimport.Print(PRT_MESSAGE, "%6d reach barrier\n", reach_barrier);
-		botimport.Print(PRT_MESSAGE, "%6d reach waterjump\n", reach_waterjump);
-		botimport.Print(PRT_MESSAGE, "%6d reach walkoffledge\n", reach_walkoffledge);
-		botimport.Print(PRT_MESSAGE, "%6d reach jump\n", reach_jump);
-		botimport.Print(PRT_MESSAGE, "%6d reach ladder\n", reach_ladder);
-		botimport.Print(PRT_MESSAGE, "%6d reach walk\n", reach_walk);
-		botimport.Print(PRT_MESSAGE, "%6d reach teleport\n", reach_teleport);
-		botimport.Print(PRT_MESSAGE, "%6d reach funcbob\n", reach_funcbob);
-		botimport.Print(PRT_MESSAGE, "%6d reach elevator\n", reach_elevator);
-		botimport.Print(PRT_MESSAGE, "%6d reach grapple\n", reach_grapple);
-		botimport.Print(PRT_MESSAGE, "%6d reach rocketjump\n", reach_rocketjump);
-		botimport.Print(PRT_MESSAGE, "%6d reach jumppad\n", reach_jumppad);
+		botimport.Print(PRT_MESSAGE, "%6d reach swim\n", reachcounts.swim);
+		botimport.Print(PRT_MESSAGE, "%6d reach equal floor\n", reachcounts.equalfloor);
+		botimport.Print(PRT_MESSAGE, "%6d reach step\n", reachcounts.step);
+		botimport.Print(PRT_MESSAGE, "%6d reach barrier\n", reachcounts.barrier);
+		botimport.Print(PRT_MESSAGE, "%6d reach waterjump\n", reachcounts.waterjump);
+		botimport.Print(PRT_MESSAGE, "%6d reach walkoffledge\n", reachcounts.walkoffledge);
+		botimport.Print(PRT_MESSAGE, "%6d reach jump\n", reachcounts.jump);
+		botimport.Print(PRT_MESSAGE, "%6d reach ladder\n", reachcounts.ladder);
+		botimport.Print(PRT_MESSAGE, "%6d reach walk\n", reachcounts.walk);
+		botimport.Print(PRT_MESSAGE, "%6d reach teleport\n", reachcounts.teleport);
+		botimport.Print(PRT_MESSAGE, "%6d reach funcbob\n", reachcounts.funcbob);
+		botimport.Print(PRT_MESSAGE, "%6d reach elevator\n", reachcounts.elevator);
+		botimport.Print(PRT_MESSAGE, "%6d reach grapple\n", reachcounts.grapple);
+		botimport.Print(PRT_MESSAGE, "%6d reach rocketjump\n", reachcounts.rocketjump);
+		botimport.Print(PRT_MESSAGE, "%6d reach jumppad\n", reachcounts.jumppad);
 #endif
 		//*/
 		//store all the reachabilities
@@ -4477,6 +4743,7 @@ int AAS_ContinueInitReachability(float time)
 		AAS_ShutDownReachabilityHeap();
 		//
 		FreeMemory(areareachability);
+		FreeMemory(areareachabilitybatch);
 		//
 		aasworld.numreachabilityareas++;
 		//
@@ -4525,6 +4792,8 @@ void AAS_InitReachability(void)
 	//allocate area reachability link array
 	areareachability = (aas_lreachability_t **) GetClearedMemory(
 									aasworld.numareas * sizeof(aas_lreachability_t *));
+	areareachabilitybatch = (int *) GetClearedMemory(aasworld.numareas * sizeof(int));
+	reachabilitybatch = 0;
 	//
 	AAS_SetWeaponJumpAreaFlags();
 } //end of the function AAS_InitReachable
@@ -28,6 +28,9 @@
 #include "be_interface.h"
 #include "be_aas_def.h"
 
+#include <atomic>
+#include <mutex>
+
 #define ROUTING_DEBUG
 
 //travel time in hundreths of a second = distance * 100 / speed
@@ -67,6 +70,66 @@ int numportalcacheupdates;
 int routingcachesize;
 int max_routingcachesize;
 
+//route cache file with the area and portal cache for the default travel flags
+//precomputed, either mapped from maps/<mapname>.rcd or computed in memory
+typedef struct aas_routecachefile_s
+{
+	byte *buffer;								//route cache header followed by the cache
+	int size;									//size of the buffer
+	qboolean fromfile;							//buffer is from botimport.FS_MapFile
+	qboolean modified;							//some of the cache has been invalidated
+	int travelflags;							//travel flags the cache is valid for
+	int *clusterfirstcache;						//first area cache of every cluster
+	qboolean *clustervalid;						//area cache of the cluster is still valid
+	qboolean portalvalid;						//portal cache is still valid
+	int numareacache;
+	aas_routingcache_t *areacache;				//cache for the reachability areas of every cluster
+	aas_routingcache_t *portalcache;			//portal cache for every area
+} aas_routecachefile_t;
+
+aas_routecachefile_t routecachefile;
+
+//maximum number of used cache a routing thread remembers for the time list
+#define MAX_ROUTINGTHREADACCESS		1024
+
+//new cache per job thread put in the pool before every batch
+#define ROUTINGTHREAD_POOLCACHE		8
+//the pool grows up to this much cache per job thread when it runs empty
+#define MAX_ROUTINGTHREAD_POOLCACHE	64
+
+//routing state of a job thread while bot AI runs on the job threads
+typedef struct aas_routingthread_s
+{
+	aas_routingupdate_t *areaupdate;			//area update fields of the thread
+	aas_routingupdate_t *portalupdate;			//portal update fields of the thread
+	aas_routingcache_t *areascratch;			//used when the pool is empty, never linked
+	aas_routingcache_t *portalscratch;
+	int numaccessed;
+	aas_routingcache_t *accessed[MAX_ROUTINGTHREADACCESS];	//cache used by the thread
+} aas_routingthread_t;
+
+//cache allocated on the main thread that the job threads take new cache from
+typedef struct aas_routingcachepool_s
+{
+	aas_routingcache_t *first;
+	int num;
+} aas_routingcachepool_t;
+
+aas_routingthread_t *routingthreads;
+int numroutingthreads;
+//pools of area and portal cache, indexed by cache type
+aas_routingcachepool_t routingthreadpool[2];
+int routingthreadpoolsize;
+qboolean routingthreadpoolempty;
+//travel times in the cache of the area pool, enough for the largest cluster
+int routingthreadareasize;
+//cache calculated by the threads, linked into the time list afterwards
+aas_routingcache_t *routingthreadcache;
+//guards the memory allocation and adding cache to the cache lists
+static std::mutex routingthreadmutex;
+//routing state of the calling thread, NULL when not a routing thread
+static thread_local aas_routingthread_t *routingthread;
+
 //===========================================================================
 //
 // Parameter:			-
@@ -79,6 +142,11 @@ void AAS_RoutingInfo(void)
 	botimport.Print(PRT_MESSAGE, "%d area cache updates\n", numareacacheupdates);
 	botimport.Print(PRT_MESSAGE, "%d portal cache updates\n", numportalcacheupdates);
 	botimport.Print(PRT_MESSAGE, "%d bytes routing cache\n", routingcachesize);
+	if (routecachefile.buffer)
+	{
+		botimport.Print(PRT_MESSAGE, "%d bytes precomputed routing cache%s\n", routecachefile.size,
+										routecachefile.modified ? " (partly invalidated)" : "");
+	} //end if
 } //end of the function AAS_RoutingInfo
 #endif //ROUTING_DEBUG
 //===========================================================================
@@ -218,6 +286,8 @@ void AAS_LinkCache(aas_routingcache_t *cache)
 //===========================================================================
 void AAS_FreeRoutingCache(aas_routingcache_t *cache)
 {
+	//cache in the route cache file is never linked or freed
+	if (cache->mapped) return;
 	AAS_UnlinkCache(cache);
 	routingcachesize -= cache->size;
 	FreeMemory(cache);
@@ -236,6 +306,12 @@ void AAS_RemoveRoutingCacheInCluster( int clusternum )
 
 	if (!aasworld.clusterareacache)
 		return;
+	//the precomputed cache of this cluster is no longer up to date
+	if (routecachefile.clustervalid && routecachefile.clustervalid[clusternum])
+	{
+		routecachefile.clustervalid[clusternum] = qfalse;
+		routecachefile.modified = qtrue;
+	} //end if
 	cluster = &aasworld.clusters[clusternum];
 	for (i = 0; i < cluster->numareas; i++)
 	{
@@ -271,6 +347,11 @@ void AAS_RemoveRoutingCacheUsingArea( int areanum )
 		AAS_RemoveRoutingCacheInCluster( aasworld.portals[-clusternum].backcluster );
 	} //end else
 	// remove all portal cache
+	if (routecachefile.portalvalid)
+	{
+		routecachefile.portalvalid = qfalse;
+		routecachefile.modified = qtrue;
+	} //end if
 	for (i = 0; i < aasworld.numareas; i++)
 	{
 		//refresh portal cache
@@ -727,6 +808,7 @@ aas_routingcache_t *AAS_AllocRoutingCache(int numtraveltimes)
 	routingcachesize += size;
 	//
 	cache = (aas_routingcache_t *) GetClearedMemory(size);
+	cache->traveltimes = (unsigned short int *) ((unsigned char *) cache + sizeof(aas_routingcache_t));
 	cache->reachabilities = (unsigned char *) cache + sizeof(aas_routingcache_t)
 								+ numtraveltimes * sizeof(unsigned short int);
 	cache->size = size;
@@ -867,252 +949,436 @@ void AAS_InitRoutingUpdate(void)
 // Returns:				-
 // Changes Globals:		-
 //===========================================================================
-void AAS_CreateAllRoutingCache(void)
-{
-	int i, j, t;
-
-	aasworld.initialized = qtrue;
-	botimport.Print(PRT_MESSAGE, "AAS_CreateAllRoutingCache\n");
-	for (i = 1; i < aasworld.numareas; i++)
-	{
-		if (!AAS_AreaReachability(i)) continue;
-		for (j = 1; j < aasworld.numareas; j++)
-		{
-			if (i == j) continue;
-			if (!AAS_AreaReachability(j)) continue;
-			t = AAS_AreaTravelTimeToGoalArea(i, aasworld.areas[i].center, j, TFL_DEFAULT);
-			//Log_Write("traveltime from %d to %d is %d", i, j, t);
-		} //end for
-	} //end for
-	aasworld.initialized = qfalse;
-} //end of the function AAS_CreateAllRoutingCache
-//===========================================================================
-//
-// Parameter:			-
-// Returns:				-
-// Changes Globals:		-
-//===========================================================================
 
-//the route cache header
-//this header is followed by numportalcache + numareacache aas_routingcache_t
-//structures that store routing cache
+//the route cache file
+//the header is followed by the area cache for the reachability areas of
+//every cluster and then by the portal cache for every area. The cache is
+//stored at fixed offsets without any pointers so the file can be mapped
+//and used in place. Every cache stores its travel times followed by the
+//reachabilities and is padded to a multiple of 4 bytes.
 typedef struct routecacheheader_s
 {
 	int ident;
 	int version;
 	int numareas;
 	int numclusters;
+	int numportals;
 	int areacrc;
 	int clustercrc;
-	int numportalcache;
+	int areasettingscrc;
+	int reachabilitycrc;
+	int travelflags;							//travel flags the cache was computed with
 	int numareacache;
+	int numportalcache;
+	int size;									//size of the whole file
 } routecacheheader_t;
 
 #define RCID						(('C'<<24)+('R'<<16)+('E'<<8)+'M')
-#define RCVERSION					2
+#define RCVERSION					3
+
+//routing update fields of all the threads calculating the route cache file
+typedef struct routecachejob_s
+{
+	aas_routingupdate_t *update;
+	int numupdates;								//number of update fields per thread
+} routecachejob_t;
 
-//void AAS_DecompressVis(byte *in, int numareas, byte *decompressed);
-//int AAS_CompressVis(byte *vis, int numareas, byte *dest);
+static void AAS_CalculateAreaRoutingCache(aas_routingcache_t *areacache, aas_routingupdate_t *areaupdate);
+static void AAS_CalculatePortalRoutingCache(aas_routingcache_t *portalcache, aas_routingupdate_t *portalupdate, qboolean precomputed);
+static void AAS_FreeRoutingThreads(void);
 
-void AAS_WriteRouteCache(void)
+//===========================================================================
+// returns the size of a cache in the route cache file
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static int AAS_RouteCacheSize(int numtraveltimes)
 {
-	int i, j, numportalcache, numareacache, totalsize;
-	aas_routingcache_t *cache;
-	aas_cluster_t *cluster;
-	fileHandle_t fp;
-	char filename[MAX_QPATH];
-	routecacheheader_t routecacheheader;
+	int size;
 
-	numportalcache = 0;
-	for (i = 0; i < aasworld.numareas; i++)
+	size = numtraveltimes * sizeof(unsigned short int)
+				+ numtraveltimes * sizeof(unsigned char);
+	return (size + 3) & ~3;
+} //end of the function AAS_RouteCacheSize
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_RouteCacheHeader(routecacheheader_t *header, int travelflags)
+{
+	int i;
+
+	Com_Memset(header, 0, sizeof(routecacheheader_t));
+	header->ident = RCID;
+	header->version = RCVERSION;
+	header->numareas = aasworld.numareas;
+	header->numclusters = aasworld.numclusters;
+	header->numportals = aasworld.numportals;
+	header->areacrc = CRC_ProcessString( (unsigned char *)aasworld.areas, sizeof(aas_area_t) * aasworld.numareas );
+	header->clustercrc = CRC_ProcessString( (unsigned char *)aasworld.clusters, sizeof(aas_cluster_t) * aasworld.numclusters );
+	header->areasettingscrc = CRC_ProcessString( (unsigned char *)aasworld.areasettings, sizeof(aas_areasettings_t) * aasworld.numareasettings );
+	header->reachabilitycrc = CRC_ProcessString( (unsigned char *)aasworld.reachability, sizeof(aas_reachability_t) * aasworld.reachabilitysize );
+	header->travelflags = travelflags;
+	//
+	header->size = sizeof(routecacheheader_t);
+	for (i = 0; i < aasworld.numclusters; i++)
 	{
-		for (cache = aasworld.portalcache[i]; cache; cache = cache->next)
+		header->numareacache += aasworld.clusters[i].numreachabilityareas;
+		header->size += aasworld.clusters[i].numreachabilityareas *
+							AAS_RouteCacheSize(aasworld.clusters[i].numreachabilityareas);
+	} //end for
+	header->numportalcache = aasworld.numareas;
+	header->size += aasworld.numareas * AAS_RouteCacheSize(aasworld.numportals);
+} //end of the function AAS_RouteCacheHeader
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_SetRouteCacheFileArea(int clusternum, int areanum)
+{
+	int clusterareanum;
+	aas_routingcache_t *cache;
+
+	clusterareanum = AAS_ClusterAreaNum(clusternum, areanum);
+	if (clusterareanum >= aasworld.clusters[clusternum].numreachabilityareas) return;
+	cache = &routecachefile.areacache[routecachefile.clusterfirstcache[clusternum] + clusterareanum];
+	cache->areanum = areanum;
+	VectorCopy(aasworld.areas[areanum].center, cache->origin);
+} //end of the function AAS_SetRouteCacheFileArea
+//===========================================================================
+// creates the cache pointing into the route cache file buffer
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_SetupRouteCacheFile(void)
+{
+	int i, j, k, clusternum, numtraveltimes, offset;
+	routecacheheader_t *header;
+	aas_routingcache_t *cache;
+
+	header = (routecacheheader_t *) routecachefile.buffer;
+	routecachefile.travelflags = header->travelflags;
+	routecachefile.numareacache = header->numareacache;
+	routecachefile.clusterfirstcache = (int *) GetClearedMemory(
+							aasworld.numclusters * (sizeof(int) + sizeof(qboolean)));
+	routecachefile.clustervalid = (qboolean *) (routecachefile.clusterfirstcache + aasworld.numclusters);
+	routecachefile.areacache = (aas_routingcache_t *) GetClearedMemory(
+							(header->numareacache + header->numportalcache) * sizeof(aas_routingcache_t));
+	routecachefile.portalcache = routecachefile.areacache + header->numareacache;
+	routecachefile.portalvalid = qtrue;
+	routecachefile.modified = qfalse;
+	//
+	offset = sizeof(routecacheheader_t);
+	//area cache for the reachability areas of every cluster
+	for (i = 0, k = 0; i < aasworld.numclusters; i++)
+	{
+		numtraveltimes = aasworld.clusters[i].numreachabilityareas;
+		routecachefile.clusterfirstcache[i] = k;
+		routecachefile.clustervalid[i] = qtrue;
+		for (j = 0; j < numtraveltimes; j++, k++)
 		{
-			numportalcache++;
+			cache = &routecachefile.areacache[k];
+			cache->type = CACHETYPE_AREA;
+			cache->mapped = qtrue;
+			cache->cluster = i;
+			cache->starttraveltime = 1;
+			cache->travelflags = routecachefile.travelflags;
+			cache->traveltimes = (unsigned short int *) (routecachefile.buffer + offset);
+			cache->reachabilities = (unsigned char *) (cache->traveltimes + numtraveltimes);
+			offset += AAS_RouteCacheSize(numtraveltimes);
 		} //end for
 	} //end for
-	numareacache = 0;
-	for (i = 0; i < aasworld.numclusters; i++)
+	//find the area for every area cache, portals are in two clusters
+	for (i = 1; i < aasworld.numareas; i++)
 	{
-		cluster = &aasworld.clusters[i];
-		for (j = 0; j < cluster->numareas; j++)
+		clusternum = aasworld.areasettings[i].cluster;
+		if (clusternum > 0)
 		{
-			for (cache = aasworld.clusterareacache[i][j]; cache; cache = cache->next)
-			{
-				numareacache++;
-			} //end for
-		} //end for
+			AAS_SetRouteCacheFileArea(clusternum, i);
+		} //end if
+		else if (clusternum < 0)
+		{
+			AAS_SetRouteCacheFileArea(aasworld.portals[-clusternum].frontcluster, i);
+			AAS_SetRouteCacheFileArea(aasworld.portals[-clusternum].backcluster, i);
+		} //end else if
 	} //end for
-	// open the file for writing
-	Com_sprintf(filename, MAX_QPATH, "maps/%s.rcd", aasworld.mapname);
-	botimport.FS_FOpenFile( filename, &fp, FS_WRITE );
-	if (!fp)
-	{
-		AAS_Error("Unable to open file: %s\n", filename);
-		return;
-	} //end if
-	//create the header
-	routecacheheader.ident = RCID;
-	routecacheheader.version = RCVERSION;
-	routecacheheader.numareas = aasworld.numareas;
-	routecacheheader.numclusters = aasworld.numclusters;
-	routecacheheader.areacrc = CRC_ProcessString( (unsigned char *)aasworld.areas, sizeof(aas_area_t) * aasworld.numareas );
-	routecacheheader.clustercrc = CRC_ProcessString( (unsigned char *)aasworld.clusters, sizeof(aas_cluster_t) * aasworld.numclusters );
-	routecacheheader.numportalcache = numportalcache;
-	routecacheheader.numareacache = numareacache;
-	//write the header
-	botimport.FS_Write(&routecacheheader, sizeof(routecacheheader_t), fp);
-	//
-	totalsize = 0;
-	//write all the cache
+	//portal cache for every area
+	numtraveltimes = aasworld.numportals;
 	for (i = 0; i < aasworld.numareas; i++)
 	{
-		for (cache = aasworld.portalcache[i]; cache; cache = cache->next)
-		{
-			botimport.FS_Write(cache, cache->size, fp);
-			totalsize += cache->size;
-		} //end for
+		cache = &routecachefile.portalcache[i];
+		cache->type = CACHETYPE_PORTAL;
+		cache->mapped = qtrue;
+		//a goal area in a portal is assumed to be part of the front cluster
+		clusternum = aasworld.areasettings[i].cluster;
+		if (clusternum < 0) clusternum = aasworld.portals[-clusternum].frontcluster;
+		cache->cluster = clusternum;
+		cache->areanum = i;
+		VectorCopy(aasworld.areas[i].center, cache->origin);
+		cache->starttraveltime = 1;
+		cache->travelflags = routecachefile.travelflags;
+		cache->traveltimes = (unsigned short int *) (routecachefile.buffer + offset);
+		cache->reachabilities = (unsigned char *) (cache->traveltimes + numtraveltimes);
+		offset += AAS_RouteCacheSize(numtraveltimes);
 	} //end for
-	for (i = 0; i < aasworld.numclusters; i++)
+} //end of the function AAS_SetupRouteCacheFile
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void AAS_FreeRouteCacheFile(void)
+{
+	int i, j;
+	aas_routingcache_t *cache, *nextcache;
+
+	if (!routecachefile.buffer) return;
+	//remove the precomputed cache from the cache lists
+	if (aasworld.clusterareacache)
 	{
-		cluster = &aasworld.clusters[i];
-		for (j = 0; j < cluster->numareas; j++)
+		for (i = 0; i < aasworld.numclusters; i++)
 		{
-			for (cache = aasworld.clusterareacache[i][j]; cache; cache = cache->next)
+			for (j = 0; j < aasworld.clusters[i].numareas; j++)
 			{
-				botimport.FS_Write(cache, cache->size, fp);
-				totalsize += cache->size;
+				for (cache = aasworld.clusterareacache[i][j]; cache; cache = nextcache)
+				{
+					nextcache = cache->next;
+					if (!cache->mapped) continue;
+					if (cache->prev) cache->prev->next = cache->next;
+					else aasworld.clusterareacache[i][j] = cache->next;
+					if (cache->next) cache->next->prev = cache->prev;
+				} //end for
 			} //end for
 		} //end for
-	} //end for
-	// write the visareas
-	/*
-	for (i = 0; i < aasworld.numareas; i++)
+	} //end if
+	if (aasworld.portalcache)
 	{
-		if (!aasworld.areavisibility[i]) {
-			size = 0;
-			botimport.FS_Write(&size, sizeof(int), fp);
-			continue;
-		}
-		AAS_DecompressVis( aasworld.areavisibility[i], aasworld.numareas, aasworld.decompressedvis );
-		size = AAS_CompressVis( aasworld.decompressedvis, aasworld.numareas, aasworld.decompressedvis );
-		botimport.FS_Write(&size, sizeof(int), fp);
-		botimport.FS_Write(aasworld.decompressedvis, size, fp);
-	}
-	*/
+		for (i = 0; i < aasworld.numareas; i++)
+		{
+			for (cache = aasworld.portalcache[i]; cache; cache = nextcache)
+			{
+				nextcache = cache->next;
+				if (!cache->mapped) continue;
+				if (cache->prev) cache->prev->next = cache->next;
+				else aasworld.portalcache[i] = cache->next;
+				if (cache->next) cache->next->prev = cache->prev;
+			} //end for
+		} //end for
+	} //end if
 	//
-	botimport.FS_FCloseFile(fp);
-	botimport.Print(PRT_MESSAGE, "\nroute cache written to %s\n", filename);
-	botimport.Print(PRT_MESSAGE, "written %d bytes of routing cache\n", totalsize);
-} //end of the function AAS_WriteRouteCache
+	if (routecachefile.fromfile) botimport.FS_UnmapFile(routecachefile.buffer);
+	else FreeMemory(routecachefile.buffer);
+	if (routecachefile.areacache) FreeMemory(routecachefile.areacache);
+	if (routecachefile.clusterfirstcache) FreeMemory(routecachefile.clusterfirstcache);
+	Com_Memset(&routecachefile, 0, sizeof(aas_routecachefile_t));
+} //end of the function AAS_FreeRouteCacheFile
+//===========================================================================
+// returns the precomputed area cache if it can be used
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
 //===========================================================================
+static aas_routingcache_t *AAS_RouteCacheFileAreaCache(int clusternum, int clusterareanum, int travelflags)
+{
+	if (!routecachefile.buffer) return NULL;
+	if (routecachefile.travelflags != travelflags) return NULL;
+	if (!routecachefile.clustervalid[clusternum]) return NULL;
+	if (clusterareanum >= aasworld.clusters[clusternum].numreachabilityareas) return NULL;
+	return &routecachefile.areacache[routecachefile.clusterfirstcache[clusternum] + clusterareanum];
+} //end of the function AAS_RouteCacheFileAreaCache
+//===========================================================================
+// returns the precomputed portal cache if it can be used
 //
 // Parameter:			-
 // Returns:				-
 // Changes Globals:		-
 //===========================================================================
-aas_routingcache_t *AAS_ReadCache(fileHandle_t fp)
+static aas_routingcache_t *AAS_RouteCacheFilePortalCache(int clusternum, int areanum, int travelflags)
 {
-	int size;
+	if (!routecachefile.buffer) return NULL;
+	if (routecachefile.travelflags != travelflags) return NULL;
+	if (!routecachefile.portalvalid) return NULL;
+	if (routecachefile.portalcache[areanum].cluster != clusternum) return NULL;
+	return &routecachefile.portalcache[areanum];
+} //end of the function AAS_RouteCacheFilePortalCache
+//===========================================================================
+// returns the precomputed travel times towards the area in the cluster
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static unsigned short int *AAS_RouteCacheFileTravelTimes(int clusternum, int areanum)
+{
+	int clusterareanum;
+
+	clusterareanum = AAS_ClusterAreaNum(clusternum, areanum);
+	if (clusterareanum >= aasworld.clusters[clusternum].numreachabilityareas) return NULL;
+	return routecachefile.areacache[routecachefile.clusterfirstcache[clusternum] + clusterareanum].traveltimes;
+} //end of the function AAS_RouteCacheFileTravelTimes
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_AreaRoutingCacheJob(void *data, int index, int threadNum)
+{
+	routecachejob_t *job = (routecachejob_t *) data;
 	aas_routingcache_t *cache;
 
-	botimport.FS_Read(&size, sizeof(size), fp);
-	cache = (aas_routingcache_t *) GetMemory(size);
-	cache->size = size;
-	botimport.FS_Read((unsigned char *)cache + sizeof(size), size - sizeof(size), fp);
-	cache->reachabilities = (unsigned char *) cache + sizeof(aas_routingcache_t) - sizeof(unsigned short) +
-		(size - sizeof(aas_routingcache_t) + sizeof(unsigned short)) / 3 * 2;
-	return cache;
-} //end of the function AAS_ReadCache
+	cache = &routecachefile.areacache[index];
+	if (!cache->areanum) return;
+	AAS_CalculateAreaRoutingCache(cache, job->update + threadNum * job->numupdates);
+} //end of the function AAS_AreaRoutingCacheJob
 //===========================================================================
 //
 // Parameter:			-
 // Returns:				-
 // Changes Globals:		-
 //===========================================================================
-int AAS_ReadRouteCache(void)
+static void AAS_PortalRoutingCacheJob(void *data, int index, int threadNum)
 {
-	int i, clusterareanum;//, size;
-	fileHandle_t fp;
-	char filename[MAX_QPATH];
-	routecacheheader_t routecacheheader;
+	routecachejob_t *job = (routecachejob_t *) data;
 	aas_routingcache_t *cache;
 
-	Com_sprintf(filename, MAX_QPATH, "maps/%s.rcd", aasworld.mapname);
-	botimport.FS_FOpenFile( filename, &fp, FS_READ );
-	if (!fp)
+	cache = &routecachefile.portalcache[index];
+	if (!cache->areanum || cache->cluster <= 0) return;
+	AAS_CalculatePortalRoutingCache(cache, job->update + threadNum * job->numupdates, qtrue);
+} //end of the function AAS_PortalRoutingCacheJob
+//===========================================================================
+// calculates the area cache of all the clusters and the portal cache of
+// all the areas for the default travel flags on the job threads
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void AAS_CreateAllRoutingCache(void)
+{
+	int i, numthreads;
+	routecacheheader_t header;
+	routecachejob_t job;
+
+	//the current file might be mapped from the file that's about to be written
+	AAS_FreeRouteCacheFile();
+	//
+	AAS_RouteCacheHeader(&header, TFL_DEFAULT);
+	routecachefile.buffer = (byte *) GetClearedMemory(header.size);
+	routecachefile.size = header.size;
+	routecachefile.fromfile = qfalse;
+	Com_Memcpy(routecachefile.buffer, &header, sizeof(routecacheheader_t));
+	AAS_SetupRouteCacheFile();
+	//
+	numthreads = botimport.MaxJobThreads();
+	//every thread uses its own routing update fields
+	job.numupdates = 1;
+	for (i = 0; i < aasworld.numclusters; i++)
 	{
-		return qfalse;
-	} //end if
-	botimport.FS_Read(&routecacheheader, sizeof(routecacheheader_t), fp );
-	if (routecacheheader.ident != RCID)
+		if (aasworld.clusters[i].numreachabilityareas > job.numupdates)
+		{
+			job.numupdates = aasworld.clusters[i].numreachabilityareas;
+		} //end if
+	} //end for
+	job.update = (aas_routingupdate_t *) GetClearedMemory(numthreads * job.numupdates * sizeof(aas_routingupdate_t));
+	botimport.ParallelFor(header.numareacache, numthreads, AAS_AreaRoutingCacheJob, &job);
+	FreeMemory(job.update);
+	//the portal cache is calculated from the area cache
+	job.numupdates = aasworld.numportals + 1;
+	job.update = (aas_routingupdate_t *) GetClearedMemory(numthreads * job.numupdates * sizeof(aas_routingupdate_t));
+	botimport.ParallelFor(header.numportalcache, numthreads, AAS_PortalRoutingCacheJob, &job);
+	FreeMemory(job.update);
+	//
+	botimport.Print(PRT_MESSAGE, "AAS_CreateAllRoutingCache: %d area and %d portal cache on %d threads\n",
+						header.numareacache, header.numportalcache, numthreads);
+} //end of the function AAS_CreateAllRoutingCache
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void AAS_WriteRouteCache(void)
+{
+	fileHandle_t fp;
+	char filename[MAX_QPATH];
+
+	//a mapped file can't be written while it's mapped and invalidated
+	//cache has to be calculated again
+	if (!routecachefile.buffer || routecachefile.fromfile || routecachefile.modified)
 	{
-		AAS_Error("%s is not a route cache dump\n", filename);
-		return qfalse;
+		AAS_CreateAllRoutingCache();
 	} //end if
-	if (routecacheheader.version != RCVERSION)
+	// open the file for writing
+	Com_sprintf(filename, MAX_QPATH, "maps/%s.rcd", aasworld.mapname);
+	botimport.FS_FOpenFile( filename, &fp, FS_WRITE );
+	if (!fp)
 	{
-		AAS_Error("route cache dump has wrong version %d, should be %d", routecacheheader.version, RCVERSION);
-		return qfalse;
+		AAS_Error("Unable to open file: %s\n", filename);
+		return;
 	} //end if
-	if (routecacheheader.numareas != aasworld.numareas)
+	botimport.FS_Write(routecachefile.buffer, routecachefile.size, fp);
+	botimport.FS_FCloseFile(fp);
+	botimport.Print(PRT_MESSAGE, "\nroute cache written to %s\n", filename);
+	botimport.Print(PRT_MESSAGE, "written %d bytes of routing cache\n", routecachefile.size);
+} //end of the function AAS_WriteRouteCache
+//===========================================================================
+// maps the route cache file, the cache in it is used in place
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+int AAS_ReadRouteCache(void)
+{
+	int size;
+	char filename[MAX_QPATH];
+	routecacheheader_t routecacheheader, *fileheader;
+	void *buffer;
+
+	AAS_FreeRouteCacheFile();
+	//
+	Com_sprintf(filename, MAX_QPATH, "maps/%s.rcd", aasworld.mapname);
+	size = botimport.FS_MapFile(filename, &buffer);
+	if (!buffer)
 	{
-		//AAS_Error("route cache dump has wrong number of areas\n");
 		return qfalse;
 	} //end if
-	if (routecacheheader.numclusters != aasworld.numclusters)
+	fileheader = (routecacheheader_t *) buffer;
+	if (size < (int) sizeof(routecacheheader_t) || fileheader->ident != RCID)
 	{
-		//AAS_Error("route cache dump has wrong number of clusters\n");
+		botimport.FS_UnmapFile(buffer);
+		AAS_Error("%s is not a route cache dump\n", filename);
 		return qfalse;
 	} //end if
-	if (routecacheheader.areacrc !=
-		CRC_ProcessString( (unsigned char *)aasworld.areas, sizeof(aas_area_t) * aasworld.numareas ))
+	if (fileheader->version != RCVERSION)
 	{
-		//AAS_Error("route cache dump area CRC incorrect\n");
+		botimport.Print(PRT_WARNING, "%s has wrong version %d, should be %d\n", filename, fileheader->version, RCVERSION);
+		botimport.FS_UnmapFile(buffer);
 		return qfalse;
 	} //end if
-	if (routecacheheader.clustercrc !=
-		CRC_ProcessString( (unsigned char *)aasworld.clusters, sizeof(aas_cluster_t) * aasworld.numclusters ))
+	//the cache is only valid for the exact AAS data it was calculated from
+	AAS_RouteCacheHeader(&routecacheheader, fileheader->travelflags);
+	if (memcmp(fileheader, &routecacheheader, sizeof(routecacheheader_t)) || size != routecacheheader.size)
 	{
-		//AAS_Error("route cache dump cluster CRC incorrect\n");
+		botimport.Print(PRT_MESSAGE, "%s is out of date\n", filename);
+		botimport.FS_UnmapFile(buffer);
 		return qfalse;
 	} //end if
-	//read all the portal cache
-	for (i = 0; i < routecacheheader.numportalcache; i++)
-	{
-		cache = AAS_ReadCache(fp);
-		cache->next = aasworld.portalcache[cache->areanum];
-		cache->prev = NULL;
-		if (aasworld.portalcache[cache->areanum])
-			aasworld.portalcache[cache->areanum]->prev = cache;
-		aasworld.portalcache[cache->areanum] = cache;
-	} //end for
-	//read all the cluster area cache
-	for (i = 0; i < routecacheheader.numareacache; i++)
-	{
-		cache = AAS_ReadCache(fp);
-		clusterareanum = AAS_ClusterAreaNum(cache->cluster, cache->areanum);
-		cache->next = aasworld.clusterareacache[cache->cluster][clusterareanum];
-		cache->prev = NULL;
-		if (aasworld.clusterareacache[cache->cluster][clusterareanum])
-			aasworld.clusterareacache[cache->cluster][clusterareanum]->prev = cache;
-		aasworld.clusterareacache[cache->cluster][clusterareanum] = cache;
-	} //end for
-	// read the visareas
-	/*
-	aasworld.areavisibility = (byte **) GetClearedMemory(aasworld.numareas * sizeof(byte *));
-	aasworld.decompressedvis = (byte *) GetClearedMemory(aasworld.numareas * sizeof(byte));
-	for (i = 0; i < aasworld.numareas; i++)
-	{
-		botimport.FS_Read(&size, sizeof(size), fp );
-		if (size) {
-			aasworld.areavisibility[i] = (byte *) GetMemory(size);
-			botimport.FS_Read(aasworld.areavisibility[i], size, fp );
-		}
-	}
-	*/
-	//
-	botimport.FS_FCloseFile(fp);
+	routecachefile.buffer = (byte *) buffer;
+	routecachefile.size = size;
+	routecachefile.fromfile = qtrue;
+	AAS_SetupRouteCacheFile();
 	return qtrue;
 } //end of the function AAS_ReadRouteCache
 //===========================================================================
@@ -1222,8 +1488,13 @@ void AAS_InitRouting(void)
 	//
 	routingcachesize = 0;
 	max_routingcachesize = 1024 * (int) LibVarValue("max_routingcache", "4096");
-	// read any routing cache if available
-	AAS_ReadRouteCache();
+	// map the routing cache file if available
+	if (!AAS_ReadRouteCache() && LibVarValue("precomputeroutingcache", "0"))
+	{
+		// first run on this map, compute all the cache and save it
+		AAS_CreateAllRoutingCache();
+		AAS_WriteRouteCache();
+	} //end if
 } //end of the function AAS_InitRouting
 //===========================================================================
 //
@@ -1237,6 +1508,8 @@ void AAS_FreeRoutingCaches(void)
 	AAS_FreeAllClusterAreaCache();
 	// free all the existing portal cache
 	AAS_FreeAllPortalCache();
+	// free the precomputed cache
+	AAS_FreeRouteCacheFile();
 	// free cached travel times within areas
 	if (aasworld.areatraveltimes) FreeMemory(aasworld.areatraveltimes);
 	aasworld.areatraveltimes = NULL;
@@ -1251,6 +1524,7 @@ void AAS_FreeRoutingCaches(void)
 	aasworld.areaupdate = NULL;
 	if (aasworld.portalupdate) FreeMemory(aasworld.portalupdate);
 	aasworld.portalupdate = NULL;
+	AAS_FreeRoutingThreads();
 	// free lists with areas the reachabilities go through
 	if (aasworld.reachabilityareas) FreeMemory(aasworld.reachabilityareas);
 	aasworld.reachabilityareas = NULL;
@@ -1262,13 +1536,15 @@ void AAS_FreeRoutingCaches(void)
 	aasworld.areacontentstravelflags = NULL;
 } //end of the function AAS_FreeRoutingCaches
 //===========================================================================
-// update the given routing cache
+// calculates the given routing cache with the given routing update fields,
+// caches of the route cache file are calculated on several threads at once
 //
-// Parameter:			areacache		: routing cache to update
+// Parameter:			areacache		: routing cache to calculate
+//						areaupdate		: routing update fields of the calling thread
 // Returns:				-
 // Changes Globals:		-
 //===========================================================================
-void AAS_UpdateAreaRoutingCache(aas_routingcache_t *areacache)
+static void AAS_CalculateAreaRoutingCache(aas_routingcache_t *areacache, aas_routingupdate_t *areaupdate)
 {
 	int i, nextareanum, cluster, badtravelflags, clusterareanum, linknum;
 	int numreachabilityareas;
@@ -1278,13 +1554,8 @@ void AAS_UpdateAreaRoutingCache(aas_routingcache_t *areacache)
 	aas_reversedreachability_t *revreach;
 	aas_reversedlink_t *revlink;
 
-#ifdef ROUTING_DEBUG
-	numareacacheupdates++;
-#endif //ROUTING_DEBUG
 	//number of reachability areas within this cluster
 	numreachabilityareas = aasworld.clusters[areacache->cluster].numreachabilityareas;
-	//
-	aasworld.frameroutingupdates++;
 	//clear the routing update fields
 //	Com_Memset(aasworld.areaupdate, 0, aasworld.numareas * sizeof(aas_routingupdate_t));
 	//
@@ -1295,7 +1566,7 @@ void AAS_UpdateAreaRoutingCache(aas_routingcache_t *areacache)
 	//
 	Com_Memset(startareatraveltimes, 0, sizeof(startareatraveltimes));
 	//
-	curupdate = &aasworld.areaupdate[clusterareanum];
+	curupdate = &areaupdate[clusterareanum];
 	curupdate->areanum = areacache->areanum;
 	//VectorCopy(areacache->origin, curupdate->start);
 	curupdate->areatraveltimes = startareatraveltimes;
@@ -1351,7 +1622,7 @@ void AAS_UpdateAreaRoutingCache(aas_routingcache_t *areacache)
 			{
 				areacache->traveltimes[clusterareanum] = t;
 				areacache->reachabilities[clusterareanum] = linknum - aasworld.areasettings[nextareanum].firstreachablearea;
-				nextupdate = &aasworld.areaupdate[clusterareanum];
+				nextupdate = &areaupdate[clusterareanum];
 				nextupdate->areanum = nextareanum;
 				nextupdate->tmptraveltime = t;
 				//VectorCopy(reach->start, nextupdate->start);
@@ -1372,8 +1643,164 @@ void AAS_UpdateAreaRoutingCache(aas_routingcache_t *areacache)
 			} //end if
 		} //end for
 	} //end while
+} //end of the function AAS_CalculateAreaRoutingCache
+//===========================================================================
+// update the given routing cache
+//
+// Parameter:			areacache		: routing cache to update
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void AAS_UpdateAreaRoutingCache(aas_routingcache_t *areacache)
+{
+#ifdef ROUTING_DEBUG
+	numareacacheupdates++;
+#endif //ROUTING_DEBUG
+	//
+	aasworld.frameroutingupdates++;
+	AAS_CalculateAreaRoutingCache(areacache, aasworld.areaupdate);
 } //end of the function AAS_UpdateAreaRoutingCache
 //===========================================================================
+// clears all travel times of cache from the routing thread pool, the cache
+// can be larger than the cluster it's used for
+//
+// Parameter:			cache			: cache to clear
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_ClearThreadCache(aas_routingcache_t *cache)
+{
+	int numtraveltimes;
+
+	numtraveltimes = (cache->size - sizeof(aas_routingcache_t)) /
+						(sizeof(unsigned short int) + sizeof(unsigned char));
+	Com_Memset(cache->traveltimes, 0, numtraveltimes * sizeof(unsigned short int));
+	Com_Memset(cache->reachabilities, 0, numtraveltimes * sizeof(unsigned char));
+} //end of the function AAS_ClearThreadCache
+//===========================================================================
+// returns the routing cache from the given cache list for a routing thread
+// the cache lists are read without locking, while the threads run cache is
+// only ever added at the head of a list. Missing cache is calculated in the
+// update fields of the thread and added to the list under the mutex, unless
+// another thread added the same cache in the meantime. The time list is left
+// to AAS_EndRoutingThreads. The threads can't allocate memory, new cache
+// comes from the pool filled by AAS_BeginRoutingThreads. When the pool is
+// empty the cache is calculated in the scratch cache of the thread which
+// is only valid until the thread asks for the next cache of the same type
+//
+// Parameter:			list			: cluster area cache or portal cache list
+//						type			: CACHETYPE_AREA or CACHETYPE_PORTAL
+// Returns:				routing cache
+// Changes Globals:		-
+//===========================================================================
+static aas_routingcache_t *AAS_ThreadRoutingCache(aas_routingcache_t **list, int type, int clusternum, int areanum, int travelflags)
+{
+	std::atomic<aas_routingcache_t *> *head;
+	aas_routingcache_t *cache, *first, *newcache;
+	qboolean scratch;
+
+	head = reinterpret_cast<std::atomic<aas_routingcache_t *> *>(list);
+	first = head->load(std::memory_order_acquire);
+	for (cache = first; cache; cache = cache->next)
+	{
+		if (cache->travelflags == travelflags) break;
+	} //end for
+	if (cache)
+	{
+		//remember the cache so it's moved to the end of the time list
+		if (!cache->mapped && routingthread->numaccessed < MAX_ROUTINGTHREADACCESS)
+		{
+			routingthread->accessed[routingthread->numaccessed++] = cache;
+		} //end if
+		return cache;
+	} //end if
+	//use the precomputed cache if available
+	if (type == CACHETYPE_AREA)
+	{
+		newcache = AAS_RouteCacheFileAreaCache(clusternum, AAS_ClusterAreaNum(clusternum, areanum), travelflags);
+	} //end if
+	else
+	{
+		newcache = AAS_RouteCacheFilePortalCache(clusternum, areanum, travelflags);
+	} //end else
+	scratch = qfalse;
+	if (!newcache)
+	{
+		//the job threads can't allocate memory, new cache comes from the pool
+		routingthreadmutex.lock();
+		newcache = routingthreadpool[type].first;
+		if (newcache)
+		{
+			routingthreadpool[type].first = newcache->next;
+			routingthreadpool[type].num--;
+			newcache->next = NULL;
+			routingcachesize += newcache->size;
+		} //end if
+		else
+		{
+			routingthreadpoolempty = qtrue;
+		} //end else
+#ifdef ROUTING_DEBUG
+		if (type == CACHETYPE_AREA) numareacacheupdates++;
+		else numportalcacheupdates++;
+#endif //ROUTING_DEBUG
+		routingthreadmutex.unlock();
+		//without one the routing is calculated again for every query
+		if (!newcache)
+		{
+			newcache = (type == CACHETYPE_AREA) ? routingthread->areascratch : routingthread->portalscratch;
+			AAS_ClearThreadCache(newcache);
+			scratch = qtrue;
+		} //end if
+		newcache->cluster = clusternum;
+		newcache->areanum = areanum;
+		VectorCopy(aasworld.areas[areanum].center, newcache->origin);
+		newcache->starttraveltime = 1;
+		newcache->travelflags = travelflags;
+		if (type == CACHETYPE_AREA) AAS_CalculateAreaRoutingCache(newcache, routingthread->areaupdate);
+		else AAS_CalculatePortalRoutingCache(newcache, routingthread->portalupdate, qfalse);
+	} //end if
+	//scratch cache is only used until the thread asks for the next one
+	if (scratch) return newcache;
+	//
+	routingthreadmutex.lock();
+	//check the cache other threads added since the list was searched
+	for (cache = head->load(std::memory_order_relaxed); cache != first; cache = cache->next)
+	{
+		if (cache->travelflags == travelflags) break;
+	} //end for
+	if (cache != first)
+	{
+		if (!newcache->mapped)
+		{
+			//back into the pool
+			routingcachesize -= newcache->size;
+			AAS_ClearThreadCache(newcache);
+			newcache->next = routingthreadpool[type].first;
+			routingthreadpool[type].first = newcache;
+			routingthreadpool[type].num++;
+		} //end if
+	} //end if
+	else
+	{
+		newcache->time = AAS_RoutingTime();
+		newcache->type = type;
+		newcache->prev = NULL;
+		newcache->next = first;
+		if (first) first->prev = newcache;
+		if (!newcache->mapped)
+		{
+			newcache->time_next = routingthreadcache;
+			routingthreadcache = newcache;
+		} //end if
+		//the cache is complete before other threads can find it
+		head->store(newcache, std::memory_order_release);
+		cache = newcache;
+	} //end else
+	routingthreadmutex.unlock();
+	return cache;
+} //end of the function AAS_ThreadRoutingCache
+//===========================================================================
 //
 // Parameter:			-
 // Returns:				-
@@ -1386,6 +1813,11 @@ aas_routingcache_t *AAS_GetAreaRoutingCache(int clusternum, int areanum, int tra
 
 	//number of the area in the cluster
 	clusterareanum = AAS_ClusterAreaNum(clusternum, areanum);
+	if (routingthread)
+	{
+		return AAS_ThreadRoutingCache(&aasworld.clusterareacache[clusternum][clusterareanum],
+										CACHETYPE_AREA, clusternum, areanum, travelflags);
+	} //end if
 	//pointer to the cache for the area in the cluster
 	clustercache = aasworld.clusterareacache[clusternum][clusterareanum];
 	//find the cache without undesired travel flags
@@ -1397,50 +1829,56 @@ aas_routingcache_t *AAS_GetAreaRoutingCache(int clusternum, int areanum, int tra
 	//if there was no cache
 	if (!cache)
 	{
-		cache = AAS_AllocRoutingCache(aasworld.clusters[clusternum].numreachabilityareas);
-		cache->cluster = clusternum;
-		cache->areanum = areanum;
-		VectorCopy(aasworld.areas[areanum].center, cache->origin);
-		cache->starttraveltime = 1;
-		cache->travelflags = travelflags;
+		//use the precomputed cache if available
+		cache = AAS_RouteCacheFileAreaCache(clusternum, clusterareanum, travelflags);
+		if (!cache)
+		{
+			cache = AAS_AllocRoutingCache(aasworld.clusters[clusternum].numreachabilityareas);
+			cache->cluster = clusternum;
+			cache->areanum = areanum;
+			VectorCopy(aasworld.areas[areanum].center, cache->origin);
+			cache->starttraveltime = 1;
+			cache->travelflags = travelflags;
+		} //end if
 		cache->prev = NULL;
 		cache->next = clustercache;
 		if (clustercache) clustercache->prev = cache;
 		aasworld.clusterareacache[clusternum][clusterareanum] = cache;
-		AAS_UpdateAreaRoutingCache(cache);
+		if (!cache->mapped) AAS_UpdateAreaRoutingCache(cache);
 	} //end if
-	else
+	else if (!cache->mapped)
 	{
 		AAS_UnlinkCache(cache);
 	} //end else
 	//the cache has been accessed
 	cache->time = AAS_RoutingTime();
 	cache->type = CACHETYPE_AREA;
-	AAS_LinkCache(cache);
+	//precomputed cache is never freed so it stays out of the time list
+	if (!cache->mapped) AAS_LinkCache(cache);
 	return cache;
 } //end of the function AAS_GetAreaRoutingCache
 //===========================================================================
+// calculates the given portal cache, the area cache it needs is taken from
+// the route cache file when precomputing the file
 //
-// Parameter:			-
+// Parameter:			portalcache		: portal cache to calculate
+//						portalupdate	: portal update fields of the calling thread
+//						precomputed		: area cache is in the route cache file
 // Returns:				-
 // Changes Globals:		-
 //===========================================================================
-void AAS_UpdatePortalRoutingCache(aas_routingcache_t *portalcache)
+static void AAS_CalculatePortalRoutingCache(aas_routingcache_t *portalcache, aas_routingupdate_t *portalupdate, qboolean precomputed)
 {
 	int i, portalnum, clusterareanum, clusternum;
-	unsigned short int t;
+	unsigned short int t, *traveltimes;
 	aas_portal_t *portal;
 	aas_cluster_t *cluster;
-	aas_routingcache_t *cache;
 	aas_routingupdate_t *updateliststart, *updatelistend, *curupdate, *nextupdate;
 
-#ifdef ROUTING_DEBUG
-	numportalcacheupdates++;
-#endif //ROUTING_DEBUG
 	//clear the routing update fields
 //	Com_Memset(aasworld.portalupdate, 0, (aasworld.numportals+1) * sizeof(aas_routingupdate_t));
 	//
-	curupdate = &aasworld.portalupdate[aasworld.numportals];
+	curupdate = &portalupdate[aasworld.numportals];
 	curupdate->cluster = portalcache->cluster;
 	curupdate->areanum = portalcache->areanum;
 	curupdate->tmptraveltime = portalcache->starttraveltime;
@@ -1468,8 +1906,17 @@ void AAS_UpdatePortalRoutingCache(aas_routingcache_t *portalcache)
 		//
 		cluster = &aasworld.clusters[curupdate->cluster];
 		//
-		cache = AAS_GetAreaRoutingCache(curupdate->cluster,
-								curupdate->areanum, portalcache->travelflags);
+		//travel times towards the area of the current update
+		if (precomputed)
+		{
+			traveltimes = AAS_RouteCacheFileTravelTimes(curupdate->cluster, curupdate->areanum);
+			if (!traveltimes) continue;
+		} //end if
+		else
+		{
+			traveltimes = AAS_GetAreaRoutingCache(curupdate->cluster,
+								curupdate->areanum, portalcache->travelflags)->traveltimes;
+		} //end else
 		//take all portals of the cluster
 		for (i = 0; i < cluster->numportals; i++)
 		{
@@ -1481,7 +1928,7 @@ void AAS_UpdatePortalRoutingCache(aas_routingcache_t *portalcache)
 			clusterareanum = AAS_ClusterAreaNum(curupdate->cluster, portal->areanum);
 			if (clusterareanum >= cluster->numreachabilityareas) continue;
 			//
-			t = cache->traveltimes[clusterareanum];
+			t = traveltimes[clusterareanum];
 			if (!t) continue;
 			t += curupdate->tmptraveltime;
 			//
@@ -1489,7 +1936,7 @@ void AAS_UpdatePortalRoutingCache(aas_routingcache_t *portalcache)
 					portalcache->traveltimes[portalnum] > t)
 			{
 				portalcache->traveltimes[portalnum] = t;
-				nextupdate = &aasworld.portalupdate[portalnum];
+				nextupdate = &portalupdate[portalnum];
 				if (portal->frontcluster == curupdate->cluster)
 				{
 					nextupdate->cluster = portal->backcluster;
@@ -1516,6 +1963,19 @@ void AAS_UpdatePortalRoutingCache(aas_routingcache_t *portalcache)
 			} //end if
 		} //end for
 	} //end while
+} //end of the function AAS_CalculatePortalRoutingCache
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void AAS_UpdatePortalRoutingCache(aas_routingcache_t *portalcache)
+{
+#ifdef ROUTING_DEBUG
+	numportalcacheupdates++;
+#endif //ROUTING_DEBUG
+	AAS_CalculatePortalRoutingCache(portalcache, aasworld.portalupdate, qfalse);
 } //end of the function AAS_UpdatePortalRoutingCache
 //===========================================================================
 //
@@ -1527,6 +1987,10 @@ aas_routingcache_t *AAS_GetPortalRoutingCache(int clusternum, int areanum, int t
 {
 	aas_routingcache_t *cache;
 
+	if (routingthread)
+	{
+		return AAS_ThreadRoutingCache(&aasworld.portalcache[areanum], CACHETYPE_PORTAL, clusternum, areanum, travelflags);
+	} //end if
 	//find the cached portal routing if existing
 	for (cache = aasworld.portalcache[areanum]; cache; cache = cache->next)
 	{
@@ -1535,31 +1999,212 @@ aas_routingcache_t *AAS_GetPortalRoutingCache(int clusternum, int areanum, int t
 	//if the portal routing isn't cached
 	if (!cache)
 	{
-		cache = AAS_AllocRoutingCache(aasworld.numportals);
-		cache->cluster = clusternum;
-		cache->areanum = areanum;
-		VectorCopy(aasworld.areas[areanum].center, cache->origin);
-		cache->starttraveltime = 1;
-		cache->travelflags = travelflags;
+		//use the precomputed cache if available
+		cache = AAS_RouteCacheFilePortalCache(clusternum, areanum, travelflags);
+		if (!cache)
+		{
+			cache = AAS_AllocRoutingCache(aasworld.numportals);
+			cache->cluster = clusternum;
+			cache->areanum = areanum;
+			VectorCopy(aasworld.areas[areanum].center, cache->origin);
+			cache->starttraveltime = 1;
+			cache->travelflags = travelflags;
+		} //end if
 		//add the cache to the cache list
 		cache->prev = NULL;
 		cache->next = aasworld.portalcache[areanum];
 		if (aasworld.portalcache[areanum]) aasworld.portalcache[areanum]->prev = cache;
 		aasworld.portalcache[areanum] = cache;
 		//update the cache
-		AAS_UpdatePortalRoutingCache(cache);
+		if (!cache->mapped) AAS_UpdatePortalRoutingCache(cache);
 	} //end if
-	else
+	else if (!cache->mapped)
 	{
 		AAS_UnlinkCache(cache);
 	} //end else
 	//the cache has been accessed
 	cache->time = AAS_RoutingTime();
 	cache->type = CACHETYPE_PORTAL;
-	AAS_LinkCache(cache);
+	//precomputed cache is never freed so it stays out of the time list
+	if (!cache->mapped) AAS_LinkCache(cache);
 	return cache;
 } //end of the function AAS_GetPortalRoutingCache
 //===========================================================================
+// frees the routing state of the job threads
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_FreeRoutingThreads(void)
+{
+	int i;
+
+	aas_routingcache_t *cache, *nextcache;
+
+	for (i = 0; i < numroutingthreads; i++)
+	{
+		FreeMemory(routingthreads[i].areaupdate);
+		FreeMemory(routingthreads[i].portalupdate);
+		FreeMemory(routingthreads[i].areascratch);
+		FreeMemory(routingthreads[i].portalscratch);
+	} //end for
+	if (routingthreads) FreeMemory(routingthreads);
+	routingthreads = NULL;
+	numroutingthreads = 0;
+	//
+	for (i = 0; i < 2; i++)
+	{
+		for (cache = routingthreadpool[i].first; cache; cache = nextcache)
+		{
+			nextcache = cache->next;
+			FreeMemory(cache);
+		} //end for
+		routingthreadpool[i].first = NULL;
+		routingthreadpool[i].num = 0;
+	} //end for
+	routingthreadpoolsize = 0;
+	routingthreadpoolempty = qfalse;
+} //end of the function AAS_FreeRoutingThreads
+//===========================================================================
+// allocates cache that isn't counted as routing cache until a thread uses it
+//
+// Parameter:			numtraveltimes	: travel times in the cache
+// Returns:				cleared cache
+// Changes Globals:		-
+//===========================================================================
+static aas_routingcache_t *AAS_AllocThreadCache(int numtraveltimes)
+{
+	aas_routingcache_t *cache;
+
+	cache = AAS_AllocRoutingCache(numtraveltimes);
+	routingcachesize -= cache->size;
+	return cache;
+} //end of the function AAS_AllocThreadCache
+//===========================================================================
+// fills the cache pool of the given type for the next batch
+//
+// Parameter:			type			: CACHETYPE_AREA or CACHETYPE_PORTAL
+//						numtraveltimes	: travel times in the cache
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+static void AAS_FillRoutingThreadPool(int type, int numtraveltimes)
+{
+	aas_routingcache_t *cache;
+
+	while (routingthreadpool[type].num < numroutingthreads * routingthreadpoolsize)
+	{
+		cache = AAS_AllocThreadCache(numtraveltimes);
+		cache->next = routingthreadpool[type].first;
+		routingthreadpool[type].first = cache;
+		routingthreadpool[type].num++;
+	} //end while
+} //end of the function AAS_FillRoutingThreadPool
+//===========================================================================
+// prepares routing on the job threads, after this every thread can use the
+// routing cache once it called AAS_RoutingThread with its thread number
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void AAS_BeginRoutingThreads(void)
+{
+	int i, numthreads, maxreachabilityareas;
+
+	//the threads can't free cache
+	while(AvailableMemory() < 1 * 1024 * 1024) {
+		if (!AAS_FreeOldestCache()) break;
+	}
+	//
+	numthreads = botimport.MaxJobThreads();
+	if (numroutingthreads != numthreads)
+	{
+		AAS_FreeRoutingThreads();
+		//
+		maxreachabilityareas = 0;
+		for (i = 0; i < aasworld.numclusters; i++)
+		{
+			if (aasworld.clusters[i].numreachabilityareas > maxreachabilityareas)
+			{
+				maxreachabilityareas = aasworld.clusters[i].numreachabilityareas;
+			} //end if
+		} //end for
+		routingthreads = (aas_routingthread_t *) GetClearedMemory(numthreads * sizeof(aas_routingthread_t));
+		for (i = 0; i < numthreads; i++)
+		{
+			routingthreads[i].areaupdate = (aas_routingupdate_t *) GetClearedMemory(
+										maxreachabilityareas * sizeof(aas_routingupdate_t));
+			routingthreads[i].portalupdate = (aas_routingupdate_t *) GetClearedMemory(
+										(aasworld.numportals+1) * sizeof(aas_routingupdate_t));
+			routingthreads[i].areascratch = AAS_AllocThreadCache(maxreachabilityareas);
+			routingthreads[i].portalscratch = AAS_AllocThreadCache(aasworld.numportals);
+		} //end for
+		numroutingthreads = numthreads;
+		routingthreadareasize = maxreachabilityareas;
+		routingthreadpoolsize = ROUTINGTHREAD_POOLCACHE;
+	} //end if
+	//more cache for the next batch if a thread ran out of it
+	if (routingthreadpoolempty && routingthreadpoolsize < MAX_ROUTINGTHREAD_POOLCACHE)
+	{
+		routingthreadpoolsize *= 2;
+	} //end if
+	routingthreadpoolempty = qfalse;
+	AAS_FillRoutingThreadPool(CACHETYPE_AREA, routingthreadareasize);
+	AAS_FillRoutingThreadPool(CACHETYPE_PORTAL, aasworld.numportals);
+} //end of the function AAS_BeginRoutingThreads
+//===========================================================================
+// makes the calling thread a routing thread, -1 turns it back into a
+// regular thread
+//
+// Parameter:			threadnum		: job thread number
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void AAS_RoutingThread(int threadnum)
+{
+	if (threadnum < 0 || threadnum >= numroutingthreads) routingthread = NULL;
+	else routingthread = &routingthreads[threadnum];
+} //end of the function AAS_RoutingThread
+//===========================================================================
+// links the cache calculated by the threads into the time list and moves
+// the cache they used to the end of it
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void AAS_EndRoutingThreads(void)
+{
+	int i, j;
+	float time;
+	aas_routingcache_t *cache, *nextcache;
+
+	for (cache = routingthreadcache; cache; cache = nextcache)
+	{
+		nextcache = cache->time_next;
+		cache->time_next = NULL;
+		AAS_LinkCache(cache);
+	} //end for
+	routingthreadcache = NULL;
+	//
+	time = AAS_RoutingTime();
+	for (i = 0; i < numroutingthreads; i++)
+	{
+		for (j = 0; j < routingthreads[i].numaccessed; j++)
+		{
+			cache = routingthreads[i].accessed[j];
+			//new cache or already moved
+			if (cache->time == time) continue;
+			AAS_UnlinkCache(cache);
+			cache->time = time;
+			AAS_LinkCache(cache);
+		} //end for
+		routingthreads[i].numaccessed = 0;
+	} //end for
+} //end of the function AAS_EndRoutingThreads
+//===========================================================================
 //
 // Parameter:			-
 // Returns:				-
@@ -1601,8 +2246,8 @@ int AAS_AreaRouteToGoalArea(int areanum, const vec3_t origin, int goalareanum, i
 		} //end if
 		return qfalse;
 	} //end if
-	// make sure the routing cache doesn't grow to large
-	while(AvailableMemory() < 1 * 1024 * 1024) {
+	// make sure the routing cache doesn't grow to large, routing threads can't free cache
+	while(!routingthread && AvailableMemory() < 1 * 1024 * 1024) {
 		if (!AAS_FreeOldestCache()) break;
 	}
 	//
@@ -26,6 +26,12 @@ void AAS_WriteRouteCache(void);
 void AAS_RoutingInfo(void);
 #endif //AASINTERN
 
+//prepare routing on the job threads
+void AAS_BeginRoutingThreads(void);
+//make the calling job thread a routing thread, -1 ends it
+void AAS_RoutingThread(int threadnum);
+//update the cache time list after the routing threads are done
+void AAS_EndRoutingThreads(void);
 //returns the travel flag for the given travel type
 int AAS_TravelFlagForType(int traveltype);
 //return the travel flag(s) for traveling through this area
@@ -197,6 +197,20 @@ bot_goalstate_t *BotGoalStateFromHandle(int handle)
 	} //end if
 	return botgoalstates[handle];
 } //end of the function BotGoalStateFromHandle
+//========================================================================
+// returns the client of the goal state, -1 for an invalid handle
+// without printing an error
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//========================================================================
+int BotGoalStateClient(int handle)
+{
+	if (handle <= 0 || handle > MAX_CLIENTS) return -1;
+	if (!botgoalstates[handle]) return -1;
+	return botgoalstates[handle]->client;
+} //end of the function BotGoalStateClient
 //===========================================================================
 //
 // Parameter:				-
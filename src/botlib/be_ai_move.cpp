@@ -163,6 +163,20 @@ bot_movestate_t *BotMoveStateFromHandle(int handle)
 	return botmovestates[handle];
 } //end of the function BotMoveStateFromHandle
 //========================================================================
+// returns the client of the move state, -1 for an invalid handle
+// without printing an error
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//========================================================================
+int BotMoveStateClient(int handle)
+{
+	if (handle <= 0 || handle > MAX_CLIENTS) return -1;
+	if (!botmovestates[handle]) return -1;
+	return botmovestates[handle]->client;
+} //end of the function BotMoveStateClient
+//========================================================================
 //
 // Parameter:			-
 // Returns:				-
@@ -292,6 +292,136 @@ int Export_BotLibUpdateEntity(int ent, const bot_entitystate_t *state)
 // Returns:					-
 // Changes Globals:		-
 //===========================================================================
+int BotMoveStateClient(int handle);
+int BotGoalStateClient(int handle);
+
+//requests of a bot AI batch
+typedef struct botaibatch_s
+{
+	bot_airequest_t *requests;
+	int threaded[MAX_BOTAIREQUESTS];		//requests that run on the job threads
+} botaibatch_t;
+
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+static void BotAIRequest(bot_airequest_t *request)
+{
+	switch(request->type)
+	{
+		case BOTAI_MOVETOGOAL:
+			BotMoveToGoal(request->moveresult, request->handle, request->goal, request->travelflags);
+			request->result = 0;
+			break;
+		case BOTAI_CHOOSELTGITEM:
+			request->result = BotChooseLTGItem(request->handle, request->origin, request->inventory, request->travelflags);
+			break;
+		case BOTAI_CHOOSENBGITEM:
+			request->result = BotChooseNBGItem(request->handle, request->origin, request->inventory, request->travelflags,
+													request->goal, request->maxtime);
+			break;
+		default:
+			request->result = 0;
+			break;
+	} //end switch
+} //end of the function BotAIRequest
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+static void BotAIBatchJob(void *data, int index, int threadNum)
+{
+	botaibatch_t *batch = (botaibatch_t *) data;
+
+	AAS_RoutingThread(threadNum);
+	BotAIRequest(&batch->requests[batch->threaded[index]]);
+	AAS_RoutingThread(-1);
+} //end of the function BotAIBatchJob
+//===========================================================================
+// runs independent move and goal requests of several bots, on the job
+// threads when numthreads > 1. Every bot only changes its own move or goal
+// state and input, the AAS world is only read and the routing cache is
+// shared between the threads. Requests with an invalid handle and further
+// requests for a bot that is already in the batch run afterwards on the
+// calling thread
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
+void Export_BotAIBatch(bot_airequest_t *requests, int numrequests, int numthreads)
+{
+	botaibatch_t batch;
+	int i, first, num, numthreaded, client;
+	qboolean moveclients[MAX_CLIENTS+1], goalstates[MAX_CLIENTS+1];
+	qboolean serial[MAX_BOTAIREQUESTS];
+
+	if (!BotLibSetup("BotAIBatch")) return;
+	//
+	for (first = 0; first < numrequests; first += MAX_BOTAIREQUESTS)
+	{
+		num = numrequests - first;
+		if (num > MAX_BOTAIREQUESTS) num = MAX_BOTAIREQUESTS;
+		batch.requests = requests + first;
+		numthreaded = 0;
+		for (i = 0; i < num; i++) serial[i] = qtrue;
+		//find the requests that can run next to each other
+		if (numthreads > 1 && AAS_Initialized())
+		{
+			Com_Memset(moveclients, 0, sizeof(moveclients));
+			Com_Memset(goalstates, 0, sizeof(goalstates));
+			for (i = 0; i < num; i++)
+			{
+				if (batch.requests[i].type == BOTAI_MOVETOGOAL)
+				{
+					//the movement writes the input of the client
+					client = BotMoveStateClient(batch.requests[i].handle);
+					if (client < 0 || client > MAX_CLIENTS || moveclients[client]) continue;
+					moveclients[client] = qtrue;
+				} //end if
+				else if (batch.requests[i].type == BOTAI_CHOOSELTGITEM ||
+							batch.requests[i].type == BOTAI_CHOOSENBGITEM)
+				{
+					if (BotGoalStateClient(batch.requests[i].handle) < 0) continue;
+					if (goalstates[batch.requests[i].handle]) continue;
+					goalstates[batch.requests[i].handle] = qtrue;
+				} //end else if
+				else
+				{
+					continue;
+				} //end else
+				batch.threaded[numthreaded++] = i;
+				serial[i] = qfalse;
+			} //end for
+		} //end if
+		if (numthreaded > 1)
+		{
+			AAS_BeginRoutingThreads();
+			botimport.ParallelFor(numthreaded, numthreads, BotAIBatchJob, &batch);
+			AAS_EndRoutingThreads();
+		} //end if
+		else
+		{
+			for (i = 0; i < num; i++) serial[i] = qtrue;
+		} //end else
+		//
+		for (i = 0; i < num; i++)
+		{
+			if (serial[i]) BotAIRequest(&batch.requests[i]);
+		} //end for
+	} //end for
+} //end of the function Export_BotAIBatch
+//===========================================================================
+//
+// Parameter:				-
+// Returns:					-
+// Changes Globals:		-
+//===========================================================================
 void AAS_TestMovementPrediction(int entnum, vec3_t origin, vec3_t dir);
 void ElevatorBottomCenter(aas_reachability_t *reach, vec3_t bottomcenter);
 int BotGetReachabilityToGoal(const vec3_t origin, int areanum,
@@ -836,6 +966,10 @@ static void Init_AI_Export( ai_export_t *ai ) {
 	// be_ai_gen.h
 	//-----------------------------------
 	ai->GeneticParentsAndChildSelection = GeneticParentsAndChildSelection;
+	//-----------------------------------
+	// independent requests of several bots
+	//-----------------------------------
+	ai->BotAIBatch = Export_BotAIBatch;
 }
 
 
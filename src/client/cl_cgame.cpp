@@ -1334,6 +1334,37 @@ Ghoul2 Insert End
 }
 
 
+/*
+====================
+CL_PrefetchLevelFiles
+
+Starts inflating the map and the models and sounds the gamestate
+lists, so they are ready by the time the cgame registers them.
+Sounds are read with FS_ReadFileAsync and loaded when the reads
+are delivered, at the latest by FS_FlushAsyncReads in CL_InitCGame.
+====================
+*/
+static void CL_PrefetchLevelFiles( void ) {
+	const char	*s;
+	int			i;
+
+	FS_PrefetchFile( cl.mapname );
+
+	for ( i = 1 ; i < MAX_MODELS ; i++ ) {
+		s = cl.gameState.stringData + cl.gameState.stringOffsets[ CS_MODELS + i ];
+		if ( s[0] && s[0] != '*' ) {
+			FS_PrefetchFile( s );
+		}
+	}
+
+	for ( i = 1 ; i < MAX_SOUNDS ; i++ ) {
+		s = cl.gameState.stringData + cl.gameState.stringOffsets[ CS_SOUNDS + i ];
+		if ( s[0] && s[0] != '*' ) {
+			S_PrecacheSound( s );
+		}
+	}
+}
+
 /*
 ====================
 CL_InitCGame
@@ -1358,6 +1389,8 @@ void CL_InitCGame( void ) {
 	mapname = Info_ValueForKey( info, "mapname" );
 	Com_sprintf( cl.mapname, sizeof( cl.mapname ), "maps/%s.bsp", mapname );
 
+	CL_PrefetchLevelFiles();
+
 	// load the dll or bytecode
 	if ( cl_connectedToPureServer != 0 ) {
 		// if sv_pure is set we only allow qvms to be loaded
@@ -1397,6 +1430,9 @@ void CL_InitCGame( void ) {
 
 	Com_Printf( "CL_InitCGame: %5.2f seconds\n", (t2-t1)/1000.0 );
 
+	// drop whatever was prefetched but not loaded
+	FS_FlushAsyncReads();
+
 	// have the renderer touch all its images, so they are present
 	// on the card even if the driver does deferred loading
 	re->EndRegistration();
@@ -2799,6 +2799,9 @@ void CL_InitRef( void ) {
 	ri.Error = Com_Error;
 	ri.OPrintf = Com_OPrintf;
 	ri.Milliseconds = CL_ScaledMilliseconds;
+	ri.Microseconds = Sys_Microseconds;
+	ri.ParallelFor = Com_ParallelFor;
+	ri.JobMaxThreads = Com_JobMaxThreads;
 	ri.Malloc = Z_Malloc;//CL_RefMalloc;
 	ri.Free = Z_Free;
 #ifdef HUNK_DEBUG
@@ -2826,6 +2829,7 @@ void CL_InitRef( void ) {
 	ri.FS_ListFiles = FS_ListFiles;
 	ri.FS_FileIsInPAK = FS_FileIsInPAK;
 	ri.FS_FileExists = FS_FileExists;
+	ri.FS_PrefetchFile = FS_PrefetchFile;
 	ri.FS_FCloseFile = FS_FCloseFile_RI;
 	ri.FS_FOpenFileRead = FS_FOpenFileRead_RI;
 	ri.FS_FOpenFileWrite = FS_FOpenFileWrite_RI;
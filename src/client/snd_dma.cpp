@@ -591,6 +591,11 @@ void S_Shutdown( void )
 	}
 #endif
 
+	// reads of S_PrecacheSound still on their way are dropped on delivery
+	for ( i = 0 ; i < s_numSfx ; i++ ) {
+		s_knownSfx[i].bAsyncLoad = qfalse;
+	}
+
 	s_soundStarted = qfalse;
 
     Cmd_RemoveCommand("play");
@@ -871,6 +876,12 @@ sfxHandle_t	S_RegisterSound( const char *name)
 		}
 	}
 
+	// S_PrecacheSound is reading it, loaded on delivery
+	if ( sfx->bAsyncLoad )
+	{
+		return sfx - s_knownSfx;
+	}
+
 	sfx->bInMemory = qfalse;
 
 	S_memoryLoad(sfx);
@@ -886,8 +897,29 @@ sfxHandle_t	S_RegisterSound( const char *name)
 	return sfx - s_knownSfx;
 }
 
+/*
+==================
+S_PrecacheSound
+
+Starts reading a sound of the precache list, S_RegisterSound doesn't
+load it again while the read is on its way
+==================
+*/
+void S_PrecacheSound( const char *name )
+{
+	// before S_BeginRegistration the default sound isn't in place yet
+	if ( !s_soundStarted || !s_numSfx || !name || !name[0] || strlen( name ) >= MAX_QPATH ) {
+		return;
+	}
+
+	S_LoadSoundAsync( S_FindName( name ) );
+}
+
 void S_memoryLoad(sfx_t	*sfx)
 {
+	// needed before the precache read is delivered, that one is dropped
+	sfx->bAsyncLoad = qfalse;
+
 	// load the sound file...
 	//
 	if ( !S_LoadSound( sfx ) )
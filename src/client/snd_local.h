@@ -62,6 +62,7 @@ typedef struct sfx_s {
 	short			*pSoundData;
 	qboolean		bDefaultSound;			// couldn't be loaded, so use buzz
 	qboolean		bInMemory;				// not in Memory, set qtrue when loaded, and qfalse when its buffers are freed up because of being old, so can be reloaded
+	qboolean		bAsyncLoad;				// file is being read by S_LoadSoundAsync, S_RegisterSound leaves the loading to it
 	SoundCompressionMethod_t eSoundCompressionMethod;
 	MP3STREAM		*pMP3StreamHeader;		// NULL ptr unless this sfx_t is an MP3. Use Z_Malloc and Z_Free
 	int 			iSoundLengthInSamples;	// length in samples, always kept as 16bit now so this is #shorts (watch for stereo later for music?)
@@ -247,6 +248,7 @@ int		 SND_FreeOldestSound();
 void	 SND_TouchSFX(sfx_t *sfx);
 void	S_DisplayFreeMemory(void);
 void	S_memoryLoad(sfx_t *sfx);
+void	S_LoadSoundAsync(sfx_t *sfx);
 //
 ////////////////
 
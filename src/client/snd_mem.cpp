@@ -222,6 +222,37 @@ void S_LoadSound_Finalize(wavinfo_t	*info, sfx_t *sfx, byte *data)
 // adjust filename for foreign languages and WAV/MP3 issues.
 //
 // returns qfalse if failed to load, else fills in *pData
+// swaps the "chars" of a voice for the directory of the language in use, returns where
+// it did so or NULL if the English voice is used
+static char *S_LoadSound_ForeignVoice(char *psFilename)
+{
+	extern cvar_t* s_s_language;
+	char *psVoice = strstr(psFilename,"chars");
+
+	if (!psVoice)
+	{
+		return NULL;
+	}
+
+	if (s_s_language && Q_stricmp("DEUTSCH",s_s_language->string)==0)
+	{
+		memcpy(psVoice, "chr_d", 5);	// same number of letters as "chars"
+	}
+	else if (s_s_language && Q_stricmp("FRANCAIS",s_s_language->string)==0)
+	{
+		memcpy(psVoice, "chr_f", 5);	// same number of letters as "chars"
+	}
+	else if (s_s_language && Q_stricmp("ESPANOL",s_s_language->string)==0)
+	{
+		memcpy(psVoice, "chr_e", 5);	// same number of letters as "chars"
+	}
+	else
+	{
+		psVoice = NULL;	// use this ptr as a flag as to whether or not we substituted with a foreign version
+	}
+	return psVoice;
+}
+
 //
 extern	cvar_t	*com_buildScript;
 static qboolean S_LoadSound_FileLoadAndNameAdjuster(char *psFilename, byte **pData, int *piSize, int iNameStrlen)
@@ -281,23 +312,7 @@ static qboolean S_LoadSound_FileLoadAndNameAdjuster(char *psFilename, byte **pDa
 
 		// account for foreign voices...
 		//
-		extern cvar_t* s_s_language;
-		if (s_s_language && Q_stricmp("DEUTSCH",s_s_language->string)==0)
-		{
-			memcpy(psVoice, "chr_d", 5);	// same number of letters as "chars"
-		}
-		else if (s_s_language && Q_stricmp("FRANCAIS",s_s_language->string)==0)
-		{
-			memcpy(psVoice, "chr_f", 5);	// same number of letters as "chars"
-		}
-		else if (s_s_language && Q_stricmp("ESPANOL",s_s_language->string)==0)
-		{
-			memcpy(psVoice, "chr_e", 5);	// same number of letters as "chars"
-		}
-		else
-		{
-			psVoice = NULL;	// use this ptr as a flag as to whether or not we substituted with a foreign version
-		}
+		psVoice = S_LoadSound_ForeignVoice(psFilename);
 	}
 
 	*piSize = FS_ReadFile( psFilename, (void **)pData );	// try WAV
@@ -359,15 +374,11 @@ of a forced fallback of a player specific sound
 ==============
 */
 qboolean gbInsideLoadSound = qfalse;	// important to default to this!!!
+static qboolean S_LoadSound_FromFile( sfx_t *sfx, const char *psFilename, byte *data, int size );
 static qboolean S_LoadSound_Actual( sfx_t *sfx )
 {
 	byte		*data;
-	short		*samples;
-	wavinfo_t	info;
 	int			size;
-#ifdef USE_OPENAL
-	ALuint		Buffer;
-#endif
 
 	// player specific sounds are never directly loaded...
 	//
@@ -383,13 +394,30 @@ static qboolean S_LoadSound_Actual( sfx_t *sfx )
 	COM_StripExtension(sfx->sSoundName, sRootName, sizeof(sRootName));
 	Com_sprintf(sLoadName, MAX_QPATH, "%s.wav", sRootName);
 
-	const char *psExt = &sLoadName[strlen(sLoadName)-4];
-
 	if (!S_LoadSound_FileLoadAndNameAdjuster(sLoadName, &data, &size, (int)strlen(sLoadName)))
 	{
 		return qfalse;
 	}
 
+	return S_LoadSound_FromFile( sfx, sLoadName, data, size );
+}
+
+/*
+==============
+S_LoadSound_FromFile
+
+Turns the wav or mp3 file psFilename of sfx into sound data, data is freed
+==============
+*/
+static qboolean S_LoadSound_FromFile( sfx_t *sfx, const char *psFilename, byte *data, int size )
+{
+	short		*samples;
+	wavinfo_t	info;
+#ifdef USE_OPENAL
+	ALuint		Buffer;
+#endif
+	const char *psExt = &psFilename[strlen(psFilename)-4];
+
 	SND_TouchSFX(sfx);
 	sfx->iLastTimeUsed = Com_Milliseconds()+1;	// why +1? Hmmm, leave it for now I guess
 
@@ -547,3 +575,89 @@ qboolean S_LoadSound( sfx_t *sfx )
 	return bReturn;
 }
 
+
+/*
+==============
+S_LoadSoundAsyncRead
+
+Completion of the FS_ReadFileAsync S_LoadSoundAsync started. Without a buffer the
+sound is left for S_memoryLoad, the first time it's played.
+==============
+*/
+static void S_LoadSoundAsyncRead( const char *qpath, void *buffer, int len, void *userData )
+{
+	sfx_t	*sfx = (sfx_t *)userData;
+	char	sRootName[MAX_QPATH];
+	char	sFileRoot[MAX_QPATH];
+
+	// loaded in the meantime, or the sfx_t went to another sound
+	COM_StripExtension(qpath, sFileRoot, sizeof(sFileRoot));
+	Q_strncpyz(sRootName, sfx->sSoundName, sizeof(sRootName));
+	if (!sfx->bAsyncLoad ||
+		(Q_stricmp(sRootName, sFileRoot) && (!S_LoadSound_ForeignVoice(sRootName) || Q_stricmp(sRootName, sFileRoot))))
+	{
+		if (buffer)
+		{
+			FS_FreeFile(buffer);
+		}
+		return;
+	}
+	sfx->bAsyncLoad = qfalse;
+
+	if (!buffer)
+	{
+		return;
+	}
+
+	gbInsideLoadSound = qtrue;
+	if (!S_LoadSound_FromFile(sfx, qpath, (byte *)buffer, len))
+	{
+		sfx->bDefaultSound = qtrue;
+	}
+	gbInsideLoadSound = qfalse;
+	sfx->bInMemory = qtrue;
+}
+
+/*
+==============
+S_LoadSoundAsync
+
+Starts reading the file of sfx with FS_ReadFileAsync, bAsyncLoad is set until the
+read is delivered. Sounds that can't be found are left alone, so S_RegisterSound
+still hands out the default sound for them.
+==============
+*/
+void S_LoadSoundAsync( sfx_t *sfx )
+{
+	static const char	*psExts[2] = { "wav", "mp3" };
+	char				sRootName[MAX_QPATH];
+	char				sLoadName[MAX_QPATH];
+	qboolean			bForeign;
+	int					i, j;
+
+	if (sfx->bAsyncLoad || sfx->bInMemory || sfx->bDefaultSound || sfx->sSoundName[0] == '*')
+	{
+		return;
+	}
+
+	// the same order S_LoadSound_FileLoadAndNameAdjuster tries them in
+	Q_strncpyz(sRootName, sfx->sSoundName, sizeof(sRootName));
+	bForeign = (qboolean)(S_LoadSound_ForeignVoice(sRootName) != NULL);
+	for (i = 0; i < (bForeign ? 2 : 1); i++)
+	{
+		if (i)
+		{
+			Q_strncpyz(sRootName, sfx->sSoundName, sizeof(sRootName));
+		}
+		for (j = 0; j < 2; j++)
+		{
+			Com_sprintf(sLoadName, sizeof(sLoadName), "%s.%s", sRootName, psExts[j]);
+			if (FS_ReadFile(sLoadName, NULL) > 0)
+			{
+				sfx->bAsyncLoad = qtrue;
+				FS_ReadFileAsync(sLoadName, S_LoadSoundAsyncRead, sfx);
+				return;
+			}
+		}
+	}
+}
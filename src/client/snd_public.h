@@ -44,6 +44,9 @@ void S_BeginRegistration( void );
 // checks for missing files
 sfxHandle_t	S_RegisterSound( const char *name );
 
+// starts reading a sound the level is about to register in the background
+void S_PrecacheSound( const char *name );
+
 void S_DisplayFreeMemory(void);
 
 void S_ClearSoundBuffer( void );
@@ -13,7 +13,7 @@
  *
  *****************************************************************************/
 
-#define	BOTLIB_API_VERSION		2
+#define	BOTLIB_API_VERSION		4
 
 struct aas_clientmove_s;
 struct aas_entityinfo_s;
@@ -196,6 +196,8 @@ typedef struct botlib_import_s
 	int			(*FS_Write)( const void *buffer, int len, fileHandle_t f );
 	void		(*FS_FCloseFile)( fileHandle_t f );
 	int			(*FS_Seek)( fileHandle_t f, int offset, int origin );
+	int			(*FS_MapFile)( const char *qpath, void **buffer );
+	void		(*FS_UnmapFile)( void *buffer );
 	//debug visualisation stuff
 	int			(*DebugLineCreate)(void);
 	void		(*DebugLineDelete)(int line);
@@ -205,6 +207,9 @@ typedef struct botlib_import_s
 	void		(*DebugPolygonDelete)(int id);
 
 	int			(*BSPNumInlineModels)(void);
+	//run func for every index in [0, count) on the engine job threads
+	void		(*ParallelFor)(int count, int numThreads, void (*func)(void *data, int index, int threadNum), void *data);
+	int			(*MaxJobThreads)(void);
 } botlib_import_t;
 
 typedef struct aas_export_s
@@ -301,6 +306,28 @@ typedef struct ea_export_s
 	void	(*EA_ResetInput)(int client);
 } ea_export_t;
 
+//bot AI batch request types
+#define BOTAI_MOVETOGOAL			1
+#define BOTAI_CHOOSELTGITEM			2
+#define BOTAI_CHOOSENBGITEM			3
+
+//maximum number of requests the bot AI batch handles at once
+#define MAX_BOTAIREQUESTS			256
+
+//one request of a bot AI batch, same parameters as the single call
+typedef struct bot_airequest_s
+{
+	int type;								//BOTAI_*
+	int handle;								//move state or goal state
+	int travelflags;
+	float maxtime;							//BOTAI_CHOOSENBGITEM
+	const float *origin;					//bot origin for the item choices
+	const int *inventory;					//bot inventory for the item choices
+	const struct bot_goal_s *goal;			//goal to move to or long term goal
+	struct bot_moveresult_s *moveresult;	//BOTAI_MOVETOGOAL
+	int result;								//return value of the item choices
+} bot_airequest_t;
+
 typedef struct ai_export_s
 {
 	//-----------------------------------
@@ -397,6 +424,10 @@ typedef struct ai_export_s
 	// be_ai_gen.h
 	//-----------------------------------
 	int		(*GeneticParentsAndChildSelection)(int numranks, const float *ranks, int *parent1, int *parent2, int *child);
+	//-----------------------------------
+	// independent requests of several bots, on numthreads job threads
+	//-----------------------------------
+	void	(*BotAIBatch)(bot_airequest_t *requests, int numrequests, int numthreads);
 } ai_export_t;
 
 //bot AI library imported functions
@@ -490,6 +521,7 @@ name:						default:			module(s):			description:
 
 "max_aaslinks"				"4096"				be_aas_sample.c		maximum links in the AAS
 "max_routingcache"			"4096"				be_aas_route.c		maximum routing cache size in KB
+"precomputeroutingcache"	"0"					be_aas_route.c		compute and write the routing cache file if missing
 "forceclustering"			"0"					be_aas_main.c		force recalculation of clusters
 "forcereachability"			"0"					be_aas_main.c		force recalculation of reachabilities
 "forcewrite"				"0"					be_aas_main.c		force writing of aas file
@@ -5,6 +5,7 @@
 #include "ghoul2_shared.h"
 
 class CMiniHeap;
+class CG2CollisionCache;
 
 // internal surface calls  G2_surfaces.cpp
 qboolean	G2_SetSurfaceOnOff (const char *fileName, surfaceInfo_v &slist, const char *surfaceName, const int offFlags);
@@ -57,9 +58,13 @@ qboolean	G2_Get_Bone_Anim_Index( boneInfo_v &blist, const int index, const int c
 void		G2_List_Model_Surfaces(const char *fileName);
 void		G2_List_Model_Bones(const char *fileName, int frame);
 qboolean	G2_GetAnimFileName(const char *fileName, char **filename);
-void		G2_TraceModels(CGhoul2Info_v &ghoul2, const vec3_t rayStart, const vec3_t rayEnd, CollisionRecord_t *collRecMap, int entNum, int traceFlags, int useLod, float fRadius);
+void		G2_TraceModels(CGhoul2Info_v &ghoul2, const vec3_t rayStart, const vec3_t rayEnd, CollisionRecord_t *collRecMap, int entNum, int traceFlags, int useLod, float fRadius, CG2CollisionCache *cache);
 void		TransformAndTranslatePoint (const vec3_t in, vec3_t out, const mdxaBone_t *mat);
 void		G2_TransformModel(CGhoul2Info_v &ghoul2, const int frameNum, const vec3_t scale, CMiniHeap *G2VertSpace, int useLod);
+CG2CollisionCache	*G2_CacheCollisionModel(g2handle_t g2h, CGhoul2Info_v &ghoul2, const int frameNum, const vec3_t angles,
+						const vec3_t position, const vec3_t scale, int useLod);
+void		G2_FreeCollisionCache(g2handle_t g2h);
+void		G2_FreeCollisionCaches(void);
 void		G2_GenerateWorldMatrix(const vec3_t angles, const vec3_t origin);
 void		TransformPoint (const vec3_t in, vec3_t out, const mdxaBone_t *mat);
 void		Inverse_Matrix(const mdxaBone_t *src, mdxaBone_t *dest);
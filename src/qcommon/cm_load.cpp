@@ -21,7 +21,8 @@ void SetPlaneSignbits (cplane_t *out) {
 #endif //BSPC
 
 // to allow boxes to be treated as brush models, we allocate
-// some extra indexes along with those needed by the map
+// some extra indexes along with those needed by the map, one
+// set for each thread that can trace
 #define	BOX_BRUSHES		1
 #define	BOX_SIDES		6
 #define	BOX_LEAFS		2
@@ -43,9 +44,6 @@ cvar_t		*cm_noCurves;
 cvar_t		*cm_playerCurveClip;
 #endif
 
-cmodel_t	box_model;
-cplane_t	*box_planes;
-cbrush_t	*box_brush;
 
 
 
@@ -204,6 +202,50 @@ void CM_BoundBrush( cbrush_t *b ) {
 }
 
 
+#if CM_PLANE_BLOCKS
+/*
+=================
+CM_LoadBrushPlanes
+
+Copies the planes of every brush into blocks of four for the SSE2 tests
+in CM_TraceThroughBrush and CM_TestBoxInBrush
+=================
+*/
+static void CM_LoadBrushPlanes( void ) {
+	cbrushPlanes_t	*blocks;
+	cbrush_t		*b;
+	cplane_t		*plane;
+	int				numBlocks;
+	int				i, j, k;
+
+	numBlocks = 0;
+	for ( i = 0, b = cm.brushes ; i < cm.numBrushes ; i++, b++ ) {
+		numBlocks += ( b->numsides + 3 ) >> 2;
+	}
+
+	blocks = (cbrushPlanes_t *)Hunk_Alloc( numBlocks * sizeof( *blocks ), h_high );
+
+	for ( i = 0, b = cm.brushes ; i < cm.numBrushes ; i++, b++ ) {
+		b->planes = blocks;
+
+		for ( j = 0 ; j < ( ( b->numsides + 3 ) & ~3 ) ; j++ ) {
+			if ( j < b->numsides ) {
+				plane = b->sides[j].plane;
+				for ( k = 0 ; k < 3 ; k++ ) {
+					blocks[j >> 2].normal[k][j & 3] = plane->normal[k];
+				}
+				blocks[j >> 2].dist[j & 3] = plane->dist;
+			} else {
+				// zero normal, everything is far behind it
+				blocks[j >> 2].dist[j & 3] = 1e30f;
+			}
+		}
+
+		blocks += ( b->numsides + 3 ) >> 2;
+	}
+}
+#endif
+
 /*
 =================
 CMod_LoadBrushes
@@ -221,7 +263,7 @@ void CMod_LoadBrushes( lump_t *l ) {
 	}
 	count = l->filelen / sizeof(*in);
 
-	cm.brushes = (cbrush_t *)Hunk_Alloc( ( BOX_BRUSHES + count ) * sizeof( *cm.brushes ), h_high );
+	cm.brushes = (cbrush_t *)Hunk_Alloc( ( BOX_BRUSHES * cm.numThreads + count ) * sizeof( *cm.brushes ), h_high );
 	cm.numBrushes = count;
 
 	out = cm.brushes;
@@ -239,6 +281,9 @@ void CMod_LoadBrushes( lump_t *l ) {
 		CM_BoundBrush( out );
 	}
 
+#if CM_PLANE_BLOCKS
+	CM_LoadBrushPlanes();
+#endif
 }
 
 /*
@@ -308,7 +353,7 @@ void CMod_LoadPlanes (lump_t *l)
 
 	if (count < 1)
 		Com_Error (ERR_DROP, "Map with no planes");
-	cm.planes = (struct cplane_s *)Hunk_Alloc( ( BOX_PLANES + count ) * sizeof( *cm.planes ), h_high );
+	cm.planes = (struct cplane_s *)Hunk_Alloc( ( BOX_PLANES * cm.numThreads + count ) * sizeof( *cm.planes ), h_high );
 	cm.numPlanes = count;
 
 	out = cm.planes;
@@ -346,7 +391,7 @@ void CMod_LoadLeafBrushes (lump_t *l)
 		Com_Error (ERR_DROP, "MOD_LoadBmodel: funny lump size");
 	count = l->filelen / sizeof(*in);
 
-	cm.leafbrushes = (int *)Hunk_Alloc( (count + BOX_BRUSHES) * sizeof( *cm.leafbrushes ), h_high );
+	cm.leafbrushes = (int *)Hunk_Alloc( (count + BOX_BRUSHES * cm.numThreads) * sizeof( *cm.leafbrushes ), h_high );
 	cm.numLeafBrushes = count;
 
 	out = cm.leafbrushes;
@@ -402,7 +447,7 @@ void CMod_LoadBrushSides (lump_t *l)
 	}
 	count = l->filelen / sizeof(*in);
 
-	cm.brushsides = (cbrushside_t *)Hunk_Alloc( ( BOX_SIDES + count ) * sizeof( *cm.brushsides ), h_high );
+	cm.brushsides = (cbrushside_t *)Hunk_Alloc( ( BOX_SIDES * cm.numThreads + count ) * sizeof( *cm.brushsides ), h_high );
 	cm.numBrushSides = count;
 
 	out = cm.brushsides;
@@ -631,11 +676,22 @@ static void CM_LoadMap_Actual( const char *name, qboolean clientload, int *check
 	// free old stuff
 	CM_ClearMap();
 
+#ifdef BSPC
+	cm.numThreads = 1;
+#else
+	cm.numThreads = Com_JobMaxThreads();
+#endif
+
 	if ( !name[0] ) {
 		cm.numLeafs = 1;
 		cm.numClusters = 1;
 		cm.numAreas = 1;
 		cm.cmodels = (struct cmodel_s *)Hunk_Alloc( sizeof( *cm.cmodels ), h_high );
+		cm.planes = (struct cplane_s *)Hunk_Alloc( BOX_PLANES * cm.numThreads * sizeof( *cm.planes ), h_high );
+		cm.brushes = (cbrush_t *)Hunk_Alloc( BOX_BRUSHES * cm.numThreads * sizeof( *cm.brushes ), h_high );
+		cm.brushsides = (cbrushside_t *)Hunk_Alloc( BOX_SIDES * cm.numThreads * sizeof( *cm.brushsides ), h_high );
+		cm.leafbrushes = (int *)Hunk_Alloc( BOX_BRUSHES * cm.numThreads * sizeof( *cm.leafbrushes ), h_high );
+		CM_InitBoxHull ();
 		*checksum = 0;
 		return;
 	}
@@ -656,13 +712,11 @@ static void CM_LoadMap_Actual( const char *name, qboolean clientload, int *check
 	//	then discard it after that...
 	//
 	buf = NULL;
-	fileHandle_t h;
-	const int iBSPLen = FS_FOpenFileRead( name, &h, qfalse );
-	if (h)
+	// through FS_ReadFile so a prefetch of the map can be picked up
+	const int iBSPLen = FS_ReadFile( name, &gpvCachedMapDiskImage );
+	if (gpvCachedMapDiskImage)
 	{
-		gpvCachedMapDiskImage = Z_Malloc( iBSPLen, TAG_BSP_DISKIMAGE );
-		FS_Read( gpvCachedMapDiskImage, iBSPLen, h);
-		FS_FCloseFile( h );
+		Z_MorphMallocTag( gpvCachedMapDiskImage, TAG_BSP_DISKIMAGE );
 
 		buf = (int*) gpvCachedMapDiskImage;	// so the rest of the code works as normal
 
@@ -757,7 +811,7 @@ cmodel_t	*CM_ClipHandleToModel( clipHandle_t handle ) {
 		return &cm.cmodels[handle];
 	}
 	if ( handle == cm.boxModelHandle ) {
-		return &box_model;
+		return &CM_Thread()->boxModel;
 	}
 	if ( handle < MAX_SUBMODELS ) {
 		Com_Error( ERR_DROP, "CM_ClipHandleToModel: bad handle %i < %i < %i",
@@ -810,6 +864,38 @@ int		CM_LeafArea( int leafnum ) {
 //=======================================================================
 
 
+/*
+==================
+CM_Thread
+
+Box hull and check marks of the calling thread
+==================
+*/
+cmThread_t *CM_Thread( void ) {
+#ifdef BSPC
+	return cm.threads;
+#else
+	int		threadNum = Com_JobThreadNum();
+
+	if ( threadNum >= cm.numThreads ) {
+		Com_Error( ERR_FATAL, "CM_Thread: trace on job thread %i, only %i set up", threadNum, cm.numThreads );
+	}
+
+	return &cm.threads[threadNum];
+#endif
+}
+
+/*
+==================
+CM_NumThreads
+
+Number of threads, including the main one, that can trace at once
+==================
+*/
+int CM_NumThreads( void ) {
+	return cm.numThreads;
+}
+
 /*
 ===================
 CM_InitBoxHull
@@ -820,46 +906,57 @@ can just be stored out and get a proper clipping hull structure.
 */
 void CM_InitBoxHull (void)
 {
-	int			i;
+	int			i, t;
 	int			side;
 	cplane_t	*p;
 	cbrushside_t	*s;
+	cmThread_t	*thread;
 
-	box_planes = &cm.planes[cm.numPlanes];
+	cm.threads = (cmThread_t *)Hunk_Alloc( cm.numThreads * sizeof( *cm.threads ), h_high );
 
-	box_brush = &cm.brushes[cm.numBrushes];
-	box_brush->numsides = 6;
-	box_brush->sides = cm.brushsides + cm.numBrushSides;
-	box_brush->contents = CONTENTS_BODY;
-
-	box_model.leaf.numLeafBrushes = 1;
-//	box_model.leaf.firstLeafBrush = cm.numBrushes;
-	box_model.leaf.firstLeafBrush = cm.numLeafBrushes;
-	cm.leafbrushes[cm.numLeafBrushes] = cm.numBrushes;
-
-	for (i=0 ; i<6 ; i++)
+	for ( t = 0 ; t < cm.numThreads ; t++ )
 	{
-		side = i&1;
+		thread = &cm.threads[t];
+
+		thread->brushChecks = (int *)Hunk_Alloc( ( cm.numBrushes + BOX_BRUSHES * cm.numThreads ) * sizeof( int ), h_high );
+		thread->patchChecks = (int *)Hunk_Alloc( cm.numSurfaces * sizeof( int ), h_high );
 
-		// brush sides
-		s = &cm.brushsides[cm.numBrushSides+i];
-		s->plane =	cm.planes + (cm.numPlanes+i*2+side);
-		s->surfaceFlags = 0;
+		thread->boxPlanes = &cm.planes[cm.numPlanes + BOX_PLANES * t];
 
-		// planes
-		p = &box_planes[i*2];
-		p->type = i>>1;
-		p->signbits = 0;
-		VectorClear (p->normal);
-		p->normal[i>>1] = 1;
+		thread->boxBrush = &cm.brushes[cm.numBrushes + BOX_BRUSHES * t];
+		thread->boxBrush->numsides = 6;
+		thread->boxBrush->sides = cm.brushsides + cm.numBrushSides + BOX_SIDES * t;
+		thread->boxBrush->contents = CONTENTS_BODY;
 
-		p = &box_planes[i*2+1];
-		p->type = 3 + (i>>1);
-		p->signbits = 0;
-		VectorClear (p->normal);
-		p->normal[i>>1] = -1;
+		thread->boxModel.leaf.numLeafBrushes = 1;
+//		thread->boxModel.leaf.firstLeafBrush = cm.numBrushes;
+		thread->boxModel.leaf.firstLeafBrush = cm.numLeafBrushes + BOX_BRUSHES * t;
+		cm.leafbrushes[cm.numLeafBrushes + BOX_BRUSHES * t] = cm.numBrushes + BOX_BRUSHES * t;
 
-		SetPlaneSignbits( p );
+		for (i=0 ; i<6 ; i++)
+		{
+			side = i&1;
+
+			// brush sides
+			s = &thread->boxBrush->sides[i];
+			s->plane = thread->boxPlanes + (i*2+side);
+			s->surfaceFlags = 0;
+
+			// planes
+			p = &thread->boxPlanes[i*2];
+			p->type = i>>1;
+			p->signbits = 0;
+			VectorClear (p->normal);
+			p->normal[i>>1] = 1;
+
+			p = &thread->boxPlanes[i*2+1];
+			p->type = 3 + (i>>1);
+			p->signbits = 0;
+			VectorClear (p->normal);
+			p->normal[i>>1] = -1;
+
+			SetPlaneSignbits( p );
+		}
 	}
 }
 
@@ -873,9 +970,11 @@ Capsules are handled differently though.
 ===================
 */
 clipHandle_t CM_TempBoxModel( const vec3_t mins, const vec3_t maxs, qboolean capsule ) {
+	cmThread_t	*thread = CM_Thread();
+	cplane_t	*box_planes = thread->boxPlanes;
 
-	VectorCopy( mins, box_model.mins );
-	VectorCopy( maxs, box_model.maxs );
+	VectorCopy( mins, thread->boxModel.mins );
+	VectorCopy( maxs, thread->boxModel.maxs );
 
 	if ( capsule ) {
 		return cm.capsuleModelHandle;
@@ -894,8 +993,8 @@ clipHandle_t CM_TempBoxModel( const vec3_t mins, const vec3_t maxs, qboolean cap
 	box_planes[10].dist = mins[2];
 	box_planes[11].dist = -mins[2];
 
-	VectorCopy( mins, box_brush->bounds[0] );
-	VectorCopy( maxs, box_brush->bounds[1] );
+	VectorCopy( mins, thread->boxBrush->bounds[0] );
+	VectorCopy( maxs, thread->boxBrush->bounds[1] );
 
 	return cm.boxModelHandle;
 }
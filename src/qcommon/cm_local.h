@@ -34,13 +34,32 @@ typedef struct {
 	int			damage;
 } cbrushside_t;
 
+// the SSE2 plane tests are only bit-identical to the scalar ones when
+// those don't use x87 math either
+#if idx64 || ( id386 && ( defined( __SSE2_MATH__ ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 ) ) )
+#define CM_PLANE_BLOCKS		1
+#else
+#define CM_PLANE_BLOCKS		0
+#endif
+
+#if CM_PLANE_BLOCKS
+// four brush planes side by side for the SSE2 plane tests, the lanes past
+// the last side hold a plane nothing is ever in front of
+typedef struct {
+	float		normal[3][4];
+	float		dist[4];
+} cbrushPlanes_t;
+#endif
+
 typedef struct {
 	int			shaderNum;		// the shader that determined the contents
 	int			contents;
 	vec3_t		bounds[2];
 	int			numsides;
 	cbrushside_t	*sides;
-	int			checkcount;		// to avoid repeated testings
+#if CM_PLANE_BLOCKS
+	cbrushPlanes_t	*planes;	// [(numsides+3)/4], NULL for the box brushes
+#endif
 } cbrush_t;
 
 class CCMShader
@@ -66,7 +85,6 @@ class CCMShader	*mNext;
 };
 
 typedef struct {
-	int			checkcount;				// to avoid repeated testings
 	int			surfaceFlags;
 	int			contents;
 	struct patchCollide_s	*pc;
@@ -78,6 +96,19 @@ typedef struct {
 	int			floodvalid;
 } cArea_t;
 
+// Traces may run on any job thread. Each of them gets its own box hull and
+// its own marks for the brushes and patches a trace has already tested, the
+// rest of the clip map is only read while tracing.
+typedef struct {
+	int			checkcount;			// incremented on each trace
+	int			*brushChecks;		// [numBrushes + numThreads], to avoid repeated testings
+	int			*patchChecks;		// [numSurfaces]
+
+	cmodel_t	boxModel;
+	cplane_t	*boxPlanes;
+	cbrush_t	*boxBrush;
+} cmThread_t;
+
 typedef struct {
 	char		name[MAX_QPATH];
 
@@ -124,7 +155,9 @@ typedef struct {
 	cPatch_t	**surfaces;			// non-patches will be NULL
 
 	int			floodvalid;
-	int			checkcount;					// incremented on each trace
+
+	int			numThreads;
+	cmThread_t	*threads;
 
 	int			boxModelHandle;
 	int			capsuleModelHandle;
@@ -138,6 +171,8 @@ typedef struct {
 extern	clipMap_t	cm;
 extern	int			c_pointcontents;
 extern	int			c_traces, c_brush_traces, c_patch_traces;
+extern	qboolean	cm_planeBlocks;
+
 extern	cvar_t		*cm_noAreas;
 extern	cvar_t		*cm_noCurves;
 extern	cvar_t		*cm_playerCurveClip;
@@ -166,6 +201,7 @@ typedef struct {
 	qboolean	isPoint;	// optimized case
 	trace_t		trace;		// returned from trace call
 	sphere_t	sphere;		// sphere for oriendted capsule collision
+	cmThread_t	*thread;	// of the thread running the trace
 } traceWork_t;
 
 typedef struct leafList_s {
@@ -176,6 +212,7 @@ typedef struct leafList_s {
 	vec3_t	bounds[2];
 	int		lastLeaf;		// for overflows where each leaf can't be stored individually
 	void	(*storeLeafs)( struct leafList_s *ll, int nodenum );
+	cmThread_t	*thread;
 } leafList_t;
 
 
@@ -187,6 +224,7 @@ void CM_StoreBrushes( leafList_t *ll, int nodenum );
 void CM_BoxLeafnums_r( leafList_t *ll, int nodenum );
 
 cmodel_t	*CM_ClipHandleToModel( clipHandle_t handle );
+cmThread_t	*CM_Thread( void );
 
 // cm_patch.c
 
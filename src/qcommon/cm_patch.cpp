@@ -1305,8 +1305,10 @@ void CM_TraceThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *
 		//
 		if (fraction < tw->trace.fraction)
 		{
-			debugPatchCollide = pc;
-			debugFacet = facet;
+			if ( tw->thread == cm.threads ) {
+				debugPatchCollide = pc;
+				debugFacet = facet;
+			}
 
 			tw->trace.fraction = fraction;
 			planes = &pc->planes[ facet->surfacePlane ];
@@ -1392,12 +1394,15 @@ void CM_TracePointThroughPatchCollide( traceWork_t *tw, const struct patchCollid
 		if ( j == facet->numBorders ) {
 			// we hit this facet
 #ifndef BSPC
-			if (!cv) {
-				cv = Cvar_Get( "r_debugSurfaceUpdate", "1", 0 );
-			}
-			if (cv->integer) {
-				debugPatchCollide = pc;
-				debugFacet = facet;
+			// the debug surface is only tracked for the main thread
+			if ( tw->thread == cm.threads ) {
+				if (!cv) {
+					cv = Cvar_Get( "r_debugSurfaceUpdate", "1", 0 );
+				}
+				if (cv->integer) {
+					debugPatchCollide = pc;
+					debugFacet = facet;
+				}
 			}
 #endif //BSPC
 			planes = &pc->planes[facet->surfacePlane];
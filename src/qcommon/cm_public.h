@@ -12,6 +12,9 @@ int			CM_NumClusters (void);
 int			CM_NumInlineModels( void );
 char		*CM_EntityString (void);
 
+// traces may run on this many job threads at once, the main one included
+int			CM_NumThreads( void );
+
 // returns an ORed contents mask
 int			CM_PointContents( const vec3_t p, clipHandle_t model );
 int			CM_TransformedPointContents( const vec3_t p, clipHandle_t model, const vec3_t origin, const vec3_t angles );
@@ -23,6 +26,7 @@ void		CM_TransformedBoxTrace( trace_t *results, const vec3_t start, const vec3_t
 						  const vec3_t mins, const vec3_t maxs,
 						  clipHandle_t model, int brushmask,
 						  const vec3_t origin, const vec3_t angles, qboolean capsule );
+void		CM_TraceReplay_f( void );
 
 byte		*CM_ClusterPVS (int cluster);
 
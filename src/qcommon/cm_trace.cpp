@@ -1,5 +1,14 @@
 #include "cm_local.h"
 
+#ifndef BSPC
+#include <atomic>
+#include <mutex>
+#include <vector>
+#endif
+
+// cm_tracereplay turns the SSE2 plane tests off to compare them with the scalar ones
+qboolean	cm_planeBlocks = qtrue;
+
 // always use bbox vs. bbox collision and never capsule vs. bbox or vice versa
 //#define ALWAYS_BBOX_VS_BBOX
 // always use capsule vs. capsule collision and never capsule vs. bbox or vice versa
@@ -133,6 +142,61 @@ POSITION TESTING
 ===============================================================================
 */
 
+#if CM_PLANE_BLOCKS
+/*
+================
+CM_PlaneDots
+
+DotProduct( v, normal ) for four planes, summed in the same order as the
+scalar macro so the results are bit-identical
+================
+*/
+static inline __m128 CM_PlaneDots( const __m128 v[3], const cbrushPlanes_t *p ) {
+	return _mm_add_ps( _mm_add_ps( _mm_mul_ps( v[0], _mm_loadu_ps( p->normal[0] ) ),
+		_mm_mul_ps( v[1], _mm_loadu_ps( p->normal[1] ) ) ),
+		_mm_mul_ps( v[2], _mm_loadu_ps( p->normal[2] ) ) );
+}
+
+/*
+================
+CM_PlaneDists
+
+plane->dist - DotProduct( tw->offsets[ plane->signbits ], plane->normal )
+for four planes, size holds both corners of the box on each axis
+================
+*/
+static inline __m128 CM_PlaneDists( const __m128 size[2][3], const cbrushPlanes_t *p ) {
+	__m128	offset[3];
+	__m128	negative;
+	int		k;
+
+	for ( k = 0 ; k < 3 ; k++ ) {
+		// signbits picks the maxs on axes the normal points backwards on
+		negative = _mm_cmplt_ps( _mm_loadu_ps( p->normal[k] ), _mm_setzero_ps() );
+		offset[k] = _mm_or_ps( _mm_and_ps( negative, size[1][k] ), _mm_andnot_ps( negative, size[0][k] ) );
+	}
+
+	return _mm_sub_ps( _mm_loadu_ps( p->dist ), CM_PlaneDots( offset, p ) );
+}
+
+/*
+================
+CM_SetupPlaneTests
+
+Broadcasts a trace point and the box size for CM_PlaneDots and CM_PlaneDists
+================
+*/
+static inline void CM_SetupPlaneTests( const traceWork_t *tw, const vec3_t point, __m128 v[3], __m128 size[2][3] ) {
+	int		k;
+
+	for ( k = 0 ; k < 3 ; k++ ) {
+		v[k] = _mm_set1_ps( point[k] );
+		size[0][k] = _mm_set1_ps( tw->size[0][k] );
+		size[1][k] = _mm_set1_ps( tw->size[1][k] );
+	}
+}
+#endif
+
 /*
 ================
 CM_TestBoxInBrush
@@ -187,6 +251,29 @@ void CM_TestBoxInBrush( traceWork_t *tw, cbrush_t *brush ) {
 				return;
 			}
 		}
+#if CM_PLANE_BLOCKS
+	} else if ( brush->planes && cm_planeBlocks ) {
+		__m128	start[3], size[2][3];
+		int		front;
+
+		CM_SetupPlaneTests( tw, tw->start, start, size );
+
+		// same test as below four planes at a time, starting with the block
+		// that holds the first non-axial plane
+		for ( i = 4 ; i < brush->numsides ; i += 4 ) {
+			const cbrushPlanes_t *p = &brush->planes[i >> 2];
+
+			front = _mm_movemask_ps( _mm_cmpgt_ps( _mm_sub_ps( CM_PlaneDots( start, p ), CM_PlaneDists( size, p ) ), _mm_setzero_ps() ) );
+			if ( i == 4 ) {
+				front &= ~3;	// planes 4 and 5 are axial
+			}
+
+			// if completely in front of face, no intersection
+			if ( front ) {
+				return;
+			}
+		}
+#endif
 	} else {
 		// the first six planes are the axial planes, so we only
 		// need to test the remainder
@@ -222,6 +309,7 @@ CM_TestInLeaf
 void CM_TestInLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	int			k;
 	int			brushnum;
+	int			surfacenum;
 	cbrush_t	*b;
 	cPatch_t	*patch;
 
@@ -229,10 +317,10 @@ void CM_TestInLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	for (k=0 ; k<leaf->numLeafBrushes ; k++) {
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
 		b = &cm.brushes[brushnum];
-		if (b->checkcount == cm.checkcount) {
+		if (tw->thread->brushChecks[brushnum] == tw->thread->checkcount) {
 			continue;	// already checked this brush in another leaf
 		}
-		b->checkcount = cm.checkcount;
+		tw->thread->brushChecks[brushnum] = tw->thread->checkcount;
 
 		if ( !(b->contents & tw->contents)) {
 			continue;
@@ -251,14 +339,15 @@ void CM_TestInLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	if ( !cm_noCurves->integer ) {
 #endif //BSPC
 		for ( k = 0 ; k < leaf->numLeafSurfaces ; k++ ) {
-			patch = cm.surfaces[ cm.leafsurfaces[ leaf->firstLeafSurface + k ] ];
+			surfacenum = cm.leafsurfaces[ leaf->firstLeafSurface + k ];
+			patch = cm.surfaces[ surfacenum ];
 			if ( !patch ) {
 				continue;
 			}
-			if ( patch->checkcount == cm.checkcount ) {
+			if ( tw->thread->patchChecks[surfacenum] == tw->thread->checkcount ) {
 				continue;	// already checked this brush in another leaf
 			}
-			patch->checkcount = cm.checkcount;
+			tw->thread->patchChecks[surfacenum] = tw->thread->checkcount;
 
 			if ( !(patch->contents & tw->contents)) {
 				continue;
@@ -407,13 +496,11 @@ void CM_PositionTest( traceWork_t *tw ) {
 	ll.storeLeafs = CM_StoreLeafs;
 	ll.lastLeaf = 0;
 	ll.overflowed = qfalse;
-
-	cm.checkcount++;
+	ll.thread = tw->thread;
 
 	CM_BoxLeafnums_r( &ll, 0 );
 
-
-	cm.checkcount++;
+	tw->thread->checkcount++;
 
 	// test the contents of the leafs
 	for (i=0 ; i < ll.count ; i++) {
@@ -442,7 +529,9 @@ CM_TraceThroughPatch
 void CM_TraceThroughPatch( traceWork_t *tw, cPatch_t *patch ) {
 	float		oldFrac;
 
-	c_patch_traces++;
+	if ( tw->thread == cm.threads ) {
+		c_patch_traces++;
+	}
 
 	oldFrac = tw->trace.fraction;
 
@@ -480,7 +569,9 @@ void CM_TraceThroughBrush( traceWork_t *tw, cbrush_t *brush ) {
 		return;
 	}
 
-	c_brush_traces++;
+	if ( tw->thread == cm.threads ) {
+		c_brush_traces++;
+	}
 
 	getout = qfalse;
 	startout = qfalse;
@@ -554,6 +645,82 @@ void CM_TraceThroughBrush( traceWork_t *tw, cbrush_t *brush ) {
 				}
 			}
 		}
+#if CM_PLANE_BLOCKS
+	} else if ( brush->planes && cm_planeBlocks ) {
+		__m128	start[3], end[3], size[2][3];
+		__m128	dist, v1, v2, zero;
+		float	d1s[4], d2s[4];
+		int		crosses;
+		int		j;
+
+		CM_SetupPlaneTests( tw, tw->start, start, size );
+		CM_SetupPlaneTests( tw, tw->end, end, size );
+		zero = _mm_setzero_ps();
+
+		//
+		// same as below, with the distances of four planes computed at once
+		//
+		for (i = 0; i < brush->numsides; i += 4) {
+			const cbrushPlanes_t *p = &brush->planes[i >> 2];
+
+			dist = CM_PlaneDists( size, p );
+			v1 = _mm_sub_ps( CM_PlaneDots( start, p ), dist );
+			v2 = _mm_sub_ps( CM_PlaneDots( end, p ), dist );
+
+			// if completely in front of any face, no intersection with the entire brush
+			if ( _mm_movemask_ps( _mm_and_ps( _mm_cmpgt_ps( v1, zero ),
+				_mm_or_ps( _mm_cmpge_ps( v2, _mm_set1_ps( SURFACE_CLIP_EPSILON ) ), _mm_cmpge_ps( v2, v1 ) ) ) ) ) {
+				return;
+			}
+
+			if ( _mm_movemask_ps( _mm_cmpgt_ps( v2, zero ) ) ) {
+				getout = qtrue;	// endpoint is not in solid
+			}
+			if ( _mm_movemask_ps( _mm_cmpgt_ps( v1, zero ) ) ) {
+				startout = qtrue;
+			}
+
+			// planes it doesn't cross aren't relevent
+			crosses = _mm_movemask_ps( _mm_and_ps( _mm_cmple_ps( v1, zero ), _mm_cmple_ps( v2, zero ) ) ) ^ 15;
+			if ( !crosses ) {
+				continue;
+			}
+
+			_mm_storeu_ps( d1s, v1 );
+			_mm_storeu_ps( d2s, v2 );
+
+			for ( j = 0 ; j < 4 ; j++ ) {
+				if ( !( crosses & ( 1 << j ) ) ) {
+					continue;
+				}
+
+				d1 = d1s[j];
+				d2 = d2s[j];
+				side = brush->sides + i + j;
+
+				// crosses face
+				if (d1 > d2) {	// enter
+					f = (d1-SURFACE_CLIP_EPSILON) / (d1-d2);
+					if ( f < 0 ) {
+						f = 0;
+					}
+					if (f > enterFrac) {
+						enterFrac = f;
+						clipplane = side->plane;
+						leadside = side;
+					}
+				} else {	// leave
+					f = (d1+SURFACE_CLIP_EPSILON) / (d1-d2);
+					if ( f > 1 ) {
+						f = 1;
+					}
+					if (f < leaveFrac) {
+						leaveFrac = f;
+					}
+				}
+			}
+		}
+#endif
 	} else {
 		//
 		// compare the trace against all planes of the brush
@@ -646,6 +813,7 @@ CM_TraceThroughLeaf
 void CM_TraceThroughLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	int			k;
 	int			brushnum;
+	int			surfacenum;
 	cbrush_t	*b;
 	cPatch_t	*patch;
 
@@ -654,10 +822,10 @@ void CM_TraceThroughLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
 
 		b = &cm.brushes[brushnum];
-		if ( b->checkcount == cm.checkcount ) {
+		if ( tw->thread->brushChecks[brushnum] == tw->thread->checkcount ) {
 			continue;	// already checked this brush in another leaf
 		}
-		b->checkcount = cm.checkcount;
+		tw->thread->brushChecks[brushnum] = tw->thread->checkcount;
 
 		if ( !(b->contents & tw->contents) ) {
 			continue;
@@ -676,14 +844,15 @@ void CM_TraceThroughLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	if ( !cm_noCurves->integer ) {
 #endif
 		for ( k = 0 ; k < leaf->numLeafSurfaces ; k++ ) {
-			patch = cm.surfaces[ cm.leafsurfaces[ leaf->firstLeafSurface + k ] ];
+			surfacenum = cm.leafsurfaces[ leaf->firstLeafSurface + k ];
+			patch = cm.surfaces[ surfacenum ];
 			if ( !patch ) {
 				continue;
 			}
-			if ( patch->checkcount == cm.checkcount ) {
+			if ( tw->thread->patchChecks[surfacenum] == tw->thread->checkcount ) {
 				continue;	// already checked this patch in another leaf
 			}
-			patch->checkcount = cm.checkcount;
+			tw->thread->patchChecks[surfacenum] = tw->thread->checkcount;
 
 			if ( !(patch->contents & tw->contents) ) {
 				continue;
@@ -1136,10 +1305,6 @@ void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end,
 
 	cmod = CM_ClipHandleToModel( model );
 
-	cm.checkcount++;		// for multi-check avoidance
-
-	c_traces++;				// for statistics, may be zeroed
-
 	// fill in a default trace
 	Com_Memset( &tw, 0, sizeof(tw) );
 	tw.trace.fraction = 1;	// assume it goes the entire distance until shown otherwise
@@ -1151,6 +1316,13 @@ void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end,
 		return;	// map not loaded, shouldn't happen
 	}
 
+	tw.thread = CM_Thread();
+	tw.thread->checkcount++;	// for multi-check avoidance
+
+	if ( tw.thread == cm.threads ) {
+		c_traces++;				// for statistics, may be zeroed
+	}
+
 	// allow NULL to be passed in for 0,0,0
 	if ( !mins ) {
 		mins = vec3_origin;
@@ -1340,6 +1512,171 @@ void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end,
 	*results = tw.trace;
 }
 
+#ifndef BSPC
+/*
+===============================================================================
+
+TRACE REPLAY
+
+cm_tracereplay record [count] keeps the next count box traces of the running
+game, cm_tracereplay runs them again with and without the SSE2 plane tests
+and reports every trace whose results differ in any bit.
+
+===============================================================================
+*/
+
+typedef struct {
+	vec3_t			start, end;
+	vec3_t			mins, maxs;
+	clipHandle_t	model;
+	int				brushmask;
+	qboolean		transformed;
+	vec3_t			origin, angles;
+	qboolean		capsule;
+} cmRecordedTrace_t;
+
+static std::atomic<int>					cmRecordTraces;		// how many more to keep
+static std::mutex						cmRecordMutex;		// traces can come from job threads
+static std::vector<cmRecordedTrace_t>	cmRecordedTraces;
+static char								cmRecordedMap[MAX_QPATH];
+
+static void CM_RecordTrace( const vec3_t start, const vec3_t end, const vec3_t mins, const vec3_t maxs, clipHandle_t model,
+	int brushmask, const vec3_t origin, const vec3_t angles, qboolean capsule ) {
+	cmRecordedTrace_t	rec;
+
+	// the temporary box models are rebuilt for every trace
+	if ( model == cm.boxModelHandle || model == cm.capsuleModelHandle ) {
+		return;
+	}
+
+	VectorCopy( start, rec.start );
+	VectorCopy( end, rec.end );
+	VectorCopy( mins ? mins : vec3_origin, rec.mins );
+	VectorCopy( maxs ? maxs : vec3_origin, rec.maxs );
+	rec.model = model;
+	rec.brushmask = brushmask;
+	rec.transformed = origin ? qtrue : qfalse;
+	VectorCopy( origin ? origin : vec3_origin, rec.origin );
+	VectorCopy( angles ? angles : vec3_origin, rec.angles );
+	rec.capsule = capsule;
+
+	std::lock_guard<std::mutex> lk( cmRecordMutex );
+	if ( cmRecordTraces > 0 ) {
+		cmRecordedTraces.push_back( rec );
+		cmRecordTraces--;
+	}
+}
+
+static void CM_ReplayTrace( trace_t *results, const cmRecordedTrace_t *rec ) {
+	if ( rec->transformed ) {
+		CM_TransformedBoxTrace( results, rec->start, rec->end, rec->mins, rec->maxs, rec->model, rec->brushmask,
+			rec->origin, rec->angles, rec->capsule );
+	} else {
+		CM_BoxTrace( results, rec->start, rec->end, rec->mins, rec->maxs, rec->model, rec->brushmask, rec->capsule );
+	}
+}
+
+// bitwise, so -0 and 0 or two different NaNs count as different
+#define CM_SameBits( a, b )		( !memcmp( &(a), &(b), sizeof( a ) ) )
+
+static qboolean CM_SameTrace( const trace_t *a, const trace_t *b ) {
+	return (qboolean)( CM_SameBits( a->allsolid, b->allsolid ) && CM_SameBits( a->startsolid, b->startsolid ) &&
+		CM_SameBits( a->fraction, b->fraction ) && CM_SameBits( a->endpos, b->endpos ) &&
+		CM_SameBits( a->plane.normal, b->plane.normal ) && CM_SameBits( a->plane.dist, b->plane.dist ) &&
+		CM_SameBits( a->surfaceFlags, b->surfaceFlags ) && CM_SameBits( a->contents, b->contents ) );
+}
+
+/*
+==================
+CM_TraceReplay_f
+==================
+*/
+void CM_TraceReplay_f( void ) {
+	trace_t		*scalar, *blocks;
+	int64_t		start, usec[2];
+	int			numTraces, mismatches;
+	int			i;
+
+	if ( Cmd_Argc() > 1 ) {
+		if ( Q_stricmp( Cmd_Argv( 1 ), "record" ) ) {
+			Com_Printf( "usage: cm_tracereplay [record [count]]\n" );
+			return;
+		}
+		if ( !cm.name[0] ) {
+			Com_Printf( "No map loaded.\n" );
+			return;
+		}
+
+		std::lock_guard<std::mutex> lk( cmRecordMutex );
+		cmRecordedTraces.clear();
+		Q_strncpyz( cmRecordedMap, cm.name, sizeof( cmRecordedMap ) );
+		cmRecordTraces = Cmd_Argc() > 2 ? Com_Clampi( 1, 1 << 22, atoi( Cmd_Argv( 2 ) ) ) : 65536;
+		Com_Printf( "Recording the next %i traces on %s.\n", cmRecordTraces.load(), cmRecordedMap );
+		return;
+	}
+
+	if ( cmRecordTraces > 0 ) {
+		Com_Printf( "Still recording, %i traces to go.\n", cmRecordTraces.load() );
+		return;
+	}
+	if ( cmRecordedTraces.empty() ) {
+		Com_Printf( "Nothing recorded, use cm_tracereplay record first.\n" );
+		return;
+	}
+	if ( Q_stricmp( cmRecordedMap, cm.name ) ) {
+		Com_Printf( "The traces were recorded on %s, not %s.\n", cmRecordedMap, cm.name );
+		return;
+	}
+
+#if !CM_PLANE_BLOCKS
+	Com_Printf( "This build has no SSE2 plane tests, both passes use the scalar ones.\n" );
+#endif
+
+	numTraces = (int)cmRecordedTraces.size();
+	scalar = (trace_t *)Z_Malloc( numTraces * sizeof( trace_t ), TAG_TEMP_WORKSPACE, qfalse );
+	blocks = (trace_t *)Z_Malloc( numTraces * sizeof( trace_t ), TAG_TEMP_WORKSPACE, qfalse );
+
+	cm_planeBlocks = qfalse;
+	start = Sys_Microseconds();
+	for ( i = 0 ; i < numTraces ; i++ ) {
+		CM_ReplayTrace( &scalar[i], &cmRecordedTraces[i] );
+	}
+	usec[0] = Sys_Microseconds() - start;
+
+	cm_planeBlocks = qtrue;
+	start = Sys_Microseconds();
+	for ( i = 0 ; i < numTraces ; i++ ) {
+		CM_ReplayTrace( &blocks[i], &cmRecordedTraces[i] );
+	}
+	usec[1] = Sys_Microseconds() - start;
+
+	mismatches = 0;
+	for ( i = 0 ; i < numTraces ; i++ ) {
+		if ( !CM_SameTrace( &scalar[i], &blocks[i] ) ) {
+			if ( mismatches < 10 ) {
+				Com_Printf( "trace %i: fraction %.9g / %.9g, plane dist %.9g / %.9g, surfaceFlags %i / %i\n", i,
+					scalar[i].fraction, blocks[i].fraction, scalar[i].plane.dist, blocks[i].plane.dist,
+					scalar[i].surfaceFlags, blocks[i].surfaceFlags );
+			}
+			mismatches++;
+		}
+	}
+
+	Com_Printf( "%i traces on %s\n", numTraces, cm.name );
+	Com_Printf( "scalar: %8.3f usec/trace\n", (double)usec[0] / numTraces );
+	Com_Printf( "SSE2:   %8.3f usec/trace, %.2fx\n", (double)usec[1] / numTraces,
+		(double)MAX( usec[0], (int64_t)1 ) / MAX( usec[1], (int64_t)1 ) );
+	if ( mismatches ) {
+		Com_Printf( S_COLOR_RED "FAIL: %i traces differ\n", mismatches );
+	} else {
+		Com_Printf( "PASS: all traces are bit-identical\n" );
+	}
+
+	Z_Free( blocks );
+	Z_Free( scalar );
+}
+#endif
+
 /*
 ==================
 CM_BoxTrace
@@ -1348,6 +1685,11 @@ CM_BoxTrace
 void CM_BoxTrace( trace_t *results, const vec3_t start, const vec3_t end,
 						  const vec3_t mins, const vec3_t maxs,
 						  clipHandle_t model, int brushmask, qboolean capsule ) {
+#ifndef BSPC
+	if ( cmRecordTraces.load( std::memory_order_relaxed ) ) {
+		CM_RecordTrace( start, end, mins, maxs, model, brushmask, NULL, NULL, capsule );
+	}
+#endif
 	CM_Trace( results, start, end, mins, maxs, model, vec3_origin, brushmask, capsule, NULL );
 }
 
@@ -1382,6 +1724,12 @@ void CM_TransformedBoxTrace( trace_t *results, const vec3_t start, const vec3_t
 		maxs = vec3_origin;
 	}
 
+#ifndef BSPC
+	if ( cmRecordTraces.load( std::memory_order_relaxed ) ) {
+		CM_RecordTrace( start, end, mins, maxs, model, brushmask, origin, angles, capsule );
+	}
+#endif
+
 	// adjust so that mins and maxs are always symetric, which
 	// avoids some complications with plane expanding of rotated
 	// bmodels
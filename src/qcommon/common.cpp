@@ -2,6 +2,8 @@
 
 #include <math.h>
 #include <setjmp.h>
+#include <unordered_map>
+#include <vector>
 #ifndef WIN32
 # include <fenv.h>
 #endif
@@ -798,17 +800,22 @@ int Com_RealTime(qtime_t *qtime) {
 
 
 // This handles zone memory allocation.
-// It is a wrapper around malloc with a tag id and a magic number at the start
+// Every block carries a tag id and a magic number at the start. Blocks of up to ZONE_SLAB_MAX bytes
+//	are carved from fixed-size slabs that belong to an arena per tag, bigger ones are a wrapper
+//	around malloc. Freeing a whole tag hands its slabs back to the system in one go instead of
+//	walking every block in the zone.
 
 #define ZONE_MAGIC			0x21436587
+#define ZONE_FREE_MAGIC		0x78563412	// slab chunk sitting on its slab's free list
 
 typedef struct zoneHeader_s
 {
 		int					iMagic;
 		memtag_t			eTag;
 		int					iSize;
-struct	zoneHeader_s		*pNext;
-struct	zoneHeader_s		*pPrev;
+		int					iSlabOffset;	// offset of the block from the start of its slab, 0 for malloc'd blocks
+struct	zoneHeader_s		*pNext;			// malloc'd blocks: on their tag's list. Slab blocks: free list link,
+struct	zoneHeader_s		*pPrev;			//	or on their tag's list if they were morphed away from the slab's tag
 } zoneHeader_t;
 
 typedef struct
@@ -827,12 +834,70 @@ map <void*,int> mapAllocatedZones;
 #endif
 
 
+// slab size classes, anything bigger than the last one goes straight to malloc
+//
+#define ZONE_SLAB_SIZE		(16 * 1024)
+#define ZONE_SLAB_MAX		512
+#define ZONE_SLAB_CLASSES	10
+
+static const int zoneSlabClassSizes[ZONE_SLAB_CLASSES] = { 16, 32, 48, 64, 96, 128, 192, 256, 384, 512 };
+
+// indexed by (iSize + 15) / 16
+static const byte zoneSlabClassForSize[ZONE_SLAB_MAX / 16 + 1] = {
+	0, 0, 1, 2, 3, 4, 4, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7,
+	8, 8, 8, 8, 8, 8, 8, 8, 9, 9, 9, 9, 9, 9, 9, 9,
+};
+
+typedef struct zoneSlab_s
+{
+	struct zoneSlab_s	*pNext;				// every slab of the arena
+	struct zoneSlab_s	*pPrev;
+	struct zoneSlab_s	*pNextPartial;		// slabs of the arena with a chunk to spare, per class
+	struct zoneSlab_s	*pPrevPartial;
+	zoneHeader_t		*pFree;
+	memtag_t			eTag;
+	int					iClass;
+	int					iCarved;			// chunks handed out at least once, the rest has never been touched
+	int					iUsed;				// live chunks, including the ones morphed to another tag
+	int					iForeign;			// live chunks morphed to another tag
+	int					iBytes;				// user bytes of the live chunks that still have the slab's tag
+} zoneSlab_t;
+
+#define ZONE_SLAB_START		PAD((int)sizeof(zoneSlab_t), 16)
+
+static inline int Zone_SlabStride(int iClass)
+{
+	return PAD((int)sizeof(zoneHeader_t) + zoneSlabClassSizes[iClass] + (int)sizeof(zoneTail_t), 16);
+}
+
+static inline int Zone_SlabChunks(int iClass)
+{
+	return (ZONE_SLAB_SIZE - ZONE_SLAB_START) / Zone_SlabStride(iClass);
+}
+
+static inline zoneSlab_t *Zone_SlabFromHeader(zoneHeader_t *pHeader)
+{
+	return (zoneSlab_t *)((char *)pHeader - pHeader->iSlabOffset);
+}
+
+static inline zoneHeader_t *Zone_SlabChunk(zoneSlab_t *pSlab, int iChunk)
+{
+	return (zoneHeader_t *)((char *)pSlab + ZONE_SLAB_START + iChunk * Zone_SlabStride(pSlab->iClass));
+}
+
+
 typedef struct zoneStats_s
 {
 	int		iCount;
 	int		iCurrent;
 	int		iPeak;
 
+	// what the zone holds from the system, headers and unused slab chunks included
+	//
+	int		iSystem;
+	int		iSystemPeak;
+	int		iSlabs;
+
 	// I'm keeping these updated on the fly, since it's quicker for cache-pool
 	//	purposes rather than recalculating each time...
 	//
@@ -841,54 +906,554 @@ typedef struct zoneStats_s
 
 } zoneStats_t;
 
+typedef struct zoneArena_s
+{
+	zoneHeader_t			Header;			// list of the malloc'd blocks with this tag
+	zoneSlab_t				*pSlabs;
+	zoneSlab_t				*pPartial[ZONE_SLAB_CLASSES];
+} zoneArena_t;
+
 typedef struct zone_s
 {
 	zoneStats_t				Stats;
-	zoneHeader_t			Header;
+	zoneArena_t				Arenas[TAG_COUNT];
 } zone_t;
 
 cvar_t	*com_validateZone;
+cvar_t	*com_zoneSlabs;
 
 static zone_t	TheZone = {};
 
 
+static inline void Zone_SystemAlloc(zone_t *zone, int iBytes)
+{
+	zone->Stats.iSystem += iBytes;
+	if (zone->Stats.iSystem > zone->Stats.iSystemPeak)
+	{
+		zone->Stats.iSystemPeak = zone->Stats.iSystem;
+	}
+}
+
+static inline void Zone_Link(zoneArena_t *arena, zoneHeader_t *pMemory)
+{
+	pMemory->pNext = arena->Header.pNext;
+	arena->Header.pNext = pMemory;
+	if (pMemory->pNext)
+	{
+		pMemory->pNext->pPrev = pMemory;
+	}
+	pMemory->pPrev = &arena->Header;
+}
+
+static inline void Zone_Unlink(zoneHeader_t *pMemory)
+{
+	// Sanity checks...
+	//
+	assert(pMemory->pPrev->pNext == pMemory);
+	assert(!pMemory->pNext || (pMemory->pNext->pPrev == pMemory));
+
+	pMemory->pPrev->pNext = pMemory->pNext;
+	if(pMemory->pNext)
+	{
+		pMemory->pNext->pPrev = pMemory->pPrev;
+	}
+}
 
+static void Zone_SlabLinkPartial(zoneArena_t *arena, zoneSlab_t *pSlab)
+{
+	pSlab->pPrevPartial = NULL;
+	pSlab->pNextPartial = arena->pPartial[pSlab->iClass];
+	if (pSlab->pNextPartial)
+	{
+		pSlab->pNextPartial->pPrevPartial = pSlab;
+	}
+	arena->pPartial[pSlab->iClass] = pSlab;
+}
 
-// Scans through the linked list of mallocs and makes sure no data has been overwritten
+static void Zone_SlabUnlinkPartial(zoneArena_t *arena, zoneSlab_t *pSlab)
+{
+	if (pSlab->pPrevPartial)
+	{
+		pSlab->pPrevPartial->pNextPartial = pSlab->pNextPartial;
+	}
+	else
+	{
+		arena->pPartial[pSlab->iClass] = pSlab->pNextPartial;
+	}
+	if (pSlab->pNextPartial)
+	{
+		pSlab->pNextPartial->pPrevPartial = pSlab->pPrevPartial;
+	}
+	pSlab->pNextPartial = pSlab->pPrevPartial = NULL;
+}
 
-void Z_Validate(void)
+// hands a slab back to the system, whatever is still in it goes with it
+//
+static void Zone_SlabRelease(zone_t *zone, zoneSlab_t *pSlab)
 {
-	if(!com_validateZone || !com_validateZone->integer)
+	zoneArena_t *arena = &zone->Arenas[pSlab->eTag];
+
+	if (pSlab->iUsed < Zone_SlabChunks(pSlab->iClass))
 	{
-		return;
+		Zone_SlabUnlinkPartial(arena, pSlab);
 	}
 
-	zoneHeader_t *pMemory = TheZone.Header.pNext;
-	while (pMemory)
+	if (pSlab->pPrev)
+	{
+		pSlab->pPrev->pNext = pSlab->pNext;
+	}
+	else
+	{
+		arena->pSlabs = pSlab->pNext;
+	}
+	if (pSlab->pNext)
+	{
+		pSlab->pNext->pPrev = pSlab->pPrev;
+	}
+
+	zone->Stats.iCount -= pSlab->iUsed;
+	zone->Stats.iCurrent -= pSlab->iBytes;
+	zone->Stats.iSizesPerTag	[pSlab->eTag] -= pSlab->iBytes;
+	zone->Stats.iCountsPerTag	[pSlab->eTag] -= pSlab->iUsed;
+	zone->Stats.iSystem -= ZONE_SLAB_SIZE;
+	zone->Stats.iSlabs--;
+
+#ifdef DETAILED_ZONE_DEBUG_CODE
+	if (zone == &TheZone)
+	{
+		for (int i = 0; i < pSlab->iCarved; i++)
+		{
+			zoneHeader_t *pMemory = Zone_SlabChunk(pSlab, i);
+			if (pMemory->iMagic == ZONE_MAGIC)
+			{
+				mapAllocatedZones[pMemory]--;
+			}
+		}
+	}
+#endif
+
+	free(pSlab);
+}
+
+static zoneHeader_t *Zone_SlabAlloc(zone_t *zone, int iSize, memtag_t eTag)
+{
+	const int	iClass = zoneSlabClassForSize[(iSize + 15) >> 4];
+	zoneArena_t	*arena = &zone->Arenas[eTag];
+	zoneSlab_t	*pSlab = arena->pPartial[iClass];
+	zoneHeader_t *pMemory;
+
+	if (!pSlab)
+	{
+		pSlab = (zoneSlab_t *) malloc(ZONE_SLAB_SIZE);
+		if (!pSlab)
+		{
+			return NULL;
+		}
+		memset(pSlab, 0, sizeof(*pSlab));
+		pSlab->eTag		= eTag;
+		pSlab->iClass	= iClass;
+
+		pSlab->pNext = arena->pSlabs;
+		if (pSlab->pNext)
+		{
+			pSlab->pNext->pPrev = pSlab;
+		}
+		arena->pSlabs = pSlab;
+		Zone_SlabLinkPartial(arena, pSlab);
+
+		zone->Stats.iSlabs++;
+		Zone_SystemAlloc(zone, ZONE_SLAB_SIZE);
+	}
+
+	if (pSlab->pFree)
+	{
+		pMemory = pSlab->pFree;
+		pSlab->pFree = pMemory->pNext;
+	}
+	else
+	{
+		pMemory = Zone_SlabChunk(pSlab, pSlab->iCarved++);
+		pMemory->iSlabOffset = (int)((char *)pMemory - (char *)pSlab);
+	}
+
+	if (++pSlab->iUsed == Zone_SlabChunks(iClass))
+	{
+		Zone_SlabUnlinkPartial(arena, pSlab);
+	}
+	pSlab->iBytes += iSize;
+
+	pMemory->pNext = pMemory->pPrev = NULL;
+	return pMemory;
+}
+
+static void Zone_SlabFree(zone_t *zone, zoneHeader_t *pMemory)
+{
+	zoneSlab_t	*pSlab = Zone_SlabFromHeader(pMemory);
+	zoneArena_t	*arena = &zone->Arenas[pSlab->eTag];
+
+	if (pMemory->eTag != pSlab->eTag)
+	{
+		Zone_Unlink(pMemory);
+		pSlab->iForeign--;
+	}
+	else
+	{
+		pSlab->iBytes -= pMemory->iSize;
+	}
+
+	pMemory->iMagic = ZONE_FREE_MAGIC;
+	pMemory->pNext = pSlab->pFree;
+	pSlab->pFree = pMemory;
+
+	if (pSlab->iUsed-- == Zone_SlabChunks(pSlab->iClass))
+	{
+		Zone_SlabLinkPartial(arena, pSlab);
+	}
+
+	// keep one empty slab per class around so a block bouncing between alloc and free doesn't
+	//	go to the system every time
+	//
+	if (!pSlab->iUsed && (arena->pPartial[pSlab->iClass] != pSlab || pSlab->pNextPartial))
+	{
+		Zone_SlabRelease(zone, pSlab);
+	}
+}
+
+// gets a block from a slab or from the system, NULL if the system is out of memory
+//
+static zoneHeader_t *Zone_Alloc(zone_t *zone, int iSize, memtag_t eTag, qboolean bZeroit, qboolean bSlabs)
+{
+	zoneHeader_t *pMemory;
+
+	if (bSlabs && iSize <= ZONE_SLAB_MAX)
+	{
+		pMemory = Zone_SlabAlloc(zone, iSize, eTag);
+		if (!pMemory)
+		{
+			return NULL;
+		}
+		if (bZeroit)
+		{
+			memset(pMemory + 1, 0, iSize);
+		}
+	}
+	else
+	{
+		int iRealSize = sizeof(zoneHeader_t) + PAD(iSize, alignof(zoneTail_t)) + sizeof(zoneTail_t);
+
+		if (bZeroit) {
+			pMemory = (zoneHeader_t *) calloc ( iRealSize, 1 );
+		} else {
+			pMemory = (zoneHeader_t *) malloc ( iRealSize );
+		}
+		if (!pMemory)
+		{
+			return NULL;
+		}
+		pMemory->iSlabOffset = 0;
+		Zone_Link(&zone->Arenas[eTag], pMemory);
+		Zone_SystemAlloc(zone, iRealSize);
+	}
+
+	pMemory->iMagic	= ZONE_MAGIC;
+	pMemory->eTag	= eTag;
+	pMemory->iSize	= iSize;
+	//
+	// add tail...
+	//
+	ZoneTailFromHeader(pMemory)->iMagic = ZONE_MAGIC;
+
+	// Update stats...
+	//
+	zone->Stats.iCurrent += iSize;
+	zone->Stats.iCount++;
+	zone->Stats.iSizesPerTag	[eTag] += iSize;
+	zone->Stats.iCountsPerTag	[eTag]++;
+
+	if (zone->Stats.iCurrent > zone->Stats.iPeak)
+	{
+		zone->Stats.iPeak	= zone->Stats.iCurrent;
+	}
+
+	return pMemory;
+}
+
+static void Zone_FreeBlock(zone_t *zone, zoneHeader_t *pMemory)
+{
+	if (pMemory->eTag != TAG_STATIC)	// belt and braces, should never hit this though
 	{
+		// Update stats...
+		//
+		zone->Stats.iCount--;
+		zone->Stats.iCurrent -= pMemory->iSize;
+		zone->Stats.iSizesPerTag	[pMemory->eTag] -= pMemory->iSize;
+		zone->Stats.iCountsPerTag	[pMemory->eTag]--;
+
 		#ifdef DETAILED_ZONE_DEBUG_CODE
-		// this won't happen here, but wtf?
-		int& iAllocCount = mapAllocatedZones[pMemory];
-		if (iAllocCount <= 0)
+		// this has already been checked for in execution order, but wtf?
+		if (zone == &TheZone)
 		{
-			Com_Error(ERR_FATAL, "Z_Validate(): Bad block allocation count!");
-			return;
+			int& iAllocCount = mapAllocatedZones[pMemory];
+			if (iAllocCount == 0)
+			{
+				Com_Error(ERR_FATAL, "Zone_FreeBlock(): Double-freeing block!");
+				return;
+			}
+			iAllocCount--;
 		}
 		#endif
 
-		if(pMemory->iMagic != ZONE_MAGIC)
+		if (pMemory->iSlabOffset)
 		{
-			Com_Error(ERR_FATAL, "Z_Validate(): Corrupt zone header!");
+			Zone_SlabFree(zone, pMemory);
 			return;
 		}
 
-		if (ZoneTailFromHeader(pMemory)->iMagic != ZONE_MAGIC)
+		// Unlink and free...
+		//
+		Zone_Unlink(pMemory);
+		zone->Stats.iSystem -= sizeof(zoneHeader_t) + PAD(pMemory->iSize, alignof(zoneTail_t)) + sizeof(zoneTail_t);
+		free (pMemory);
+	}
+}
+
+static void Zone_Morph(zone_t *zone, zoneHeader_t *pMemory, memtag_t eDesiredTag)
+{
+	// DEC existing tag stats...
+	//
+//	zone->Stats.iCurrent	- unchanged
+//	zone->Stats.iCount	- unchanged
+	zone->Stats.iSizesPerTag	[pMemory->eTag] -= pMemory->iSize;
+	zone->Stats.iCountsPerTag	[pMemory->eTag]--;
+
+	// morph... slab blocks stay in the slab they came from, but if they end up with another tag
+	//	than the slab they go on that tag's list so Z_TagFree() still finds them
+	//
+	if (pMemory->iSlabOffset)
+	{
+		zoneSlab_t *pSlab = Zone_SlabFromHeader(pMemory);
+
+		if (pMemory->eTag != pSlab->eTag)
+		{
+			Zone_Unlink(pMemory);
+			pSlab->iForeign--;
+			pSlab->iBytes += pMemory->iSize;
+		}
+		if (eDesiredTag != pSlab->eTag)
+		{
+			Zone_Link(&zone->Arenas[eDesiredTag], pMemory);
+			pSlab->iForeign++;
+			pSlab->iBytes -= pMemory->iSize;
+		}
+	}
+	else
+	{
+		Zone_Unlink(pMemory);
+		Zone_Link(&zone->Arenas[eDesiredTag], pMemory);
+	}
+	pMemory->eTag = eDesiredTag;
+
+	// INC new tag stats...
+	//
+//	zone->Stats.iCurrent	- unchanged
+//	zone->Stats.iCount	- unchanged
+	zone->Stats.iSizesPerTag	[pMemory->eTag] += pMemory->iSize;
+	zone->Stats.iCountsPerTag	[pMemory->eTag]++;
+}
+
+static void Zone_FreeList(zone_t *zone, memtag_t eTag)
+{
+	zoneHeader_t *pMemory = zone->Arenas[eTag].Header.pNext;
+	while (pMemory)
+	{
+		zoneHeader_t *pNext = pMemory->pNext;
+		Zone_FreeBlock(zone, pMemory);
+		pMemory = pNext;
+	}
+}
+
+static void Zone_FreeSlabs(zone_t *zone, memtag_t eTag)
+{
+	zoneSlab_t *pSlab = zone->Arenas[eTag].pSlabs;
+	while (pSlab)
+	{
+		zoneSlab_t *pNext = pSlab->pNext;
+		if (pSlab->iForeign)
+		{
+			// some of it got morphed to another tag, so only free what's still ours and leave the
+			//	slab in the arena until the rest goes
+			//
+			for (int i = 0; i < pSlab->iCarved; i++)
+			{
+				zoneHeader_t *pMemory = Zone_SlabChunk(pSlab, i);
+				if (pMemory->iMagic == ZONE_MAGIC && pMemory->eTag == eTag)
+				{
+					Zone_FreeBlock(zone, pMemory);
+				}
+			}
+		}
+		else
+		{
+			Zone_SlabRelease(zone, pSlab);
+		}
+		pSlab = pNext;
+	}
+}
+
+static void Zone_TagFree(zone_t *zone, memtag_t eTag)
+{
+	if (eTag == TAG_ALL)
+	{
+		// lists first, they hold the morphed slab blocks that keep slabs of other tags alive...
+		//
+		for (int i = 0; i < TAG_COUNT; i++)
+		{
+			Zone_FreeList(zone, (memtag_t)i);
+		}
+		for (int i = 0; i < TAG_COUNT; i++)
+		{
+			Zone_FreeSlabs(zone, (memtag_t)i);
+		}
+		return;
+	}
+
+	Zone_FreeList(zone, eTag);
+	Zone_FreeSlabs(zone, eTag);
+}
+
+
+// allocation trace recording for zone_bench
+//
+enum
+{
+	ZONE_TRACE_MALLOC,
+	ZONE_TRACE_FREE,
+	ZONE_TRACE_TAGFREE,
+	ZONE_TRACE_MORPH,
+};
+
+#define ZONE_TRACE_IDENT	(('T'<<24)+('R'<<16)+('Z'<<8)+'J')
+#define ZONE_TRACE_VERSION	1
+
+typedef struct
+{
+	int			iOp;
+	int			iTag;
+	int			iSize;
+	int			iPad;
+	uint64_t	iAddress;
+} zoneTraceEvent_t;
+
+typedef struct
+{
+	int			iIdent;
+	int			iVersion;
+	int			iCount;
+	int			iPad;
+} zoneTraceHeader_t;
+
+static struct
+{
+	qboolean			bRecording;
+	zoneTraceEvent_t	*pEvents;
+	int					iCount;
+	int					iAllocated;
+} zoneTrace;
+
+static void Zone_TraceEvent(int iOp, int iTag, int iSize, const void *pvAddress)
+{
+	if (zoneTrace.iCount == zoneTrace.iAllocated)
+	{
+		int iAllocated = zoneTrace.iAllocated ? zoneTrace.iAllocated * 2 : 65536;
+		zoneTraceEvent_t *pEvents = (zoneTraceEvent_t *) realloc(zoneTrace.pEvents, iAllocated * sizeof(zoneTraceEvent_t));
+		if (!pEvents)
 		{
-			Com_Error(ERR_FATAL, "Z_Validate(): Corrupt zone tail!");
+			zoneTrace.bRecording = qfalse;	// drop the rest, what we have is still a valid trace
 			return;
 		}
+		zoneTrace.pEvents = pEvents;
+		zoneTrace.iAllocated = iAllocated;
+	}
+
+	zoneTraceEvent_t *pEvent = &zoneTrace.pEvents[zoneTrace.iCount++];
+	pEvent->iOp			= iOp;
+	pEvent->iTag		= iTag;
+	pEvent->iSize		= iSize;
+	pEvent->iPad		= 0;
+	pEvent->iAddress	= (uint64_t)(uintptr_t)pvAddress;
+}
+
+
+// Scans through the linked list of mallocs and makes sure no data has been overwritten
+
+void Z_Validate(void)
+{
+	if(!com_validateZone || !com_validateZone->integer)
+	{
+		return;
+	}
+
+	for (int iTag = 0; iTag < TAG_COUNT; iTag++)
+	{
+		zoneHeader_t *pMemory = TheZone.Arenas[iTag].Header.pNext;
+		while (pMemory)
+		{
+			#ifdef DETAILED_ZONE_DEBUG_CODE
+			// this won't happen here, but wtf?
+			int& iAllocCount = mapAllocatedZones[pMemory];
+			if (iAllocCount <= 0)
+			{
+				Com_Error(ERR_FATAL, "Z_Validate(): Bad block allocation count!");
+				return;
+			}
+			#endif
+
+			if(pMemory->iMagic != ZONE_MAGIC)
+			{
+				Com_Error(ERR_FATAL, "Z_Validate(): Corrupt zone header!");
+				return;
+			}
+
+			if (ZoneTailFromHeader(pMemory)->iMagic != ZONE_MAGIC)
+			{
+				Com_Error(ERR_FATAL, "Z_Validate(): Corrupt zone tail!");
+				return;
+			}
+
+			pMemory = pMemory->pNext;
+		}
+
+		for (zoneSlab_t *pSlab = TheZone.Arenas[iTag].pSlabs; pSlab; pSlab = pSlab->pNext)
+		{
+			int iUsed = 0;
+			for (int i = 0; i < pSlab->iCarved; i++)
+			{
+				pMemory = Zone_SlabChunk(pSlab, i);
+				if (pMemory->iMagic == ZONE_FREE_MAGIC)
+				{
+					continue;
+				}
 
-		pMemory = pMemory->pNext;
+				if (pMemory->iMagic != ZONE_MAGIC || pMemory->iSlabOffset != (char *)pMemory - (char *)pSlab)
+				{
+					Com_Error(ERR_FATAL, "Z_Validate(): Corrupt zone header!");
+					return;
+				}
+
+				if (ZoneTailFromHeader(pMemory)->iMagic != ZONE_MAGIC)
+				{
+					Com_Error(ERR_FATAL, "Z_Validate(): Corrupt zone tail!");
+					return;
+				}
+				iUsed++;
+			}
+
+			if (iUsed != pSlab->iUsed)
+			{
+				Com_Error(ERR_FATAL, "Z_Validate(): Corrupt zone slab!");
+				return;
+			}
+		}
 	}
 }
 
@@ -911,20 +1476,20 @@ typedef struct
 } StaticMem_t;
 
 static const StaticZeroMem_t gZeroMalloc  =
-	{ {ZONE_MAGIC, TAG_STATIC,0,NULL,NULL},{ZONE_MAGIC}};
+	{ {ZONE_MAGIC, TAG_STATIC,0,0,NULL,NULL},{ZONE_MAGIC}};
 static const StaticMem_t gEmptyString =
-	{ {ZONE_MAGIC, TAG_STATIC,2,NULL,NULL}, {'\0', '\0'}, {ZONE_MAGIC}};
+	{ {ZONE_MAGIC, TAG_STATIC,2,0,NULL,NULL}, {'\0', '\0'}, {ZONE_MAGIC}};
 static const StaticMem_t gNumberString[] = {
-	{ {ZONE_MAGIC, TAG_STATIC,2,NULL,NULL}, {'0', '\0'}, {ZONE_MAGIC}},
-	{ {ZONE_MAGIC, TAG_STATIC,2,NULL,NULL}, {'1', '\0'}, {ZONE_MAGIC}},
-	{ {ZONE_MAGIC, TAG_STATIC,2,NULL,NULL}, {'2', '\0'}, {ZONE_MAGIC}},
-	{ {ZONE_MAGIC, TAG_STATIC,2,NULL,NULL}, {'3', '\0'}, {ZONE_MAGIC}},
-	{ {ZONE_MAGIC, TAG_STATIC,2,NULL,NULL}, {'4', '\0'}, {ZONE_MAGIC}},
-	{ {ZONE_MAGIC, TAG_STATIC,2,NULL,NULL}, {'5', '\0'}, {ZONE_MAGIC}},
-	{ {ZONE_MAGIC, TAG_STATIC,2,NULL,NULL}, {'6', '\0'}, {ZONE_MAGIC}},
-	{ {ZONE_MAGIC, TAG_STATIC,2,NULL,NULL}, {'7', '\0'}, {ZONE_MAGIC}},
-	{ {ZONE_MAGIC, TAG_STATIC,2,NULL,NULL}, {'8', '\0'}, {ZONE_MAGIC}},
-	{ {ZONE_MAGIC, TAG_STATIC,2,NULL,NULL}, {'9', '\0'}, {ZONE_MAGIC}},
+	{ {ZONE_MAGIC, TAG_STATIC,2,0,NULL,NULL}, {'0', '\0'}, {ZONE_MAGIC}},
+	{ {ZONE_MAGIC, TAG_STATIC,2,0,NULL,NULL}, {'1', '\0'}, {ZONE_MAGIC}},
+	{ {ZONE_MAGIC, TAG_STATIC,2,0,NULL,NULL}, {'2', '\0'}, {ZONE_MAGIC}},
+	{ {ZONE_MAGIC, TAG_STATIC,2,0,NULL,NULL}, {'3', '\0'}, {ZONE_MAGIC}},
+	{ {ZONE_MAGIC, TAG_STATIC,2,0,NULL,NULL}, {'4', '\0'}, {ZONE_MAGIC}},
+	{ {ZONE_MAGIC, TAG_STATIC,2,0,NULL,NULL}, {'5', '\0'}, {ZONE_MAGIC}},
+	{ {ZONE_MAGIC, TAG_STATIC,2,0,NULL,NULL}, {'6', '\0'}, {ZONE_MAGIC}},
+	{ {ZONE_MAGIC, TAG_STATIC,2,0,NULL,NULL}, {'7', '\0'}, {ZONE_MAGIC}},
+	{ {ZONE_MAGIC, TAG_STATIC,2,0,NULL,NULL}, {'8', '\0'}, {ZONE_MAGIC}},
+	{ {ZONE_MAGIC, TAG_STATIC,2,0,NULL,NULL}, {'9', '\0'}, {ZONE_MAGIC}},
 };
 
 static qboolean gbMemFreeupOccured = qfalse;
@@ -939,17 +1504,14 @@ void *Z_Malloc(int iSize, memtag_t eTag, qboolean bZeroit /* = qfalse */)
 	}
 
 	int iRealSize = sizeof(zoneHeader_t) + PAD(iSize, alignof(zoneTail_t)) + sizeof(zoneTail_t);
+	qboolean bSlabs = (qboolean)(!com_zoneSlabs || com_zoneSlabs->integer);
 
 	// Allocate a chunk...
 	//
 	zoneHeader_t *pMemory = NULL;
 	while (pMemory == NULL)
 	{
-		if (bZeroit) {
-			pMemory = (zoneHeader_t *) calloc ( iRealSize, 1 );
-		} else {
-			pMemory = (zoneHeader_t *) malloc ( iRealSize );
-		}
+		pMemory = Zone_Alloc(&TheZone, iSize, eTag, bZeroit, bSlabs);
 		if (!pMemory)
 		{
 			// new bit, if we fail to malloc memory, try dumping some of the cached stuff that's non-vital and try again...
@@ -1033,40 +1595,15 @@ void *Z_Malloc(int iSize, memtag_t eTag, qboolean bZeroit /* = qfalse */)
 	}
 
 
-
-
-	// Link in
-	pMemory->iMagic	= ZONE_MAGIC;
-	pMemory->eTag	= eTag;
-	pMemory->iSize	= iSize;
-	pMemory->pNext  = TheZone.Header.pNext;
-	TheZone.Header.pNext = pMemory;
-	if (pMemory->pNext)
-	{
-		pMemory->pNext->pPrev = pMemory;
-	}
-	pMemory->pPrev = &TheZone.Header;
-	//
-	// add tail...
-	//
-	ZoneTailFromHeader(pMemory)->iMagic = ZONE_MAGIC;
-
-	// Update stats...
-	//
-	TheZone.Stats.iCurrent += iSize;
-	TheZone.Stats.iCount++;
-	TheZone.Stats.iSizesPerTag	[eTag] += iSize;
-	TheZone.Stats.iCountsPerTag	[eTag]++;
-
-	if (TheZone.Stats.iCurrent > TheZone.Stats.iPeak)
-	{
-		TheZone.Stats.iPeak	= TheZone.Stats.iCurrent;
-	}
-
 #ifdef DETAILED_ZONE_DEBUG_CODE
 	mapAllocatedZones[pMemory]++;
 #endif
 
+	if (zoneTrace.bRecording)
+	{
+		Zone_TraceEvent(ZONE_TRACE_MALLOC, eTag, iSize, pMemory);
+	}
+
 	Z_Validate();	// check for corruption
 
 	void *pvReturnMem = &pMemory[1];
@@ -1086,62 +1623,12 @@ void Z_MorphMallocTag( void *pvAddress, memtag_t eDesiredTag )
 		return;	// won't get here
 	}
 
-	// DEC existing tag stats...
-	//
-//	TheZone.Stats.iCurrent	- unchanged
-//	TheZone.Stats.iCount	- unchanged
-	TheZone.Stats.iSizesPerTag	[pMemory->eTag] -= pMemory->iSize;
-	TheZone.Stats.iCountsPerTag	[pMemory->eTag]--;
-
-	// morph...
-	//
-	pMemory->eTag = eDesiredTag;
-
-	// INC new tag stats...
-	//
-//	TheZone.Stats.iCurrent	- unchanged
-//	TheZone.Stats.iCount	- unchanged
-	TheZone.Stats.iSizesPerTag	[pMemory->eTag] += pMemory->iSize;
-	TheZone.Stats.iCountsPerTag	[pMemory->eTag]++;
-}
-
-static void Zone_FreeBlock(zoneHeader_t *pMemory)
-{
-	if (pMemory->eTag != TAG_STATIC)	// belt and braces, should never hit this though
+	if (zoneTrace.bRecording)
 	{
-		// Update stats...
-		//
-		TheZone.Stats.iCount--;
-		TheZone.Stats.iCurrent -= pMemory->iSize;
-		TheZone.Stats.iSizesPerTag	[pMemory->eTag] -= pMemory->iSize;
-		TheZone.Stats.iCountsPerTag	[pMemory->eTag]--;
-
-		// Sanity checks...
-		//
-		assert(pMemory->pPrev->pNext == pMemory);
-		assert(!pMemory->pNext || (pMemory->pNext->pPrev == pMemory));
-
-		// Unlink and free...
-		//
-		pMemory->pPrev->pNext = pMemory->pNext;
-		if(pMemory->pNext)
-		{
-			pMemory->pNext->pPrev = pMemory->pPrev;
-		}
-		free (pMemory);
-
-
-		#ifdef DETAILED_ZONE_DEBUG_CODE
-		// this has already been checked for in execution order, but wtf?
-		int& iAllocCount = mapAllocatedZones[pMemory];
-		if (iAllocCount == 0)
-		{
-			Com_Error(ERR_FATAL, "Zone_FreeBlock(): Double-freeing block!");
-			return;
-		}
-		iAllocCount--;
-		#endif
+		Zone_TraceEvent(ZONE_TRACE_MORPH, eDesiredTag, 0, pMemory);
 	}
+
+	Zone_Morph(&TheZone, pMemory, eDesiredTag);
 }
 
 // stats-query function to ask how big a malloc is...
@@ -1212,7 +1699,12 @@ void Z_Free(void *pvAddress)
 		return;
 	}
 
-	Zone_FreeBlock(pMemory);
+	if (zoneTrace.bRecording)
+	{
+		Zone_TraceEvent(ZONE_TRACE_FREE, pMemory->eTag, 0, pMemory);
+	}
+
+	Zone_FreeBlock(&TheZone, pMemory);
 }
 
 
@@ -1225,28 +1717,12 @@ int Z_MemSize(memtag_t eTag)
 //
 void Z_TagFree(memtag_t eTag)
 {
-//#ifdef _DEBUG
-//	int iZoneBlocks = TheZone.Stats.iCount;
-//#endif
-
-	zoneHeader_t *pMemory = TheZone.Header.pNext;
-	while (pMemory)
+	if (zoneTrace.bRecording)
 	{
-		zoneHeader_t *pNext = pMemory->pNext;
-		if ( (eTag == TAG_ALL) || (pMemory->eTag == eTag))
-		{
-			Zone_FreeBlock(pMemory);
-		}
-		pMemory = pNext;
+		Zone_TraceEvent(ZONE_TRACE_TAGFREE, eTag, 0, NULL);
 	}
 
-// these stupid pragmas don't work here???!?!?!
-//
-//#ifdef _DEBUG
-//#pragma warning( disable : 4189)
-//	int iBlocksFreed = iZoneBlocks - TheZone.Stats.iCount;
-//#pragma warning( default : 4189)
-//#endif
+	Zone_TagFree(&TheZone, eTag);
 }
 
 
@@ -1292,6 +1768,12 @@ static void Z_Stats_f(void)
 									TheZone.Stats.iPeak,
 									         (float)TheZone.Stats.iPeak / 1024.0f / 1024.0f
 				);
+
+	Com_Printf("The zone holds %d bytes (%.2fMB) from the system, %d slabs of %d bytes\n",
+									TheZone.Stats.iSystem,
+									         (float)TheZone.Stats.iSystem / 1024.0f / 1024.0f,
+													  TheZone.Stats.iSlabs, ZONE_SLAB_SIZE
+				);
 }
 
 // Gives a detailed breakdown of the memory blocks in the zone
@@ -1327,6 +1809,249 @@ static void Z_Details_f(void)
 	Z_Stats_f();
 }
 
+
+// zone_bench replays a recorded trace, first through plain malloc and then through the slabs,
+//	each in a zone of its own so the live one isn't touched
+//
+typedef struct
+{
+	int		iOp;
+	int		iTag;
+	int		iSize;
+	int		iSlot;
+} zoneBenchOp_t;
+
+static void Zone_BenchReplay(const zoneBenchOp_t *pOps, int iOps, int iSlots, int iLoops, qboolean bSlabs, const char *psName)
+{
+	zone_t			*zone = (zone_t *) calloc(1, sizeof(zone_t));
+	zoneHeader_t	**ppSlots = (zoneHeader_t **) calloc(iSlots ? iSlots : 1, sizeof(zoneHeader_t *));
+	int64_t			iRun = 0, iTeardown = 0;
+	int				iSystemPeak = 0, iPeak = 0, iSlabs = 0;
+
+	if (!zone || !ppSlots)
+	{
+		free(zone);
+		free(ppSlots);
+		Com_Printf("zone_bench: out of memory\n");
+		return;
+	}
+
+	for (int iLoop = 0; iLoop < iLoops; iLoop++)
+	{
+		memset(zone, 0, sizeof(zone_t));
+
+		int64_t iStart = Sys_Nanoseconds();
+		for (int i = 0; i < iOps; i++)
+		{
+			const zoneBenchOp_t *pOp = &pOps[i];
+			switch (pOp->iOp)
+			{
+			case ZONE_TRACE_MALLOC:
+				ppSlots[pOp->iSlot] = Zone_Alloc(zone, pOp->iSize, (memtag_t)pOp->iTag, qfalse, bSlabs);
+				if (!ppSlots[pOp->iSlot])
+				{
+					Com_Error(ERR_DROP, "zone_bench: failed to alloc %d bytes", pOp->iSize);
+				}
+				break;
+			case ZONE_TRACE_FREE:
+				Zone_FreeBlock(zone, ppSlots[pOp->iSlot]);
+				break;
+			case ZONE_TRACE_TAGFREE:
+				Zone_TagFree(zone, (memtag_t)pOp->iTag);
+				break;
+			case ZONE_TRACE_MORPH:
+				Zone_Morph(zone, ppSlots[pOp->iSlot], (memtag_t)pOp->iTag);
+				break;
+			}
+		}
+		int64_t iEnd = Sys_Nanoseconds();
+
+		iPeak = zone->Stats.iPeak;
+		iSystemPeak = zone->Stats.iSystemPeak;
+		iSlabs = zone->Stats.iSlabs;
+
+		Zone_TagFree(zone, TAG_ALL);
+		iRun += iEnd - iStart;
+		iTeardown += Sys_Nanoseconds() - iEnd;
+	}
+
+	Com_Printf("%-7s %8.2f ms %6.1f ns/op, teardown %6.2f ms, peak %7d KB from the system for %7d KB of blocks (%.2fx), %d slabs at the end\n",
+		psName, iRun / 1e6 / iLoops, (double)iRun / iLoops / (iOps ? iOps : 1), iTeardown / 1e6 / iLoops,
+		iSystemPeak / 1024, iPeak / 1024, iPeak ? (double)iSystemPeak / iPeak : 0.0, iSlabs);
+
+	free(ppSlots);
+	free(zone);
+}
+
+static void Z_Bench_f(void)
+{
+	const char *psCmd = Cmd_Argv(1);
+	char sName[MAX_QPATH];
+
+	Q_strncpyz(sName, Cmd_Argc() > 2 ? Cmd_Argv(2) : "zonetrace", sizeof(sName));
+	COM_DefaultExtension(sName, sizeof(sName), ".ztr");
+
+	if (!Q_stricmp(psCmd, "record"))
+	{
+		zoneTrace.iCount = 0;
+		zoneTrace.bRecording = qtrue;
+		Com_Printf("zone_bench: recording allocations\n");
+		return;
+	}
+
+	if (!Q_stricmp(psCmd, "stop"))
+	{
+		zoneTrace.bRecording = qfalse;
+
+		fileHandle_t f = FS_FOpenFileWrite(sName);
+		if (!f)
+		{
+			Com_Printf("zone_bench: couldn't write %s\n", sName);
+			return;
+		}
+
+		zoneTraceHeader_t header = { ZONE_TRACE_IDENT, ZONE_TRACE_VERSION, zoneTrace.iCount, 0 };
+		FS_Write(&header, sizeof(header), f);
+		FS_Write(zoneTrace.pEvents, zoneTrace.iCount * sizeof(zoneTraceEvent_t), f);
+		FS_FCloseFile(f);
+		Com_Printf("zone_bench: wrote %d events to %s\n", zoneTrace.iCount, sName);
+
+		free(zoneTrace.pEvents);
+		memset(&zoneTrace, 0, sizeof(zoneTrace));
+		return;
+	}
+
+	if (Q_stricmp(psCmd, "replay"))
+	{
+		Com_Printf("usage: zone_bench record | stop [name] | replay [name] [loops]\n");
+		return;
+	}
+
+	int iLoops = Cmd_Argc() > 3 ? atoi(Cmd_Argv(3)) : 10;
+	if (iLoops < 1)
+	{
+		iLoops = 1;
+	}
+
+	void *pvBuffer;
+	int iLen = FS_ReadFile(sName, &pvBuffer);
+	if (iLen < 0)
+	{
+		Com_Printf("zone_bench: couldn't read %s\n", sName);
+		return;
+	}
+
+	const zoneTraceHeader_t *pHeader = (const zoneTraceHeader_t *)pvBuffer;
+	if (iLen < (int)sizeof(*pHeader) || pHeader->iIdent != ZONE_TRACE_IDENT || pHeader->iVersion != ZONE_TRACE_VERSION ||
+		pHeader->iCount < 0 || iLen < (int)(sizeof(*pHeader) + pHeader->iCount * sizeof(zoneTraceEvent_t)))
+	{
+		Com_Printf("zone_bench: %s is not a zone trace\n", sName);
+		FS_FreeFile(pvBuffer);
+		return;
+	}
+
+	// turn the recorded addresses into slots, dropping whatever refers to blocks that were
+	//	allocated before recording started...
+	//
+	const zoneTraceEvent_t *pEvents = (const zoneTraceEvent_t *)(pHeader + 1);
+	zoneBenchOp_t *pOps = (zoneBenchOp_t *) malloc((pHeader->iCount ? pHeader->iCount : 1) * sizeof(zoneBenchOp_t));
+	std::unordered_map<uint64_t, int> live;
+	std::vector<int> slotTags, freeSlots;
+	int iOps = 0, iMallocs = 0, iTagFrees = 0;
+
+	if (!pOps)
+	{
+		Com_Printf("zone_bench: out of memory\n");
+		FS_FreeFile(pvBuffer);
+		return;
+	}
+
+	for (int i = 0; i < pHeader->iCount; i++)
+	{
+		const zoneTraceEvent_t *pEvent = &pEvents[i];
+		zoneBenchOp_t *pOp = &pOps[iOps];
+
+		if (pEvent->iTag < 0 || pEvent->iTag >= TAG_COUNT || pEvent->iTag == TAG_STATIC)
+		{
+			continue;
+		}
+
+		pOp->iOp	= pEvent->iOp;
+		pOp->iTag	= pEvent->iTag;
+		pOp->iSize	= pEvent->iSize;
+		pOp->iSlot	= 0;
+
+		if (pEvent->iOp == ZONE_TRACE_MALLOC)
+		{
+			if (pEvent->iSize <= 0)
+			{
+				continue;
+			}
+			if (freeSlots.empty())
+			{
+				pOp->iSlot = (int)slotTags.size();
+				slotTags.push_back(pEvent->iTag);
+			}
+			else
+			{
+				pOp->iSlot = freeSlots.back();
+				freeSlots.pop_back();
+				slotTags[pOp->iSlot] = pEvent->iTag;
+			}
+			live[pEvent->iAddress] = pOp->iSlot;
+			iMallocs++;
+		}
+		else if (pEvent->iOp == ZONE_TRACE_FREE || pEvent->iOp == ZONE_TRACE_MORPH)
+		{
+			std::unordered_map<uint64_t, int>::iterator it = live.find(pEvent->iAddress);
+			if (it == live.end())
+			{
+				continue;
+			}
+			pOp->iSlot = it->second;
+			if (pEvent->iOp == ZONE_TRACE_FREE)
+			{
+				freeSlots.push_back(it->second);
+				live.erase(it);
+			}
+			else
+			{
+				slotTags[pOp->iSlot] = pEvent->iTag;
+			}
+		}
+		else if (pEvent->iOp == ZONE_TRACE_TAGFREE)
+		{
+			for (std::unordered_map<uint64_t, int>::iterator it = live.begin(); it != live.end(); )
+			{
+				if (pEvent->iTag == TAG_ALL || slotTags[it->second] == pEvent->iTag)
+				{
+					freeSlots.push_back(it->second);
+					it = live.erase(it);
+				}
+				else
+				{
+					++it;
+				}
+			}
+			iTagFrees++;
+		}
+		else
+		{
+			continue;
+		}
+		iOps++;
+	}
+
+	FS_FreeFile(pvBuffer);
+
+	Com_Printf("zone_bench: %d ops (%d mallocs, %d frees, %d tag frees) from %s, %d loops\n",
+		iOps, iMallocs, iOps - iMallocs - iTagFrees, iTagFrees, sName, iLoops);
+	Zone_BenchReplay(pOps, iOps, (int)slotTags.size(), iLoops, qfalse, "malloc");
+	Zone_BenchReplay(pOps, iOps, (int)slotTags.size(), iLoops, qtrue, "slabs");
+
+	free(pOps);
+}
+
 // Shuts down the zone memory system and frees up all memory
 void Com_ShutdownZoneMemory(void)
 {
@@ -1334,15 +2059,24 @@ void Com_ShutdownZoneMemory(void)
 
 	Cmd_RemoveCommand("zone_stats");
 	Cmd_RemoveCommand("zone_details");
+	Cmd_RemoveCommand("zone_bench");
+
+	zoneTrace.bRecording = qfalse;
+	free(zoneTrace.pEvents);
+	memset(&zoneTrace, 0, sizeof(zoneTrace));
 
 	if(TheZone.Stats.iCount)
 	{
 		Com_Printf("Automatically freeing %d blocks making up %d bytes\n", TheZone.Stats.iCount, TheZone.Stats.iCurrent);
-		Z_TagFree(TAG_ALL);
-
-		assert(!TheZone.Stats.iCount);
-		assert(!TheZone.Stats.iCurrent);
 	}
+
+	// even with no blocks left there can be empty slabs kept around for reuse
+	//
+	Z_TagFree(TAG_ALL);
+
+	assert(!TheZone.Stats.iCount);
+	assert(!TheZone.Stats.iCurrent);
+	assert(!TheZone.Stats.iSlabs);
 }
 
 // Initialises the zone memory system
@@ -1352,16 +2086,21 @@ void Com_InitZoneMemory( void )
 	Com_Printf("Initialising zone memory .....\n");
 
 	memset(&TheZone, 0, sizeof(TheZone));
-	TheZone.Header.iMagic = ZONE_MAGIC;
+	for (int i = 0; i < TAG_COUNT; i++)
+	{
+		TheZone.Arenas[i].Header.iMagic = ZONE_MAGIC;
+	}
 
 #ifdef DEBUG
 	com_validateZone = Cvar_Get("com_validateZone", "1", 0);
 #else
 	com_validateZone = Cvar_Get("com_validateZone", "0", 0);
 #endif
+	com_zoneSlabs = Cvar_Get("com_zoneSlabs", "1", 0);
 
 	Cmd_AddCommand("zone_stats", Z_Stats_f);
 	Cmd_AddCommand("zone_details", Z_Details_f);
+	Cmd_AddCommand("zone_bench", Z_Bench_f);
 
 #ifdef DEBUG
 	Cmd_AddCommand("zone_memrecovertest", Z_MemRecoverTest_f);
@@ -1648,16 +2387,27 @@ void Com_TouchMemory( void ) {
 
 	sum = 0;
 
-	zoneHeader_t *pMemory = TheZone.Header.pNext;
-	while (pMemory)
+	for (int iTag = 0; iTag < TAG_COUNT; iTag++)
 	{
-		byte *pMem = (byte *) &pMemory[1];
-		j = pMemory->iSize >> 2;
-		for (i=0; i<j; i+=64){
-			sum += ((volatile int*)pMem)[i];
+		zoneHeader_t *pMemory = TheZone.Arenas[iTag].Header.pNext;
+		while (pMemory)
+		{
+			byte *pMem = (byte *) &pMemory[1];
+			j = pMemory->iSize >> 2;
+			for (i=0; i<j; i+=64){
+				sum += ((volatile int*)pMem)[i];
+			}
+
+			pMemory = pMemory->pNext;
 		}
 
-		pMemory = pMemory->pNext;
+		for (zoneSlab_t *pSlab = TheZone.Arenas[iTag].pSlabs; pSlab; pSlab = pSlab->pNext)
+		{
+			j = ZONE_SLAB_SIZE >> 2;
+			for (i=0; i<j; i+=64){
+				sum += ((volatile int*)pSlab)[i];
+			}
+		}
 	}
 
 
@@ -2658,6 +3408,9 @@ void Com_Init( char *commandLine ) {
 	}
 	Cmd_AddCommand ("quit", Com_Quit_f);
 	Cmd_AddCommand ("changeVectors", MSG_ReportChangeVectors_f );
+	Cmd_AddCommand ("msgbench", MSG_Bench_f );
+	Cmd_AddCommand ("msgfuzz", MSG_Fuzz_f );
+	Cmd_AddCommand ("cm_tracereplay", CM_TraceReplay_f );
 	Cmd_AddCommand ("writeconfig", Com_WriteConfig_f );
 	Cmd_SetCommandCompletionFunc( "writeconfig", Cmd_CompleteCfgName );
 	Cmd_AddCommand ("uptime", Com_Uptime_f );
@@ -2951,6 +3704,8 @@ void Com_Frame( void ) {
 	com_frameMsec = msec;
 	msec = Com_ModifyMsec( msec );
 
+	FS_RunAsyncReads();
+
 	NET_HTTP_ProcessEvents();
 
 	//
@@ -3075,6 +3830,8 @@ void Com_Shutdown (void)
 	}
 
 	MSG_shutdownHuffman();
+
+	Com_ShutdownJobs();
 /*
 	// Only used for testing changes to huffman frequency table when tuning.
 	{
@@ -6,6 +6,7 @@
 cvar_t		*cvar_vars;
 cvar_t		*cvar_cheats;
 int			cvar_modifiedFlags;
+int			cvar_modificationCount;
 
 #define	MAX_CVARS	2048 // increased in jk2mv
 cvar_t		cvar_indexes[MAX_CVARS];
@@ -243,6 +244,7 @@ cvar_t *Cvar_Get( const char *var_name, const char *var_value, int flags, qboole
 		// ZOID--needs to be set so that cvars the game sets as
 		// SERVERINFO get sent to clients
 		cvar_modifiedFlags |= flags;
+		cvar_modificationCount++;
 
 		// only allow one non-empty reset string without a warning
 		if ( !var->resetString[0] ) {
@@ -301,6 +303,7 @@ cvar_t *Cvar_Get( const char *var_name, const char *var_value, int flags, qboole
 
 	var->flags = flags;
 	cvar_modifiedFlags |= flags;
+	cvar_modificationCount++;
 
 	hash = generateHashValue(var_name);
 	var->hashNext = hashTable[hash];
@@ -376,6 +379,7 @@ cvar_t *Cvar_Set2( const char *var_name, const char *value, qboolean force, qboo
 
 	// note what types of cvars have been modified (userinfo, archive, serverinfo, systeminfo)
 	cvar_modifiedFlags |= var->flags;
+	cvar_modificationCount++;
 
 	if (!force)
 	{
@@ -759,6 +763,7 @@ void Cvar_SetU_f( void ) {
 		return;
 	}
 	v->flags |= CVAR_USERINFO;
+	cvar_modificationCount++;
 }
 
 /*
@@ -781,6 +786,7 @@ void Cvar_SetS_f( void ) {
 		return;
 	}
 	v->flags |= CVAR_SERVERINFO;
+	cvar_modificationCount++;
 }
 
 /*
@@ -803,6 +809,7 @@ void Cvar_SetA_f( void ) {
 		return;
 	}
 	v->flags |= CVAR_ARCHIVE;
+	cvar_modificationCount++;
 }
 
 /*
@@ -12,6 +12,9 @@
  *****************************************************************************/
 
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include "../qcommon/q_shared.h"
 #include "qcommon.h"
 #include <unzip.h>	// minizip
@@ -253,6 +256,31 @@ static	int			fs_packFiles;			// total number of files in packs
 static int fs_fakeChkSum;
 static int fs_checksumFeed;
 
+// one hash over the pk3 files of all search paths, so a lookup only visits the packs
+// that have the file instead of hashing the name once for every pack
+typedef struct fileLookup_s {
+	fileInPack_t			*file;
+	pack_t					*pack;
+	unsigned int			hash;			// hash of the whole name, before masking
+	int						order;			// position of the pack in the search path
+	struct fileLookup_s		*nextPack;		// same name in a later pack
+	struct fileLookup_s		*next;			// next name in the hash bucket
+} fileLookup_t;
+
+typedef struct {
+	int				order;
+	directory_t		*dir;
+} lookupDir_t;
+
+static struct {
+	fileLookup_t	**hashTable;
+	int				hashSize;
+	fileLookup_t	*entries;
+	int				numNames;
+	lookupDir_t		*dirs;
+	int				numDirs;
+} fs_lookup;
+
 typedef union qfile_gus {
 	FILE*		o;
 	unzFile		z;
@@ -1237,6 +1265,363 @@ int FS_PakReadFile(pack_t *pak, const char *filename, char *buffer, int bufferle
 }
 
 
+/*
+================
+FS_LookupHash
+
+Case and separator insensitive like FS_FilenameCompare, extension included
+================
+*/
+static unsigned int FS_LookupHash( const char *fname ) {
+	unsigned int	hash = 2166136261u;
+	int				c;
+
+	while ( (c = *fname++) != '\0' ) {
+		if ( c >= 'A' && c <= 'Z' ) {
+			c += 'a' - 'A';
+		} else if ( c == '\\' || c == ':' ) {
+			c = '/';
+		}
+		hash = (hash ^ (unsigned char)c) * 16777619u;
+	}
+	return hash;
+}
+
+/*
+================
+FS_FreeFileLookup
+================
+*/
+static void FS_FreeFileLookup( void ) {
+	if ( fs_lookup.hashTable ) {
+		Z_Free( fs_lookup.hashTable );
+	}
+	if ( fs_lookup.entries ) {
+		Z_Free( fs_lookup.entries );
+	}
+	if ( fs_lookup.dirs ) {
+		Z_Free( fs_lookup.dirs );
+	}
+	Com_Memset( &fs_lookup, 0, sizeof( fs_lookup ) );
+}
+
+/*
+================
+FS_BuildFileLookup
+
+Every name gets the list of packs that have it, in search order. Pure and
+version checks still happen per lookup, so changing the pure list doesn't
+need a rebuild, only changing the search paths does.
+================
+*/
+static void FS_BuildFileLookup( void ) {
+	searchpath_t	*search;
+	searchpath_t	**paths;
+	int				numPaths, numFiles;
+	int				i, j;
+
+	FS_FreeFileLookup();
+
+	numPaths = numFiles = 0;
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		numPaths++;
+		if ( search->pack ) {
+			numFiles += search->pack->numfiles;
+		} else if ( search->dir ) {
+			fs_lookup.numDirs++;
+		}
+	}
+
+	for ( fs_lookup.hashSize = 1 ; fs_lookup.hashSize < numFiles ; fs_lookup.hashSize <<= 1 ) {
+	}
+
+	paths = (searchpath_t **)Z_Malloc( (numPaths ? numPaths : 1) * sizeof( *paths ), TAG_FILESYS, qfalse );
+	fs_lookup.hashTable = (fileLookup_t **)Z_Malloc( fs_lookup.hashSize * sizeof( *fs_lookup.hashTable ), TAG_FILESYS, qtrue );
+	fs_lookup.entries = (fileLookup_t *)Z_Malloc( (numFiles ? numFiles : 1) * sizeof( *fs_lookup.entries ), TAG_FILESYS, qfalse );
+	fs_lookup.dirs = (lookupDir_t *)Z_Malloc( (fs_lookup.numDirs ? fs_lookup.numDirs : 1) * sizeof( *fs_lookup.dirs ), TAG_FILESYS, qfalse );
+
+	for ( i = 0, j = 0, search = fs_searchpaths ; search ; search = search->next, i++ ) {
+		paths[i] = search;
+		if ( !search->pack && search->dir ) {
+			fs_lookup.dirs[j].order = i;
+			fs_lookup.dirs[j].dir = search->dir;
+			j++;
+		}
+	}
+
+	// go backwards, so putting each pack in front of the ones already there leaves them in search order
+	numFiles = 0;
+	for ( i = numPaths - 1 ; i >= 0 ; i-- ) {
+		pack_t *pak = paths[i]->pack;
+
+		if ( !pak ) {
+			continue;
+		}
+
+		for ( j = 0 ; j < pak->hashSize ; j++ ) {
+			fileInPack_t *pakFile;
+
+			for ( pakFile = pak->hashTable[j] ; pakFile ; pakFile = pakFile->next ) {
+				unsigned int	hash = FS_LookupHash( pakFile->name );
+				fileLookup_t	**link = &fs_lookup.hashTable[hash & (fs_lookup.hashSize - 1)];
+				fileLookup_t	*entry;
+
+				while ( *link && ((*link)->hash != hash || FS_FilenameCompare( (*link)->file->name, pakFile->name )) ) {
+					link = &(*link)->next;
+				}
+
+				// the same name twice in one pack, the first one in its hash chain is the one FS_PakReadFile finds
+				if ( *link && (*link)->pack == pak ) {
+					continue;
+				}
+
+				entry = &fs_lookup.entries[numFiles++];
+				entry->file = pakFile;
+				entry->pack = pak;
+				entry->hash = hash;
+				entry->order = i;
+				entry->nextPack = *link;
+				if ( *link ) {
+					entry->next = (*link)->next;
+				} else {
+					entry->next = NULL;
+					fs_lookup.numNames++;
+				}
+				*link = entry;
+			}
+		}
+	}
+
+	Z_Free( paths );
+}
+
+/*
+================
+FS_LookupFile
+
+First pack in the search path that has the file, NULL if there is none
+================
+*/
+static fileLookup_t *FS_LookupFile( const char *filename ) {
+	unsigned int	hash;
+	fileLookup_t	*entry;
+
+	if ( !fs_lookup.hashTable ) {
+		FS_BuildFileLookup();
+	}
+
+	hash = FS_LookupHash( filename );
+	for ( entry = fs_lookup.hashTable[hash & (fs_lookup.hashSize - 1)] ; entry ; entry = entry->next ) {
+		if ( entry->hash == hash && !FS_FilenameCompare( entry->file->name, filename ) ) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+/*
+================
+FS_PakAllowsFile
+
+Pure, version and per-file rules for loading a file from a pack
+================
+*/
+static qboolean FS_PakAllowsFile( pack_t *pak, const char *filename, qboolean skipJKA ) {
+	// Skip JKA assets if desired
+	if ( pak->isJKA && skipJKA ) {
+		return qfalse;
+	}
+
+	// disregard if it doesn't match one of the allowed pure pak files
+	if ( !FS_PakIsPure(pak) ) {
+		return qfalse;
+	}
+
+	// version specific pk3's
+	// downloaded files are always okey because they are only loaded on servers currently using them
+	if (Q_stricmpn(pak->pakBasename, "dl_", 3) &&
+		!((pak->gvc & PACKGVC_1_02 && MV_GetCurrentGameversion() == VERSION_1_02) ||
+		  (pak->gvc & PACKGVC_1_03 && MV_GetCurrentGameversion() == VERSION_1_03) ||
+		  (pak->gvc & PACKGVC_1_04 && MV_GetCurrentGameversion() == VERSION_1_04) ||
+		  (Q_stricmp(pak->pakGamename, BASEGAME) && pak->gvc == PACKGVC_UNKNOWN) ||
+		  (MV_GetCurrentGameversion() == VERSION_UNDEF))) {
+
+		// prevent loading unsupported qvm's
+		if (!Q_stricmp(filename, "vm/cgame.qvm") || !Q_stricmp(filename, "vm/ui.qvm") || !Q_stricmp(filename, "vm/jk2mpgame.qvm"))
+			return qfalse;
+
+		// incompatible pk3
+		if (pak->gvc != PACKGVC_UNKNOWN && !FS_idPak(pak))
+			return qfalse;
+	}
+
+	// patchfiles are only allowed from within assetsmv.pk3
+	if (!Q_stricmp(get_filename_ext(filename), "menu_patch") && Q_stricmp(pak->pakBasename, "assetsmv")) {
+		return qfalse;
+	}
+
+#ifdef NTCLIENT_WORKAROUND
+	// this should do the trick for the moment
+	if (!Q_stricmpn(pak->pakGamename, "nt", 2) && !Q_stricmpn(pak->pakBasename, "dl_nt", 5) &&
+		!Q_stricmp(filename, "vm/ui.qvm")) {
+		return qfalse;
+	}
+#endif
+
+	return qtrue;
+}
+
+/*
+================
+FS_OpenFileInPak
+================
+*/
+static int FS_OpenFileInPak( fileHandle_t file, pack_t *pak, fileInPack_t *pakFile, const char *filename, qboolean uniqueFILE, unsigned long *filehash ) {
+	// reference lists
+	if ( !pak->noref ) {
+		// JK2MV automatically references pk3's in three cases:
+		// 1. A .bsp file is loaded from it (and thus it is expected to be a map)
+		// 2. cgame.qvm or ui.qvm is loaded from it (expected to be a clientside)
+		// 3. pk3 is located in fs_game != base (standard jk2 behavior)
+		// 4. All retail assets from base directory (for sv_pure servers)
+		// All others need to be referenced manually by the use of reflists.
+
+		const char *baseName = pak->pakBasename;
+
+		if (!Q_stricmp(get_filename_ext(filename), "bsp")) {
+			pak->referenced |= FS_GENERAL_REF;
+		}
+
+		if (!Q_stricmp(filename, "vm/cgame.qvm")) {
+			pak->referenced |= FS_CGAME_REF;
+		}
+
+		if (!Q_stricmp(filename, "vm/ui.qvm")) {
+			pak->referenced |= FS_UI_REF;
+		}
+
+		if (!Q_stricmpn(pak->pakGamename, BASEGAME, (int)strlen(BASEGAME))) {
+			if (!Q_stricmp(baseName, "assets0") || !Q_stricmp(baseName, "assets1") ||
+				!Q_stricmp(baseName, "assets2") || !Q_stricmp(baseName, "assets5")) {
+				pak->referenced |= FS_GENERAL_REF;
+			}
+		}
+	}
+
+	if (uniqueFILE)
+	{
+		// open a new file on the pakfile
+		fsh[file].handleFiles.file.z = unzOpen(pak->pakFilename);
+
+		if (fsh[file].handleFiles.file.z == NULL)
+			Com_Error(ERR_FATAL, "Couldn't open %s", pak->pakFilename);
+	} else
+		fsh[file].handleFiles.file.z = pak->handle;
+
+	Q_strncpyz(fsh[file].name, filename, sizeof(fsh[file].name));
+	fsh[file].zipFile = qtrue;
+
+	// set the file position in the zip file (also sets the current file info)
+	unzSetOffset(fsh[file].handleFiles.file.z, pakFile->pos);
+
+	// open the file in the zip
+	unzOpenCurrentFile(fsh[file].handleFiles.file.z);
+	fsh[file].zipFilePos = pakFile->pos;
+	fsh[file].zipFileLen = pakFile->len;
+
+	if ( fs_debug->integer ) {
+		Com_Printf( "FS_FOpenFileRead: %s (found in '%s')\n",
+			filename, pak->pakFilename );
+	}
+#ifndef DEDICATED
+#ifndef FINAL_BUILD
+	// Check for unprecached files when in game but not in the menus
+	if((cls.state == CA_ACTIVE) && !(cls.keyCatchers & KEYCATCH_UI))
+	{
+		Com_Printf(S_COLOR_YELLOW "WARNING: File %s not precached\n", filename);
+	}
+#endif
+#endif // DEDICATED
+
+	// return the hash of the file
+	if (filehash) {
+		unz_file_info fi;
+
+		if (!unzGetCurrentFileInfo(fsh[file].handleFiles.file.z, &fi, NULL, 0, NULL, 0, NULL, 0)) {
+			*filehash = fi.crc;
+		}
+	}
+
+	return pakFile->len;
+}
+
+/*
+================
+FS_OpenFileInDir
+
+Returns -1 if the file isn't in the directory or may not be loaded from it
+================
+*/
+static int FS_OpenFileInDir( fileHandle_t file, directory_t *dir, const char *filename, const char *demoExt, module_t module ) {
+	char	*netpath;
+	int		l;
+
+	// check a file in the directory tree
+
+	// if we are running restricted, the only files we
+	// will allow to come from the directory are .cfg files
+	l = (int)strlen( filename );
+  // FIXME TTimo I'm not sure about the fs_numServerPaks test
+  // if you are using FS_ReadFile to find out if a file exists,
+  //   this test can make the search fail although the file is in the directory
+  // I had the problem on https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=8
+  // turned out I used FS_FileExists instead
+	if ( fs_numServerPaks ) {
+
+		if ( Q_stricmp( filename + l - 4, ".cfg" )		// for config files
+			&& Q_stricmp( filename + l - 4, ".fcf" )	// force configuration files
+			&& Q_stricmp( filename + l - 5, ".menu" )	// menu files
+			&& Q_stricmp( filename + l - 5, ".game" )	// menu files
+			&& Q_stricmp( filename + l - strlen(demoExt), demoExt )	// menu files
+			&& Q_stricmp( filename + l - 4, ".dat" ) ) {	// for journal files
+			return -1;
+		}
+	}
+
+	netpath = FS_BuildOSPath( dir->path, dir->gamedir, filename );
+	fsh[file].handleFiles.file.o = fopen (netpath, "rb");
+	if ( !fsh[file].handleFiles.file.o ) {
+		return -1;
+	}
+
+	if ( Q_stricmp( filename + l - 4, ".cfg" )		// for config files
+		&& Q_stricmp( filename + l - 4, ".fcf" )	// force configuration files
+		&& Q_stricmp( filename + l - 5, ".menu" )	// menu files
+		&& Q_stricmp( filename + l - 5, ".game" )	// menu files
+		&& Q_stricmp( filename + l - strlen(demoExt), demoExt )	// menu files
+		&& Q_stricmp( filename + l - 4, ".dat" ) ) {	// for journal files
+		fs_fakeChkSum = qrandom();
+	}
+
+	Q_strncpyz( fsh[file].name, filename, sizeof( fsh[file].name ) );
+	fsh[file].zipFile = qfalse;
+	if ( fs_debug->integer ) {
+		Com_Printf( "FS_FOpenFileRead: %s (found in '%s/%s')\n", filename,
+			dir->path, dir->gamedir );
+	}
+
+#ifndef DEDICATED
+#ifndef FINAL_BUILD
+	// Check for unprecached files when in game but not in the menus
+	if((cls.state == CA_ACTIVE) && !(cls.keyCatchers & KEYCATCH_UI))
+	{
+		Com_Printf(S_COLOR_YELLOW "WARNING: File %s not precached\n", filename);
+	}
+#endif
+#endif // dedicated
+	return FS_filelength (file, module);
+}
+
 /*
 ===========
 FS_FOpenFileRead
@@ -1260,17 +1645,11 @@ int FS_FOpenFileRead_RI(const char *filename, fileHandle_t *file, qboolean uniqu
 
 int FS_FOpenFileReadHash(const char *filename, fileHandle_t *file, qboolean uniqueFILE, unsigned long *filehash, module_t module, qboolean skipJKA) {
 	bool			isLocalConfig;
-	searchpath_t	*search;
-	char			*netpath;
-	pack_t			*pak;
-	fileInPack_t	*pakFile;
-	directory_t		*dir;
-	int			hash;
-	int				l;
+	fileLookup_t	*entry;
+	int				dir;
+	int				len;
 	char demoExt[16];
 
-	hash = 0;
-
 	if ( !fs_searchpaths ) {
 		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
 	}
@@ -1303,209 +1682,35 @@ int FS_FOpenFileReadHash(const char *filename, fileHandle_t *file, qboolean uniq
 		!strcmp( filename, "jk2mvglobal.cfg" ) );
 
 	//
-	// search through the path, one element at a time
+	// search through the path, one element at a time: the packs that have the file
+	// and the directories in between
 	//
 
 	*file = FS_HandleForFile();
 	fsh[*file].module = module;
 	fsh[*file].handleFiles.unique = uniqueFILE;
 
-	for ( search = fs_searchpaths ; search ; search = search->next ) {
-		//
-		if ( isLocalConfig && search->pack ) {
-			continue;
-		}
-		// Skip JKA assets if desired
-		if ( search->pack && search->pack->isJKA && skipJKA ) {
-			continue;
-		}
-		//
-		if ( search->pack ) {
-			hash = FS_HashFileName(filename, search->pack->hashSize);
-		}
-		// is the element a pak file?
-		if ( search->pack && search->pack->hashTable[hash] ) {
-			// disregard if it doesn't match one of the allowed pure pak files
-			if ( !FS_PakIsPure(search->pack) ) {
-				continue;
-			}
-
-			// version specific pk3's
-			// downloaded files are always okey because they are only loaded on servers currently using them
-			if (Q_stricmpn(search->pack->pakBasename, "dl_", 3) &&
-				!((search->pack->gvc & PACKGVC_1_02 && MV_GetCurrentGameversion() == VERSION_1_02) ||
-				  (search->pack->gvc & PACKGVC_1_03 && MV_GetCurrentGameversion() == VERSION_1_03) ||
-				  (search->pack->gvc & PACKGVC_1_04 && MV_GetCurrentGameversion() == VERSION_1_04) ||
-				  (Q_stricmp(search->pack->pakGamename, BASEGAME) && search->pack->gvc == PACKGVC_UNKNOWN) ||
-				  (MV_GetCurrentGameversion() == VERSION_UNDEF))) {
-
-				// prevent loading unsupported qvm's
-				if (!Q_stricmp(filename, "vm/cgame.qvm") || !Q_stricmp(filename, "vm/ui.qvm") || !Q_stricmp(filename, "vm/jk2mpgame.qvm"))
-					continue;
-
-				// incompatible pk3
-				if (search->pack->gvc != PACKGVC_UNKNOWN && !FS_idPak(search->pack))
-					continue;
-			}
-
-			// patchfiles are only allowed from within assetsmv.pk3
-			if (!Q_stricmp(get_filename_ext(filename), "menu_patch") && Q_stricmp(search->pack->pakBasename, "assetsmv")) {
-				continue;
-			}
-
-#ifdef NTCLIENT_WORKAROUND
-			// this should do the trick for the moment
-			if (!Q_stricmpn(search->pack->pakGamename, "nt", 2) && !Q_stricmpn(search->pack->pakBasename, "dl_nt", 5) &&
-				!Q_stricmp(filename, "vm/ui.qvm")) {
-				continue;
-			}
-#endif
-
-			// look through all the pak file elements
-			pak = search->pack;
-			pakFile = pak->hashTable[hash];
-			do {
-				// case and separator insensitive comparisons
-				if ( !FS_FilenameCompare( pakFile->name, filename ) ) {
-					// found it!
-
-					// reference lists
-					if ( !pak->noref ) {
-						// JK2MV automatically references pk3's in three cases:
-						// 1. A .bsp file is loaded from it (and thus it is expected to be a map)
-						// 2. cgame.qvm or ui.qvm is loaded from it (expected to be a clientside)
-						// 3. pk3 is located in fs_game != base (standard jk2 behavior)
-						// 4. All retail assets from base directory (for sv_pure servers)
-						// All others need to be referenced manually by the use of reflists.
-
-						const char *baseName = pak->pakBasename;
-
-						if (!Q_stricmp(get_filename_ext(filename), "bsp")) {
-							pak->referenced |= FS_GENERAL_REF;
-						}
-
-						if (!Q_stricmp(filename, "vm/cgame.qvm")) {
-							pak->referenced |= FS_CGAME_REF;
-						}
-
-						if (!Q_stricmp(filename, "vm/ui.qvm")) {
-							pak->referenced |= FS_UI_REF;
-						}
-
-						if (!Q_stricmpn(pak->pakGamename, BASEGAME, (int)strlen(BASEGAME))) {
-							if (!Q_stricmp(baseName, "assets0") || !Q_stricmp(baseName, "assets1") ||
-								!Q_stricmp(baseName, "assets2") || !Q_stricmp(baseName, "assets5")) {
-								pak->referenced |= FS_GENERAL_REF;
-							}
-						}
-					}
-
-					if (uniqueFILE)
-					{
-						// open a new file on the pakfile
-						fsh[*file].handleFiles.file.z = unzOpen(pak->pakFilename);
-
-						if (fsh[*file].handleFiles.file.z == NULL)
-							Com_Error(ERR_FATAL, "Couldn't open %s", pak->pakFilename);
-					} else
-						fsh[*file].handleFiles.file.z = pak->handle;
-
-					Q_strncpyz(fsh[*file].name, filename, sizeof(fsh[*file].name));
-					fsh[*file].zipFile = qtrue;
-
-					// set the file position in the zip file (also sets the current file info)
-					unzSetOffset(fsh[*file].handleFiles.file.z, pakFile->pos);
-
-					// open the file in the zip
-					unzOpenCurrentFile(fsh[*file].handleFiles.file.z);
-					fsh[*file].zipFilePos = pakFile->pos;
-					fsh[*file].zipFileLen = pakFile->len;
-
-					if ( fs_debug->integer ) {
-						Com_Printf( "FS_FOpenFileRead: %s (found in '%s')\n",
-							filename, pak->pakFilename );
-					}
-#ifndef DEDICATED
-#ifndef FINAL_BUILD
-					// Check for unprecached files when in game but not in the menus
-					if((cls.state == CA_ACTIVE) && !(cls.keyCatchers & KEYCATCH_UI))
-					{
-						Com_Printf(S_COLOR_YELLOW "WARNING: File %s not precached\n", filename);
-					}
-#endif
-#endif // DEDICATED
-
-					// return the hash of the file
-					if (filehash) {
-						unz_file_info fi;
+	entry = isLocalConfig ? NULL : FS_LookupFile( filename );
+	dir = 0;
 
-						if (!unzGetCurrentFileInfo(fsh[*file].handleFiles.file.z, &fi, NULL, 0, NULL, 0, NULL, 0)) {
-							*filehash = fi.crc;
-						}
-					}
-
-					return pakFile->len;
-				}
-				pakFile = pakFile->next;
-			} while(pakFile != NULL);
-		} else if ( search->dir ) {
-			// check a file in the directory tree
-
-			// if we are running restricted, the only files we
-			// will allow to come from the directory are .cfg files
-			l = (int)strlen( filename );
-	  // FIXME TTimo I'm not sure about the fs_numServerPaks test
-      // if you are using FS_ReadFile to find out if a file exists,
-      //   this test can make the search fail although the file is in the directory
-      // I had the problem on https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=8
-      // turned out I used FS_FileExists instead
-			if ( fs_numServerPaks ) {
-
-				if ( Q_stricmp( filename + l - 4, ".cfg" )		// for config files
-					&& Q_stricmp( filename + l - 4, ".fcf" )	// force configuration files
-					&& Q_stricmp( filename + l - 5, ".menu" )	// menu files
-					&& Q_stricmp( filename + l - 5, ".game" )	// menu files
-					&& Q_stricmp( filename + l - strlen(demoExt), demoExt )	// menu files
-					&& Q_stricmp( filename + l - 4, ".dat" ) ) {	// for journal files
-					continue;
-				}
-			}
-
-			dir = search->dir;
-
-			netpath = FS_BuildOSPath( dir->path, dir->gamedir, filename );
-			fsh[*file].handleFiles.file.o = fopen (netpath, "rb");
-			if ( !fsh[*file].handleFiles.file.o ) {
-				continue;
-			}
+	for ( ;; ) {
+		int order = entry ? entry->order : INT_MAX;
 
-			if ( Q_stricmp( filename + l - 4, ".cfg" )		// for config files
-				&& Q_stricmp( filename + l - 4, ".fcf" )	// force configuration files
-				&& Q_stricmp( filename + l - 5, ".menu" )	// menu files
-				&& Q_stricmp( filename + l - 5, ".game" )	// menu files
-				&& Q_stricmp( filename + l - strlen(demoExt), demoExt )	// menu files
-				&& Q_stricmp( filename + l - 4, ".dat" ) ) {	// for journal files
-				fs_fakeChkSum = qrandom();
+		for ( ; dir < fs_lookup.numDirs && fs_lookup.dirs[dir].order < order ; dir++ ) {
+			len = FS_OpenFileInDir( *file, fs_lookup.dirs[dir].dir, filename, demoExt, module );
+			if ( len >= 0 ) {
+				return len;
 			}
+		}
 
-			Q_strncpyz( fsh[*file].name, filename, sizeof( fsh[*file].name ) );
-			fsh[*file].zipFile = qfalse;
-			if ( fs_debug->integer ) {
-				Com_Printf( "FS_FOpenFileRead: %s (found in '%s/%s')\n", filename,
-					dir->path, dir->gamedir );
-			}
+		if ( !entry ) {
+			break;
+		}
 
-#ifndef DEDICATED
-#ifndef FINAL_BUILD
-			// Check for unprecached files when in game but not in the menus
-			if((cls.state == CA_ACTIVE) && !(cls.keyCatchers & KEYCATCH_UI))
-			{
-				Com_Printf(S_COLOR_YELLOW "WARNING: File %s not precached\n", filename);
-			}
-#endif
-#endif // dedicated
-			return FS_filelength (*file, module);
+		if ( FS_PakAllowsFile( entry->pack, filename, skipJKA ) ) {
+			return FS_OpenFileInPak( *file, entry->pack, entry->file, filename, uniqueFILE, filehash );
 		}
+		entry = entry->nextPack;
 	}
 
 	if ( fs_debug->integer ) {
@@ -1694,10 +1899,7 @@ CONVENIENCE FUNCTIONS FOR ENTIRE FILES
 */
 
 int	FS_FileIsInPAK(const char *filename, int *pChecksum ) {
-	searchpath_t	*search;
-	pack_t			*pak;
-	fileInPack_t	*pakFile;
-	int			hash = 0;
+	fileLookup_t	*entry;
 
 	if ( !fs_searchpaths ) {
 		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
@@ -1720,44 +1922,527 @@ int	FS_FileIsInPAK(const char *filename, int *pChecksum ) {
 	}
 
 	//
-	// search through the path, one element at a time
+	// search through the packs that have the file, in search path order
 	//
 
-	for ( search = fs_searchpaths ; search ; search = search->next ) {
-		//
-		if (search->pack) {
-			hash = FS_HashFileName(filename, search->pack->hashSize);
+	for ( entry = FS_LookupFile( filename ) ; entry ; entry = entry->nextPack ) {
+		// disregard if it doesn't match one of the allowed pure pak files
+		if ( !FS_PakIsPure(entry->pack) ) {
+			continue;
 		}
-		// is the element a pak file?
-		if ( search->pack && search->pack->hashTable[hash] ) {
-			// disregard if it doesn't match one of the allowed pure pak files
-			if ( !FS_PakIsPure(search->pack) ) {
-				continue;
+
+		// if scanning for cgame, ui or jk2mpgame and we are in 1.02 mode ignore assets5.pk3 and assets2.pk3
+		if (MV_GetCurrentGameversion() == VERSION_1_02 &&
+			(!Q_stricmp(filename, "vm/cgame.qvm") || !Q_stricmp(filename, "vm/ui.qvm") || !Q_stricmp(filename, "vm/jk2mpgame.qvm")) &&
+			(!Q_stricmp(entry->pack->pakBasename, "assets2") || !Q_stricmp(entry->pack->pakBasename, "assets5"))) {
+			continue;
+		}
+
+		if (pChecksum) {
+			*pChecksum = entry->pack->pure_checksum;
+		}
+		return 1;
+	}
+	return -1;
+}
+
+/*
+=================================================================================
+
+ASYNCHRONOUS READS
+
+FS_ReadFileAsync and FS_PrefetchFile look the file up on the main thread, allocate
+its buffer and leave the inflating to a small pool of reader threads, each with its
+own handle on the pk3. FS_ReadFile picks up a prefetched buffer instead of reading the
+file again, and completion callbacks are run from Com_Frame through FS_RunAsyncReads.
+Files outside of pk3 files aren't worth a thread and are read on delivery.
+
+=================================================================================
+*/
+
+#define	MAX_ASYNC_READS		256
+#define	MAX_ASYNC_THREADS	8
+
+typedef enum {
+	ASYNC_FREE,
+	ASYNC_QUEUED,
+	ASYNC_RUNNING,
+	ASYNC_DONE
+} asyncReadState_t;
+
+typedef struct asyncRead_s {
+	asyncReadState_t	state;
+	int					sequence;
+	char				qpath[MAX_QPATH];
+	qboolean			skipJKA;
+	fsReadCallback_t	callback;		// NULL for prefetches
+	void				*userData;
+
+	pack_t				*pack;			// NULL if the file isn't in a pk3
+	int					pos;
+	int					len;
+	byte				*buffer;
+	qboolean			ok;
+} asyncRead_t;
+
+static struct {
+	std::mutex				mutex;
+	std::condition_variable	cvWork;
+	std::condition_variable	cvDone;
+	std::thread				*threads[MAX_ASYNC_THREADS];
+	int						numThreads;
+	qboolean				shutdown;
+
+	asyncRead_t				reads[MAX_ASYNC_READS];
+	int						numActive;		// main thread only
+	int						sequence;
+	int						prefetchBytes;
+	int						prefetchUsed;
+	int						prefetchDropped;
+} fs_async;
+
+static cvar_t *fs_readThreads;
+static cvar_t *fs_prefetchMB;
+
+int FS_ReadFile_real( const char *qpath, void **buffer, qboolean skipJKA, asyncRead_t *read );
+
+/*
+=================
+FS_AsyncReadWorker
+=================
+*/
+static void FS_AsyncReadWorker( void ) {
+	unzFile			zip = NULL;
+	const pack_t	*zipPack = NULL;
+	asyncRead_t		*read;
+	qboolean		ok;
+	int				i;
+
+	for ( ;; ) {
+		{
+			std::unique_lock<std::mutex> lk(fs_async.mutex);
+
+			for ( ;; ) {
+				read = NULL;
+				if ( fs_async.shutdown ) {
+					break;
+				}
+				for ( i = 0 ; i < MAX_ASYNC_READS ; i++ ) {
+					if ( fs_async.reads[i].state == ASYNC_QUEUED && (!read || fs_async.reads[i].sequence < read->sequence) ) {
+						read = &fs_async.reads[i];
+					}
+				}
+				if ( read ) {
+					read->state = ASYNC_RUNNING;
+					break;
+				}
+				if ( zip ) {
+					// don't keep the pk3 open while idle
+					lk.unlock();
+					unzClose( zip );
+					zip = NULL;
+					zipPack = NULL;
+					lk.lock();
+					continue;
+				}
+				fs_async.cvWork.wait(lk);
 			}
+		}
 
-			// if scanning for cgame, ui or jk2mpgame and we are in 1.02 mode ignore assets5.pk3 and assets2.pk3
-			if (MV_GetCurrentGameversion() == VERSION_1_02 &&
-				(!Q_stricmp(filename, "vm/cgame.qvm") || !Q_stricmp(filename, "vm/ui.qvm") || !Q_stricmp(filename, "vm/jk2mpgame.qvm")) &&
-				(!Q_stricmp(search->pack->pakBasename, "assets2") || !Q_stricmp(search->pack->pakBasename, "assets5"))) {
-				continue;
+		if ( !read ) {
+			break;
+		}
+
+		if ( zipPack != read->pack ) {
+			if ( zip ) {
+				unzClose( zip );
 			}
+			zip = unzOpen( read->pack->pakFilename );
+			zipPack = read->pack;
+		}
 
-			// look through all the pak file elements
-			pak = search->pack;
-			pakFile = pak->hashTable[hash];
-			do {
-				// case and separator insensitive comparisons
-				if ( !FS_FilenameCompare( pakFile->name, filename ) ) {
-					if (pChecksum) {
-						*pChecksum = pak->pure_checksum;
-					}
-					return 1;
+		ok = qfalse;
+		if ( zip && unzSetOffset( zip, read->pos ) == UNZ_OK && unzOpenCurrentFile( zip ) == UNZ_OK ) {
+			ok = (qboolean)( unzReadCurrentFile( zip, read->buffer, read->len ) == read->len );
+			unzCloseCurrentFile( zip );
+		}
+
+		{
+			std::lock_guard<std::mutex> lk(fs_async.mutex);
+			read->ok = ok;
+			read->state = ASYNC_DONE;
+		}
+		fs_async.cvDone.notify_all();
+	}
+
+	if ( zip ) {
+		unzClose( zip );
+	}
+}
+
+/*
+=================
+FS_ReleaseAsyncRead
+
+Frees a request that no thread is working on anymore
+=================
+*/
+static void FS_ReleaseAsyncRead( asyncRead_t *read ) {
+	if ( read->buffer ) {
+		Z_Free( read->buffer );
+		if ( !read->callback ) {
+			fs_async.prefetchBytes -= read->len + 1;
+		}
+	}
+	read->buffer = NULL;
+	read->pack = NULL;
+	read->callback = NULL;
+	fs_async.numActive--;
+
+	std::lock_guard<std::mutex> lk(fs_async.mutex);
+	read->state = ASYNC_FREE;
+}
+
+/*
+=================
+FS_WaitAsyncRead
+
+Takes a request back from the reader threads: a queued one is cancelled,
+a running one is waited for
+=================
+*/
+static void FS_WaitAsyncRead( asyncRead_t *read ) {
+	std::unique_lock<std::mutex> lk(fs_async.mutex);
+
+	if ( read->state == ASYNC_QUEUED ) {
+		read->state = ASYNC_DONE;
+		read->ok = qfalse;
+		return;
+	}
+	fs_async.cvDone.wait(lk, [read] { return read->state != ASYNC_RUNNING; });
+}
+
+/*
+=================
+FS_ShutdownAsyncReads
+
+Stops the reader threads and drops all requests, the packs they point to are about to go.
+Callbacks that haven't run yet get a failed read so their userData isn't lost.
+=================
+*/
+static void FS_ShutdownAsyncReads( void ) {
+	asyncRead_t			*read;
+	fsReadCallback_t	callback;
+	void				*userData;
+	char				qpath[MAX_QPATH];
+	int					i;
+
+	if ( fs_async.numThreads ) {
+		{
+			std::lock_guard<std::mutex> lk(fs_async.mutex);
+			fs_async.shutdown = qtrue;
+		}
+		fs_async.cvWork.notify_all();
+
+		for ( i = 0 ; i < fs_async.numThreads ; i++ ) {
+			fs_async.threads[i]->join();
+			delete fs_async.threads[i];
+			fs_async.threads[i] = NULL;
+		}
+		fs_async.numThreads = 0;
+		fs_async.shutdown = qfalse;
+	}
+
+	for ( i = 0 ; i < MAX_ASYNC_READS ; i++ ) {
+		read = &fs_async.reads[i];
+		if ( read->state == ASYNC_FREE ) {
+			continue;
+		}
+
+		Q_strncpyz( qpath, read->qpath, sizeof( qpath ) );
+		callback = read->callback;
+		userData = read->userData;
+		FS_ReleaseAsyncRead( read );
+		if ( callback ) {
+			callback( qpath, NULL, -1, userData );
+		}
+	}
+}
+
+/*
+=================
+FS_QueueAsyncRead
+
+Returns NULL if the request can't be queued
+=================
+*/
+static asyncRead_t *FS_QueueAsyncRead( const char *qpath, qboolean skipJKA, fsReadCallback_t callback, void *userData ) {
+	asyncRead_t		*read;
+	fileLookup_t	*entry;
+	int				i;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	}
+
+	if ( !qpath || !qpath[0] ) {
+		Com_Error( ERR_FATAL, "FS_ReadFileAsync with empty name" );
+	}
+
+	// the journal has to see every read in order
+	if ( com_journal && com_journal->integer ) {
+		return NULL;
+	}
+
+	if ( qpath[0] == '/' || qpath[0] == '\\' ) {
+		qpath++;
+	}
+	if ( strlen( qpath ) >= MAX_QPATH || strstr( qpath, ".." ) || strstr( qpath, "::" ) ) {
+		return NULL;
+	}
+
+	read = NULL;
+	{
+		std::lock_guard<std::mutex> lk(fs_async.mutex);
+		for ( i = 0 ; i < MAX_ASYNC_READS ; i++ ) {
+			if ( fs_async.reads[i].state == ASYNC_FREE ) {
+				if ( !read ) {
+					read = &fs_async.reads[i];
+				}
+			} else if ( !callback && !fs_async.reads[i].callback && !Q_stricmp( fs_async.reads[i].qpath, qpath ) ) {
+				return &fs_async.reads[i];	// already on its way
+			}
+		}
+	}
+	if ( !read ) {
+		return NULL;
+	}
+
+	// find the pk3 FS_FOpenFileRead is going to pick, unless a directory comes first,
+	// FS_ClaimAsyncRead double checks
+	entry = FS_LookupFile( qpath );
+	while ( entry && !FS_PakAllowsFile( entry->pack, qpath, skipJKA ) ) {
+		entry = entry->nextPack;
+	}
+
+	if ( !entry || fs_readThreads->integer <= 0 ) {
+		if ( !callback ) {
+			return NULL;
+		}
+		// read on delivery
+		Q_strncpyz( read->qpath, qpath, sizeof( read->qpath ) );
+		read->skipJKA = skipJKA;
+		read->callback = callback;
+		read->userData = userData;
+		read->ok = qfalse;
+		fs_async.numActive++;
+
+		std::lock_guard<std::mutex> lk(fs_async.mutex);
+		read->sequence = fs_async.sequence++;
+		read->state = ASYNC_DONE;
+		return read;
+	}
+
+	if ( !callback && fs_async.prefetchBytes + (int)entry->file->len + 1 > fs_prefetchMB->integer * 1024 * 1024 ) {
+		return NULL;
+	}
+
+	Q_strncpyz( read->qpath, qpath, sizeof( read->qpath ) );
+	read->skipJKA = skipJKA;
+	read->callback = callback;
+	read->userData = userData;
+	read->pack = entry->pack;
+	read->pos = entry->file->pos;
+	read->len = entry->file->len;
+	read->buffer = (byte *)Z_Malloc( read->len + 1, TAG_FILESYS, qfalse );
+	read->buffer[read->len] = 0;
+	read->ok = qfalse;
+	if ( !callback ) {
+		fs_async.prefetchBytes += read->len + 1;
+	}
+	fs_async.numActive++;
+
+	// start the readers on first use
+	while ( fs_async.numThreads < fs_readThreads->integer && fs_async.numThreads < MAX_ASYNC_THREADS ) {
+		fs_async.threads[fs_async.numThreads++] = new std::thread(FS_AsyncReadWorker);
+	}
+
+	{
+		std::lock_guard<std::mutex> lk(fs_async.mutex);
+		read->sequence = fs_async.sequence++;
+		read->state = ASYNC_QUEUED;
+	}
+	fs_async.cvWork.notify_one();
+
+	return read;
+}
+
+/*
+=================
+FS_ClaimAsyncRead
+
+Called by FS_ReadFile with the file already opened as h. Returns the buffer of the
+matching request if its thread read the same file, NULL if it has to be read now.
+=================
+*/
+static byte *FS_ClaimAsyncRead( const char *qpath, fileHandle_t h, int len, asyncRead_t *read ) {
+	byte	*buf;
+	int		i;
+
+	if ( !read ) {
+		if ( !fs_async.numActive ) {
+			return NULL;
+		}
+
+		if ( qpath[0] == '/' || qpath[0] == '\\' ) {
+			qpath++;
+		}
+
+		std::lock_guard<std::mutex> lk(fs_async.mutex);
+		for ( i = 0 ; i < MAX_ASYNC_READS ; i++ ) {
+			if ( fs_async.reads[i].state != ASYNC_FREE && !fs_async.reads[i].callback && !Q_stricmp( fs_async.reads[i].qpath, qpath ) ) {
+				read = &fs_async.reads[i];
+				break;
+			}
+		}
+	}
+
+	if ( !read ) {
+		return NULL;
+	}
+
+	FS_WaitAsyncRead( read );
+
+	buf = NULL;
+	if ( read->ok && read->len == len && fsh[h].zipFile &&
+		fsh[h].handleFiles.file.z == read->pack->handle && fsh[h].zipFilePos == read->pos ) {
+		buf = read->buffer;
+		if ( !read->callback ) {
+			fs_async.prefetchBytes -= read->len + 1;
+			fs_async.prefetchUsed++;
+		}
+		read->buffer = NULL;
+	} else if ( !read->callback ) {
+		fs_async.prefetchDropped++;
+	}
+
+	FS_ReleaseAsyncRead( read );
+	return buf;
+}
+
+/*
+=================
+FS_ReadFileAsync
+
+Reads the file in the background, callback gets the same result FS_ReadFile
+would have returned on the main thread during a later frame. The buffer belongs
+to the callback and has to be freed with FS_FreeFile.
+=================
+*/
+void FS_ReadFileAsync( const char *qpath, fsReadCallback_t callback, void *userData ) {
+	void	*buf;
+	int		len;
+
+	if ( !callback ) {
+		Com_Error( ERR_FATAL, "FS_ReadFileAsync without callback" );
+	}
+
+	if ( !FS_QueueAsyncRead( qpath, qfalse, callback, userData ) ) {
+		len = FS_ReadFile( qpath, &buf );
+		callback( qpath, buf, len, userData );
+	}
+}
+
+/*
+=================
+FS_PrefetchFile
+
+Hint that qpath is about to be read with FS_ReadFile
+=================
+*/
+qboolean FS_PrefetchFile( const char *qpath ) {
+	return (qboolean)( FS_QueueAsyncRead( qpath, qfalse, NULL, NULL ) != NULL );
+}
+
+/*
+=================
+FS_RunAsyncReads
+
+Runs the callbacks of completed reads, called every frame
+=================
+*/
+void FS_RunAsyncReads( void ) {
+	asyncRead_t			*read;
+	fsReadCallback_t	callback;
+	void				*userData;
+	char				qpath[MAX_QPATH];
+	void				*buf;
+	int					len;
+	int					i;
+
+	while ( fs_async.numActive ) {
+		read = NULL;
+		{
+			std::lock_guard<std::mutex> lk(fs_async.mutex);
+			for ( i = 0 ; i < MAX_ASYNC_READS ; i++ ) {
+				if ( fs_async.reads[i].state == ASYNC_DONE && fs_async.reads[i].callback &&
+					(!read || fs_async.reads[i].sequence < read->sequence) ) {
+					read = &fs_async.reads[i];
 				}
-				pakFile = pakFile->next;
-			} while(pakFile != NULL);
+			}
+		}
+		if ( !read ) {
+			break;
+		}
+
+		Q_strncpyz( qpath, read->qpath, sizeof( qpath ) );
+		callback = read->callback;
+		userData = read->userData;
+		len = FS_ReadFile_real( qpath, &buf, read->skipJKA, read );
+		if ( read->state != ASYNC_FREE ) {
+			FS_ReleaseAsyncRead( read );	// not found
 		}
+		callback( qpath, buf, len, userData );
 	}
-	return -1;
+}
+
+/*
+=================
+FS_FlushAsyncReads
+
+Delivers all outstanding callbacks and drops prefetched files nobody asked for,
+called once a level is loaded
+=================
+*/
+void FS_FlushAsyncReads( void ) {
+	int i;
+
+	for ( i = 0 ; i < MAX_ASYNC_READS ; i++ ) {
+		asyncRead_t	*read = &fs_async.reads[i];
+		qboolean	active;
+
+		{
+			std::lock_guard<std::mutex> lk(fs_async.mutex);
+			active = (qboolean)( read->state != ASYNC_FREE );
+		}
+		if ( !active ) {
+			continue;
+		}
+
+		FS_WaitAsyncRead( read );
+		if ( !read->callback ) {
+			FS_ReleaseAsyncRead( read );
+			fs_async.prefetchDropped++;
+		}
+	}
+
+	FS_RunAsyncReads();
+
+	if ( fs_async.prefetchUsed || fs_async.prefetchDropped ) {
+		Com_DPrintf( "%d prefetched files used, %d dropped\n", fs_async.prefetchUsed, fs_async.prefetchDropped );
+	}
+	fs_async.prefetchUsed = 0;
+	fs_async.prefetchDropped = 0;
 }
 
 /*
@@ -1768,7 +2453,7 @@ Filename are relative to the quake search path
 a null buffer will just return the file length without loading
 ============
 */
-int FS_ReadFile_real( const char *qpath, void **buffer, qboolean skipJKA ) {
+int FS_ReadFile_real( const char *qpath, void **buffer, qboolean skipJKA, asyncRead_t *read ) {
 	fileHandle_t	h;
 	byte*			buf;
 	qboolean		isConfig;
@@ -1845,166 +2530,767 @@ int FS_ReadFile_real( const char *qpath, void **buffer, qboolean skipJKA ) {
 		return -1;
 	}
 
-	if ( !buffer ) {
-		if ( isConfig && com_journal && com_journal->integer == 1 ) {
-			Com_DPrintf( "Writing len for %s to journal file.\n", qpath );
-			FS_Write( &len, sizeof( len ), com_journalDataFile );
-			FS_Flush( com_journalDataFile );
+	if ( !buffer ) {
+		if ( isConfig && com_journal && com_journal->integer == 1 ) {
+			Com_DPrintf( "Writing len for %s to journal file.\n", qpath );
+			FS_Write( &len, sizeof( len ), com_journalDataFile );
+			FS_Flush( com_journalDataFile );
+		}
+		FS_FCloseFile( h );
+		return len;
+	}
+
+	fs_loadCount++;
+/*	fs_loadStack++;
+
+	buf = (unsigned char *)Hunk_AllocateTempMemory(len+1);
+	*buffer = buf;*/
+
+	// a reader thread may have inflated it already
+	buf = FS_ClaimAsyncRead( qpath, h, len, read );
+	if ( buf ) {
+		*buffer = buf;
+	} else {
+		buf = (byte*)Z_Malloc( len+1, TAG_FILESYS, qfalse);
+		buf[len]='\0';	// because we're not calling Z_Malloc with optional trailing 'bZeroIt' bool
+		*buffer = buf;
+
+//		Z_Label(buf, qpath);
+
+		FS_Read (buf, len, h);
+	}
+
+	// guarantee that it will have a trailing 0 for string operations
+	buf[len] = 0;
+	FS_FCloseFile( h );
+
+	// if we are journalling and it is a config file, write it to the journal file
+	if ( isConfig && com_journal && com_journal->integer == 1 ) {
+		Com_DPrintf( "Writing %s to journal file.\n", qpath );
+		FS_Write( &len, sizeof( len ), com_journalDataFile );
+		FS_Write( buf, len, com_journalDataFile );
+		FS_Flush( com_journalDataFile );
+	}
+	return len;
+}
+
+int FS_ReadFile( const char *qpath, void **buffer ) {
+	return FS_ReadFile_real( qpath, buffer, qfalse, NULL );
+}
+
+int FS_ReadFileSkipJKA( const char *qpath, void **buffer ) {
+	return FS_ReadFile_real( qpath, buffer, qtrue, NULL );
+}
+
+/*
+=============
+FS_FreeFile
+=============
+*/
+void FS_FreeFile( void *buffer ) {
+	/*
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	}
+	if ( !buffer ) {
+		Com_Error( ERR_FATAL, "FS_FreeFile( NULL )" );
+	}
+	fs_loadStack--;
+
+	Hunk_FreeTempMemory( buffer );
+
+	// if all of our temp files are free, clear all of our space
+	if ( fs_loadStack == 0 ) {
+		Hunk_ClearTempMemory();
+	}
+	*/
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	}
+	if ( !buffer ) {
+		Com_Error( ERR_FATAL, "FS_FreeFile( NULL )" );
+	}
+
+	Z_Free( buffer );
+}
+
+#define	MAX_MAPPED_FILES	16
+
+static struct {
+	void	*ptr;
+	int		len;
+} fs_mappedFiles[MAX_MAPPED_FILES];
+
+/*
+============
+FS_MapFile
+
+Maps a file outside of the pk3s straight from the disk and falls back
+to FS_ReadFile for everything else. The buffer is read-only and has to
+be released with FS_UnmapFile.
+============
+*/
+int FS_MapFile( const char *qpath, void **buffer ) {
+	fileHandle_t	h;
+	void			*ptr;
+	int				len, i;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	}
+
+	if ( !qpath || !qpath[0] || !buffer ) {
+		Com_Error( ERR_FATAL, "FS_MapFile: NULL parameter" );
+	}
+
+	*buffer = NULL;
+
+	len = FS_FOpenFileRead( qpath, &h, qfalse );
+	if ( !h ) {
+		return -1;
+	}
+
+	ptr = NULL;
+	if ( !fsh[h].zipFile && len > 0 ) {
+		for ( i = 0; i < MAX_MAPPED_FILES; i++ ) {
+			if ( !fs_mappedFiles[i].ptr ) {
+				break;
+			}
+		}
+		if ( i < MAX_MAPPED_FILES ) {
+			ptr = Sys_MapFile( fileno( fsh[h].handleFiles.file.o ), len );
+			if ( ptr ) {
+				fs_mappedFiles[i].ptr = ptr;
+				fs_mappedFiles[i].len = len;
+			}
+		}
+	}
+	FS_FCloseFile( h );
+
+	if ( !ptr ) {
+		return FS_ReadFile( qpath, buffer );
+	}
+
+	*buffer = ptr;
+	return len;
+}
+
+/*
+=============
+FS_UnmapFile
+=============
+*/
+void FS_UnmapFile( void *buffer ) {
+	int		i;
+
+	if ( !buffer ) {
+		Com_Error( ERR_FATAL, "FS_UnmapFile( NULL )" );
+	}
+
+	for ( i = 0; i < MAX_MAPPED_FILES; i++ ) {
+		if ( fs_mappedFiles[i].ptr == buffer ) {
+			Sys_UnmapFile( fs_mappedFiles[i].ptr, fs_mappedFiles[i].len );
+			fs_mappedFiles[i].ptr = NULL;
+			return;
+		}
+	}
+
+	FS_FreeFile( buffer );
+}
+
+/*
+============
+FS_WriteFile
+
+Filename are reletive to the quake search path
+============
+*/
+void FS_WriteFile( const char *qpath, const void *buffer, int size ) {
+	fileHandle_t f;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	}
+
+	if ( !qpath || !buffer ) {
+		Com_Error( ERR_FATAL, "FS_WriteFile: NULL parameter" );
+	}
+
+	f = FS_FOpenFileWrite( qpath );
+	if ( !f ) {
+		Com_Printf( "Failed to open %s\n", qpath );
+		return;
+	}
+
+	FS_Write( buffer, size, f );
+
+	FS_FCloseFile( f );
+}
+
+
+
+/*
+==========================================================================
+
+ZIP FILE LOADING
+
+==========================================================================
+*/
+
+/*
+=================
+pk3 central directory cache
+
+The file lists of the pk3 files are kept in one file in fs_homepath, keyed by
+path, size and modification time, so a restart only reads the central
+directories of pk3 files that are new or have changed.
+=================
+*/
+#define PAKCACHE_IDENT		(('C'<<24)+('K'<<16)+('A'<<8)+'P')
+#define PAKCACHE_VERSION	1
+#define PAKCACHE_NAME		"pk3cache.dat"
+
+typedef struct {
+	int			ident;
+	int			version;
+	int			numRecords;
+	int			pad;
+} pakCacheHeader_t;
+
+typedef struct {
+	int			size;				// whole record, padded to 8 bytes
+	int			assetsJKA;
+	int64_t		fileSize;
+	int64_t		fileTime;
+	int			numFiles;
+	int			numHeaderLongs;
+	int			namesSize;
+	int			pathSize;
+	// followed by the path, numFiles pos / len pairs, the header longs and the file names
+} pakCacheRecord_t;
+
+static struct {
+	qboolean				loaded;
+	byte					*in;
+	const pakCacheRecord_t	**records;
+	qboolean				*used;
+	int						numRecords;
+	byte					*out;
+	int						outSize;
+	int						outAllocated;
+	int						numOut;
+	int						hits;
+	int						misses;
+} fs_pakCache;
+
+static cvar_t *fs_pk3cache;
+
+// where FS_Startup spends its time, the read and checksum times are summed over all job threads
+static struct {
+	int64_t		total;
+	int64_t		mount;
+	int64_t		read;
+	int64_t		checksum;
+	int64_t		build;
+	int64_t		cache;
+	int64_t		lookup;
+} fs_startupTimes;
+
+static inline const char *FS_PakCachePath( const pakCacheRecord_t *record ) {
+	return (const char *)(record + 1);
+}
+
+static inline const unsigned int *FS_PakCacheFiles( const pakCacheRecord_t *record ) {
+	return (const unsigned int *)((const byte *)(record + 1) + PAD(record->pathSize, 8));
+}
+
+static inline const int *FS_PakCacheHeaderLongs( const pakCacheRecord_t *record ) {
+	return (const int *)(FS_PakCacheFiles(record) + 2 * record->numFiles);
+}
+
+static inline const char *FS_PakCacheNames( const pakCacheRecord_t *record ) {
+	return (const char *)(FS_PakCacheHeaderLongs(record) + record->numHeaderLongs);
+}
+
+static int FS_PakCacheCountNames( const pakCacheRecord_t *record ) {
+	const char	*names = FS_PakCacheNames( record );
+	int			i, count = 0;
+
+	for ( i = 0 ; i < record->namesSize ; i++ ) {
+		if ( names[i] == '\0' ) {
+			count++;
+		}
+	}
+	return count;
+}
+
+/*
+=================
+FS_PakCacheLoad
+=================
+*/
+static void FS_PakCacheLoad( void ) {
+	pakCacheHeader_t	*header;
+	FILE				*f;
+	int					len, ofs, i;
+
+	fs_pakCache.loaded = qtrue;
+
+	if ( !fs_pk3cache->integer ) {
+		return;
+	}
+
+	f = fopen( FS_BuildOSPath( fs_homepath->string, PAKCACHE_NAME ), "rb" );
+	if ( !f ) {
+		return;
+	}
+
+	fseek( f, 0, SEEK_END );
+	len = ftell( f );
+	fseek( f, 0, SEEK_SET );
+
+	if ( len < (int)sizeof( *header ) ) {
+		fclose( f );
+		return;
+	}
+
+	fs_pakCache.in = (byte *)Z_Malloc( len, TAG_FILESYS, qfalse );
+	if ( (int)fread( fs_pakCache.in, 1, len, f ) != len ) {
+		len = 0;
+	}
+	fclose( f );
+
+	header = (pakCacheHeader_t *)fs_pakCache.in;
+	if ( len < (int)sizeof( *header ) || header->ident != PAKCACHE_IDENT || header->version != PAKCACHE_VERSION ||
+		header->numRecords < 0 || header->numRecords > len / (int)sizeof( pakCacheRecord_t ) ) {
+		Com_DPrintf( "FS_PakCacheLoad: ignoring %s\n", PAKCACHE_NAME );
+		return;
+	}
+
+	fs_pakCache.records = (const pakCacheRecord_t **)Z_Malloc( (header->numRecords + 1) * sizeof( *fs_pakCache.records ), TAG_FILESYS, qfalse );
+	fs_pakCache.used = (qboolean *)Z_Malloc( (header->numRecords + 1) * sizeof( *fs_pakCache.used ), TAG_FILESYS, qtrue );
+
+	// anything that doesn't add up ends the list, those pk3s just get read again
+	ofs = sizeof( *header );
+	for ( i = 0 ; i < header->numRecords ; i++ ) {
+		const pakCacheRecord_t *record = (const pakCacheRecord_t *)(fs_pakCache.in + ofs);
+		int64_t need;
+
+		if ( len - ofs < (int)sizeof( *record ) || record->size < (int)sizeof( *record ) || record->size > len - ofs || (record->size & 7) ) {
+			break;
+		}
+		if ( record->numFiles < 0 || record->numHeaderLongs < 0 || record->numHeaderLongs > record->numFiles ||
+			record->namesSize < record->numFiles || record->pathSize < 1 ) {
+			break;
+		}
+		need = (int64_t)sizeof( *record ) + PAD(record->pathSize, 8) + 8 * (int64_t)record->numFiles +
+			4 * (int64_t)record->numHeaderLongs + record->namesSize;
+		if ( need > record->size || FS_PakCachePath(record)[record->pathSize - 1] != '\0' ||
+			(record->namesSize && FS_PakCacheNames(record)[record->namesSize - 1] != '\0') ) {
+			break;
+		}
+		if ( FS_PakCacheCountNames( record ) != record->numFiles ) {
+			break;
+		}
+
+		fs_pakCache.records[fs_pakCache.numRecords++] = record;
+		ofs += record->size;
+	}
+}
+
+/*
+=================
+FS_PakCacheReserve
+=================
+*/
+static byte *FS_PakCacheReserve( int size ) {
+	if ( fs_pakCache.outSize + size > fs_pakCache.outAllocated ) {
+		int		allocated = fs_pakCache.outAllocated ? fs_pakCache.outAllocated : 256 * 1024;
+		byte	*out;
+
+		while ( fs_pakCache.outSize + size > allocated ) {
+			allocated *= 2;
+		}
+
+		out = (byte *)Z_Malloc( allocated, TAG_FILESYS, qfalse );
+		if ( fs_pakCache.out ) {
+			Com_Memcpy( out, fs_pakCache.out, fs_pakCache.outSize );
+			Z_Free( fs_pakCache.out );
+		}
+		fs_pakCache.out = out;
+		fs_pakCache.outAllocated = allocated;
+	}
+
+	fs_pakCache.numOut++;
+	fs_pakCache.outSize += size;
+	return fs_pakCache.out + fs_pakCache.outSize - size;
+}
+
+/*
+=================
+FS_PakCacheFind
+
+Returns the cached file list of a pk3 if it hasn't changed since
+=================
+*/
+static const pakCacheRecord_t *FS_PakCacheFind( const char *zipfile, qboolean assetsJKA, int64_t fileSize, int64_t fileTime ) {
+	int i;
+
+	if ( !fs_pakCache.loaded ) {
+		FS_PakCacheLoad();
+	}
+
+	for ( i = 0 ; i < fs_pakCache.numRecords ; i++ ) {
+		const pakCacheRecord_t *record = fs_pakCache.records[i];
+
+		if ( fs_pakCache.used[i] || record->fileSize != fileSize || record->fileTime != fileTime ||
+			record->assetsJKA != (int)assetsJKA ) {
+			continue;
 		}
-		FS_FCloseFile( h );
-		return len;
+		if ( strcmp( FS_PakCachePath(record), zipfile ) ) {
+			continue;
+		}
+
+		fs_pakCache.used[i] = qtrue;
+		return record;
 	}
 
-	fs_loadCount++;
-/*	fs_loadStack++;
+	return NULL;
+}
 
-	buf = (unsigned char *)Hunk_AllocateTempMemory(len+1);
-	*buffer = buf;*/
+/*
+=================
+FS_PakCacheKeep
 
-	buf = (byte*)Z_Malloc( len+1, TAG_FILESYS, qfalse);
-	buf[len]='\0';	// because we're not calling Z_Malloc with optional trailing 'bZeroIt' bool
-	*buffer = buf;
+Keeps a record returned by FS_PakCacheFind for the next startup
+=================
+*/
+static void FS_PakCacheKeep( const pakCacheRecord_t *record ) {
+	Com_Memcpy( FS_PakCacheReserve( record->size ), record, record->size );
+	fs_pakCache.hits++;
+}
 
-//	Z_Label(buf, qpath);
+/*
+=================
+FS_PakCacheAdd
+=================
+*/
+static void FS_PakCacheAdd( const char *zipfile, qboolean assetsJKA, int64_t fileSize, int64_t fileTime,
+	const fileInPack_t *files, int numFiles, const int *headerLongs, int numHeaderLongs ) {
+	pakCacheRecord_t	*record;
+	unsigned int		*pos;
+	char				*names;
+	int					pathSize, namesSize, size, i;
 
-	FS_Read (buf, len, h);
+	fs_pakCache.misses++;
 
-	// guarantee that it will have a trailing 0 for string operations
-	buf[len] = 0;
-	FS_FCloseFile( h );
+	if ( !fs_pk3cache->integer ) {
+		return;
+	}
 
-	// if we are journalling and it is a config file, write it to the journal file
-	if ( isConfig && com_journal && com_journal->integer == 1 ) {
-		Com_DPrintf( "Writing %s to journal file.\n", qpath );
-		FS_Write( &len, sizeof( len ), com_journalDataFile );
-		FS_Write( buf, len, com_journalDataFile );
-		FS_Flush( com_journalDataFile );
+	pathSize = (int)strlen( zipfile ) + 1;
+	namesSize = 0;
+	for ( i = 0 ; i < numFiles ; i++ ) {
+		namesSize += (int)strlen( files[i].name ) + 1;
 	}
-	return len;
-}
+	size = PAD( (int)sizeof( *record ) + PAD(pathSize, 8) + 8 * numFiles + 4 * numHeaderLongs + namesSize, 8 );
 
-int FS_ReadFile( const char *qpath, void **buffer ) {
-	return FS_ReadFile_real( qpath, buffer, qfalse );
-}
+	record = (pakCacheRecord_t *)FS_PakCacheReserve( size );
+	Com_Memset( record, 0, size );
+	record->size = size;
+	record->assetsJKA = assetsJKA;
+	record->fileSize = fileSize;
+	record->fileTime = fileTime;
+	record->numFiles = numFiles;
+	record->numHeaderLongs = numHeaderLongs;
+	record->namesSize = namesSize;
+	record->pathSize = pathSize;
+	Com_Memcpy( (char *)FS_PakCachePath(record), zipfile, pathSize );
 
-int FS_ReadFileSkipJKA( const char *qpath, void **buffer ) {
-	return FS_ReadFile_real( qpath, buffer, qtrue );
+	pos = (unsigned int *)FS_PakCacheFiles( record );
+	for ( i = 0 ; i < numFiles ; i++ ) {
+		pos[2 * i] = files[i].pos;
+		pos[2 * i + 1] = files[i].len;
+	}
+	Com_Memcpy( (int *)FS_PakCacheHeaderLongs(record), headerLongs, 4 * numHeaderLongs );
+
+	names = (char *)FS_PakCacheNames( record );
+	for ( i = 0 ; i < numFiles ; i++ ) {
+		int len = (int)strlen( files[i].name ) + 1;
+		Com_Memcpy( names, files[i].name, len );
+		names += len;
+	}
 }
 
 /*
-=============
-FS_FreeFile
-=============
+=================
+FS_PakCacheFlush
+
+Writes the cache if anything changed, called at the end of FS_Startup
+=================
 */
-void FS_FreeFile( void *buffer ) {
-	/*
-	if ( !fs_searchpaths ) {
-		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+static void FS_PakCacheFlush( void ) {
+	qboolean	changed = (qboolean)(fs_pakCache.misses > 0);
+	int			i;
+
+	// keep what belongs to pk3s outside the current search path if they're still there unchanged
+	for ( i = 0 ; i < fs_pakCache.numRecords ; i++ ) {
+		const pakCacheRecord_t	*record = fs_pakCache.records[i];
+		int64_t					fileSize;
+
+		if ( fs_pakCache.used[i] ) {
+			continue;
+		}
+		if ( Sys_FileTime( FS_PakCachePath(record), &fileSize ) == record->fileTime && fileSize == record->fileSize ) {
+			Com_Memcpy( FS_PakCacheReserve( record->size ), record, record->size );
+		} else {
+			changed = qtrue;
+		}
 	}
-	if ( !buffer ) {
-		Com_Error( ERR_FATAL, "FS_FreeFile( NULL )" );
+
+	if ( fs_pakCache.hits || fs_pakCache.misses ) {
+		Com_Printf( "%d pk3 files from %s, %d read\n", fs_pakCache.hits, PAKCACHE_NAME, fs_pakCache.misses );
 	}
-	fs_loadStack--;
 
-	Hunk_FreeTempMemory( buffer );
+	if ( changed && fs_pk3cache->integer ) {
+		char				*ospath = FS_BuildOSPath( fs_homepath->string, PAKCACHE_NAME );
+		pakCacheHeader_t	header = { PAKCACHE_IDENT, PAKCACHE_VERSION, fs_pakCache.numOut, 0 };
+		FILE				*f;
 
-	// if all of our temp files are free, clear all of our space
-	if ( fs_loadStack == 0 ) {
-		Hunk_ClearTempMemory();
+		FS_CreatePath( ospath );
+		f = fopen( ospath, "wb" );
+		if ( f ) {
+			if ( fwrite( &header, sizeof( header ), 1, f ) != 1 ||
+				(fs_pakCache.outSize && fwrite( fs_pakCache.out, fs_pakCache.outSize, 1, f ) != 1) ) {
+				Com_Printf( S_COLOR_YELLOW "WARNING: couldn't write %s\n", ospath );
+				fclose( f );
+				remove( ospath );
+			} else {
+				fclose( f );
+			}
+		}
 	}
-	*/
 
-	if ( !fs_searchpaths ) {
-		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	if ( fs_pakCache.in ) {
+		Z_Free( fs_pakCache.in );
 	}
-	if ( !buffer ) {
-		Com_Error( ERR_FATAL, "FS_FreeFile( NULL )" );
+	if ( fs_pakCache.records ) {
+		Z_Free( (void *)fs_pakCache.records );
 	}
-
-	Z_Free( buffer );
+	if ( fs_pakCache.used ) {
+		Z_Free( fs_pakCache.used );
+	}
+	if ( fs_pakCache.out ) {
+		Z_Free( fs_pakCache.out );
+	}
+	Com_Memset( &fs_pakCache, 0, sizeof( fs_pakCache ) );
 }
 
 /*
-============
-FS_WriteFile
+=================
+FS_ReadZipDirectory
 
-Filename are reletive to the quake search path
-============
+The part of mounting a pk3 that only reads the zip: opens it, gets the file list from
+the central directory (or the cache), computes the checksums and reads mv.info. Runs on
+the job threads, so it uses plain malloc and nothing but its own mount.
+=================
 */
-void FS_WriteFile( const char *qpath, const void *buffer, int size ) {
-	fileHandle_t f;
+typedef struct {
+	// in
+	char					zipfile[MAX_OSPATH];
+	const char				*basename;
+	qboolean				assetsJKA;
+	int64_t					fileSize;
+	int64_t					fileTime;
+	const pakCacheRecord_t	*cached;
+
+	// out
+	unzFile					handle;
+	int						numEntries;		// entries in the central directory
+	int						numFiles;		// entries that could be read
+	const unsigned int		*files;			// pos / len pairs
+	const char				*names;
+	const int				*headerLongs;
+	int						numHeaderLongs;
+	int						checksum;
+	int						pure_checksum;
+	char					mvInfo[128];
+	int						mvInfoLen;
+	int64_t					readTime;
+	int64_t					checksumTime;
+} zipMount_t;
+
+static void FS_ReadZipDirectory( zipMount_t *mount ) {
+	unz_global_info gi;
+	unz_file_info	file_info;
+	char			filename_inzip[MAX_ZPATH];
+	unsigned int	*files;
+	int				*headerLongs;
+	char			*names;
+	int				namesSize, namesAllocated;
+	int				strLength;
+	int				i;
+	int64_t			start = Sys_Nanoseconds();
 
-	if ( !fs_searchpaths ) {
-		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	mount->handle = unzOpen(mount->zipfile);
+	if (!mount->handle) {
+		return;
+	}
+	if (unzGetGlobalInfo(mount->handle, &gi) != UNZ_OK) {
+		unzClose(mount->handle);
+		mount->handle = NULL;
+		return;
 	}
+	mount->numEntries = (int)gi.number_entry;
 
-	if ( !qpath || !buffer ) {
-		Com_Error( ERR_FATAL, "FS_WriteFile: NULL parameter" );
+	if (mount->cached && mount->cached->numFiles != mount->numEntries) {
+		mount->cached = NULL;
 	}
 
-	f = FS_FOpenFileWrite( qpath );
-	if ( !f ) {
-		Com_Printf( "Failed to open %s\n", qpath );
-		return;
+	if (mount->cached) {
+		mount->numFiles = mount->numEntries;
+		mount->files = FS_PakCacheFiles(mount->cached);
+		mount->names = FS_PakCacheNames(mount->cached);
+		mount->headerLongs = FS_PakCacheHeaderLongs(mount->cached);
+		mount->numHeaderLongs = mount->cached->numHeaderLongs;
+	} else {
+		files = (unsigned int *)malloc((mount->numEntries + 1) * 2 * sizeof(*files));
+		headerLongs = (int *)malloc((mount->numEntries + 1) * sizeof(*headerLongs));
+		namesAllocated = mount->numEntries * 32 + 1;
+		names = (char *)malloc(namesAllocated);
+		namesSize = 0;
+
+		unzGoToFirstFile(mount->handle);
+
+		for (i = 0; i < mount->numEntries && files && headerLongs && names; i++)
+		{
+			if (unzGetCurrentFileInfo(mount->handle, &file_info, filename_inzip, sizeof(filename_inzip), NULL, 0, NULL, 0) != UNZ_OK) {
+				break;
+			}
+			if (file_info.uncompressed_size > 0) {
+				headerLongs[mount->numHeaderLongs++] = LittleLong(file_info.crc);
+			}
+			if ( mount->assetsJKA ) {
+				// Ugly workarounds:
+				//  - rename academy shader files to avoid collisions
+				//  - rename academy sounds.cfg files to prevent them from overriding sounds of jk2 models that don't have a sounds.cfg
+				strLength = strlen( filename_inzip );
+				if ( strLength > 7 && !Q_stricmp(filename_inzip + strLength - 7, ".shader") ) {
+					Q_strcat( filename_inzip, sizeof(filename_inzip), "_jka" );
+				} else if ( strLength > 15 && !Q_stricmpn(filename_inzip, "models/players/", 15) && !Q_stricmp(filename_inzip + strLength - 11, "/sounds.cfg") ) {
+					Q_strcat( filename_inzip, sizeof(filename_inzip), "_jka" );
+				}
+			}
+			Q_strlwr( filename_inzip );
+
+			strLength = (int)strlen( filename_inzip ) + 1;
+			if (namesSize + strLength > namesAllocated) {
+				char *grown;
+
+				namesAllocated = namesAllocated * 2 + strLength;
+				grown = (char *)realloc(names, namesAllocated);
+				if (!grown) {
+					break;
+				}
+				names = grown;
+			}
+			Com_Memcpy(names + namesSize, filename_inzip, strLength);
+			namesSize += strLength;
+
+			// store the file position in the zip
+			files[2 * i] = unzGetOffset(mount->handle);
+			files[2 * i + 1] = file_info.uncompressed_size;
+			unzGoToNextFile(mount->handle);
+		}
+
+		mount->numFiles = (files && headerLongs && names) ? i : 0;
+		mount->files = files;
+		mount->names = names;
+		mount->headerLongs = headerLongs;
 	}
 
-	FS_Write( buffer, size, f );
+	// mv.info file in root directory of pk3 file, the last one wins like in FS_PakReadFile
+	{
+		const char	*name = mount->names;
+		int			mvInfo = -1;
 
-	FS_FCloseFile( f );
-}
+		for (i = 0; i < mount->numFiles; i++) {
+			if (!FS_FilenameCompare(name, "mv.info")) {
+				mvInfo = i;
+			}
+			name += strlen(name) + 1;
+		}
 
+		if (mvInfo >= 0) {
+			unzSetOffset(mount->handle, mount->files[2 * mvInfo]);
+			unzOpenCurrentFile(mount->handle);
+			mount->mvInfoLen = unzReadCurrentFile(mount->handle, mount->mvInfo, sizeof(mount->mvInfo) - 1);
+			unzCloseCurrentFile(mount->handle);
+		}
+	}
 
+	mount->checksumTime = Sys_Nanoseconds();
+	mount->readTime = mount->checksumTime - start;
 
-/*
-==========================================================================
+	mount->checksum = Com_BlockChecksum( mount->headerLongs, 4 * mount->numHeaderLongs );
+	mount->pure_checksum = Com_BlockChecksumKey( (void *)mount->headerLongs, 4 * mount->numHeaderLongs, LittleLong(fs_checksumFeed) );
+	mount->checksum = LittleLong( mount->checksum );
+	mount->pure_checksum = LittleLong( mount->pure_checksum );
 
-ZIP FILE LOADING
+	mount->checksumTime = Sys_Nanoseconds() - mount->checksumTime;
+}
 
-==========================================================================
+static void FS_ReadZipDirectoryJob( void *data, int index, int threadNum ) {
+	FS_ReadZipDirectory( (zipMount_t *)data + index );
+}
+
+/*
+=================
+FS_FreeZipMount
+=================
 */
+static void FS_FreeZipMount( zipMount_t *mount ) {
+	if (!mount->cached) {
+		free((void *)mount->files);
+		free((void *)mount->names);
+		free((void *)mount->headerLongs);
+	}
+	mount->files = NULL;
+	mount->names = NULL;
+	mount->headerLongs = NULL;
+}
 
 /*
 =================
 FS_LoadZipFile
 
 Creates a new pak_t in the search chain for the contents
-of a zip file.
+of a zip file read by FS_ReadZipDirectory.
 =================
 */
-static pack_t *FS_LoadZipFile( char *zipfile, const char *basename, qboolean assetsJKA )
+static pack_t *FS_LoadZipFile( zipMount_t *mount )
 {
 	fileInPack_t	*buildBuffer;
 	stringPool_t	*namesPool;
 	pack_t			*pack;
-	unzFile			uf;
-	int				err;
-	unz_global_info gi;
-	char			filename_inzip[MAX_ZPATH];
-	unz_file_info	file_info;
-	ZPOS64_T		i;
-	int			hash;
-	int				fs_numHeaderLongs;
-	int				*fs_headerLongs;
-	int				strLength;
-
-	fs_numHeaderLongs = 0;
-
-	uf = unzOpen(zipfile);
-	err = unzGetGlobalInfo (uf,&gi);
+	const char		*names;
+	int				i;
+	int				hash;
 
-	if (err != UNZ_OK)
+	if (!mount->handle) {
 		return NULL;
+	}
 
-	fs_packFiles += gi.number_entry;
+	fs_packFiles += mount->numEntries;
 
-	buildBuffer = (struct fileInPack_s *)Z_Malloc((int)((gi.number_entry * sizeof(fileInPack_t))), TAG_FILESYS, qtrue);
-	namesPool = Z_StringPoolNew(gi.number_entry * 8, TAG_FILESYS);
-	fs_headerLongs = (int *)Z_Malloc( gi.number_entry * sizeof(int), TAG_FILESYS, qtrue );
+	buildBuffer = (struct fileInPack_s *)Z_Malloc((int)((mount->numEntries * sizeof(fileInPack_t))), TAG_FILESYS, qtrue);
+	namesPool = Z_StringPoolNew(mount->numEntries * 8, TAG_FILESYS);
 
 	// get the hash table size from the number of files in the zip
 	// because lots of custom pk3 files have less than 32 or 64 files
 	for (i = 1; i <= MAX_FILEHASH_SIZE; i <<= 1) {
-		if (i > gi.number_entry) {
+		if (i > mount->numEntries) {
 			break;
 		}
 	}
@@ -2016,55 +3302,39 @@ static pack_t *FS_LoadZipFile( char *zipfile, const char *basename, qboolean ass
 		pack->hashTable[i] = NULL;
 	}
 
-	Q_strncpyz( pack->pakFilename, zipfile, sizeof( pack->pakFilename ) );
-	Q_strncpyz( pack->pakBasename, basename, sizeof( pack->pakBasename ) );
+	Q_strncpyz( pack->pakFilename, mount->zipfile, sizeof( pack->pakFilename ) );
+	Q_strncpyz( pack->pakBasename, mount->basename, sizeof( pack->pakBasename ) );
 
 	// strip .pk3 if needed
 	if ( strlen( pack->pakBasename ) > 4 && !Q_stricmp( pack->pakBasename + strlen( pack->pakBasename ) - 4, ".pk3" ) ) {
 		pack->pakBasename[strlen( pack->pakBasename ) - 4] = 0;
 	}
 
-	pack->handle = uf;
-	pack->numfiles = gi.number_entry;
-	unzGoToFirstFile(uf);
+	pack->handle = mount->handle;
+	pack->numfiles = mount->numEntries;
 
-	for (i = 0; i < gi.number_entry; i++)
-	{
-		err = unzGetCurrentFileInfo(uf, &file_info, filename_inzip, sizeof(filename_inzip), NULL, 0, NULL, 0);
-		if (err != UNZ_OK) {
-			break;
-		}
-		if (file_info.uncompressed_size > 0) {
-			fs_headerLongs[fs_numHeaderLongs++] = LittleLong(file_info.crc);
-		}
-		if ( assetsJKA ) {
-			// Ugly workarounds:
-			//  - rename academy shader files to avoid collisions
-			//  - rename academy sounds.cfg files to prevent them from overriding sounds of jk2 models that don't have a sounds.cfg
-			strLength = strlen( filename_inzip );
-			if ( strLength > 7 && !Q_stricmp(filename_inzip + strLength - 7, ".shader") ) {
-				Q_strcat( filename_inzip, sizeof(filename_inzip), "_jka" );
-			} else if ( strLength > 15 && !Q_stricmpn(filename_inzip, "models/players/", 15) && !Q_stricmp(filename_inzip + strLength - 11, "/sounds.cfg") ) {
-				Q_strcat( filename_inzip, sizeof(filename_inzip), "_jka" );
-			}
-		}
-		Q_strlwr( filename_inzip );
-		hash = FS_HashFileName(filename_inzip, pack->hashSize);
-		buildBuffer[i].name = Z_StringPoolAdd(namesPool, filename_inzip);
-		// store the file position in the zip
-		buildBuffer[i].pos = unzGetOffset(uf);
-		buildBuffer[i].len = file_info.uncompressed_size;
+	names = mount->names;
+	for (i = 0; i < mount->numFiles; i++) {
+		buildBuffer[i].name = Z_StringPoolAdd(namesPool, names);
+		buildBuffer[i].pos = mount->files[2 * i];
+		buildBuffer[i].len = mount->files[2 * i + 1];
+		names += strlen(names) + 1;
+
+		hash = FS_HashFileName(buildBuffer[i].name, pack->hashSize);
 		buildBuffer[i].next = pack->hashTable[hash];
 		pack->hashTable[hash] = &buildBuffer[i];
-		unzGoToNextFile(uf);
 	}
 
-	pack->checksum = Com_BlockChecksum( fs_headerLongs, 4 * fs_numHeaderLongs );
-	pack->pure_checksum = Com_BlockChecksumKey( fs_headerLongs, 4 * fs_numHeaderLongs, LittleLong(fs_checksumFeed) );
-	pack->checksum = LittleLong( pack->checksum );
-	pack->pure_checksum = LittleLong( pack->pure_checksum );
+	if (mount->cached) {
+		FS_PakCacheKeep(mount->cached);
+	} else if (mount->numFiles == mount->numEntries && mount->fileTime != -1) {
+		FS_PakCacheAdd(mount->zipfile, mount->assetsJKA, mount->fileSize, mount->fileTime, buildBuffer, mount->numFiles, mount->headerLongs, mount->numHeaderLongs);
+	} else {
+		fs_pakCache.misses++;
+	}
 
-	Z_Free(fs_headerLongs);
+	pack->checksum = mount->checksum;
+	pack->pure_checksum = mount->pure_checksum;
 
 	pack->buildBuffer = buildBuffer;
 	pack->namesPool = namesPool;
@@ -2072,17 +3342,17 @@ static pack_t *FS_LoadZipFile( char *zipfile, const char *basename, qboolean ass
 	// which versions does this pk3 support?
 
 	// filename prefixes
-	if (!Q_stricmpn(basename, "o102_", 5)) {
+	if (!Q_stricmpn(mount->basename, "o102_", 5)) {
 		pack->gvc = PACKGVC_1_02;
-	} else if (!Q_stricmpn(basename, "o103_", 5)) {
+	} else if (!Q_stricmpn(mount->basename, "o103_", 5)) {
 		pack->gvc = PACKGVC_1_03;
-	} else if (!Q_stricmpn(basename, "o104_", 5)) {
+	} else if (!Q_stricmpn(mount->basename, "o104_", 5)) {
 		pack->gvc = PACKGVC_1_04;
 	}
 
 	// mv.info file in root directory of pk3 file
-	char cversion[128];
-	int cversionlen = FS_PakReadFile(pack, "mv.info", cversion, sizeof(cversion) - 1);
+	char *cversion = mount->mvInfo;
+	int cversionlen = mount->mvInfoLen;
 	if (cversionlen) {
 		cversion[cversionlen] = '\0';
 		pack->gvc = PACKGVC_UNKNOWN; // mv.info file overwrites version prefixes
@@ -2105,7 +3375,7 @@ static pack_t *FS_LoadZipFile( char *zipfile, const char *basename, qboolean ass
 	}
 
 	// assets are hardcoded
-	if ( !assetsJKA ) {
+	if ( !mount->assetsJKA ) {
 		if (!Q_stricmp(pack->pakBasename, "assets0")) {
 			pack->gvc = PACKGVC_1_02 | PACKGVC_1_03 | PACKGVC_1_04;
 		} else if (!Q_stricmp(pack->pakBasename, "assets1")) {
@@ -2120,6 +3390,82 @@ static pack_t *FS_LoadZipFile( char *zipfile, const char *basename, qboolean ass
 	return pack;
 }
 
+/*
+=================
+FS_SV_VerifyZipJob
+
+Decompresses one slice of the files in a zip through its own handle,
+minizip checks the CRC of each one
+=================
+*/
+typedef struct {
+	const char			*ospath;
+	const ZPOS64_T		*offsets;
+	int					numFiles;
+	int					numSlices;
+	qboolean			*failed;		// one per slice
+} zipVerify_t;
+
+static void FS_SV_VerifyZipJob( void *data, int index, int threadNum ) {
+	zipVerify_t		*verify = (zipVerify_t *)data;
+	int				first = (int)((int64_t)verify->numFiles * index / verify->numSlices);
+	int				last = (int)((int64_t)verify->numFiles * (index + 1) / verify->numSlices);
+	const int		read_buffer_size = 16384; // UNZ_BUFSIZE
+	char			*read_buffer;
+	unzFile			uf;
+	int				err;
+	int				i;
+
+	verify->failed[index] = qtrue;
+
+	uf = unzOpen(verify->ospath);
+	if (uf == NULL)
+		return;
+
+	read_buffer = (char *)malloc(read_buffer_size);
+	if (read_buffer == NULL) {
+		unzClose(uf);
+		return;
+	}
+
+	for (i = first; i < last; i++)
+	{
+		if (unzSetOffset64(uf, verify->offsets[i]))
+			break;
+
+		if (unzOpenCurrentFile(uf))
+			break;
+
+		// read whole file to make minizip calculate CRC
+		do {
+			err = unzReadCurrentFile(uf, read_buffer, read_buffer_size);
+		} while (err > 0);
+
+		if (err < 0) {
+			unzCloseCurrentFile(uf);
+			break;
+		}
+
+		// decompression may fail early due to bitrot
+		// unzCloseCurrentFile() does not verify CRC unless unzeof() returns 1
+		if (unzeof(uf) != 1) {
+			unzCloseCurrentFile(uf);
+			break;
+		}
+
+		// returns UNZ_CRCERROR if CRC does not match
+		if (unzCloseCurrentFile(uf))
+			break;
+	}
+
+	if (i == last) {
+		verify->failed[index] = qfalse;
+	}
+
+	free(read_buffer);
+	unzClose(uf);
+}
+
 /*
 =================
 FS_SV_VerifyZipFile
@@ -2133,23 +3479,23 @@ It does not check the actual content and zip metadata
 */
 qboolean FS_SV_VerifyZipFile( const char *zipfile, int *checksum )
 {
-	const char		*ospath;
+	char			ospath[MAX_OSPATH];
 	unzFile			uf;
-	int				err;
 	unz_global_info gi;
 	unz_file_info	file_info;
 	ZPOS64_T		i;
 	int				fs_numHeaderLongs;
 	int				*fs_headerLongs = NULL;
+	ZPOS64_T		*offsets = NULL;
+	qboolean		failed[MAX_JOB_THREADS];
+	zipVerify_t		verify;
 	int				chksum;
-	char			*read_buffer = NULL;
-	const int		read_buffer_size = 16384; // UNZ_BUFSIZE
 
 	if ( !fs_searchpaths ) {
 		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
 	}
 
-	ospath = FS_BuildOSPath( fs_homepath->string, zipfile );
+	Q_strncpyz( ospath, FS_BuildOSPath( fs_homepath->string, zipfile ), sizeof( ospath ) );
 
 	uf = unzOpen(ospath);
 	if (uf == NULL)
@@ -2160,7 +3506,7 @@ qboolean FS_SV_VerifyZipFile( const char *zipfile, int *checksum )
 
 	fs_numHeaderLongs = 0;
 	fs_headerLongs = (int *)Hunk_AllocateTempMemory(gi.number_entry * sizeof(int));
-	read_buffer = (char *)Hunk_AllocateTempMemory(read_buffer_size);
+	offsets = (ZPOS64_T *)Hunk_AllocateTempMemory(gi.number_entry * sizeof(ZPOS64_T));
 
 	if (unzGoToFirstFile(uf))
 		goto unzip_error;
@@ -2174,31 +3520,31 @@ qboolean FS_SV_VerifyZipFile( const char *zipfile, int *checksum )
 			fs_headerLongs[fs_numHeaderLongs++] = LittleLong(file_info.crc);
 		}
 
-		if (unzOpenCurrentFile(uf))
-			goto unzip_error;
+		offsets[i] = unzGetOffset64(uf);
+		unzGoToNextFile(uf);
+	}
 
-		// read whole file to make minizip calculate CRC
-		do {
-			err = unzReadCurrentFile(uf, read_buffer, read_buffer_size);
+	unzClose(uf);
+	uf = NULL;
 
-			if (err < 0) {
-				unzCloseCurrentFile(uf);
-				goto unzip_error;
-			}
-		} while (err != UNZ_EOF);
+	// the decompression is what takes time, split it over the job threads
+	verify.ospath = ospath;
+	verify.offsets = offsets;
+	verify.numFiles = (int)gi.number_entry;
+	verify.numSlices = Com_JobMaxThreads();
+	if (verify.numSlices > MAX_JOB_THREADS) {
+		verify.numSlices = MAX_JOB_THREADS;
+	}
+	if (verify.numSlices > verify.numFiles) {
+		verify.numSlices = verify.numFiles;
+	}
+	verify.failed = failed;
 
-		// decompression may fail early due to bitrot
-		// unzCloseCurrentFile() does not verify CRC unless unzeof() returns 1
-		if (unzeof(uf) != 1) {
-			unzCloseCurrentFile(uf);
-			goto unzip_error;
-		}
+	Com_ParallelFor(verify.numSlices, verify.numSlices, FS_SV_VerifyZipJob, &verify);
 
-		// returns UNZ_CRCERROR if CRC does not match
-		if (unzCloseCurrentFile(uf))
+	for (int j = 0; j < verify.numSlices; j++) {
+		if (failed[j])
 			goto unzip_error;
-
-		unzGoToNextFile(uf);
 	}
 
 	if (checksum) {
@@ -2207,9 +3553,7 @@ qboolean FS_SV_VerifyZipFile( const char *zipfile, int *checksum )
 		*checksum = chksum;
 	}
 
-	unzClose(uf);
-
-	Hunk_FreeTempMemory(read_buffer);
+	Hunk_FreeTempMemory(offsets);
 	Hunk_FreeTempMemory(fs_headerLongs);
 
 	return qfalse;
@@ -2218,8 +3562,8 @@ unzip_error:
 	if (uf)
 		unzClose(uf);
 
-	if (read_buffer)
-		Hunk_FreeTempMemory(read_buffer);
+	if (offsets)
+		Hunk_FreeTempMemory(offsets);
 
 	if (fs_headerLongs)
 		Hunk_FreeTempMemory(fs_headerLongs);
@@ -3071,6 +4415,9 @@ static void FS_AddGameDirectory( const char *path, const char *dir, qboolean ass
 	int				numfiles;
 	const char		**pakfiles;
 	const char		*filename;
+	zipMount_t		*mounts, *mount;
+	int				numMounts;
+	int64_t			start;
 
 	// this fixes the case where fs_basepath is the same as fs_cdpath
 	// which happens on full installs
@@ -3087,6 +4434,7 @@ static void FS_AddGameDirectory( const char *path, const char *dir, qboolean ass
 	}
 
 	Q_strncpyz( fs_gamedir, dir, sizeof( fs_gamedir ) );
+	FS_FreeFileLookup();
 
 	//
 	// add the directory to the search path
@@ -3113,6 +4461,11 @@ static void FS_AddGameDirectory( const char *path, const char *dir, qboolean ass
 		qsort( pakfiles, numfiles, sizeof(void *), paksort );
 	}
 
+	// stat the pk3 files and look them up in the cache, then open and checksum
+	// them on the job threads. The search path is built in sorted order afterwards.
+	mounts = (zipMount_t *)Z_Malloc( (numfiles + 1) * sizeof(*mounts), TAG_FILESYS, qtrue );
+	numMounts = 0;
+
 	for ( i = 0 ; i < numfiles ; i++ ) {
 		pakfile = FS_BuildOSPath( path, dir, pakfiles[i] );
 		filename = get_filename(pakfile);
@@ -3129,9 +4482,35 @@ static void FS_AddGameDirectory( const char *path, const char *dir, qboolean ass
 			}
 		}
 
-		if ( ( pak = FS_LoadZipFile( pakfile, pakfiles[i], assetsJKA ) ) == 0 )
+		mount = &mounts[numMounts++];
+		Q_strncpyz( mount->zipfile, pakfile, sizeof( mount->zipfile ) );
+		mount->basename = pakfiles[i];
+		mount->assetsJKA = assetsJKA;
+		mount->fileTime = Sys_FileTime( mount->zipfile, &mount->fileSize );
+		if ( fs_pk3cache->integer && mount->fileTime != -1 ) {
+			mount->cached = FS_PakCacheFind( mount->zipfile, assetsJKA, mount->fileSize, mount->fileTime );
+		}
+	}
+
+	start = Sys_Nanoseconds();
+	Com_ParallelFor( numMounts, Com_JobMaxThreads(), FS_ReadZipDirectoryJob, mounts );
+	fs_startupTimes.mount += Sys_Nanoseconds() - start;
+
+	for ( i = 0 ; i < numMounts ; i++ ) {
+		mount = &mounts[i];
+		fs_startupTimes.read += mount->readTime;
+		fs_startupTimes.checksum += mount->checksumTime;
+
+		start = Sys_Nanoseconds();
+		pak = FS_LoadZipFile( mount );
+		FS_FreeZipMount( mount );
+		fs_startupTimes.build += Sys_Nanoseconds() - start;
+
+		if ( !pak )
 			continue;
 
+		filename = get_filename(pak->pakFilename);
+
 #ifndef DEDICATED
 		// files beginning with "dl_" are only loaded when referenced by the server
 		if (!Q_stricmpn(filename, "dl_", 3)) {
@@ -3175,6 +4554,7 @@ static void FS_AddGameDirectory( const char *path, const char *dir, qboolean ass
 	}
 
 	// done
+	Z_Free( mounts );
 	Sys_FreeFileList( pakfiles );
 }
 
@@ -3388,6 +4768,8 @@ void FS_Shutdown( qboolean closemfp, qboolean keepModuleFiles ) {
 	searchpath_t	*p, *next;
 	int	i;
 
+	FS_ShutdownAsyncReads();
+
 	for(i = 1; i < MAX_FILE_HANDLES; i++) {
 		switch (fsh[i].module) {
 		case MODULE_GAME:
@@ -3419,6 +4801,7 @@ void FS_Shutdown( qboolean closemfp, qboolean keepModuleFiles ) {
 
 	// any FS_ calls will now be an error until reinitialized
 	fs_searchpaths = NULL;
+	FS_FreeFileLookup();
 
 	Cmd_RemoveCommand( "path" );
 	Cmd_RemoveCommand( "dir" );
@@ -3443,9 +4826,13 @@ static void FS_Startup( const char *gameName ) {
 	int f_wl, f_bl, f_fl;
 	int s;
 	searchpath_t *search;
+	int64_t start;
 
 	Com_Printf( "----- FS_Startup -----\n" );
 
+	Com_Memset( &fs_startupTimes, 0, sizeof( fs_startupTimes ) );
+	fs_startupTimes.total = Sys_Nanoseconds();
+
 	fs_debug = Cvar_Get( "fs_debug", "0", 0 );
 	fs_copyfiles = Cvar_Get( "fs_copyfiles", "0", CVAR_INIT );
 	fs_basepath = Cvar_Get ("fs_basepath", Sys_DefaultInstallPath(), CVAR_INIT | CVAR_VM_NOWRITE );
@@ -3462,6 +4849,9 @@ static void FS_Startup( const char *gameName ) {
 	fs_basejka = Cvar_Get("fs_basejka", fs_assetspathjka->string[0] ? "base" : "basejka", CVAR_INIT | CVAR_VM_NOWRITE);
 
 	fs_loadjka = Cvar_Get("fs_loadjka", "1", CVAR_ARCHIVE | CVAR_LATCH);
+	fs_pk3cache = Cvar_Get("fs_pk3cache", "1", CVAR_ARCHIVE);
+	fs_readThreads = Cvar_Get("fs_readThreads", "2", CVAR_ARCHIVE);
+	fs_prefetchMB = Cvar_Get("fs_prefetchMB", "64", CVAR_ARCHIVE);
 
 	if (!FS_AllPath_Base_FileExists("assets5.pk3")) {
 		// assets files found in none of the paths
@@ -3542,6 +4932,15 @@ static void FS_Startup( const char *gameName ) {
 		Q_strncpyz( fs_gamedir, fs_forcegame->string, sizeof( fs_gamedir ) );
 	}
 
+	// the search path is complete
+	start = Sys_Nanoseconds();
+	FS_PakCacheFlush();
+	fs_startupTimes.cache = Sys_Nanoseconds() - start;
+
+	start = Sys_Nanoseconds();
+	FS_BuildFileLookup();
+	fs_startupTimes.lookup = Sys_Nanoseconds() - start;
+
 	// add our commands
 	Cmd_AddCommand ("path", FS_Path_f);
 	Cmd_AddCommand ("dir", FS_Dir_f );
@@ -3619,7 +5018,12 @@ static void FS_Startup( const char *gameName ) {
 	}
 
 	Com_Printf( "----------------------\n" );
-	Com_Printf( "%d files in pk3 files\n", fs_packFiles );
+	Com_Printf( "%d files in pk3 files, %d different names\n", fs_packFiles, fs_lookup.numNames );
+
+	fs_startupTimes.total = Sys_Nanoseconds() - fs_startupTimes.total;
+	Com_Printf( "FS_Startup: %.1f ms (mount %.1f ms on %d threads: read %.1f ms, checksum %.1f ms; packs %.1f ms, cache %.1f ms, lookup %.1f ms)\n",
+		fs_startupTimes.total / 1e6, fs_startupTimes.mount / 1e6, Com_JobMaxThreads(), fs_startupTimes.read / 1e6,
+		fs_startupTimes.checksum / 1e6, fs_startupTimes.build / 1e6, fs_startupTimes.cache / 1e6, fs_startupTimes.lookup / 1e6 );
 }
 
 /*
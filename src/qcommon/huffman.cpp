@@ -6,7 +6,7 @@
 #include "../qcommon/q_shared.h"
 #include "qcommon.h"
 
-static int			bloc = 0;
+static thread_local int	bloc = 0;
 
 void	Huff_putBit( int bit, byte *fout, int *offset) {
 	bloc = *offset;
@@ -300,6 +300,155 @@ void Huff_offsetTransmit (huff_t *huff, int ch, byte *fout, int *offset) {
 	*offset = bloc;
 }
 
+/*
+==================
+Huff_BuildTable
+
+Flattens the compressor codes into code words and the decompressor tree into
+a lookup table. Leaves table->valid unset if the trees can't be represented.
+==================
+*/
+void Huff_BuildTable( huffTable_t *table, huffman_t *huff ) {
+	node_t		*node;
+	int			ch, length;
+	unsigned	code;
+
+	Com_Memset( table, 0, sizeof( *table ) );
+
+	for ( ch = 0; ch < HMAX; ch++ ) {
+		node = huff->compressor.loc[ch];
+		if ( !node ) {
+			return;
+		}
+
+		// the path is found from the leaf up, so the bit next to the
+		// root, which is sent first, ends up in bit 0
+		for ( length = 0, code = 0; node->parent; node = node->parent, length++ ) {
+			if ( length == 32 ) {
+				return;
+			}
+			code = (code << 1) | (node->parent->right == node);
+		}
+
+		table->code[ch] = code;
+		table->codeLength[ch] = length;
+		if ( length > table->maxCodeLength ) {
+			table->maxCodeLength = length;
+		}
+	}
+
+	table->tree = huff->decompressor.tree;
+	if ( !table->tree || table->tree->symbol != INTERNAL_NODE ) {
+		return;
+	}
+
+	for ( code = 0; code < (1 << HUFF_LOOKUP_BITS); code++ ) {
+		huffLookup_t *entry = &table->lookup[code];
+
+		node = table->tree;
+		for ( length = 0; node && node->symbol == INTERNAL_NODE && length < HUFF_LOOKUP_BITS; length++ ) {
+			node = ((code >> length) & 1) ? node->right : node->left;
+		}
+
+		if ( !node ) {
+			continue;
+		}
+
+		entry->length = length;
+		if ( node->symbol == INTERNAL_NODE ) {
+			entry->node = node;
+		} else {
+			entry->symbol = node->symbol;
+		}
+	}
+
+	table->valid = qtrue;
+}
+
+/*
+==================
+Huff_tableTransmit
+
+Same as Huff_offsetTransmit, but several bits at a time
+==================
+*/
+void Huff_tableTransmit( const huffTable_t *table, int ch, byte *fout, int *offset ) {
+	unsigned	code = table->code[ch];
+	int			length = table->codeLength[ch];
+	int			pos = *offset;
+	int			shift, n;
+
+	while ( length > 0 ) {
+		shift = pos & 7;
+		if ( !shift ) {
+			fout[pos >> 3] = 0;
+		}
+		fout[pos >> 3] |= (byte)(code << shift);
+
+		n = 8 - shift;
+		if ( n > length ) {
+			n = length;
+		}
+		code >>= n;
+		length -= n;
+		pos += n;
+	}
+
+	*offset = pos;
+}
+
+/*
+==================
+Huff_tableReceive
+
+Same as Huff_offsetReceive on the decompressor tree. size is the number of
+bytes in fin, the lookup isn't used within the last bytes so it never reads
+past them.
+==================
+*/
+void Huff_tableReceive( const huffTable_t *table, int *ch, byte *fin, int *offset, int size ) {
+	const huffLookup_t	*entry;
+	node_t				*node;
+	int					pos = *offset;
+	int					i;
+
+	i = pos >> 3;
+	if ( i + 2 >= size ) {
+		Huff_offsetReceive( table->tree, ch, fin, offset );
+		return;
+	}
+
+	entry = &table->lookup[((fin[i] | (fin[i+1] << 8) | (fin[i+2] << 16)) >> (pos & 7)) & ((1 << HUFF_LOOKUP_BITS) - 1)];
+	if ( !entry->length ) {
+		*ch = 0;
+		return;
+	}
+
+	pos += entry->length;
+	if ( !entry->node ) {
+		*ch = entry->symbol;
+		*offset = pos;
+		return;
+	}
+
+	// rare long code, walk the rest of the way
+	node = entry->node;
+	while ( node && node->symbol == INTERNAL_NODE ) {
+		if ( (fin[pos >> 3] >> (pos & 7)) & 1 ) {
+			node = node->right;
+		} else {
+			node = node->left;
+		}
+		pos++;
+	}
+	if ( !node ) {
+		*ch = 0;
+		return;
+	}
+	*ch = node->symbol;
+	*offset = pos;
+}
+
 void Huff_Decompress(msg_t *mbuf, int offset) {
 	int			ch, cch, i, j, size;
 	byte		seq[65536];
@@ -352,8 +501,6 @@ void Huff_Decompress(msg_t *mbuf, int offset) {
 	Com_Memcpy(mbuf->data + offset, seq, cch);
 }
 
-extern	int oldsize;
-
 void Huff_Compress(msg_t *mbuf, int offset) {
 	int			i, ch, size;
 	byte		seq[65536];
@@ -0,0 +1,197 @@
+// jobs.cpp -- small worker pool used to split independent per-frame work across cores
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include "../qcommon/q_shared.h"
+#include "qcommon.h"
+
+typedef struct {
+	// workers are allocated on first use and never destroyed, so a
+	// process exit without Com_ShutdownJobs doesn't trip over joinable
+	// std::thread destructors
+	std::thread				*threads[MAX_JOB_THREADS];
+	int						numThreads;		// spawned workers, not counting the main thread
+
+	std::mutex				mutex;
+	std::condition_variable	cvWork;
+	std::condition_variable	cvDone;
+	int						generation;		// bumped for every batch
+	qboolean				shutdown;
+	qboolean				busy;
+
+	// current batch
+	jobFunc_t				func;
+	void					*data;
+	int						count;
+	int						numWorkers;		// spawned workers taking part in the batch
+	int						pending;		// workers that haven't finished the batch
+	std::atomic<int>		next;
+} jobPool_t;
+
+static jobPool_t	jobs;
+
+// 0 on the main thread, 1..MAX_JOB_THREADS-1 on the workers
+static thread_local int	jobThreadNum = 0;
+
+/*
+================
+Com_RunJobBatch
+
+Grabs indices of the current batch until it is exhausted
+================
+*/
+static void Com_RunJobBatch( int threadNum ) {
+	int		index;
+
+	while ( (index = jobs.next.fetch_add(1)) < jobs.count ) {
+		jobs.func( jobs.data, index, threadNum );
+	}
+}
+
+/*
+================
+Com_JobWorker
+================
+*/
+static void Com_JobWorker( int threadNum ) {
+	int		generation = 0;
+
+	jobThreadNum = threadNum;
+
+	for ( ;; ) {
+		{
+			std::unique_lock<std::mutex> lk(jobs.mutex);
+			jobs.cvWork.wait(lk, [&] { return jobs.shutdown || jobs.generation != generation; });
+
+			if ( jobs.shutdown ) {
+				return;
+			}
+
+			generation = jobs.generation;
+			if ( threadNum > jobs.numWorkers ) {
+				continue;	// not part of this batch
+			}
+		}
+
+		Com_RunJobBatch( threadNum );
+
+		{
+			std::lock_guard<std::mutex> lk(jobs.mutex);
+			if ( --jobs.pending == 0 ) {
+				jobs.cvDone.notify_one();
+			}
+		}
+	}
+}
+
+/*
+================
+Com_JobMaxThreads
+
+Number of threads (including the calling one) worth using for a batch
+================
+*/
+int Com_JobMaxThreads( void ) {
+	int		cores = (int)std::thread::hardware_concurrency();
+
+	if ( cores < 1 ) {
+		cores = 1;
+	}
+	if ( cores > MAX_JOB_THREADS ) {
+		cores = MAX_JOB_THREADS;
+	}
+
+	return cores;
+}
+
+/*
+================
+Com_JobThreadNum
+================
+*/
+int Com_JobThreadNum( void ) {
+	return jobThreadNum;
+}
+
+/*
+================
+Com_ParallelFor
+
+Calls func( data, index, threadNum ) for every index in [0, count) using up
+to numThreads threads and returns once all of them are done. The calling
+thread takes part in the work as threadNum 0. Falls back to a plain loop
+when numThreads <= 1, for tiny batches and for calls made from a job.
+================
+*/
+void Com_ParallelFor( int count, int numThreads, jobFunc_t func, void *data ) {
+	int		i;
+
+	if ( count <= 0 ) {
+		return;
+	}
+
+	if ( numThreads > count ) {
+		numThreads = count;
+	}
+	if ( numThreads > MAX_JOB_THREADS ) {
+		numThreads = MAX_JOB_THREADS;
+	}
+
+	if ( numThreads <= 1 || jobThreadNum != 0 || jobs.busy || jobs.shutdown ) {
+		for ( i = 0; i < count; i++ ) {
+			func( data, i, jobThreadNum );
+		}
+		return;
+	}
+
+	// spawn missing workers
+	while ( jobs.numThreads < numThreads - 1 ) {
+		jobs.threads[jobs.numThreads] = new std::thread(Com_JobWorker, jobs.numThreads + 1);
+		jobs.numThreads++;
+	}
+
+	{
+		std::lock_guard<std::mutex> lk(jobs.mutex);
+		jobs.busy = qtrue;
+		jobs.func = func;
+		jobs.data = data;
+		jobs.count = count;
+		jobs.numWorkers = numThreads - 1;
+		jobs.pending = numThreads - 1;
+		jobs.next = 0;
+		jobs.generation++;
+	}
+	jobs.cvWork.notify_all();
+
+	Com_RunJobBatch( 0 );
+
+	{
+		std::unique_lock<std::mutex> lk(jobs.mutex);
+		jobs.cvDone.wait(lk, [] { return jobs.pending == 0; });
+		jobs.busy = qfalse;
+	}
+}
+
+/*
+================
+Com_ShutdownJobs
+================
+*/
+void Com_ShutdownJobs( void ) {
+	int		i;
+
+	{
+		std::lock_guard<std::mutex> lk(jobs.mutex);
+		jobs.shutdown = qtrue;
+	}
+	jobs.cvWork.notify_all();
+
+	for ( i = 0; i < jobs.numThreads; i++ ) {
+		jobs.threads[i]->join();
+		delete jobs.threads[i];
+		jobs.threads[i] = NULL;
+	}
+	jobs.numThreads = 0;
+}
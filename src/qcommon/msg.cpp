@@ -14,6 +14,9 @@ typedef struct {
 //#define _USINGNEWHUFFTABLE_		// Build a new frequency table to cut and paste.
 
 static huffman_t		msgHuff;
+static huffTable_t		msgHuffTable;
+static qboolean			msgWordBits;	// use MSG_WriteBitsWord/MSG_ReadBitsWord
+static int				msgBitsModes;	// see MSG_SetBitsMode
 
 static qboolean			msgInit = qfalse;
 #ifdef _NEWHUFFTABLE_
@@ -37,10 +40,11 @@ netField_t ammoField = { "ammo" };
 netField_t powerupsField = { "powerups" };
 
 netField_t noField = { "<none>" };
-netField_t *gLastField = &noField;
+// thread local so snapshots can be encoded on job threads
+thread_local netField_t *gLastField = &noField;
 
-int	fieldIndex;
-int oldsize = 0;
+thread_local int	fieldIndex;
+thread_local int oldsize = 0;
 
 void MSG_initHuffman();
 
@@ -97,6 +101,148 @@ bit functions
 
 int	overflows;
 
+// 7 raw bits and four codes have to fit into 64 bits together with the
+// up to 7 bits already in the first byte
+#define	MSG_WORD_MAX_CODE	12
+
+/*
+=================
+MSG_WriteBitsWord
+
+Huffman codes all bytes of a value into one 64 bit word and stores it at
+once. Like Huff_putBit, a byte is cleared when its first bit is written and
+ORed into otherwise, so the result is the same as writing bit by bit. The
+bytes following the written bits may get cleared.
+=================
+*/
+static void MSG_WriteBitsWord(msg_t *msg, unsigned value, int bits) {
+	uint64_t	word;
+	byte		*out;
+	int			nbits, count, shift, i;
+
+	nbits = bits & 7;
+	word = value & ((1 << nbits) - 1);
+	count = nbits;
+	value >>= nbits;
+
+	for (i = nbits; i < bits; i += 8) {
+		word |= (uint64_t)msgHuffTable.code[value & 0xff] << count;
+		count += msgHuffTable.codeLength[value & 0xff];
+		value >>= 8;
+	}
+
+	out = msg->data + (msg->bit >> 3);
+	shift = msg->bit & 7;
+	word <<= shift;
+	if (shift) {
+		word |= out[0];
+	}
+
+#ifdef Q_LITTLE_ENDIAN
+	if ((msg->bit >> 3) + 8 <= msg->maxsize) {
+		Com_Memcpy(out, &word, 8);
+	} else
+#endif
+	{
+		for (i = 0; i < shift + count; i += 8) {
+			*out++ = (byte)(word >> i);
+		}
+	}
+
+	msg->bit += count;
+	msg->cursize = (msg->bit >> 3) + 1;
+}
+
+/*
+=================
+MSG_ReadBitsWord
+
+Loads the next 64 bits of the message at once and decodes the bytes of a
+value from them. Falls back to Huff_tableReceive for codes that don't fit
+the lookup table.
+=================
+*/
+static int MSG_ReadBitsWord(msg_t *msg, int bits) {
+	const huffLookup_t	*entry;
+	uint64_t	word;
+	byte		*in;
+	int			value, nbits, pos, get, i;
+
+	in = msg->data + (msg->bit >> 3);
+#ifdef Q_LITTLE_ENDIAN
+	Com_Memcpy(&word, in, 8);
+#else
+	for (i = 0, word = 0; i < 8; i++) {
+		word |= (uint64_t)in[i] << (i * 8);
+	}
+#endif
+
+	// at least 57 valid bits, enough for 7 raw bits and four codes
+	// of at most HUFF_LOOKUP_BITS
+	word >>= msg->bit & 7;
+	pos = msg->bit;
+
+	nbits = bits & 7;
+	value = (int)(word & ((1 << nbits) - 1));
+	word >>= nbits;
+	pos += nbits;
+
+	for (i = nbits; i < bits; i += 8) {
+		entry = &msgHuffTable.lookup[word & ((1 << HUFF_LOOKUP_BITS) - 1)];
+		if (entry->node || !entry->length) {
+			// NYT or a broken code, go on symbol by symbol
+			msg->bit = pos;
+			for (; i < bits; i += 8) {
+				Huff_tableReceive(&msgHuffTable, &get, msg->data, &msg->bit, msg->maxsize);
+				value |= (get << i);
+			}
+			msg->readcount = (msg->bit >> 3) + 1;
+			return value;
+		}
+
+		value |= (entry->symbol << i);
+		word >>= entry->length;
+		pos += entry->length;
+	}
+
+	msg->bit = pos;
+	msg->readcount = (msg->bit >> 3) + 1;
+	return value;
+}
+
+/*
+=================
+MSG_SetBitsMode
+
+Picks how huffman codes are written and read, so benchmarks and tests can
+compare them. The highest mode below msgBitsModes is the normal state.
+=================
+*/
+#define	MSG_BITS_MODES		3	// trees, code tables, 64 bit words
+
+static void MSG_SetBitsMode(int mode) {
+	msgHuffTable.valid = (qboolean)(mode >= 1);
+	msgWordBits = (qboolean)(mode >= 2);
+}
+
+/*
+=================
+MSG_BuildHuffTable
+=================
+*/
+static void MSG_BuildHuffTable(void) {
+	Huff_BuildTable(&msgHuffTable, &msgHuff);
+
+	if (!msgHuffTable.valid) {
+		msgBitsModes = 1;
+	} else if (msgHuffTable.maxCodeLength > MSG_WORD_MAX_CODE) {
+		msgBitsModes = 2;
+	} else {
+		msgBitsModes = 3;
+	}
+	MSG_SetBitsMode(msgBitsModes - 1);
+}
+
 // negative bit values include signs
 void MSG_WriteBits(msg_t *msg, int value, int bits) {
 	int	i;
@@ -154,6 +300,8 @@ void MSG_WriteBits(msg_t *msg, int value, int bits) {
 		} else {
 			Com_Error(ERR_DROP, "can't read %d bits", bits);
 		}
+	} else if (msgWordBits) {
+		MSG_WriteBitsWord(msg, value & (0xffffffff >> (32 - bits)), bits);
 	} else {
 		value &= (0xffffffff >> (32 - bits));
 		if (bits & 7) {
@@ -170,7 +318,11 @@ void MSG_WriteBits(msg_t *msg, int value, int bits) {
 #ifdef _NEWHUFFTABLE_
 				fwrite(&value, 1, 1, fp);
 #endif // _NEWHUFFTABLE_
-				Huff_offsetTransmit(&msgHuff.compressor, (value & 0xff), msg->data, &msg->bit);
+				if (msgHuffTable.valid) {
+					Huff_tableTransmit(&msgHuffTable, (value & 0xff), msg->data, &msg->bit);
+				} else {
+					Huff_offsetTransmit(&msgHuff.compressor, (value & 0xff), msg->data, &msg->bit);
+				}
 				value = (value >> 8);
 			}
 		}
@@ -178,6 +330,50 @@ void MSG_WriteBits(msg_t *msg, int value, int bits) {
 	}
 }
 
+/*
+==================
+MSG_CopyBits
+
+Appends bits that were written to another non-OOB message. Huffman codes
+don't depend on their position, so this produces the same data as writing
+the values again. The caller has to make sure everything fits, as the
+per-write overflow check of MSG_WriteBits can't be reproduced here.
+==================
+*/
+void MSG_CopyBits(msg_t *msg, const byte *data, int bits) {
+	int		i, n, v, shift;
+	byte	*out;
+
+	if (bits <= 0) {
+		return;
+	}
+
+	if (msg->oob || msg->maxsize - msg->cursize < 4 + ((bits + 7) >> 3)) {
+		msg->overflowed = qtrue;
+		return;
+	}
+
+	for (i = 0; i < bits; i += 8) {
+		n = bits - i < 8 ? bits - i : 8;
+		v = data[i >> 3] & ((1 << n) - 1);
+		out = msg->data + (msg->bit >> 3);
+		shift = msg->bit & 7;
+
+		// like Huff_putBit, a byte is cleared when its first bit is written
+		if (!shift) {
+			out[0] = v;
+		} else {
+			out[0] |= v << shift;
+			if (shift + n > 8) {
+				out[1] = v >> (8 - shift);
+			}
+		}
+		msg->bit += n;
+	}
+
+	msg->cursize = (msg->bit >> 3) + 1;
+}
+
 int MSG_ReadBits(msg_t *msg, int bits) {
 	int			value;
 	int			get;
@@ -210,6 +406,9 @@ int MSG_ReadBits(msg_t *msg, int bits) {
 		} else {
 			Com_Error(ERR_DROP, "can't read %d bits", bits);
 		}
+	} else if (msgWordBits && (msg->bit >> 3) + 8 <= msg->maxsize) {
+		value = MSG_ReadBitsWord(msg, bits);
+		bits -= bits & 7;	// the sign extension below sees the same bits as with the loops
 	} else {
 		nbits = 0;
 		if (bits & 7) {
@@ -221,7 +420,11 @@ int MSG_ReadBits(msg_t *msg, int bits) {
 		}
 		if (bits) {
 			for (i = 0; i<bits; i += 8) {
-				Huff_offsetReceive(msgHuff.decompressor.tree, &get, msg->data, &msg->bit);
+				if (msgHuffTable.valid) {
+					Huff_tableReceive(&msgHuffTable, &get, msg->data, &msg->bit, msg->maxsize);
+				} else {
+					Huff_offsetReceive(msgHuff.decompressor.tree, &get, msg->data, &msg->bit);
+				}
 #ifdef _NEWHUFFTABLE_
 				fwrite(&get, 1, 1, fp);
 #endif // _NEWHUFFTABLE_
@@ -2594,6 +2797,7 @@ void MSG_initHuffman() {
 
 	if (Huff_ReadData(&msgHuff, "huffman.dat")) {
 		msgInit = qtrue;
+		MSG_BuildHuffTable();
 		return;
 	}
 
@@ -2611,6 +2815,7 @@ void MSG_initHuffman() {
 	}
 
 	Huff_SaveData(&msgHuff, "huffman.dat");
+	MSG_BuildHuffTable();
 }
 
 #else
@@ -2651,6 +2856,291 @@ void MSG_initHuffman() {
 
 #endif
 
+/*
+=================
+MSG_BenchLoadDemo
+
+Returns the huffman decoded bytes of all messages in a demo
+=================
+*/
+#define	MSGBENCH_CHUNK		1024
+#define	MSGBENCH_MAX_DATA	(1024 * 1024)
+
+static int MSG_BenchLoadDemo(const char *name, byte *out) {
+	byte	*file;
+	byte	bufData[MAX_MSGLEN];
+	msg_t	buf;
+	int		fileLen, pos, len, total;
+
+	fileLen = FS_ReadFile(name, (void **)&file);
+	if (fileLen <= 0) {
+		Com_Printf("Couldn't read %s\n", name);
+		return 0;
+	}
+
+	total = 0;
+	for (pos = 0; pos + 8 <= fileLen && total < MSGBENCH_MAX_DATA; pos += len) {
+		len = LittleLong(*(int *)(file + pos + 4));
+		pos += 8;
+		if (len < 0 || len > MAX_MSGLEN || pos + len > fileLen) {
+			break;
+		}
+
+		MSG_Init(&buf, bufData, sizeof(bufData));
+		Com_Memcpy(bufData, file + pos, len);
+		buf.cursize = len;
+		MSG_BeginReading(&buf);
+		while (buf.readcount < buf.cursize && total < MSGBENCH_MAX_DATA) {
+			out[total++] = MSG_ReadBits(&buf, 8);
+		}
+	}
+
+	FS_FreeFile(file);
+	return total;
+}
+
+/*
+=================
+MSG_Bench_f
+
+Times huffman coded MSG_WriteBits and MSG_ReadBits walking the trees, with the
+code tables and with the 64 bit words and checks that all of them give the
+same bits. Uses the messages of a recorded demo or, without one, bytes
+distributed like msg_hData.
+
+msgbench [demo] [iterations]
+=================
+*/
+void MSG_Bench_f(void) {
+	static const char	*modeNames[MSG_BITS_MODES] = { "tree", "table", "word" };
+	byte		*data, *decoded, *encoded[MSG_BITS_MODES];
+	int			*encodedBits[MSG_BITS_MODES];
+	int64_t		writeUsec[MSG_BITS_MODES], readUsec[MSG_BITS_MODES], start;
+	msg_t		msg;
+	int			modes;
+	int			size, numChunks, chunkSize, iterations;
+	int			total, seed, mode, iter, i, j, k;
+
+	if (!msgInit) {
+		MSG_initHuffman();
+	}
+
+	modes = msgBitsModes;
+
+	iterations = Cmd_Argc() > 2 ? atoi(Cmd_Argv(2)) : 20;
+	if (iterations < 1) {
+		iterations = 1;
+	}
+
+	data = (byte *)Z_Malloc(MSGBENCH_MAX_DATA, TAG_GENERAL, qfalse);
+
+	if (Cmd_Argc() > 1 && Q_stricmp(Cmd_Argv(1), "-")) {
+		size = MSG_BenchLoadDemo(Cmd_Argv(1), data);
+	} else {
+		// pick bytes with the frequencies the trees were built from
+		for (i = 0, total = 0; i < 256; i++) {
+			total += msg_hData[i];
+		}
+		seed = 0x1234567;
+		for (size = 0; size < MSGBENCH_MAX_DATA / 4; size++) {
+			seed = seed * 1103515245 + 12345;
+			k = (int)(((unsigned)seed >> 1) % (unsigned)total);
+			for (i = 0; i < 255 && k >= msg_hData[i]; i++) {
+				k -= msg_hData[i];
+			}
+			data[size] = i;
+		}
+	}
+
+	if (!size) {
+		Z_Free(data);
+		return;
+	}
+
+	numChunks = (size + MSGBENCH_CHUNK - 1) / MSGBENCH_CHUNK;
+	decoded = (byte *)Z_Malloc(size, TAG_GENERAL, qfalse);
+	for (mode = 0; mode < modes; mode++) {
+		// codes are at most 32 bits
+		encoded[mode] = (byte *)Z_Malloc(numChunks * (MSGBENCH_CHUNK * 4 + 8), TAG_GENERAL, qtrue);
+		encodedBits[mode] = (int *)Z_Malloc(numChunks * sizeof(int), TAG_GENERAL, qtrue);
+		writeUsec[mode] = readUsec[mode] = 0;
+	}
+
+	for (iter = 0; iter < iterations; iter++) {
+		for (mode = 0; mode < modes; mode++) {
+			MSG_SetBitsMode(mode);
+
+			start = Sys_Microseconds();
+			for (i = 0; i < numChunks; i++) {
+				chunkSize = i == numChunks - 1 ? size - i * MSGBENCH_CHUNK : MSGBENCH_CHUNK;
+				MSG_Init(&msg, encoded[mode] + i * (MSGBENCH_CHUNK * 4 + 8), MSGBENCH_CHUNK * 4 + 8);
+				for (j = 0; j < chunkSize; j++) {
+					MSG_WriteBits(&msg, data[i * MSGBENCH_CHUNK + j], 8);
+				}
+				encodedBits[mode][i] = msg.bit;
+			}
+			writeUsec[mode] += Sys_Microseconds() - start;
+
+			start = Sys_Microseconds();
+			for (i = 0; i < numChunks; i++) {
+				chunkSize = i == numChunks - 1 ? size - i * MSGBENCH_CHUNK : MSGBENCH_CHUNK;
+				MSG_Init(&msg, encoded[mode] + i * (MSGBENCH_CHUNK * 4 + 8), MSGBENCH_CHUNK * 4 + 8);
+				msg.cursize = (encodedBits[mode][i] >> 3) + 1;
+				MSG_BeginReading(&msg);
+				for (j = 0; j < chunkSize; j++) {
+					decoded[i * MSGBENCH_CHUNK + j] = MSG_ReadBits(&msg, 8);
+				}
+			}
+			readUsec[mode] += Sys_Microseconds() - start;
+
+			if (memcmp(decoded, data, size)) {
+				Com_Printf(S_COLOR_RED "%s decoding doesn't match the input\n", modeNames[mode]);
+			}
+		}
+	}
+
+	MSG_SetBitsMode(modes - 1);
+
+	for (mode = 1; mode < modes; mode++) {
+		for (i = 0; i < numChunks; i++) {
+			if (encodedBits[0][i] != encodedBits[mode][i] ||
+				memcmp(encoded[0] + i * (MSGBENCH_CHUNK * 4 + 8), encoded[mode] + i * (MSGBENCH_CHUNK * 4 + 8), encodedBits[0][i] >> 3)) {
+				Com_Printf(S_COLOR_RED "%s encoding differs from the tree in chunk %i\n", modeNames[mode], i);
+				break;
+			}
+		}
+	}
+
+	Com_Printf("%i bytes, %i iterations\n", size, iterations);
+	Com_Printf("mode   write MB/s  read MB/s\n");
+	for (mode = 0; mode < modes; mode++) {
+		Com_Printf("%-6s %10.1f %10.1f\n", modeNames[mode],
+			writeUsec[mode] ? (double)size * iterations / writeUsec[mode] : 0.0,
+			readUsec[mode] ? (double)size * iterations / readUsec[mode] : 0.0);
+	}
+
+	for (mode = 0; mode < modes; mode++) {
+		Z_Free(encoded[mode]);
+		Z_Free(encodedBits[mode]);
+	}
+	Z_Free(decoded);
+	Z_Free(data);
+}
+
+/*
+=================
+MSG_Fuzz_f
+
+Writes and reads random values of random sizes with the 64 bit word bit
+functions and with the original ones walking the huffman trees, including
+messages running out of space and reading garbage, and reports any
+difference in the data, the positions or the values read.
+
+msgfuzz [iterations]
+=================
+*/
+#define	MSGFUZZ_OPS		64
+#define	MSGFUZZ_SLACK	64		// MSG_WriteBits may write a bit past maxsize
+
+void MSG_Fuzz_f(void) {
+	byte		data[2][MAX_MSGLEN + MSGFUZZ_SLACK];
+	msg_t		msg[2];
+	int			opBits[MSGFUZZ_OPS], opValue[MSGFUZZ_OPS];
+	int			value[2];
+	int			iterations, numOps, maxsize, modes;
+	int			failures, seed, iter, mode, i;
+
+	if (!msgInit) {
+		MSG_initHuffman();
+	}
+
+	modes = msgBitsModes;
+	if (modes < MSG_BITS_MODES) {
+		Com_Printf("64 bit word bit functions aren't used with this huffman tree.\n");
+		return;
+	}
+
+	iterations = Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : 100000;
+	failures = 0;
+	seed = Sys_Milliseconds();
+
+#define	MSGFUZZ_RAND()	(seed = seed * 1103515245 + 12345, (int)((unsigned)seed >> 8))
+
+	for (iter = 0; iter < iterations && failures < 10; iter++) {
+		// small buffers to run into the end of the buffer often
+		maxsize = 8 + MSGFUZZ_RAND() % 256;
+		numOps = 1 + MSGFUZZ_RAND() % MSGFUZZ_OPS;
+		for (i = 0; i < numOps; i++) {
+			opBits[i] = 1 + MSGFUZZ_RAND() % 32;
+			opValue[i] = MSGFUZZ_RAND() << 16;
+			opValue[i] ^= MSGFUZZ_RAND();
+			if (opBits[i] < 32) {
+				if (opBits[i] < 8 || (MSGFUZZ_RAND() & 1)) {
+					opValue[i] &= (1 << opBits[i]) - 1;
+				} else {
+					// signed, MSG_ReadBits only sign extends from a whole byte
+					opValue[i] = (opValue[i] << (32 - opBits[i])) >> (32 - opBits[i]);
+					opBits[i] = -opBits[i];
+				}
+			}
+		}
+
+		// start with the same garbage
+		for (i = 0; i < maxsize + MSGFUZZ_SLACK; i++) {
+			data[0][i] = data[1][i] = MSGFUZZ_RAND();
+		}
+
+		for (mode = 0; mode < 2; mode++) {
+			MSG_SetBitsMode(mode ? MSG_BITS_MODES - 1 : 0);
+			MSG_Init(&msg[mode], data[mode], maxsize);
+			for (i = 0; i < numOps; i++) {
+				MSG_WriteBits(&msg[mode], opValue[i], opBits[i]);
+			}
+		}
+
+		if (msg[0].bit != msg[1].bit || msg[0].cursize != msg[1].cursize || msg[0].overflowed != msg[1].overflowed ||
+			memcmp(data[0], data[1], (msg[0].bit + 7) >> 3)) {
+			Com_Printf(S_COLOR_RED "msgfuzz: iteration %i writes differ (bit %i/%i)\n", iter, msg[0].bit, msg[1].bit);
+			failures++;
+			continue;
+		}
+
+		// read the values back, past the end of what was written into
+		// the garbage when the message overflowed. The bytes after the
+		// written bits may differ, so both read the same data.
+		Com_Memcpy(data[1], data[0], sizeof(data[1]));
+		for (mode = 0; mode < 2; mode++) {
+			MSG_BeginReading(&msg[mode]);
+		}
+		for (i = 0; i < numOps; i++) {
+			// the trees read bit by bit, keep them within the slack
+			if (msg[0].bit >= (maxsize + MSGFUZZ_SLACK - 16) * 8) {
+				break;
+			}
+			for (mode = 0; mode < 2; mode++) {
+				MSG_SetBitsMode(mode ? MSG_BITS_MODES - 1 : 0);
+				value[mode] = MSG_ReadBits(&msg[mode], opBits[i]);
+			}
+			if (value[0] != value[1] || msg[0].bit != msg[1].bit || msg[0].readcount != msg[1].readcount) {
+				Com_Printf(S_COLOR_RED "msgfuzz: iteration %i read %i differs (%i/%i)\n", iter, i, value[0], value[1]);
+				failures++;
+				break;
+			}
+			if (!msg[0].overflowed && opBits[i] > 0 && value[0] != opValue[i]) {
+				Com_Printf(S_COLOR_RED "msgfuzz: iteration %i read %i returned %i instead of %i\n", iter, i, value[0], opValue[i]);
+				failures++;
+				break;
+			}
+		}
+	}
+
+#undef MSGFUZZ_RAND
+
+	MSG_SetBitsMode(modes - 1);
+
+	Com_Printf("msgfuzz: %i iterations, %i failures\n", iter, failures);
+}
+
 void MSG_shutdownHuffman()
 {
 #ifdef _NEWHUFFTABLE_
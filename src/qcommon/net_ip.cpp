@@ -47,6 +47,11 @@
 #include <sys/filio.h>
 #endif
 
+#ifdef __linux__
+#include <sys/epoll.h>
+#define USE_NET_BATCH
+#endif
+
 typedef int SOCKET;
 #define INVALID_SOCKET                -1
 #define SOCKET_ERROR                        -1
@@ -73,6 +78,8 @@ static cvar_t	*net_port;
 
 static cvar_t	*net_dropsim;
 
+static cvar_t	*net_batch;
+
 static struct sockaddr_in	socksRelayAddr;
 
 static SOCKET	ip_socket = INVALID_SOCKET;
@@ -82,6 +89,35 @@ static SOCKET	socks_socket = INVALID_SOCKET;
 static	int		numIP;
 static	byte	localIP[MAX_IPS][4];
 
+typedef struct {
+	int		packetsReceived;
+	int		recvCalls;
+	int		packetsSent;
+	int		sendCalls;
+	int		startTime;
+} netStats_t;
+
+static netStats_t	netStats;
+
+#ifdef USE_NET_BATCH
+// datagrams moved per recvmmsg/sendmmsg call
+#define	NET_BATCH_PACKETS	32
+
+typedef struct {
+	struct mmsghdr		hdrs[NET_BATCH_PACKETS];
+	struct iovec		iovecs[NET_BATCH_PACKETS];
+	struct sockaddr_in	addrs[NET_BATCH_PACKETS];
+	qboolean			broadcast[NET_BATCH_PACKETS];
+	byte				data[NET_BATCH_PACKETS][MAX_MSGLEN + 1];
+	int					count;
+} netBatch_t;
+
+static int			epoll_fd = -1;
+static netBatch_t	recvBatch;
+static netBatch_t	sendBatch;
+static qboolean		sendBatching;
+#endif
+
 //=============================================================================
 
 /*
@@ -223,6 +259,8 @@ Receive one packet
 int	recvfromCount;
 #endif
 
+static qboolean NET_ReadPacket( struct sockaddr_in *from, socklen_t fromlen, int ret, netadr_t *net_from, msg_t *net_message );
+
 qboolean NET_GetPacket( netadr_t *net_from, msg_t *net_message, fd_set *fdr ) {
 	int ret, err;
 	socklen_t fromlen;
@@ -237,6 +275,7 @@ qboolean NET_GetPacket( netadr_t *net_from, msg_t *net_message, fd_set *fdr ) {
 	recvfromCount++;		// performance check
 #endif
 	ret = recvfrom( ip_socket, (char *)net_message->data, net_message->maxsize, 0, (struct sockaddr *)&from, &fromlen );
+	netStats.recvCalls++;
 
 	if ( ret == SOCKET_ERROR ) {
 		err = socketError;
@@ -248,9 +287,23 @@ qboolean NET_GetPacket( netadr_t *net_from, msg_t *net_message, fd_set *fdr ) {
 		return qfalse;
 	}
 
-	memset( from.sin_zero, 0, 8 );
+	return NET_ReadPacket( &from, fromlen, ret, net_from, net_message );
+}
+
+/*
+==================
+NET_ReadPacket
+
+Fills in the sender and size of a datagram of ret bytes that was received
+into net_message->data
+==================
+*/
+static qboolean NET_ReadPacket( struct sockaddr_in *from, socklen_t fromlen, int ret, netadr_t *net_from, msg_t *net_message ) {
+	netStats.packetsReceived++;
+
+	memset( from->sin_zero, 0, 8 );
 
-	if ( usingSocks && memcmp( &from, &socksRelayAddr, fromlen ) == 0 ) {
+	if ( usingSocks && memcmp( from, &socksRelayAddr, fromlen ) == 0 ) {
 		if ( ret < 10 || net_message->data[0] != 0 || net_message->data[1] != 0 || net_message->data[2] != 0 || net_message->data[3] != 1 ) {
 			return qfalse;
 		}
@@ -263,7 +316,7 @@ qboolean NET_GetPacket( netadr_t *net_from, msg_t *net_message, fd_set *fdr ) {
 		net_message->readcount = 10;
 	}
 	else {
-		SockadrToNetadr( &from, net_from );
+		SockadrToNetadr( from, net_from );
 		net_message->readcount = 0;
 	}
 
@@ -280,6 +333,77 @@ qboolean NET_GetPacket( netadr_t *net_from, msg_t *net_message, fd_set *fdr ) {
 
 static char socksBuf[4096];
 
+/*
+==================
+NET_SendError
+==================
+*/
+static void NET_SendError( qboolean broadcast ) {
+	int err = socketError;
+
+	// wouldblock is silent
+	if( err == EAGAIN ) {
+		return;
+	}
+
+	// some PPP links do not allow broadcasts and return an error
+	if( err == EADDRNOTAVAIL && broadcast ) {
+		return;
+	}
+
+	Com_Printf( "NET_SendPacket: %s\n", NET_ErrorString() );
+}
+
+#ifdef USE_NET_BATCH
+/*
+==================
+NET_FlushSendBatch
+==================
+*/
+static void NET_FlushSendBatch( void ) {
+	int		sent, ret;
+
+	for ( sent = 0; sent < sendBatch.count && ip_socket != INVALID_SOCKET; sent += ret ) {
+		ret = sendmmsg( ip_socket, sendBatch.hdrs + sent, sendBatch.count - sent, 0 );
+		netStats.sendCalls++;
+
+		if ( ret <= 0 ) {
+			// drop the packet that failed and go on with the rest
+			NET_SendError( sendBatch.broadcast[sent] );
+			ret = 1;
+		}
+	}
+
+	sendBatch.count = 0;
+}
+#endif
+
+/*
+==================
+Sys_BeginPacketBatch
+
+Packets sent until Sys_FlushPacketBatch may be queued up and handed
+to the system together
+==================
+*/
+void Sys_BeginPacketBatch( void ) {
+#ifdef USE_NET_BATCH
+	sendBatching = (qboolean)(net_batch && net_batch->integer && !usingSocks);
+#endif
+}
+
+/*
+==================
+Sys_FlushPacketBatch
+==================
+*/
+void Sys_FlushPacketBatch( void ) {
+#ifdef USE_NET_BATCH
+	NET_FlushSendBatch();
+	sendBatching = qfalse;
+#endif
+}
+
 /*
 ==================
 Sys_SendPacket
@@ -299,6 +423,36 @@ void Sys_SendPacket( int length, const void *data, netadr_t to ) {
 	}
 
 	NetadrToSockadr( &to, &addr );
+	netStats.packetsSent++;
+
+#ifdef USE_NET_BATCH
+	if ( sendBatching && length <= (int)sizeof( sendBatch.data[0] ) ) {
+		int			i = sendBatch.count++;
+		msghdr		*hdr = &sendBatch.hdrs[i].msg_hdr;
+
+		memcpy( sendBatch.data[i], data, length );
+		sendBatch.addrs[i] = addr;
+		sendBatch.iovecs[i].iov_base = sendBatch.data[i];
+		sendBatch.iovecs[i].iov_len = length;
+		sendBatch.broadcast[i] = (qboolean)(to.type == NA_BROADCAST);
+
+		memset( hdr, 0, sizeof( *hdr ) );
+		hdr->msg_name = &sendBatch.addrs[i];
+		hdr->msg_namelen = sizeof( sendBatch.addrs[i] );
+		hdr->msg_iov = &sendBatch.iovecs[i];
+		hdr->msg_iovlen = 1;
+
+		if ( sendBatch.count == NET_BATCH_PACKETS ) {
+			NET_FlushSendBatch();
+		}
+		return;
+	}
+
+	// keep the order of everything already queued
+	NET_FlushSendBatch();
+#endif
+
+	netStats.sendCalls++;
 
 	if( usingSocks && to.type == NA_IP ) {
 		socksBuf[0] = 0;	// reserved
@@ -314,19 +468,7 @@ void Sys_SendPacket( int length, const void *data, netadr_t to ) {
 		ret = sendto( ip_socket, (const char *)data, length, 0, (sockaddr *)&addr, sizeof(addr) );
 	}
 	if( ret == SOCKET_ERROR ) {
-		int err = socketError;
-
-		// wouldblock is silent
-		if( err == EAGAIN ) {
-			return;
-		}
-
-		// some PPP links do not allow broadcasts and return an error
-		if( err == EADDRNOTAVAIL && to.type == NA_BROADCAST ) {
-			return;
-		}
-
-		Com_Printf( "NET_SendPacket: %s\n", NET_ErrorString() );
+		NET_SendError( (qboolean)(to.type == NA_BROADCAST) );
 	}
 }
 
@@ -889,6 +1031,8 @@ static qboolean NET_GetCvars( void ) {
 
 	net_dropsim = Cvar_Get( "net_dropsim", "", CVAR_TEMP | CVAR_CHEAT);
 
+	net_batch = Cvar_Get( "net_batch", "1", CVAR_ARCHIVE | CVAR_GLOBAL );
+
 	return modified ? qtrue : qfalse;
 }
 
@@ -935,6 +1079,15 @@ void NET_Config( qboolean enableNetworking ) {
 	}
 
 	if ( stop ) {
+#ifdef USE_NET_BATCH
+		NET_FlushSendBatch();
+
+		if ( epoll_fd != -1 ) {
+			close( epoll_fd );
+			epoll_fd = -1;
+		}
+#endif
+
 		if ( ip_socket != INVALID_SOCKET ) {
 			closesocket( ip_socket );
 			ip_socket = INVALID_SOCKET;
@@ -973,7 +1126,10 @@ void NET_Init( void ) {
 
 	NET_Config( qtrue );
 
+	netStats.startTime = Sys_Milliseconds();
+
 	Cmd_AddCommand ("net_restart", NET_Restart_f );
+	Cmd_AddCommand ("net_stats", NET_Stats_f );
 }
 
 /*
@@ -993,6 +1149,26 @@ void NET_Shutdown( void ) {
 #endif
 }
 
+/*
+====================
+NET_DispatchPacket
+====================
+*/
+static void NET_DispatchPacket(netadr_t *from, msg_t *netmsg)
+{
+	if(net_dropsim->value > 0.0f && net_dropsim->value <= 100.0f)
+	{
+		// com_dropsim->value percent of incoming packets get dropped.
+		if(rand() < (int) (((double) RAND_MAX) / 100.0 * (double) net_dropsim->value))
+			return;          // drop this packet
+	}
+
+	if(com_sv_running->integer)
+		Com_RunAndTimeServerPacket(from, netmsg);
+	else
+		CL_PacketEvent(*from, netmsg);
+}
+
 /*
 ====================
 NET_Event
@@ -1012,23 +1188,106 @@ void NET_Event(fd_set *fdr)
 		MSG_Init(&netmsg, bufData, sizeof(bufData));
 
 		if(NET_GetPacket(&from, &netmsg, fdr))
-		{
-			if(net_dropsim->value > 0.0f && net_dropsim->value <= 100.0f)
-			{
-				// com_dropsim->value percent of incoming packets get dropped.
-				if(rand() < (int) (((double) RAND_MAX) / 100.0 * (double) net_dropsim->value))
-					continue;          // drop this packet
+			NET_DispatchPacket(&from, &netmsg);
+		else
+			break;
+	}
+}
+
+#ifdef USE_NET_BATCH
+/*
+====================
+NET_EventBatch
+
+Reads everything waiting on the socket, NET_BATCH_PACKETS datagrams per
+recvmmsg call
+====================
+*/
+static void NET_EventBatch(void)
+{
+	SOCKET		sock = ip_socket;
+	netadr_t	from;
+	msg_t		netmsg;
+	msghdr		*hdr;
+	int			i, ret;
+
+	do {
+		for ( i = 0; i < NET_BATCH_PACKETS; i++ ) {
+			hdr = &recvBatch.hdrs[i].msg_hdr;
+
+			recvBatch.iovecs[i].iov_base = recvBatch.data[i];
+			recvBatch.iovecs[i].iov_len = sizeof( recvBatch.data[i] );
+
+			memset( hdr, 0, sizeof( *hdr ) );
+			hdr->msg_name = &recvBatch.addrs[i];
+			hdr->msg_namelen = sizeof( recvBatch.addrs[i] );
+			hdr->msg_iov = &recvBatch.iovecs[i];
+			hdr->msg_iovlen = 1;
+		}
+
+		ret = recvmmsg( sock, recvBatch.hdrs, NET_BATCH_PACKETS, MSG_DONTWAIT, NULL );
+		netStats.recvCalls++;
+
+		if ( ret == SOCKET_ERROR ) {
+			if ( errno != EAGAIN && errno != ECONNRESET && errno != EINTR ) {
+				Com_Printf( "NET_GetPacket: %s\n", NET_ErrorString() );
 			}
+			return;
+		}
 
-			if(com_sv_running->integer)
-				Com_RunAndTimeServerPacket(&from, &netmsg);
-			else
-				CL_PacketEvent(from, &netmsg);
+		// a packet may restart networking
+		for ( i = 0; i < ret && ip_socket == sock; i++ ) {
+			MSG_Init( &netmsg, recvBatch.data[i], sizeof( recvBatch.data[i] ) );
+
+			if ( NET_ReadPacket( &recvBatch.addrs[i], recvBatch.hdrs[i].msg_hdr.msg_namelen, recvBatch.hdrs[i].msg_len, &from, &netmsg ) ) {
+				NET_DispatchPacket( &from, &netmsg );
+			}
+		}
+	} while ( ret == NET_BATCH_PACKETS && ip_socket == sock );
+}
+
+/*
+====================
+NET_SleepBatch
+
+Waits with epoll instead of select, returns qfalse if that isn't possible
+====================
+*/
+static qboolean NET_SleepBatch(int msec)
+{
+	struct epoll_event	ev;
+	int					ret;
+
+	if ( epoll_fd == -1 ) {
+		epoll_fd = epoll_create1( EPOLL_CLOEXEC );
+		if ( epoll_fd == -1 ) {
+			Com_Printf( "WARNING: epoll_create1: %s, setting net_batch 0\n", NET_ErrorString() );
+			Cvar_Set( "net_batch", "0" );
+			return qfalse;
+		}
+
+		memset( &ev, 0, sizeof( ev ) );
+		ev.events = EPOLLIN;
+		ev.data.fd = ip_socket;
+		if ( epoll_ctl( epoll_fd, EPOLL_CTL_ADD, ip_socket, &ev ) == -1 ) {
+			Com_Printf( "WARNING: epoll_ctl: %s, setting net_batch 0\n", NET_ErrorString() );
+			Cvar_Set( "net_batch", "0" );
+			close( epoll_fd );
+			epoll_fd = -1;
+			return qfalse;
 		}
-		else
-			break;
 	}
+
+	ret = epoll_wait( epoll_fd, &ev, 1, msec );
+
+	if ( ret == -1 && errno != EINTR )
+		Com_Printf( "Warning: epoll_wait() syscall failed: %s\n", NET_ErrorString() );
+	else if ( ret > 0 )
+		NET_EventBatch();
+
+	return qtrue;
 }
+#endif
 
 /*
 ====================
@@ -1046,6 +1305,13 @@ void NET_Sleep(int msec) {
 	if (msec < 0)
 		msec = 0;
 
+#ifdef USE_NET_BATCH
+	if (net_batch && net_batch->integer && ip_socket != INVALID_SOCKET) {
+		if (NET_SleepBatch(msec))
+			return;
+	}
+#endif
+
 	FD_ZERO(&fdset);
 	if (ip_socket != INVALID_SOCKET) {
 		FD_SET(ip_socket, &fdset); // network socket
@@ -1072,6 +1338,34 @@ void NET_Sleep(int msec) {
 		NET_Event(&fdset);
 }
 
+/*
+====================
+NET_Stats_f
+
+Prints the packet rates since the last call
+====================
+*/
+void NET_Stats_f( void ) {
+	float	seconds = ( Sys_Milliseconds() - netStats.startTime ) / 1000.0f;
+
+	if ( seconds <= 0.0f ) {
+		seconds = 0.001f;
+	}
+
+#ifdef USE_NET_BATCH
+	Com_Printf( "net_batch %i, last %.1f seconds\n", net_batch ? net_batch->integer : 0, seconds );
+#else
+	Com_Printf( "last %.1f seconds\n", seconds );
+#endif
+	Com_Printf( "received: %8.1f packets/s in %8.1f calls/s\n",
+		netStats.packetsReceived / seconds, netStats.recvCalls / seconds );
+	Com_Printf( "sent:     %8.1f packets/s in %8.1f calls/s\n",
+		netStats.packetsSent / seconds, netStats.sendCalls / seconds );
+
+	Com_Memset( &netStats, 0, sizeof( netStats ) );
+	netStats.startTime = Sys_Milliseconds();
+}
+
 /*
 ====================
 NET_Restart_f
@@ -100,6 +100,7 @@ struct entityState_s;
 struct playerState_s;
 
 void MSG_WriteBits( msg_t *msg, int value, int bits );
+void MSG_CopyBits( msg_t *msg, const byte *data, int bits );
 
 void MSG_WriteChar (msg_t *sb, int c);
 void MSG_WriteByte (msg_t *sb, int c);
@@ -144,6 +145,8 @@ void MSG_ReadDeltaPlayerstate( msg_t *msg, struct playerState_s *from, struct pl
 
 
 void MSG_ReportChangeVectors_f( void );
+void MSG_Bench_f( void );
+void MSG_Fuzz_f( void );
 
 //============================================================================
 
@@ -176,6 +179,7 @@ void		NET_Init( void );
 void		NET_Shutdown( void );
 void		NET_Config( qboolean enableNetworking );
 void		NET_Restart_f(void);
+void		NET_Stats_f(void);
 
 typedef int dlHandle_t;
 typedef void(*dl_ended_callback)(dlHandle_t handle, qboolean success, const char *err_msg);
@@ -344,6 +348,7 @@ void	VM_Clear(void);
 vm_t	*VM_Restart( vm_t *vm );
 
 intptr_t QDECL VM_Call(vm_t *vm, int callnum, ...);
+void	VM_Bench( vm_t *vm, int frames, int callnum, int arg, void (*restore)( void ) );
 
 void	VM_Debug( int level );
 
@@ -378,6 +383,23 @@ ID_INLINE float _vmf(intptr_t x)
 
 char	*VM_ExplicitArgString(vm_t *vm, intptr_t intValue);
 
+byte	*VM_DataSegment( vm_t *vm, uint32_t *dataMask );
+Q_NORETURN void	VM_ArgOverflow( int syscall );
+
+// VM_ArgPtr against a segment from VM_DataSegment, for syscall fast paths
+ID_INLINE void *VM_SegmentArg( byte *dataBase, uint32_t dataMask, int syscall, intptr_t intValue, uint64_t size ) {
+	if ( !intValue ) {
+		return NULL;
+	}
+
+	intValue &= dataMask;
+	if ( size > (uint64_t)( dataMask - (uint32_t)intValue ) + 1 ) {
+		VM_ArgOverflow( syscall );
+	}
+
+	return dataBase + intValue;
+}
+
 void	VM_Forced_Unload_Start(void);
 void	VM_Forced_Unload_Done(void);
 
@@ -571,6 +593,10 @@ extern	int			cvar_modifiedFlags;
 // etc, variables have been modified since the last check.  The bit
 // can then be cleared to allow another change detection.
 
+extern	int			cvar_modificationCount;
+// bumped whenever any cvar changes its value or flags, for caches of strings
+// built from cvars that don't share a flag
+
 /*
 ==============================================================
 
@@ -681,6 +707,33 @@ void	FS_ForceFlush( fileHandle_t f, module_t module = MODULE_MAIN );
 void	FS_FreeFile( void *buffer );
 // frees the memory returned by FS_ReadFile
 
+int		FS_MapFile( const char *qpath, void **buffer );
+// maps a file that isn't in a pk3 into memory, other files are read
+// with FS_ReadFile. Same return value as FS_ReadFile, but no 0 byte
+// is appended and the buffer has to be released with FS_UnmapFile.
+
+void	FS_UnmapFile( void *buffer );
+
+typedef void (*fsReadCallback_t)( const char *qpath, void *buffer, int len, void *userData );
+
+void	FS_ReadFileAsync( const char *qpath, fsReadCallback_t callback, void *userData );
+// reads a file on a background thread if it is in a pk3, callback gets what
+// FS_ReadFile would have returned, from FS_RunAsyncReads on the main thread.
+// The buffer belongs to the callback and has to be freed with FS_FreeFile.
+// A filesystem shutdown calls the callback with a NULL buffer and -1, it
+// must not touch the filesystem then.
+
+qboolean FS_PrefetchFile( const char *qpath );
+// starts reading a file that FS_ReadFile will be asked for soon,
+// returns qfalse if it isn't in a pk3 or there is no room
+
+void	FS_RunAsyncReads( void );
+// runs the callbacks of completed reads, called every frame
+
+void	FS_FlushAsyncReads( void );
+// delivers all outstanding callbacks and drops unused prefetches,
+// called when a level has finished loading
+
 void	FS_WriteFile( const char *qpath, const void *buffer, int size );
 // writes a complete file, creating any subdirectories needed
 
@@ -941,6 +994,28 @@ void Com_Frame( void );
 void Com_Shutdown( void );
 
 
+/*
+==============================================================
+
+JOBS
+
+==============================================================
+*/
+
+#define	MAX_JOB_THREADS		32
+
+typedef void (*jobFunc_t)( void *data, int index, int threadNum );
+
+void	Com_ParallelFor( int count, int numThreads, jobFunc_t func, void *data );
+// calls func for every index in [0, count) on up to numThreads threads and
+// waits for all of them. threadNum is 0 for the calling thread and unique
+// per worker, so it can select per-thread scratch data.
+// Jobs must not call Com_Printf, Com_Error or touch the filesystem.
+
+int		Com_JobMaxThreads( void );
+int		Com_JobThreadNum( void );
+void	Com_ShutdownJobs( void );
+
 /*
 ==============================================================
 
@@ -1071,6 +1146,29 @@ void	Huff_offsetTransmit (huff_t *huff, int ch, byte *fout, int *offset);
 void	Huff_putBit( int bit, byte *fout, int *offset);
 int		Huff_getBit( byte *fout, int *offset);
 
+// flat code tables for a huffman_t that doesn't get any more updates,
+// they produce and accept exactly the same bits as walking the trees
+#define HUFF_LOOKUP_BITS	11
+
+typedef struct {
+	node_t		*node;		// where to go on for codes longer than HUFF_LOOKUP_BITS
+	short		symbol;
+	byte		length;		// 0 if the bits don't lead anywhere
+} huffLookup_t;
+
+typedef struct {
+	qboolean		valid;
+	unsigned		code[HMAX];			// first bit sent is bit 0
+	byte			codeLength[HMAX];
+	int				maxCodeLength;
+	huffLookup_t	lookup[1 << HUFF_LOOKUP_BITS];	// indexed by the next HUFF_LOOKUP_BITS bits
+	node_t			*tree;
+} huffTable_t;
+
+void	Huff_BuildTable( huffTable_t *table, huffman_t *huff );
+void	Huff_tableTransmit( const huffTable_t *table, int ch, byte *fout, int *offset );
+void	Huff_tableReceive( const huffTable_t *table, int *ch, byte *fin, int *offset, int size );
+
 extern huffman_t clientHuffTables;
 
 #define	SV_ENCODE_START		4
@@ -49,9 +49,16 @@ static int forced_unload;
 
 vm_t	vmTable[MAX_VM];
 
+static cvar_t	*vm_jitTier;
+
 
 void VM_VmInfo_f( void );
 void VM_VmProfile_f( void );
+void VM_VmSyscalls_f( void );
+static void VM_EndBench( const vm_t *vm );
+#ifdef VM_SAMPLING
+void VM_VmSample_f( void );
+#endif
 
 
 
@@ -76,9 +83,14 @@ void VM_Init( void ) {
 	Cvar_Get( "vm_cgame", "2", CVAR_ARCHIVE );	// !@# SHIP WITH SET TO 2
 	Cvar_Get( "vm_game", "2", CVAR_ARCHIVE );	// !@# SHIP WITH SET TO 2
 	Cvar_Get( "vm_ui", "2", CVAR_ARCHIVE );		// !@# SHIP WITH SET TO 2
+	vm_jitTier = Cvar_Get( "vm_jitTier", "1", CVAR_ARCHIVE );
 
 	Cmd_AddCommand ("vmprofile", VM_VmProfile_f );
 	Cmd_AddCommand ("vminfo", VM_VmInfo_f );
+	Cmd_AddCommand ("vmsyscalls", VM_VmSyscalls_f );
+#ifdef VM_SAMPLING
+	Cmd_AddCommand ("vmsample", VM_VmSample_f );
+#endif
 
 	Com_Memset( vmTable, 0, sizeof( vmTable ) );
 }
@@ -388,9 +400,22 @@ void VM_LoadSymbols( vm_t *vm ) {
 				break;
 			}
 			value = ParseHex( token );
-			if ( value < 0 || vm->instructionCount <= value ) {
+			if ( value < 0 ) {
+				// syscalls get their own list, vmsample reports them by name
+				token = COM_Parse( &text_p );
+				if ( token[0] ) {
+					chars = (int)strlen( token );
+					sym = (vmSymbol_t *)Hunk_Alloc( sizeof( *sym ) + chars, h_high );
+					sym->next = vm->syscallSymbols;
+					vm->syscallSymbols = sym;
+					sym->symValue = value;
+					Q_strncpyz( sym->symName, token, chars + 1 );
+				}
+				continue;
+			}
+			if ( vm->instructionCount <= value ) {
 				COM_Parse( &text_p );
-				continue;		// don't load syscalls
+				continue;
 			}
 
 			token = COM_Parse( &text_p );
@@ -510,24 +535,22 @@ intptr_t QDECL __attribute__((no_sanitize_address)) VM_DllSyscall( intptr_t arg,
 	args[i] = va_arg(ap, intptr_t);
   va_end(ap);
 
-  return currentVM->systemCall( args );
+  return VM_SystemCall( currentVM, args );
 #else // original id code
-	return currentVM->systemCall( &arg );
+	return VM_SystemCall( currentVM, &arg );
 #endif
 }
 
 
 /*
 =================
-VM_LoadQVM
+VM_ReadQVMHeader
 
-Load a .qvm file
+Reads and validates vm/<name>.qvm, the caller frees the returned file
 =================
 */
-vmHeader_t *VM_LoadQVM( vm_t *vm, qboolean alloc)
+static vmHeader_t *VM_ReadQVMHeader( const char *name )
 {
-	int					dataLength;
-	int					i;
 	char				filename[MAX_QPATH];
 	union {
 		vmHeader_t	*h;
@@ -535,15 +558,13 @@ vmHeader_t *VM_LoadQVM( vm_t *vm, qboolean alloc)
 	} header;
 
 	// load the image
-	Com_sprintf( filename, sizeof(filename), "vm/%s.qvm", vm->name );
+	Com_sprintf( filename, sizeof(filename), "vm/%s.qvm", name );
 	Com_Printf( "Loading vm file %s...\n", filename );
 
 	FS_ReadFile(filename, &header.v);
 
 	if ( !header.h ) {
 		Com_Printf( "Failed.\n" );
-		VM_Free( vm );
-
 		Com_Printf(S_COLOR_YELLOW "Warning: Couldn't open VM file %s\n", filename);
 
 		return NULL;
@@ -565,14 +586,12 @@ vmHeader_t *VM_LoadQVM( vm_t *vm, qboolean alloc)
 			|| header.h->litLength < 0
 			|| header.h->codeLength <= 0 )
 		{
-			VM_Free(vm);
 			FS_FreeFile(header.v);
 
 			Com_Printf(S_COLOR_YELLOW "Warning: %s has bad header\n", filename);
 			return NULL;
 		}
 	} else {
-		VM_Free( vm );
 		FS_FreeFile(header.v);
 
 		Com_Printf(S_COLOR_YELLOW "Warning: %s does not have a recognisable "
@@ -580,6 +599,34 @@ vmHeader_t *VM_LoadQVM( vm_t *vm, qboolean alloc)
 		return NULL;
 	}
 
+	return header.h;
+}
+
+/*
+=================
+VM_LoadQVM
+
+Load a .qvm file
+=================
+*/
+vmHeader_t *VM_LoadQVM( vm_t *vm, qboolean alloc)
+{
+	int					dataLength;
+	int					i;
+	char				filename[MAX_QPATH];
+	union {
+		vmHeader_t	*h;
+		void				*v;
+	} header;
+
+	Com_sprintf( filename, sizeof(filename), "vm/%s.qvm", vm->name );
+
+	header.h = VM_ReadQVMHeader( vm->name );
+	if ( !header.h ) {
+		VM_Free( vm );
+		return NULL;
+	}
+
 	// round up to next power of 2 so all data operations can
 	// be mask protected
 	dataLength = header.h->dataLength + header.h->litLength +
@@ -758,6 +805,7 @@ vm_t *VM_Create( const char *module, qboolean mvOverride, intptr_t (*systemCalls
 	if(interpret != VMI_BYTECODE)
 	{
 		vm->compiled = qtrue;
+		vm->jitTier = vm_jitTier->integer;
 		VM_Compile( vm, header );
 	}
 #endif
@@ -804,6 +852,21 @@ void VM_Free( vm_t *vm ) {
 		}
 	}
 
+#ifdef VM_SAMPLING
+	if ( vm_sampler.vm == vm ) {
+		VM_StopSampling();
+		Z_Free( vm_sampler.samples );
+		vm_sampler.samples = NULL;
+		Com_Printf( "vmsample: %s unloaded, samples discarded\n", vm->name );
+	}
+#endif
+
+	if ( vm->syscallStats ) {
+		Z_Free( vm->syscallStats );
+	}
+
+	VM_EndBench( vm );	// puts the vm's own code back if an error hit VM_Bench
+
 	if(vm->destroy)
 		vm->destroy(vm);
 
@@ -850,6 +913,9 @@ void VM_Forced_Unload_Done(void) {
 }
 
 void *VM_ArgPtr( int syscall, intptr_t intValue, int32_t size ) {
+	if ( currentVM->syscallStats ) {
+		currentVM->syscallStats[currentVM->syscallCurrent].argChecks++;
+	}
 	if ( currentVM->entryPoint ) {
 		return (void *) intValue;
 	}
@@ -870,6 +936,9 @@ void *VM_ArgPtr( int syscall, intptr_t intValue, int32_t size ) {
 }
 
 void *VM_ArgArray( int syscall, intptr_t intValue, uint32_t size, int32_t num ) {
+	if ( currentVM->syscallStats ) {
+		currentVM->syscallStats[currentVM->syscallCurrent].argChecks++;
+	}
 	if ( currentVM->entryPoint ) {
 		return (void *) intValue;
 	}
@@ -891,6 +960,9 @@ void *VM_ArgArray( int syscall, intptr_t intValue, uint32_t size, int32_t num )
 }
 
 char *VM_ArgString( int syscall, intptr_t intValue ) {
+	if ( currentVM->syscallStats ) {
+		currentVM->syscallStats[currentVM->syscallCurrent].argChecks++;
+	}
 	if ( currentVM->entryPoint ) {
 		return (char *) intValue;
 	}
@@ -915,6 +987,30 @@ char *VM_ArgString( int syscall, intptr_t intValue ) {
 	return p;
 }
 
+/*
+============
+VM_DataSegment
+
+For syscall fast paths that check their arguments themselves with
+VM_SegmentArg, returns NULL for dll modules which pass real pointers
+============
+*/
+byte *VM_DataSegment( vm_t *vm, uint32_t *dataMask ) {
+	if ( vm->entryPoint ) {
+		return NULL;
+	}
+	if ( vm->syscallStats ) {
+		vm->syscallStats[vm->syscallCurrent].argChecks++;
+	}
+
+	*dataMask = vm->dataMask;
+	return vm->dataBase;
+}
+
+Q_NORETURN void VM_ArgOverflow( int syscall ) {
+	Com_Error( ERR_DROP, "VM_SegmentArg: memory overflow in syscall %d (%s)", syscall, currentVM->name );
+}
+
 char *VM_ExplicitArgString( vm_t *vm, intptr_t intValue ) {
 	// vm is missing on reconnect here as well?
 	if ( !vm ) {
@@ -1239,6 +1335,257 @@ void VM_VmProfile_f( void ) {
 	Z_Free( sorted );
 }
 
+/*
+==============
+VM_SyscallName
+
+Map file name of a syscall, value is the negative call number
+==============
+*/
+const char *VM_SyscallName( vm_t *vm, int value ) {
+	vmSymbol_t	*sym;
+
+	for ( sym = vm->syscallSymbols; sym; sym = sym->next ) {
+		if ( sym->symValue == value ) {
+			return sym->symName;
+		}
+	}
+
+	return va( "syscall_%i", ~value );
+}
+
+#ifdef VM_SAMPLING
+#define VM_MAX_SAMPLES		65536
+
+static int QDECL VM_SymbolValueSort( const void *a, const void *b ) {
+	return (*(const vmSymbol_t * const *)a)->symValue - (*(const vmSymbol_t * const *)b)->symValue;
+}
+
+static int QDECL VM_SampleSort( const void *a, const void *b ) {
+	const vmSample_t	*sa = (const vmSample_t *)a;
+	const vmSample_t	*sb = (const vmSample_t *)b;
+
+	if ( sa->depth != sb->depth ) {
+		return sa->depth - sb->depth;
+	}
+
+	return memcmp( sa->frames, sb->frames, sa->depth * sizeof( sa->frames[0] ) );
+}
+
+/*
+==============
+VM_WriteSamples
+
+Turns the code offsets of the samples into function symbols and writes them
+as collapsed stacks, one "root;...;leaf count" line per distinct stack
+==============
+*/
+static void VM_WriteSamples( vm_t *vm ) {
+	vmSample_t		*sample;
+	vmSymbol_t		**sorted, *sym;
+	fileHandle_t	f;
+	int				*self;
+	int				numSorted;
+	int				i, j, k, lo, hi, count;
+	int				vmSamples, time;
+	const char		*fileName;
+
+	sorted = (vmSymbol_t **)Z_Malloc( (vm->numSymbols + 1) * sizeof( *sorted ), TAG_VM, qtrue );
+	numSorted = 0;
+	for ( sym = vm->symbols; sym && numSorted < vm->numSymbols; sym = sym->next ) {
+		sorted[numSorted++] = sym;
+	}
+	qsort( sorted, numSorted, sizeof( *sorted ), VM_SymbolValueSort );
+	self = (int *)Z_Malloc( (numSorted + 1) * sizeof( *self ), TAG_VM, qtrue );
+
+	// replace code offsets with symbol indexes, drop the helper procedures
+	for ( i = 0; i < vm_sampler.numSamples; i++ ) {
+		sample = &vm_sampler.samples[i];
+
+		for ( j = k = 0; j < sample->depth; j++ ) {
+			if ( sample->frames[j] < 0 ) {
+				sample->frames[k++] = sample->frames[j];
+				continue;
+			}
+
+			if ( sample->frames[j] < vm->entryOfs || !numSorted ) {
+				continue;
+			}
+
+			lo = 0;
+			hi = numSorted - 1;
+			while ( lo < hi ) {
+				int mid = ( lo + hi + 1 ) / 2;
+				if ( sorted[mid]->symValue <= sample->frames[j] ) {
+					lo = mid;
+				} else {
+					hi = mid - 1;
+				}
+			}
+			sample->frames[k++] = lo;
+		}
+		sample->depth = k;
+
+		if ( k && sample->frames[0] >= 0 ) {
+			self[sample->frames[0]]++;
+		}
+	}
+
+	qsort( vm_sampler.samples, vm_sampler.numSamples, sizeof( vmSample_t ), VM_SampleSort );
+
+	fileName = va( "vmsample_%s.folded", vm->name );
+	f = FS_FOpenFileWrite( fileName );
+	if ( !f ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: couldn't open %s\n", fileName );
+	} else {
+		for ( i = 0; i < vm_sampler.numSamples; i += count ) {
+			sample = &vm_sampler.samples[i];
+
+			for ( count = 1; i + count < vm_sampler.numSamples; count++ ) {
+				if ( VM_SampleSort( sample, &vm_sampler.samples[i + count] ) ) {
+					break;
+				}
+			}
+
+			FS_Printf( f, "%s", vm->name );
+			for ( j = sample->depth - 1; j >= 0; j-- ) {
+				if ( sample->frames[j] < 0 ) {
+					FS_Printf( f, ";%s", VM_SyscallName( vm, sample->frames[j] ) );
+				} else {
+					FS_Printf( f, ";%s", sorted[sample->frames[j]]->symName );
+				}
+			}
+			FS_Printf( f, " %i\n", count );
+		}
+
+		if ( vm_sampler.engineSamples ) {
+			FS_Printf( f, "engine %i\n", vm_sampler.engineSamples );
+		}
+		if ( vm_sampler.otherThreadSamples ) {
+			FS_Printf( f, "other_threads %i\n", vm_sampler.otherThreadSamples );
+		}
+
+		FS_FCloseFile( f );
+	}
+
+	vmSamples = vm_sampler.numSamples;
+	time = Sys_Milliseconds() - vm_sampler.startTime;
+	Com_Printf( "%i samples in %i.%i seconds, %i in %s, written to %s\n",
+		vmSamples + vm_sampler.engineSamples, time / 1000, time % 1000 / 100,
+		vmSamples, vm->name, fileName );
+	if ( vm_sampler.droppedSamples ) {
+		Com_Printf( S_COLOR_YELLOW "%i samples dropped, the buffer holds %i\n",
+			vm_sampler.droppedSamples, vm_sampler.maxSamples );
+	}
+	if ( vm_sampler.otherThreadSamples ) {
+		Com_Printf( S_COLOR_YELLOW "%i samples dropped, they were taken on other threads\n",
+			vm_sampler.otherThreadSamples );
+	}
+
+	// top functions by samples taken in them
+	if ( vmSamples ) {
+		Com_Printf( "%4s %8s Function Name\n", "Self", "Samples" );
+		for ( k = 0; k < 15; k++ ) {
+			for ( i = 1, j = 0; i < numSorted; i++ ) {
+				if ( self[i] > self[j] ) {
+					j = i;
+				}
+			}
+			if ( !numSorted || !self[j] ) {
+				break;
+			}
+			Com_Printf( "%3i%% %8i %s\n", 100 * self[j] / vmSamples, self[j], sorted[j]->symName );
+			self[j] = 0;
+		}
+	}
+
+	// syscalls by time spent in them, nested vm calls included
+	Com_Printf( "%8s %8s Syscall\n", "msec", "Calls" );
+	for ( k = 0; k < 15; k++ ) {
+		for ( i = 1, j = 0; i < VM_SAMPLE_SYSCALLS; i++ ) {
+			if ( vm_sampler.syscallTime[i] > vm_sampler.syscallTime[j] ) {
+				j = i;
+			}
+		}
+		if ( !vm_sampler.syscallCalls[j] ) {
+			break;
+		}
+		Com_Printf( "%8i %8i %s\n", (int)( vm_sampler.syscallTime[j] / 1000 ),
+			vm_sampler.syscallCalls[j], VM_SyscallName( vm, ~j ) );
+		vm_sampler.syscallTime[j] = -1;
+		vm_sampler.syscallCalls[j] = 0;
+	}
+
+	Z_Free( self );
+	Z_Free( sorted );
+}
+
+/*
+==============
+VM_VmSample_f
+
+==============
+*/
+void VM_VmSample_f( void ) {
+	static vm_t	*sampledVM;
+	vm_t		*vm = NULL;
+	const char	*arg;
+	int			hz;
+	int			i;
+
+	arg = Cmd_Argv( 1 );
+
+	if ( !Q_stricmp( arg, "start" ) ) {
+		if ( Cmd_Argc() >= 3 ) {
+			for ( i = 0; i < MAX_VM; i++ ) {
+				if ( !Q_stricmp( Cmd_Argv(2), vmTable[i].name ) ) {
+					vm = &vmTable[i];
+					break;
+				}
+			}
+		} else {
+			// pick first compiled VM
+			for ( i = 0; i < MAX_VM; i++ ) {
+				if ( vmTable[i].compiled && !vmTable[i].dllHandle ) {
+					vm = &vmTable[i];
+					break;
+				}
+			}
+		}
+
+		if ( !vm || !vm->compiled || vm->dllHandle ) {
+			Com_Printf( "Only compiled VM can be sampled\n" );
+			return;
+		}
+
+		hz = Cmd_Argc() >= 4 ? atoi( Cmd_Argv(3) ) : 1000;
+		hz = Com_Clampi( 10, 10000, hz );
+
+		if ( VM_StartSampling( vm, hz, VM_MAX_SAMPLES ) ) {
+			sampledVM = vm;
+			Com_Printf( "Sampling %s %i times per second of cpu time...\n", vm->name, hz );
+		}
+		return;
+	}
+
+	if ( !Q_stricmp( arg, "stop" ) ) {
+		if ( !vm_sampler.vm ) {
+			Com_Printf( "Not sampling\n" );
+			return;
+		}
+
+		VM_StopSampling();
+		VM_WriteSamples( sampledVM );
+		Z_Free( vm_sampler.samples );
+		vm_sampler.samples = NULL;
+		return;
+	}
+
+	Com_Printf( "Usage: vmsample start [vm] [hz]  start sampling compiled vm call stacks\n" );
+	Com_Printf( "       vmsample stop             write vmsample_<vm>.folded for flamegraph.pl\n" );
+}
+#endif
+
 /*
 ==============
 VM_VmInfo_f
@@ -1260,7 +1607,7 @@ void VM_VmInfo_f( void ) {
 			Com_Printf( "native\n" );
 		} else {
 			if (vm->compiled) {
-				Com_Printf("compiled on load\n");
+				Com_Printf("compiled on load (tier %i)\n", vm->jitTier);
 			} else {
 				Com_Printf("interpreted\n");
 			}
@@ -1277,6 +1624,261 @@ void VM_VmInfo_f( void ) {
 	}
 }
 
+typedef struct {
+	qboolean	compiled;
+	int			jitTier;
+	byte		*codeBase;
+	int			codeLength;
+	int			entryOfs;
+	int			callProcOfs;
+	int			callProcOfsSyscall;
+	intptr_t	*instructionPointers;
+	void		(*destroy)( vm_t *self );
+
+	qboolean	available;
+	int64_t		usec;
+	int			mismatches;		// frames whose output differed from the variant before
+} vmBenchCode_t;
+
+#define	MAX_BENCH_VARIANTS	3
+
+typedef struct {
+	vm_t			*vm;
+	vmBenchCode_t	current;
+	vmBenchCode_t	variants[MAX_BENCH_VARIANTS];
+	byte			*snapshot;		// data segment before the bench
+	byte			*output;		// data segment after the last variant's frame
+} vmBench_t;
+
+static vmBench_t	vm_bench;
+
+static void VM_StoreBenchCode( const vm_t *vm, vmBenchCode_t *c ) {
+	c->compiled = vm->compiled;
+	c->jitTier = vm->jitTier;
+	c->codeBase = vm->codeBase;
+	c->codeLength = vm->codeLength;
+	c->entryOfs = vm->entryOfs;
+	c->callProcOfs = vm->callProcOfs;
+	c->callProcOfsSyscall = vm->callProcOfsSyscall;
+	c->instructionPointers = vm->instructionPointers;
+	c->destroy = vm->destroy;
+}
+
+static void VM_LoadBenchCode( vm_t *vm, const vmBenchCode_t *c ) {
+	vm->compiled = c->compiled;
+	vm->jitTier = c->jitTier;
+	vm->codeBase = c->codeBase;
+	vm->codeLength = c->codeLength;
+	vm->entryOfs = c->entryOfs;
+	vm->callProcOfs = c->callProcOfs;
+	vm->callProcOfsSyscall = c->callProcOfsSyscall;
+	vm->instructionPointers = c->instructionPointers;
+	vm->destroy = c->destroy;
+}
+
+/*
+==============
+VM_EndBench
+
+Puts the vm's own code back and frees everything VM_Bench built. Also
+called from VM_Free, so an error in the middle of a bench doesn't leave
+the vm running a variant.
+==============
+*/
+static void VM_EndBench( const vm_t *vm ) {
+	vm_t	scratch;
+	int		i;
+
+	if ( !vm || vm_bench.vm != vm ) {
+		return;
+	}
+
+	VM_LoadBenchCode( vm_bench.vm, &vm_bench.current );
+	vm_bench.vm->countInstructions = qfalse;
+
+	for ( i = 0 ; i < MAX_BENCH_VARIANTS ; i++ ) {
+		vmBenchCode_t *c = &vm_bench.variants[i];
+
+		Com_Memset( &scratch, 0, sizeof( scratch ) );
+		VM_LoadBenchCode( &scratch, c );
+		if ( scratch.destroy ) {
+			scratch.destroy( &scratch );
+		} else if ( scratch.codeBase ) {
+			Z_Free( scratch.codeBase );
+		}
+		if ( scratch.instructionPointers ) {
+			Z_Free( scratch.instructionPointers );
+		}
+	}
+
+	if ( vm_bench.snapshot ) {
+		Z_Free( vm_bench.snapshot );
+	}
+	if ( vm_bench.output ) {
+		Z_Free( vm_bench.output );
+	}
+	Com_Memset( &vm_bench, 0, sizeof( vm_bench ) );
+}
+
+/*
+==============
+VM_Bench
+
+Builds the interpreter and every compiler tier for a bytecode vm next to the
+code it is running with, calls vmMain( callnum, arg ) frames times on each of
+them and prints how fast they went.
+
+The data segment is saved first and put back before every call and at the
+end, so each variant runs the same frame from the same state and the vm is
+left as it was. restore is called after that to roll back the engine side
+of the module, it may be NULL. Compiled code doesn't count instructions, its
+rate is based on the count the interpreter needed for the same frames.
+
+Each variant's data segment below the stack is compared with the one the
+variant before it left, a difference means a compiler tier changed what the
+code does.
+==============
+*/
+void VM_Bench( vm_t *vm, int frames, int callnum, int arg, void (*restore)( void ) ) {
+	static const char	*names[MAX_BENCH_VARIANTS] = { "interpreter", "jit tier 1", "jit tier 2" };
+	vmBenchCode_t	*variants = vm_bench.variants;
+	vmBenchCode_t	results[MAX_BENCH_VARIANTS];
+	vmHeader_t		*header;
+	vm_t			scratch;
+	int				numVariants, previous, dataLength;
+	int64_t			instructions, start;
+	intptr_t		result, previousResult;
+	qboolean		pass;
+	int				i, n;
+
+	if ( !vm || vm->dllHandle ) {
+		Com_Printf( "vm is not a qvm\n" );
+		return;
+	}
+
+	if ( vm->callLevel ) {
+		Com_Printf( "%s is running\n", vm->name );
+		return;
+	}
+
+	header = VM_ReadQVMHeader( vm->name );
+	if ( !header ) {
+		return;
+	}
+
+	if ( header->instructionCount != vm->instructionCount ) {
+		Com_Printf( "vm/%s.qvm changed since it was loaded\n", vm->name );
+		FS_FreeFile( header );
+		return;
+	}
+
+#ifdef NO_VM_COMPILED
+	numVariants = 1;
+#else
+	numVariants = MAX_BENCH_VARIANTS;
+#endif
+
+	VM_EndBench( vm_bench.vm );
+	vm_bench.vm = vm;
+	VM_StoreBenchCode( vm, &vm_bench.current );
+
+	// build the variants in a copy of the vm, an error while compiling
+	// leaves the vm itself untouched and VM_EndBench frees what was built
+	for ( i = 0 ; i < numVariants ; i++ ) {
+		scratch = *vm;
+		scratch.instructionPointers = (intptr_t *)Z_Malloc( vm->instructionCount * sizeof( *vm->instructionPointers ), TAG_VM, qtrue );
+		scratch.codeLength = header->codeLength;
+		scratch.codeBase = NULL;
+		scratch.destroy = NULL;
+		VM_StoreBenchCode( &scratch, &variants[i] );
+
+		if ( i == 0 ) {
+			scratch.compiled = qfalse;
+			scratch.codeBase = (byte *)Z_Malloc( header->codeLength * 4, TAG_VM, qtrue );
+			variants[i].codeBase = scratch.codeBase;
+			VM_PrepareInterpreter( &scratch, header );
+		}
+#ifndef NO_VM_COMPILED
+		else {
+			scratch.compiled = qtrue;
+			scratch.jitTier = i;
+			VM_Compile( &scratch, header );
+		}
+#endif
+
+		VM_StoreBenchCode( &scratch, &variants[i] );
+		// a tier that isn't supported falls back to a lower one
+		variants[i].available = (qboolean)( !scratch.compiled || scratch.jitTier == i );
+	}
+
+	FS_FreeFile( header );
+
+	dataLength = vm->dataMask + 1;
+	vm_bench.snapshot = (byte *)Z_Malloc( dataLength, TAG_TEMP_WORKSPACE, qfalse );
+	vm_bench.output = (byte *)Z_Malloc( vm->stackBottom, TAG_TEMP_WORKSPACE, qfalse );
+	Com_Memcpy( vm_bench.snapshot, vm->dataBase, dataLength );
+
+	vm->countInstructions = qtrue;
+	vm->instructionsRun = 0;
+	previousResult = 0;
+	for ( n = 0 ; n < frames ; n++ ) {
+		previous = -1;
+		for ( i = 0 ; i < numVariants ; i++ ) {
+			if ( !variants[i].available ) {
+				continue;
+			}
+
+			Com_Memcpy( vm->dataBase, vm_bench.snapshot, dataLength );
+			if ( restore ) {
+				restore();
+			}
+
+			VM_LoadBenchCode( vm, &variants[i] );
+			start = Sys_Microseconds();
+			result = VM_Call( vm, callnum, arg );
+			variants[i].usec += Sys_Microseconds() - start;
+
+			if ( previous >= 0 && ( result != previousResult || memcmp( vm->dataBase, vm_bench.output, vm->stackBottom ) ) ) {
+				variants[i].mismatches++;
+			}
+			Com_Memcpy( vm_bench.output, vm->dataBase, vm->stackBottom );
+			previousResult = result;
+			previous = i;
+		}
+	}
+	instructions = vm->instructionsRun;
+
+	Com_Memcpy( vm->dataBase, vm_bench.snapshot, dataLength );
+	Com_Memcpy( results, variants, sizeof( results ) );
+	variants = results;
+	VM_EndBench( vm );
+	if ( restore ) {
+		restore();
+	}
+
+	Com_Printf( "%s: %i frames, %.0f instructions/frame\n", vm->name, frames, (double)instructions / frames );
+	pass = qtrue;
+	previous = -1;
+	for ( i = 0 ; i < numVariants ; i++ ) {
+		if ( !variants[i].available ) {
+			Com_Printf( "%-12s: not available\n", names[i] );
+			continue;
+		}
+		Com_Printf( "%-12s: %8.3f msec/frame, %8.1f M instructions/sec", names[i],
+			variants[i].usec / 1000.0 / frames,
+			variants[i].usec ? (double)instructions / variants[i].usec : 0.0 );
+		if ( previous >= 0 ) {
+			Com_Printf( ", output differs from %s in %i frames", names[previous], variants[i].mismatches );
+			if ( variants[i].mismatches ) {
+				pass = qfalse;
+			}
+		}
+		Com_Printf( "\n" );
+		previous = i;
+	}
+	Com_Printf( "vmbench: %s\n", pass ? "PASS" : "FAIL" );
+}
+
 /*
 ===============
 VM_LogSyscalls
@@ -1296,6 +1898,172 @@ void VM_LogSyscalls( int *args ) {
 		args[0], args[1], args[2], args[3], args[4] );
 }
 
+/*
+===============
+VM_CountSyscall
+
+VM_SystemCall while vmsyscalls is counting
+===============
+*/
+intptr_t VM_CountSyscall( vm_t *vm, intptr_t *args ) {
+	vmSyscallStat_t	*stat;
+	int64_t			start, nsec;
+	intptr_t		r;
+	int				saved, num, bucket;
+
+	num = (int)args[0];
+	if ( num < 0 || num >= VM_SYSCALL_STATS ) {
+		return vm->systemCall( args );
+	}
+
+	// syscalls may enter the vm again and make syscalls of their own
+	saved = vm->syscallCurrent;
+	vm->syscallCurrent = num;
+
+	start = Sys_Nanoseconds();
+	r = vm->systemCall( args );
+	nsec = Sys_Nanoseconds() - start;
+
+	vm->syscallCurrent = saved;
+
+	// counting may have been stopped by the syscall itself
+	if ( !vm->syscallStats ) {
+		return r;
+	}
+
+	for ( bucket = 0; bucket < VM_SYSCALL_BUCKETS - 1 && nsec >= ( 256 << bucket ); bucket++ ) {
+	}
+
+	stat = &vm->syscallStats[num];
+	stat->calls++;
+	stat->nsec += nsec;
+	stat->histogram[bucket]++;
+
+	return r;
+}
+
+static int QDECL VM_SyscallStatSort( const void *a, const void *b ) {
+	const vmSyscallStat_t	*sa = *(const vmSyscallStat_t * const *)a;
+	const vmSyscallStat_t	*sb = *(const vmSyscallStat_t * const *)b;
+
+	if ( sa->nsec < sb->nsec ) {
+		return 1;
+	}
+	if ( sa->nsec > sb->nsec ) {
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+===============
+VM_SyscallPercentile
+
+Upper bound of the histogram bucket the given fraction of calls falls into
+===============
+*/
+static int VM_SyscallPercentile( const vmSyscallStat_t *stat, int percent ) {
+	int		i, count, target;
+
+	target = (int)( (int64_t)stat->calls * percent / 100 );
+	for ( i = 0, count = 0; i < VM_SYSCALL_BUCKETS - 1; i++ ) {
+		count += stat->histogram[i];
+		if ( count > target ) {
+			break;
+		}
+	}
+
+	return 256 << i;
+}
+
+/*
+==============
+VM_VmSyscalls_f
+
+==============
+*/
+void VM_VmSyscalls_f( void ) {
+	vmSyscallStat_t	*sorted[VM_SYSCALL_STATS];
+	vmSyscallStat_t	*stat;
+	vm_t			*vm = NULL;
+	const char		*arg;
+	int				numSorted;
+	int				i;
+	int64_t			total;
+
+	arg = Cmd_Argv( 1 );
+
+	if ( Cmd_Argc() >= 3 ) {
+		for ( i = 0; i < MAX_VM; i++ ) {
+			if ( !Q_stricmp( Cmd_Argv(2), vmTable[i].name ) ) {
+				vm = &vmTable[i];
+				break;
+			}
+		}
+	} else {
+		// pick first loaded VM
+		for ( i = 0; i < MAX_VM; i++ ) {
+			if ( vmTable[i].name[0] ) {
+				vm = &vmTable[i];
+				break;
+			}
+		}
+	}
+
+	if ( Q_stricmp( arg, "start" ) && Q_stricmp( arg, "stop" ) && Q_stricmp( arg, "print" ) ) {
+		Com_Printf( "Usage: vmsyscalls start [vm]     start counting syscalls\n" );
+		Com_Printf( "       vmsyscalls print [vm]     print the counts\n" );
+		Com_Printf( "       vmsyscalls stop [vm]      print the counts and stop counting\n" );
+		return;
+	}
+
+	if ( !vm ) {
+		Com_Printf( "No such VM\n" );
+		return;
+	}
+
+	if ( !Q_stricmp( arg, "start" ) ) {
+		if ( !vm->syscallStats ) {
+			vm->syscallStats = (vmSyscallStat_t *)Z_Malloc( VM_SYSCALL_STATS * sizeof( vmSyscallStat_t ), TAG_VM, qtrue );
+		} else {
+			Com_Memset( vm->syscallStats, 0, VM_SYSCALL_STATS * sizeof( vmSyscallStat_t ) );
+		}
+		Com_Printf( "Counting %s syscalls...\n", vm->name );
+		return;
+	}
+
+	if ( !vm->syscallStats ) {
+		Com_Printf( "Not counting %s syscalls\n", vm->name );
+		return;
+	}
+
+	numSorted = 0;
+	total = 0;
+	for ( i = 0; i < VM_SYSCALL_STATS; i++ ) {
+		if ( vm->syscallStats[i].calls ) {
+			sorted[numSorted++] = &vm->syscallStats[i];
+			total += vm->syscallStats[i].nsec;
+		}
+	}
+	qsort( sorted, numSorted, sizeof( sorted[0] ), VM_SyscallStatSort );
+
+	// time includes nested vm calls, checks are the argument validations per call
+	Com_Printf( "%8s %9s %8s %8s %8s %6s Syscall\n", "Calls", "msec", "avg ns", "p50 ns", "p99 ns", "Checks" );
+	for ( i = 0; i < numSorted; i++ ) {
+		stat = sorted[i];
+		Com_Printf( "%8i %9.2f %8i %8i %8i %6.2f %s\n", stat->calls, stat->nsec / 1000000.0,
+			(int)( stat->nsec / stat->calls ), VM_SyscallPercentile( stat, 50 ), VM_SyscallPercentile( stat, 99 ),
+			(float)stat->argChecks / stat->calls, VM_SyscallName( vm, ~(int)( stat - vm->syscallStats ) ) );
+	}
+	Com_Printf( "%8s %9.2f msec total\n", "", total / 1000000.0 );
+
+	if ( !Q_stricmp( arg, "stop" ) ) {
+		Z_Free( vm->syscallStats );
+		vm->syscallStats = NULL;
+	}
+}
+
 /*
 =================
 VM_BlockCopy
@@ -368,7 +368,7 @@ void __attribute__((optimize("O0"))) VM_CompiledSyscall() {
 
     savedvm = currentVM;
     opStack += opStackIndex;
-    *opStack = currentVM->systemCall(args);
+    *opStack = VM_SystemCall(currentVM, args);
     currentVM = savedvm;
 }
 
@@ -380,6 +380,8 @@ void VM_Compile(vm_t *vm, vmHeader_t *header) {
     size_t i, pass;
 	int ic;
 
+    vm->jitTier = 1;    // there is no optimizing tier for ARM
+
 #ifdef __linux__
     FILE *cpuinfo = fopen("/proc/cpuinfo", "rb");
 
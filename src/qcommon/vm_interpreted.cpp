@@ -184,7 +184,9 @@ void VM_PrepareInterpreter( vm_t *vm, vmHeader_t *header ) {
 	int		instruction;
 	int		*codeBase;
 
-	vm->codeBase = (byte *)Hunk_Alloc( vm->codeLength*4, h_high );			// we're now int aligned
+	if ( !vm->codeBase ) {	// VM_Bench brings its own
+		vm->codeBase = (byte *)Hunk_Alloc( vm->codeLength*4, h_high );			// we're now int aligned
+	}
 //	memcpy( vm->codeBase, (byte *)header + header->codeOffset, vm->codeLength );
 
 	// we don't need to translate the instructions, but we still need
@@ -336,6 +338,8 @@ int	VM_CallInterpreted( vm_t *vm, int *args ) {
 	int		v1;
 	int		dataMask;
 	int		arg;
+	int64_t	instructionsRun = 0;
+	const qboolean	countInstructions = vm->countInstructions;
 #ifdef DEBUG_VM
 	vmSymbol_t	*profileSymbol;
 #endif
@@ -391,6 +395,9 @@ nextInstruction:
 		r1 = opStack[(uint8_t) (opStackOfs - 1)];
 nextInstruction2:
 		opcode = codeImage[ programCounter++ ];
+		if ( countInstructions ) {
+			instructionsRun++;
+		}
 
 #ifdef DEBUG_VM
 		if ( (unsigned)programCounter >= (unsigned)vm->codeLength ) {
@@ -518,10 +525,10 @@ nextInstruction2:
 						for (size_t i = 0; i < ARRAY_LEN(argarr); ++i) {
 							argarr[i] = *(++imagePtr);
 						}
-						r = vm->systemCall( argarr );
+						r = VM_SystemCall( vm, argarr );
 					} else {
 						intptr_t* argptr = (intptr_t *)&image[ programStack + 4 ];
-						r = vm->systemCall( argptr );
+						r = VM_SystemCall( vm, argptr );
 					}
 				}
 
@@ -919,6 +926,7 @@ nextInstruction2:
 
 done:
 	vm->currentlyInterpreting = qfalse;
+	vm->instructionsRun += instructionsRun;
 
 	if (opStackOfs != 1 || *(unsigned *)opStack != 0xDEADBEEFu)
 		Com_Error(ERR_DROP, "Interpreter error: opStack[0] = %X, opStackOfs = %d", opStack[0], opStackOfs);
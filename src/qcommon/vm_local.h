@@ -143,6 +143,16 @@ typedef struct vmSymbol_s {
 	char	symName[1];		// variable sized
 } vmSymbol_t;
 
+#define VM_SYSCALL_STATS	1024
+#define VM_SYSCALL_BUCKETS	16		// bucket i counts calls that took less than 256 << i nsec
+
+typedef struct {
+	int			calls;
+	int			argChecks;		// argument validations done by VM_Arg*
+	int64_t		nsec;
+	int			histogram[VM_SYSCALL_BUCKETS];
+} vmSyscallStat_t;
+
 #define	VM_OFFSET_PROGRAM_STACK		0
 #define	VM_OFFSET_SYSTEM_CALL		4
 
@@ -167,6 +177,7 @@ struct vm_s {
 	qboolean	currentlyInterpreting;
 
 	qboolean	compiled;
+	int			jitTier;			// vm_jitTier the code was compiled with
 	byte		*codeBase;
 	int			entryOfs;
 	int			callProcOfs;
@@ -184,11 +195,18 @@ struct vm_s {
 	int			numSymbols;
 	vmSymbol_t	*symbols;
 	vmSymbol_t	**symbolTable;
+	vmSymbol_t	*syscallSymbols;	// symValue is the negative call number
 
 	int			callLevel;		// counts recursive VM_Call
 	int			breakFunction;		// increment breakCount on function entry to this
 	int			breakCount;
 
+	qboolean	countInstructions;	// set by VM_Bench
+	int64_t		instructionsRun;	// by the interpreter, for VM_Bench
+
+	vmSyscallStat_t	*syscallStats;		// vmsyscalls, NULL when not counting
+	int			syscallCurrent;
+
 	byte		*jumpTableTargets;
 	int			numJumpTableTargets;
 
@@ -213,5 +231,54 @@ int VM_SymbolToValue( vm_t *vm, const char *symbol );
 const char *VM_ValueToSymbol( vm_t *vm, int value );
 const char *VM_SymbolForCompiledPointer( void *code );
 void VM_LogSyscalls( int *args );
+intptr_t VM_CountSyscall( vm_t *vm, intptr_t *args );
+const char *VM_SyscallName( vm_t *vm, int value );
+
+// every syscall of a vm goes through here
+static ID_INLINE intptr_t VM_SystemCall( vm_t *vm, intptr_t *args ) {
+	if ( vm->syscallStats ) {
+		return VM_CountSyscall( vm, args );
+	}
+
+	return vm->systemCall( args );
+}
 
 void VM_BlockCopy(unsigned int dest, unsigned int src, size_t n);
+
+#if defined(__linux__) && (id386 || idx64)
+#define VM_SAMPLING		// vmsample, compiled x86 code on linux only
+
+#define VM_SAMPLE_DEPTH		32
+#define VM_SAMPLE_LEVELS	8		// nested syscalls a sample can walk through
+#define VM_SAMPLE_SYSCALLS	1024
+
+typedef struct {
+	int			depth;
+	int			frames[VM_SAMPLE_DEPTH];	// leaf first, code offsets or negative syscall numbers
+} vmSample_t;
+
+typedef struct {
+	vm_t		*vm;
+
+	vmSample_t	*samples;
+	int			maxSamples;
+	volatile int	numSamples;
+	volatile int	engineSamples;		// taken outside the vm
+	volatile int	droppedSamples;
+	volatile int	otherThreadSamples;	// the signal hit another thread
+	int			startTime;
+
+	// syscalls the sampled vm is in, written by DoSyscall
+	volatile int	syscallDepth;
+	void		*syscallFrame[VM_SAMPLE_LEVELS];
+	int			syscallNum[VM_SAMPLE_LEVELS];
+
+	int64_t		syscallTime[VM_SAMPLE_SYSCALLS];	// usec, including nested vm calls
+	int			syscallCalls[VM_SAMPLE_SYSCALLS];
+} vmSampler_t;
+
+extern	vmSampler_t	vm_sampler;
+
+qboolean VM_StartSampling( vm_t *vm, int hz, int maxSamples );
+void VM_StopSampling( void );
+#endif
@@ -44,6 +44,14 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
   #endif
 #endif
 
+#ifdef VM_SAMPLING
+  #include <atomic>
+  #include <signal.h>
+  #include <pthread.h>
+  #include <ucontext.h>
+  #include <sys/time.h>
+#endif
+
 static void VM_Destroy_Compiled(vm_t* self);
 
 /*
@@ -60,6 +68,9 @@ x86_64:
 
 */
 
+// entries the optimizing tier may keep above the opStack top in registers
+#define OPT_MAX_DEPTH	8
+
 #define VMFREE_BUFFERS() do {Z_Free(buf); Z_Free(jused);} while(0)
 static	byte	*buf = NULL;
 static	byte	*jused = NULL;
@@ -406,16 +417,43 @@ int vm_programStack;
 int *vm_opStackBase;
 uint8_t vm_opStackOfs;
 intptr_t vm_arg;
+void *vm_syscallFrame;
 
 void DoSyscall(void)
 {
 	vm_t *savedVM;
+#ifdef VM_SAMPLING
+	int syscallNum = vm_syscallNum;
+	int64_t start = 0;
+	qboolean sampled = qfalse;
+#endif
 
 	// save currentVM so as to allow for recursive VM entry
 	savedVM = currentVM;
 	// modify VM stack pointer for recursive VM entry
 	currentVM->programStack = vm_programStack - 4;
 
+#ifdef VM_SAMPLING
+	if(vm_sampler.vm == savedVM && syscallNum < 0)
+	{
+		int level = vm_sampler.syscallDepth;
+
+		// the frame has to be in place before a sample can see the new depth
+		if(level < VM_SAMPLE_LEVELS)
+		{
+			vm_sampler.syscallFrame[level] = vm_syscallFrame;
+			vm_sampler.syscallNum[level] = syscallNum;
+		}
+		// keeps the compiler from sinking the stores above past this one,
+		// the handler runs on this thread so no cpu fence is needed
+		std::atomic_signal_fence(std::memory_order_release);
+		vm_sampler.syscallDepth = level + 1;
+
+		sampled = qtrue;
+		start = Sys_Microseconds();
+	}
+#endif
+
 	if(vm_syscallNum < 0)
 	{
 		int *data;
@@ -430,10 +468,10 @@ void DoSyscall(void)
 		for(size_t index = 1; index < ARRAY_LEN(args); index++)
 			args[index] = data[index];
 
-		vm_opStackBase[vm_opStackOfs + 1] = savedVM->systemCall(args);
+		vm_opStackBase[vm_opStackOfs + 1] = VM_SystemCall(savedVM, args);
 #else
 		data[0] = ~vm_syscallNum;
-		vm_opStackBase[vm_opStackOfs + 1] = savedVM->systemCall((intptr_t *) data);
+		vm_opStackBase[vm_opStackOfs + 1] = VM_SystemCall(savedVM, (intptr_t *) data);
 #endif
 	}
 	else
@@ -455,6 +493,22 @@ void DoSyscall(void)
 		}
 	}
 
+#ifdef VM_SAMPLING
+	// sampling may have been stopped by the syscall itself
+	if(sampled && vm_sampler.vm == savedVM)
+	{
+		int num = ~syscallNum;
+
+		if(num < VM_SAMPLE_SYSCALLS)
+		{
+			vm_sampler.syscallTime[num] += Sys_Microseconds() - start;
+			vm_sampler.syscallCalls[num]++;
+		}
+		if(vm_sampler.syscallDepth > 0)
+			vm_sampler.syscallDepth--;
+	}
+#endif
+
 	currentVM = savedVM;
 }
 
@@ -502,6 +556,10 @@ int EmitCallDoSyscall(vm_t *vm)
 	// syscall number
 	EmitString("A3");			// mov [0x12345678], eax
 	EmitPtr(&vm_syscallNum);
+	// frame of this procedure, its return address leads back into the calling function
+	EmitRexString(0x48, "89 E8");		// mov eax, ebp
+	EmitRexString(0x48, "A3");		// mov [0x12345678], eax
+	EmitPtr(&vm_syscallFrame);
 	// vm_programStack value
 	EmitString("89 F0");			// mov eax, esi
 	EmitString("A3");			// mov [0x12345678], eax
@@ -1074,21 +1132,17 @@ qboolean ConstOptimize(vm_t *vm, int callProcOfsSyscall)
 
 /*
 =================
-VM_Compile
+VM_BeginCompile
+Allocates the temp buffers and emits the x86-VM specific procedures both tiers
+start with, returns the offset of the DoSyscall procedure
 =================
 */
-void VM_Compile(vm_t *vm, vmHeader_t *header)
+static int VM_BeginCompile(vm_t *vm, vmHeader_t *header, int maxLength)
 {
-	int		op;
-	int		maxLength;
-	int		v;
-	int		i;
-        int		callProcOfsSyscall, callProcOfs, callDoSyscallOfs;
+	int		callDoSyscallOfs;
 
 	jusedSize = header->instructionCount + 2;
 
-	// allocate a very large temp buffer, we will shrink it later
-	maxLength = header->codeLength * 8 + 64;
 	buf = (byte *)Z_Malloc(maxLength, TAG_VM, qtrue);
 	jused = (byte *)Z_Malloc(jusedSize, TAG_VM, qtrue);
 	code = (byte *)Z_Malloc(header->codeLength + 32, TAG_VM, qtrue);
@@ -1102,212 +1156,1272 @@ void VM_Compile(vm_t *vm, vmHeader_t *header)
 	Com_Memset(code, 0, header->codeLength+32);
 	Com_Memcpy(code, (byte *)header + header->codeOffset, header->codeLength );
 
-	// ensure that the optimisation pass knows about all the jump
-	// table targets
-	pc = -1; // a bogus value to be printed in out-of-bounds error messages
-	for( i = 0; i < vm->numJumpTableTargets; i++ ) {
-		JUSED( *(int *)(vm->jumpTableTargets + ( i * sizeof( int ) ) ) );
-	}
-
 	// Start buffer with x86-VM specific procedures
 	compiledOfs = 0;
 
 	callDoSyscallOfs = compiledOfs;
-	callProcOfs = EmitCallDoSyscall(vm);
-	callProcOfsSyscall = EmitCallProcedure(vm, callDoSyscallOfs);
+	vm->callProcOfs = EmitCallDoSyscall(vm);
+	vm->callProcOfsSyscall = EmitCallProcedure(vm, callDoSyscallOfs);
 	vm->entryOfs = compiledOfs;
-	vm->callProcOfs = callProcOfs;
-	vm->callProcOfsSyscall = callProcOfsSyscall;
 
-	for(pass=0; pass < 3; pass++) {
-	oc0 = -23423;
-	oc1 = -234354;
-	pop0 = -43435;
-	pop1 = -545455;
+	return callDoSyscallOfs;
+}
 
-	// translate all instructions
-	pc = 0;
-	instruction = 0;
-	//code = (byte *)header + header->codeOffset;
-	compiledOfs = vm->entryOfs;
+/*
+=================
+VM_EndCompile
+Moves the translated code to executable memory and frees the temp buffers
+=================
+*/
+static void VM_EndCompile(vm_t *vm, vmHeader_t *header)
+{
+	int		i;
 
-	LastCommand = LAST_COMMAND_NONE;
+	// copy to an exact sized buffer with the appropriate permission bits
+	vm->codeLength = compiledOfs;
+#ifdef VM_X86_MMAP
+	vm->codeBase = (byte *)mmap(NULL, compiledOfs, PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if(vm->codeBase == MAP_FAILED)
+		Com_Error(ERR_FATAL, "VM_CompileX86: can't mmap memory");
+#elif _WIN32
+	// allocate memory with EXECUTE permissions under windows.
+	vm->codeBase = (byte*)VirtualAlloc(NULL, compiledOfs, MEM_COMMIT, PAGE_EXECUTE_READWRITE);
+	if(!vm->codeBase)
+		Com_Error(ERR_FATAL, "VM_CompileX86: VirtualAlloc failed");
+#else
+	vm->codeBase = malloc(compiledOfs);
+	if(!vm->codeBase)
+	        Com_Error(ERR_FATAL, "VM_CompileX86: malloc failed");
+#endif
 
-	while(instruction < header->instructionCount)
+	Com_Memcpy( vm->codeBase, buf, compiledOfs );
+
+#ifdef VM_X86_MMAP
+	if(mprotect(vm->codeBase, compiledOfs, PROT_READ|PROT_EXEC))
+		Com_Error(ERR_FATAL, "VM_CompileX86: mprotect failed");
+#elif _WIN32
 	{
-		if(compiledOfs > maxLength - 16)
-		{
-	        	VMFREE_BUFFERS();
-			Com_Error(ERR_DROP, "VM_CompileX86: maxLength exceeded");
-		}
+		DWORD oldProtect = 0;
 
-		vm->instructionPointers[ instruction ] = compiledOfs;
+		// remove write permissions.
+		if(!VirtualProtect(vm->codeBase, compiledOfs, PAGE_EXECUTE_READ, &oldProtect))
+			Com_Error(ERR_FATAL, "VM_CompileX86: VirtualProtect failed");
+	}
+#endif
 
-		if ( !vm->jumpTableTargets )
-			jlabel = 1;
-		else
-			jlabel = jused[ instruction ];
+	Z_Free( code );
+	Z_Free( buf );
+	Z_Free( jused );
+	Com_Printf( "VM file %s compiled to %i bytes of code (tier %i)\n", vm->name, compiledOfs, vm->jitTier );
 
-		instruction++;
+	vm->destroy = VM_Destroy_Compiled;
 
-		if(pc > header->codeLength)
-		{
-		        VMFREE_BUFFERS();
-			Com_Error(ERR_DROP, "VM_CompileX86: pc > header->codeLength");
-		}
+	// offset all the instruction pointers for the new location
+	for ( i = 0 ; i < header->instructionCount ; i++ ) {
+		vm->instructionPointers[i] += (intptr_t) vm->codeBase;
+	}
+}
 
-		op = code[ pc ];
-		pc++;
-		switch ( op ) {
-		case 0:
-			break;
-		case OP_BREAK:
-			EmitString("CC");				// int 3
-			break;
-		case OP_ENTER:
-			// save frame pointer
-			EmitString("55");					// push ebp
-			EmitRexString(0x48, "89 E5");		// mov ebp, esp
-			EmitString("81 EE");				// sub esi, 0x12345678
-			Emit4(Constant4());
-			break;
-		case OP_CONST:
-			if(ConstOptimize(vm, callProcOfsSyscall))
-				break;
+#if idx64
+/*
+==============================================================================
 
-			EmitPushStack(vm);
-			EmitString("C7 04 9F");				// mov dword ptr [edi + ebx * 4], 0x12345678
-			lastConst = Constant4();
+Optimizing tier (vm_jitTier 2, x86_64 only)
 
-			Emit4(lastConst);
-			if(code[pc] == OP_JUMP)
-				JUSED(lastConst);
+VM_Compile translates every opcode into loads and stores through the opStack
+in memory. This tier keeps the topmost opStack entries of a basic block in a
+small virtual stack instead, as constants, as not yet computed OP_LOCAL
+addresses or in registers. Constants and locals fold into immediates and
+address modes, compares are fused with their branches and the memory opStack
+is only brought up to date at block boundaries: jump labels, branches, calls,
+returns and block copies.
 
-			break;
-		case OP_LOCAL:
-			EmitPushStack(vm);
-			EmitString("8D 86");				// lea eax, [0x12345678 + esi]
-			oc0 = oc1;
-			oc1 = Constant4();
-			Emit4(oc1);
-			EmitCommand(LAST_COMMAND_MOV_STACK_EAX);	// mov dword ptr [edi + ebx * 4], eax
-			break;
-		case OP_ARG:
-			EmitMovEAXStack(vm, 0);				// mov eax, dword ptr [edi + ebx * 4]
-			EmitString("8B D6");				// mov edx, esi
-			EmitString("81 C2");				// add edx, 0x12345678
-			Emit4((Constant1() & 0xFF));
-			MASK_REG("E2", vm->dataMask);			// and edx, 0x12345678
-#if idx64
-			EmitRexString(0x41, "89 04 11");		// mov dword ptr [r9 + edx], eax
-#else
-			EmitString("89 82");				// mov dword ptr [edx + 0x12345678], eax
-			Emit4((intptr_t) vm->dataBase);
-#endif
-			EmitCommand(LAST_COMMAND_SUB_BL_1);		// sub bl, 1
-			break;
-		case OP_CALL:
-			EmitCallRel(vm, callProcOfs);
-			break;
-		case OP_PUSH:
-			EmitPushStack(vm);
-			break;
-		case OP_POP:
-			EmitCommand(LAST_COMMAND_SUB_BL_1);		// sub bl, 1
-			break;
-		case OP_LEAVE:
-			v = Constant4();
-			EmitString("81 C6");				// add	esi, 0x12345678
-			Emit4(v);
-			// Restore frame pointer
-			EmitString("5D");				// pop ebp
-			EmitString("C3");				// ret
-			break;
-		case OP_LOAD4:
-			if (code[pc] == OP_CONST && code[pc+5] == OP_ADD && code[pc+6] == OP_STORE4)
-			{
-				if(oc0 == oc1 && pop0 == OP_LOCAL && pop1 == OP_LOCAL)
-				{
-					compiledOfs -= 12;
-					vm->instructionPointers[instruction - 1] = compiledOfs;
-				}
+  r10d-r15d	cached opStack entries
+  eax, ecx, edx	scratch (divisions, shifts, computed jumps)
+  xmm0, xmm1	float scratch
 
-				pc++;				// OP_CONST
-				v = Constant4();
+All other registers are used the same way as in tier 1.
 
-				EmitMovEDXStack(vm, vm->dataMask);
-				if(v == 1 && oc0 == oc1 && pop0 == OP_LOCAL && pop1 == OP_LOCAL)
-				{
-#if idx64
-					EmitRexString(0x41, "FF 04 11");	// inc dword ptr [r9 + edx]
-#else
-					EmitString("FF 82");			// inc dword ptr [edx + 0x12345678]
-					Emit4((intptr_t) vm->dataBase);
-#endif
-				}
-				else
-				{
-#if idx64
-					EmitRexString(0x41, "8B 04 11");	// mov eax, dword ptr [r9 + edx]
-#else
-					EmitString("8B 82");			// mov eax, dword ptr [edx + 0x12345678]
-					Emit4((intptr_t) vm->dataBase);
-#endif
-					EmitString("05");			// add eax, v
-					Emit4(v);
+==============================================================================
+*/
 
-					if (oc0 == oc1 && pop0 == OP_LOCAL && pop1 == OP_LOCAL)
-					{
-#if idx64
-						EmitRexString(0x41, "89 04 11");	// mov dword ptr [r9 + edx], eax
-#else
-						EmitString("89 82");			// mov dword ptr [edx + 0x12345678], eax
-						Emit4((intptr_t) vm->dataBase);
-#endif
-					}
-					else
-					{
-						EmitCommand(LAST_COMMAND_SUB_BL_1);	// sub bl, 1
-						EmitString("8B 14 9F");			// mov edx, dword ptr [edi + ebx * 4]
-						MASK_REG("E2", vm->dataMask);		// and edx, 0x12345678
-#if idx64
-						EmitRexString(0x41, "89 04 11");	// mov dword ptr [r9 + edx], eax
-#else
-						EmitString("89 82");			// mov dword ptr [edx + 0x12345678], eax
-						Emit4((intptr_t) vm->dataBase);
-#endif
-					}
-				}
+#define OPT_FIRST_REG	10
+#define OPT_NUM_REGS	6
 
-				EmitCommand(LAST_COMMAND_SUB_BL_1);		// sub bl, 1
-				pc++;						// OP_ADD
-				pc++;						// OP_STORE
-				instruction += 3;
-				break;
-			}
+#define OPT_EAX		0
+#define OPT_ECX		1
+#define OPT_EDX		2
+#define OPT_ESI		6
+#define OPT_R9		9
 
-			if(code[pc] == OP_CONST && code[pc+5] == OP_SUB && code[pc+6] == OP_STORE4)
-			{
-				if(oc0 == oc1 && pop0 == OP_LOCAL && pop1 == OP_LOCAL)
-				{
-					compiledOfs -= 12;
-					vm->instructionPointers[instruction - 1] = compiledOfs;
-				}
+typedef enum
+{
+	OPT_CONST,		// value is a constant
+	OPT_LOCAL,		// value is programStack + constant
+	OPT_REG			// value is in a register
+} optKind_t;
 
-				pc++;					// OP_CONST
-				v = Constant4();
+typedef struct
+{
+	optKind_t	kind;
+	int			value;		// constant, local offset or register number
+} optEntry_t;
 
-				EmitMovEDXStack(vm, vm->dataMask);
-				if(v == 1 && oc0 == oc1 && pop0 == OP_LOCAL && pop1 == OP_LOCAL)
-				{
-#if idx64
-					EmitRexString(0x41, "FF 0C 11");	// dec dword ptr [r9 + edx]
-#else
-					EmitString("FF 8A");			// dec dword ptr [edx + 0x12345678]
-					Emit4((intptr_t) vm->dataBase);
-#endif
-				}
-				else
+static	optEntry_t	optStack[OPT_MAX_DEPTH];
+static	int			optDepth;
+static	int			optRegsUsed;
+
+/*
+=================
+OptOpcode
+Emits REX prefix as needed and a one or two byte opcode
+=================
+*/
+static void OptOpcode(int opcode, int reg, int index, int base)
+{
+	int rex = ((reg >> 3) << 2) | ((index >> 3) << 1) | (base >> 3);
+
+	if(rex)
+		Emit1(0x40 | rex);
+	if(opcode > 0xFF)
+		Emit1(opcode >> 8);
+	Emit1(opcode & 0xFF);
+}
+
+// op rm, reg
+static void OptRegReg(int opcode, int reg, int rm)
+{
+	OptOpcode(opcode, reg, 0, rm);
+	Emit1(0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+// 81/83 /ext rm, imm
+static void OptRegImm(int ext, int rm, int imm)
+{
+	if(iss8(imm))
+	{
+		OptRegReg(0x83, ext, rm);
+		Emit1(imm);
+	}
+	else
+	{
+		OptRegReg(0x81, ext, rm);
+		Emit4(imm);
+	}
+}
+
+// mov reg, imm
+static void OptMovImm(int reg, int imm)
+{
+	OptOpcode(0xB8 + (reg & 7), 0, 0, reg);
+	Emit4(imm);
+}
+
+// lea reg, [esi + ofs]
+static void OptLeaLocal(int reg, int ofs)
+{
+	OptOpcode(0x8D, reg, 0, OPT_ESI);
+	Emit1(0x86 | ((reg & 7) << 3));
+	Emit4(ofs);
+}
+
+// op reg, dword ptr disp[edi + ebx * 4]
+static void OptStackSlot(int opcode, int reg, int disp)
+{
+	OptOpcode(opcode, reg, 0, 0);
+	Emit1(0x44 | ((reg & 7) << 3));
+	Emit1(0x9F);
+	Emit1(disp);
+}
+
+// op reg, [r9 + index]
+static void OptDataIndex(int prefix, int opcode, int reg, int index)
+{
+	if(prefix)
+		Emit1(prefix);
+	OptOpcode(opcode, reg, index, OPT_R9);
+	Emit1(0x04 | ((reg & 7) << 3));
+	Emit1(((index & 7) << 3) | (OPT_R9 & 7));
+}
+
+// op reg, [r9 + ofs]
+static void OptDataConst(int prefix, int opcode, int reg, int ofs)
+{
+	if(prefix)
+		Emit1(prefix);
+	OptOpcode(opcode, reg, 0, OPT_R9);
+	Emit1(0x80 | ((reg & 7) << 3) | (OPT_R9 & 7));
+	Emit4(ofs);
+}
+
+// SSE op xmm/reg, xmm/reg with mandatory prefix
+static void OptSSE(int prefix, int opcode, int reg, int rm)
+{
+	Emit1(prefix);
+	OptOpcode(0x0F00 | opcode, reg, 0, rm);
+	Emit1(0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+static void OptMovdToXmm(int xmm, int reg)
+{
+	OptSSE(0x66, 0x6E, xmm, reg);	// movd xmm, reg
+}
+
+static void OptMovdFromXmm(int reg, int xmm)
+{
+	OptSSE(0x66, 0x7E, xmm, reg);	// movd reg, xmm
+}
+
+static void OptFreeReg(int reg)
+{
+	optRegsUsed &= ~(1 << (reg - OPT_FIRST_REG));
+}
+
+static void OptRelease(const optEntry_t *e)
+{
+	if(e->kind == OPT_REG)
+		OptFreeReg(e->value);
+}
+
+/*
+=================
+OptFlush
+Writes the virtual stack out to the opStack in memory
+=================
+*/
+static void OptFlush(void)
+{
+	int i, disp;
+
+	for(i = 0; i < optDepth; i++)
+	{
+		disp = 4 * (i + 1);
+
+		switch(optStack[i].kind)
+		{
+		case OPT_CONST:
+			OptStackSlot(0xC7, 0, disp);		// mov dword ptr disp[edi + ebx * 4], 0x12345678
+			Emit4(optStack[i].value);
+			break;
+		case OPT_LOCAL:
+			OptStackSlot(0x89, OPT_ESI, disp);	// mov dword ptr disp[edi + ebx * 4], esi
+			OptStackSlot(0x81, 0, disp);		// add dword ptr disp[edi + ebx * 4], 0x12345678
+			Emit4(optStack[i].value);
+			break;
+		case OPT_REG:
+			OptStackSlot(0x89, optStack[i].value, disp);	// mov dword ptr disp[edi + ebx * 4], reg
+			OptFreeReg(optStack[i].value);
+			break;
+		}
+	}
+
+	if(optDepth)
+		STACK_PUSH(optDepth);		// add bl, optDepth
+
+	optDepth = 0;
+}
+
+static int OptAllocReg(void)
+{
+	int i;
+
+	for(;;)
+	{
+		for(i = 0; i < OPT_NUM_REGS; i++)
+		{
+			if(!(optRegsUsed & (1 << i)))
+			{
+				optRegsUsed |= 1 << i;
+				return OPT_FIRST_REG + i;
+			}
+		}
+
+		if(!optDepth)
+		{
+			VMFREE_BUFFERS();
+			Com_Error(ERR_DROP, "VM_CompileOptimized: out of registers at offset %d", pc);
+		}
+
+		// all registers are held by the virtual stack, spill it
+		OptFlush();
+	}
+}
+
+static void OptPush(optKind_t kind, int value)
+{
+	if(optDepth == OPT_MAX_DEPTH)
+		OptFlush();
+
+	optStack[optDepth].kind = kind;
+	optStack[optDepth].value = value;
+	optDepth++;
+}
+
+static optEntry_t OptPop(void)
+{
+	optEntry_t e;
+
+	if(optDepth)
+		return optStack[--optDepth];
+
+	e.kind = OPT_REG;
+	e.value = OptAllocReg();
+	OptStackSlot(0x8B, e.value, 0);		// mov reg, dword ptr [edi + ebx * 4]
+	STACK_POP(1);				// sub bl, 1
+
+	return e;
+}
+
+static void OptToReg(optEntry_t *e)
+{
+	int reg;
+
+	if(e->kind == OPT_REG)
+		return;
+
+	reg = OptAllocReg();
+	if(e->kind == OPT_CONST)
+		OptMovImm(reg, e->value);
+	else
+		OptLeaLocal(reg, e->value);
+
+	e->kind = OPT_REG;
+	e->value = reg;
+}
+
+/*
+=================
+OptDataAccess
+Emits op reg, [r9 + (addr & mask)]
+=================
+*/
+static void OptDataAccess(int prefix, int opcode, int reg, optEntry_t *addr, int mask)
+{
+	if(addr->kind == OPT_CONST)
+	{
+		OptDataConst(prefix, opcode, reg, addr->value & mask);
+		return;
+	}
+
+	OptToReg(addr);
+	OptRegImm(4, addr->value, mask);	// and addr, mask
+	OptDataIndex(prefix, opcode, reg, addr->value);
+}
+
+/*
+=================
+OptFold
+Evaluates a binary integer op on two constants
+=================
+*/
+static int OptFold(int op, int a, int b)
+{
+	switch(op)
+	{
+	case OP_ADD:	return (int)((unsigned)a + (unsigned)b);
+	case OP_SUB:	return (int)((unsigned)a - (unsigned)b);
+	case OP_BAND:	return a & b;
+	case OP_BOR:	return a | b;
+	case OP_BXOR:	return a ^ b;
+	case OP_MULI:
+	case OP_MULU:	return (int)((unsigned)a * (unsigned)b);
+	case OP_LSH:	return (int)((unsigned)a << (b & 31));
+	case OP_RSHI:	return a >> (b & 31);
+	case OP_RSHU:	return (int)((unsigned)a >> (b & 31));
+	}
+
+	return 0;
+}
+
+static void OptBinary(int op)
+{
+	optEntry_t a, b;
+
+	b = OptPop();
+	a = OptPop();
+
+	if(a.kind == OPT_CONST && b.kind == OPT_CONST)
+	{
+		OptPush(OPT_CONST, OptFold(op, a.value, b.value));
+		return;
+	}
+
+	if(a.kind == OPT_LOCAL && b.kind == OPT_CONST && (op == OP_ADD || op == OP_SUB))
+	{
+		OptPush(OPT_LOCAL, OptFold(op, a.value, b.value));
+		return;
+	}
+
+	OptToReg(&a);
+
+	if(b.kind == OPT_CONST)
+	{
+		switch(op)
+		{
+		case OP_ADD:	OptRegImm(0, a.value, b.value);	break;	// add a, imm
+		case OP_SUB:	OptRegImm(5, a.value, b.value);	break;	// sub a, imm
+		case OP_BAND:	OptRegImm(4, a.value, b.value);	break;	// and a, imm
+		case OP_BOR:	OptRegImm(1, a.value, b.value);	break;	// or a, imm
+		case OP_BXOR:	OptRegImm(6, a.value, b.value);	break;	// xor a, imm
+		case OP_MULI:
+		case OP_MULU:
+			if(iss8(b.value))
+			{
+				OptRegReg(0x6B, a.value, a.value);	// imul a, a, imm8
+				Emit1(b.value);
+			}
+			else
+			{
+				OptRegReg(0x69, a.value, a.value);	// imul a, a, imm32
+				Emit4(b.value);
+			}
+			break;
+		case OP_LSH:
+		case OP_RSHI:
+		case OP_RSHU:
+			OptRegReg(0xC1, op == OP_LSH ? 4 : (op == OP_RSHI ? 7 : 5), a.value);	// shl/sar/shr a, imm
+			Emit1(b.value & 31);
+			break;
+		}
+	}
+	else
+	{
+		OptToReg(&b);
+
+		switch(op)
+		{
+		case OP_ADD:	OptRegReg(0x01, b.value, a.value);	break;	// add a, b
+		case OP_SUB:	OptRegReg(0x29, b.value, a.value);	break;	// sub a, b
+		case OP_BAND:	OptRegReg(0x21, b.value, a.value);	break;	// and a, b
+		case OP_BOR:	OptRegReg(0x09, b.value, a.value);	break;	// or a, b
+		case OP_BXOR:	OptRegReg(0x31, b.value, a.value);	break;	// xor a, b
+		case OP_MULI:
+		case OP_MULU:	OptRegReg(0x0FAF, a.value, b.value);	break;	// imul a, b
+		case OP_LSH:
+		case OP_RSHI:
+		case OP_RSHU:
+			OptRegReg(0x89, b.value, OPT_ECX);		// mov ecx, b
+			OptRegReg(0xD3, op == OP_LSH ? 4 : (op == OP_RSHI ? 7 : 5), a.value);	// shl/sar/shr a, cl
+			break;
+		}
+
+		OptRelease(&b);
+	}
+
+	OptPush(OPT_REG, a.value);
+}
+
+static void OptDivide(int op)
+{
+	optEntry_t a, b;
+
+	b = OptPop();
+	a = OptPop();
+	OptToReg(&b);
+	OptToReg(&a);
+
+	OptRegReg(0x89, a.value, OPT_EAX);		// mov eax, a
+	if(op == OP_DIVI || op == OP_MODI)
+	{
+		EmitString("99");			// cdq
+		OptRegReg(0xF7, 7, b.value);		// idiv b
+	}
+	else
+	{
+		EmitString("31 D2");			// xor edx, edx
+		OptRegReg(0xF7, 6, b.value);		// div b
+	}
+	// mov a, eax / edx
+	OptRegReg(0x89, (op == OP_DIVI || op == OP_DIVU) ? OPT_EAX : OPT_EDX, a.value);
+
+	OptRelease(&b);
+	OptPush(OPT_REG, a.value);
+}
+
+static void OptUnary(int op)
+{
+	optEntry_t a;
+
+	a = OptPop();
+
+	// conversions are not folded, cvtsi2ss and cvttss2si do them
+	if(a.kind == OPT_CONST && op != OP_CVIF && op != OP_CVFI)
+	{
+		switch(op)
+		{
+		case OP_NEGI:	a.value = (int)(0u - (unsigned)a.value);	break;
+		case OP_BCOM:	a.value = ~a.value;				break;
+		case OP_SEX8:	a.value = (signed char)a.value;			break;
+		case OP_SEX16:	a.value = (short)a.value;			break;
+		case OP_NEGF:	a.value ^= 0x80000000;				break;
+		}
+		OptPush(OPT_CONST, a.value);
+		return;
+	}
+
+	OptToReg(&a);
+
+	switch(op)
+	{
+	case OP_NEGI:	OptRegReg(0xF7, 3, a.value);		break;	// neg a
+	case OP_BCOM:	OptRegReg(0xF7, 2, a.value);		break;	// not a
+	case OP_SEX8:	OptRegReg(0x0FBE, a.value, a.value);	break;	// movsx a, a8
+	case OP_SEX16:	OptRegReg(0x0FBF, a.value, a.value);	break;	// movsx a, a16
+	case OP_NEGF:	OptRegImm(6, a.value, 0x80000000);	break;	// xor a, 0x80000000
+	case OP_CVIF:
+		OptSSE(0xF3, 0x2A, 0, a.value);			// cvtsi2ss xmm0, a
+		OptMovdFromXmm(a.value, 0);			// movd a, xmm0
+		break;
+	case OP_CVFI:
+		OptMovdToXmm(0, a.value);			// movd xmm0, a
+		OptSSE(0xF3, 0x2C, a.value, 0);			// cvttss2si a, xmm0
+		break;
+	}
+
+	OptPush(OPT_REG, a.value);
+}
+
+static void OptFloat(int op)
+{
+	optEntry_t a, b;
+
+	b = OptPop();
+	a = OptPop();
+	OptToReg(&b);
+	OptToReg(&a);
+
+	OptMovdToXmm(0, a.value);			// movd xmm0, a
+	OptMovdToXmm(1, b.value);			// movd xmm1, b
+	switch(op)
+	{
+	case OP_ADDF:	EmitString("F3 0F 58 C1");	break;	// addss xmm0, xmm1
+	case OP_SUBF:	EmitString("F3 0F 5C C1");	break;	// subss xmm0, xmm1
+	case OP_MULF:	EmitString("F3 0F 59 C1");	break;	// mulss xmm0, xmm1
+	case OP_DIVF:	EmitString("F3 0F 5E C1");	break;	// divss xmm0, xmm1
+	}
+	OptMovdFromXmm(a.value, 0);			// movd a, xmm0
+
+	OptRelease(&b);
+	OptPush(OPT_REG, a.value);
+}
+
+/*
+=================
+OptCompare
+Fused compare and branch, the opStack is flushed before the compare so
+both successors start out with an empty virtual stack
+=================
+*/
+static void OptCompare(vm_t *vm, int op, int dest)
+{
+	optEntry_t a, b;
+
+	b = OptPop();
+	a = OptPop();
+	OptToReg(&a);
+	if(b.kind != OPT_CONST || op >= OP_EQF)
+		OptToReg(&b);
+
+	OptFlush();
+
+	if(op >= OP_EQF)
+	{
+		OptMovdToXmm(0, a.value);		// movd xmm0, a
+		OptMovdToXmm(1, b.value);		// movd xmm1, b
+	}
+	else if(b.kind == OPT_CONST)
+		OptRegImm(7, a.value, b.value);		// cmp a, imm
+	else
+		OptRegReg(0x39, b.value, a.value);	// cmp a, b
+
+	OptRelease(&a);
+	OptRelease(&b);
+
+	switch(op)
+	{
+	case OP_EQ:	EmitJumpIns(vm, "0F 84", dest);	break;	// je
+	case OP_NE:	EmitJumpIns(vm, "0F 85", dest);	break;	// jne
+	case OP_LTI:	EmitJumpIns(vm, "0F 8C", dest);	break;	// jl
+	case OP_LEI:	EmitJumpIns(vm, "0F 8E", dest);	break;	// jle
+	case OP_GTI:	EmitJumpIns(vm, "0F 8F", dest);	break;	// jg
+	case OP_GEI:	EmitJumpIns(vm, "0F 8D", dest);	break;	// jge
+	case OP_LTU:	EmitJumpIns(vm, "0F 82", dest);	break;	// jb
+	case OP_LEU:	EmitJumpIns(vm, "0F 86", dest);	break;	// jbe
+	case OP_GTU:	EmitJumpIns(vm, "0F 87", dest);	break;	// ja
+	case OP_GEU:	EmitJumpIns(vm, "0F 83", dest);	break;	// jae
+	case OP_EQF:
+		EmitString("0F 2E C1");			// ucomiss xmm0, xmm1
+		EmitString("7A 06");			// jp +0x6 (jump over next opcode)
+		EmitJumpIns(vm, "0F 84", dest);		// je
+		break;
+	case OP_NEF:
+		EmitString("0F 2E C1");			// ucomiss xmm0, xmm1
+		EmitJumpIns(vm, "0F 8A", dest);		// jp
+		EmitJumpIns(vm, "0F 85", dest);		// jne
+		break;
+	case OP_LTF:
+		EmitString("0F 2E C8");			// ucomiss xmm1, xmm0
+		EmitJumpIns(vm, "0F 87", dest);		// ja
+		break;
+	case OP_LEF:
+		EmitString("0F 2E C8");			// ucomiss xmm1, xmm0
+		EmitJumpIns(vm, "0F 83", dest);		// jae
+		break;
+	case OP_GTF:
+		EmitString("0F 2E C1");			// ucomiss xmm0, xmm1
+		EmitJumpIns(vm, "0F 87", dest);		// ja
+		break;
+	case OP_GEF:
+		EmitString("0F 2E C1");			// ucomiss xmm0, xmm1
+		EmitJumpIns(vm, "0F 83", dest);		// jae
+		break;
+	}
+}
+
+static void OptLoad(vm_t *vm, int op)
+{
+	optEntry_t a;
+	int reg, opcode;
+
+	a = OptPop();
+
+	if(op == OP_LOAD4)
+		opcode = 0x8B;				// mov
+	else if(op == OP_LOAD2)
+		opcode = 0x0FB7;			// movzx word
+	else
+		opcode = 0x0FB6;			// movzx byte
+
+	if(a.kind == OPT_CONST)
+		reg = OptAllocReg();
+	else
+	{
+		OptToReg(&a);
+		reg = a.value;
+	}
+
+	OptDataAccess(0, opcode, reg, &a, vm->dataMask);
+	OptPush(OPT_REG, reg);
+}
+
+static void OptStore(vm_t *vm, int op)
+{
+	optEntry_t a, v;
+	int mask;
+
+	v = OptPop();
+	a = OptPop();
+	if(v.kind == OPT_LOCAL)
+		OptToReg(&v);
+
+	if(op == OP_STORE4)
+		mask = vm->dataMask & ~3;
+	else if(op == OP_STORE2)
+		mask = vm->dataMask & ~1;
+	else
+		mask = vm->dataMask;
+
+	if(v.kind == OPT_CONST)
+	{
+		// mov [r9 + a], imm
+		if(op == OP_STORE4)
+		{
+			OptDataAccess(0, 0xC7, 0, &a, mask);
+			Emit4(v.value);
+		}
+		else if(op == OP_STORE2)
+		{
+			OptDataAccess(0x66, 0xC7, 0, &a, mask);
+			Emit2(v.value);
+		}
+		else
+		{
+			OptDataAccess(0, 0xC6, 0, &a, mask);
+			Emit1(v.value);
+		}
+	}
+	else
+	{
+		// mov [r9 + a], v
+		if(op == OP_STORE4)
+			OptDataAccess(0, 0x89, v.value, &a, mask);
+		else if(op == OP_STORE2)
+			OptDataAccess(0x66, 0x89, v.value, &a, mask);
+		else
+			OptDataAccess(0, 0x88, v.value, &a, mask);
+	}
+
+	OptRelease(&a);
+	OptRelease(&v);
+}
+
+/*
+=================
+OptOperandSize
+=================
+*/
+static int OptOperandSize(int op)
+{
+	switch(op)
+	{
+	case OP_ENTER:
+	case OP_CONST:
+	case OP_LOCAL:
+	case OP_LEAVE:
+	case OP_EQ:
+	case OP_NE:
+	case OP_LTI:
+	case OP_LEI:
+	case OP_GTI:
+	case OP_GEI:
+	case OP_LTU:
+	case OP_LEU:
+	case OP_GTU:
+	case OP_GEU:
+	case OP_EQF:
+	case OP_NEF:
+	case OP_LTF:
+	case OP_LEF:
+	case OP_GTF:
+	case OP_GEF:
+	case OP_BLOCK_COPY:
+		return 4;
+	case OP_ARG:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/*
+=================
+OptFindLabels
+Marks every instruction control can arrive at other than by falling through,
+the virtual stack has to be flushed before each of them
+=================
+*/
+static void OptFindLabels(vm_t *vm, vmHeader_t *header)
+{
+	int i, op, v;
+
+	jused[0] = 1;
+
+	pc = 0;
+	for(i = 0; i < header->instructionCount; i++)
+	{
+		if(pc > header->codeLength)
+		{
+			VMFREE_BUFFERS();
+			Com_Error(ERR_DROP, "VM_CompileOptimized: pc > header->codeLength");
+		}
+
+		op = code[pc];
+		pc++;
+
+		switch(op)
+		{
+		case OP_ENTER:
+			jused[i] = 1;
+			break;
+		case OP_CONST:
+			v = NextConstant4();
+			if(code[pc + 4] == OP_JUMP)
+				JUSED(v);
+			else if(code[pc + 4] == OP_CALL && v >= 0 && v < vm->instructionCount)
+				jused[v] = 1;
+			break;
+		case OP_EQ:
+		case OP_NE:
+		case OP_LTI:
+		case OP_LEI:
+		case OP_GTI:
+		case OP_GEI:
+		case OP_LTU:
+		case OP_LEU:
+		case OP_GTU:
+		case OP_GEU:
+		case OP_EQF:
+		case OP_NEF:
+		case OP_LTF:
+		case OP_LEF:
+		case OP_GTF:
+		case OP_GEF:
+			v = NextConstant4();
+			JUSED(v);
+			break;
+		}
+
+		pc += OptOperandSize(op);
+	}
+
+	// computed jumps go through the switch tables in the data segment, so
+	// every word in the initialized data that is a valid instruction
+	// number may be a target
+	for(i = 0; i + 4 <= header->dataLength + header->litLength; i += 4)
+	{
+		v = *(int *)(vm->dataBase + i);
+		if(v >= 0 && v < vm->instructionCount)
+			jused[v] = 1;
+	}
+}
+
+/*
+=================
+VM_CompileOptimized
+Returns qfalse if the code doesn't fit, VM_Compile falls back to tier 1 then
+=================
+*/
+static qboolean VM_CompileOptimized(vm_t *vm, vmHeader_t *header)
+{
+	int		op;
+	int		maxLength;
+	int		v;
+	int		callProcOfs, callDoSyscallOfs;
+	optEntry_t	a;
+
+	maxLength = header->codeLength * 16 + 4096;
+	callDoSyscallOfs = VM_BeginCompile(vm, header, maxLength);
+	callProcOfs = vm->callProcOfs;
+
+	OptFindLabels(vm, header);
+
+	for(pass = 0; pass < 3; pass++)
+	{
+		pc = 0;
+		instruction = 0;
+		compiledOfs = vm->entryOfs;
+		optDepth = 0;
+		optRegsUsed = 0;
+
+		while(instruction < header->instructionCount)
+		{
+			// leaves room for two full flushes and the biggest opcode
+			if(compiledOfs > maxLength - 512)
+			{
+				VMFREE_BUFFERS();
+				Z_Free(code);
+				Com_Printf(S_COLOR_YELLOW "VM_CompileOptimized: %s doesn't fit, using tier 1\n", vm->name);
+				return qfalse;
+			}
+
+			if(jused[instruction])
+				OptFlush();
+
+			vm->instructionPointers[instruction] = compiledOfs;
+			instruction++;
+
+			if(pc > header->codeLength)
+			{
+				VMFREE_BUFFERS();
+				Com_Error(ERR_DROP, "VM_CompileOptimized: pc > header->codeLength");
+			}
+
+			op = code[pc];
+			pc++;
+			switch(op)
+			{
+			case 0:
+				break;
+			case OP_BREAK:
+				EmitString("CC");			// int 3
+				break;
+			case OP_ENTER:
+				// save frame pointer
+				EmitString("55");			// push ebp
+				EmitRexString(0x48, "89 E5");		// mov ebp, esp
+				EmitString("81 EE");			// sub esi, 0x12345678
+				Emit4(Constant4());
+				break;
+			case OP_LEAVE:
+				OptFlush();
+				EmitString("81 C6");			// add esi, 0x12345678
+				Emit4(Constant4());
+				// Restore frame pointer
+				EmitString("5D");			// pop ebp
+				EmitString("C3");			// ret
+				break;
+			case OP_CONST:
+				OptPush(OPT_CONST, Constant4());
+				break;
+			case OP_LOCAL:
+				OptPush(OPT_LOCAL, Constant4());
+				break;
+			case OP_PUSH:
+				OptPush(OPT_CONST, 0);
+				break;
+			case OP_POP:
+				if(optDepth)
+					OptRelease(&optStack[--optDepth]);
+				else
+					STACK_POP(1);			// sub bl, 1
+				break;
+			case OP_ARG:
+				v = Constant1();
+				a = OptPop();
+				if(a.kind == OPT_LOCAL)
+					OptToReg(&a);
+				EmitString("8D 96");			// lea edx, [esi + 0x12345678]
+				Emit4(v);
+				MASK_REG("E2", vm->dataMask);		// and edx, 0x12345678
+				if(a.kind == OPT_CONST)
+				{
+					OptDataIndex(0, 0xC7, 0, OPT_EDX);	// mov dword ptr [r9 + edx], 0x12345678
+					Emit4(a.value);
+				}
+				else
+					OptDataIndex(0, 0x89, a.value, OPT_EDX);	// mov dword ptr [r9 + edx], a
+				OptRelease(&a);
+				break;
+			case OP_CALL:
+				a = OptPop();
+				if(a.kind == OPT_CONST && a.value < vm->instructionCount)
+				{
+					OptFlush();
+					if(a.value < 0)
+					{
+						EmitString("B8");		// mov eax, 0x12345678
+						Emit4(a.value);
+						EmitCallRel(vm, callDoSyscallOfs);
+						// have opStack reg point at return value
+						STACK_PUSH(1);			// add bl, 1
+					}
+					else
+						EmitCallIns(vm, a.value);
+					break;
+				}
+				OptPush(a.kind, a.value);
+				OptFlush();
+				EmitCallRel(vm, callProcOfs);
+				break;
+			case OP_JUMP:
+				a = OptPop();
+				if(a.kind == OPT_CONST && (unsigned)a.value < (unsigned)vm->instructionCount)
+				{
+					OptFlush();
+					EmitJumpIns(vm, "E9", a.value);		// jmp 0x12345678
+					break;
+				}
+				OptToReg(&a);
+				OptFlush();
+				OptRegReg(0x89, a.value, OPT_EAX);	// mov eax, a
+				OptRelease(&a);
+				EmitString("3D");			// cmp eax, vm->instructionCount
+				Emit4(vm->instructionCount);
+				EmitString("73 04");			// jae +4
+				EmitRexString(0x49, "FF 24 C0");	// jmp qword ptr [r8 + eax * 8]
+				EmitCallErrJump(vm, callDoSyscallOfs);
+				break;
+			case OP_BLOCK_COPY:
+				OptFlush();
+				EmitString("B8");			// mov eax, 0x12345678
+				Emit4(VM_BLOCK_COPY);
+				EmitString("B9");			// mov ecx, 0x12345678
+				Emit4(Constant4());
+
+				EmitCallRel(vm, callDoSyscallOfs);
+
+				STACK_POP(2);				// sub bl, 2
+				break;
+
+			case OP_LOAD4:
+			case OP_LOAD2:
+			case OP_LOAD1:
+				OptLoad(vm, op);
+				break;
+			case OP_STORE4:
+			case OP_STORE2:
+			case OP_STORE1:
+				OptStore(vm, op);
+				break;
+
+			case OP_EQ:
+			case OP_NE:
+			case OP_LTI:
+			case OP_LEI:
+			case OP_GTI:
+			case OP_GEI:
+			case OP_LTU:
+			case OP_LEU:
+			case OP_GTU:
+			case OP_GEU:
+			case OP_EQF:
+			case OP_NEF:
+			case OP_LTF:
+			case OP_LEF:
+			case OP_GTF:
+			case OP_GEF:
+				OptCompare(vm, op, Constant4());
+				break;
+
+			case OP_ADD:
+			case OP_SUB:
+			case OP_BAND:
+			case OP_BOR:
+			case OP_BXOR:
+			case OP_MULI:
+			case OP_MULU:
+			case OP_LSH:
+			case OP_RSHI:
+			case OP_RSHU:
+				OptBinary(op);
+				break;
+			case OP_DIVI:
+			case OP_DIVU:
+			case OP_MODI:
+			case OP_MODU:
+				OptDivide(op);
+				break;
+			case OP_NEGI:
+			case OP_BCOM:
+			case OP_SEX8:
+			case OP_SEX16:
+			case OP_NEGF:
+			case OP_CVIF:
+			case OP_CVFI:
+				OptUnary(op);
+				break;
+			case OP_ADDF:
+			case OP_SUBF:
+			case OP_MULF:
+			case OP_DIVF:
+				OptFloat(op);
+				break;
+
+			default:
+				VMFREE_BUFFERS();
+				Com_Error(ERR_DROP, "VM_CompileOptimized: bad opcode %i at offset %i", op, pc);
+			}
+		}
+
+		OptFlush();
+	}
+
+	VM_EndCompile(vm, header);
+	return qtrue;
+}
+#endif
+
+/*
+=================
+VM_Compile
+=================
+*/
+void VM_Compile(vm_t *vm, vmHeader_t *header)
+{
+	int		op;
+	int		maxLength;
+	int		v;
+	int		i;
+        int		callProcOfsSyscall, callProcOfs, callDoSyscallOfs;
+
+#if idx64
+	if (vm->jitTier >= 2 && VM_CompileOptimized(vm, header))
+		return;
+#endif
+	vm->jitTier = 1;
+
+	// allocate a very large temp buffer, we will shrink it later
+	maxLength = header->codeLength * 8 + 64;
+	callDoSyscallOfs = VM_BeginCompile(vm, header, maxLength);
+	callProcOfs = vm->callProcOfs;
+	callProcOfsSyscall = vm->callProcOfsSyscall;
+
+	// ensure that the optimisation pass knows about all the jump
+	// table targets
+	pc = -1; // a bogus value to be printed in out-of-bounds error messages
+	for( i = 0; i < vm->numJumpTableTargets; i++ ) {
+		JUSED( *(int *)(vm->jumpTableTargets + ( i * sizeof( int ) ) ) );
+	}
+
+	for(pass=0; pass < 3; pass++) {
+	oc0 = -23423;
+	oc1 = -234354;
+	pop0 = -43435;
+	pop1 = -545455;
+
+	// translate all instructions
+	pc = 0;
+	instruction = 0;
+	//code = (byte *)header + header->codeOffset;
+	compiledOfs = vm->entryOfs;
+
+	LastCommand = LAST_COMMAND_NONE;
+
+	while(instruction < header->instructionCount)
+	{
+		if(compiledOfs > maxLength - 16)
+		{
+	        	VMFREE_BUFFERS();
+			Com_Error(ERR_DROP, "VM_CompileX86: maxLength exceeded");
+		}
+
+		vm->instructionPointers[ instruction ] = compiledOfs;
+
+		if ( !vm->jumpTableTargets )
+			jlabel = 1;
+		else
+			jlabel = jused[ instruction ];
+
+		instruction++;
+
+		if(pc > header->codeLength)
+		{
+		        VMFREE_BUFFERS();
+			Com_Error(ERR_DROP, "VM_CompileX86: pc > header->codeLength");
+		}
+
+		op = code[ pc ];
+		pc++;
+		switch ( op ) {
+		case 0:
+			break;
+		case OP_BREAK:
+			EmitString("CC");				// int 3
+			break;
+		case OP_ENTER:
+			// save frame pointer
+			EmitString("55");					// push ebp
+			EmitRexString(0x48, "89 E5");		// mov ebp, esp
+			EmitString("81 EE");				// sub esi, 0x12345678
+			Emit4(Constant4());
+			break;
+		case OP_CONST:
+			if(ConstOptimize(vm, callProcOfsSyscall))
+				break;
+
+			EmitPushStack(vm);
+			EmitString("C7 04 9F");				// mov dword ptr [edi + ebx * 4], 0x12345678
+			lastConst = Constant4();
+
+			Emit4(lastConst);
+			if(code[pc] == OP_JUMP)
+				JUSED(lastConst);
+
+			break;
+		case OP_LOCAL:
+			EmitPushStack(vm);
+			EmitString("8D 86");				// lea eax, [0x12345678 + esi]
+			oc0 = oc1;
+			oc1 = Constant4();
+			Emit4(oc1);
+			EmitCommand(LAST_COMMAND_MOV_STACK_EAX);	// mov dword ptr [edi + ebx * 4], eax
+			break;
+		case OP_ARG:
+			EmitMovEAXStack(vm, 0);				// mov eax, dword ptr [edi + ebx * 4]
+			EmitString("8B D6");				// mov edx, esi
+			EmitString("81 C2");				// add edx, 0x12345678
+			Emit4((Constant1() & 0xFF));
+			MASK_REG("E2", vm->dataMask);			// and edx, 0x12345678
+#if idx64
+			EmitRexString(0x41, "89 04 11");		// mov dword ptr [r9 + edx], eax
+#else
+			EmitString("89 82");				// mov dword ptr [edx + 0x12345678], eax
+			Emit4((intptr_t) vm->dataBase);
+#endif
+			EmitCommand(LAST_COMMAND_SUB_BL_1);		// sub bl, 1
+			break;
+		case OP_CALL:
+			EmitCallRel(vm, callProcOfs);
+			break;
+		case OP_PUSH:
+			EmitPushStack(vm);
+			break;
+		case OP_POP:
+			EmitCommand(LAST_COMMAND_SUB_BL_1);		// sub bl, 1
+			break;
+		case OP_LEAVE:
+			v = Constant4();
+			EmitString("81 C6");				// add	esi, 0x12345678
+			Emit4(v);
+			// Restore frame pointer
+			EmitString("5D");				// pop ebp
+			EmitString("C3");				// ret
+			break;
+		case OP_LOAD4:
+			if (code[pc] == OP_CONST && code[pc+5] == OP_ADD && code[pc+6] == OP_STORE4)
+			{
+				if(oc0 == oc1 && pop0 == OP_LOCAL && pop1 == OP_LOCAL)
+				{
+					compiledOfs -= 12;
+					vm->instructionPointers[instruction - 1] = compiledOfs;
+				}
+
+				pc++;				// OP_CONST
+				v = Constant4();
+
+				EmitMovEDXStack(vm, vm->dataMask);
+				if(v == 1 && oc0 == oc1 && pop0 == OP_LOCAL && pop1 == OP_LOCAL)
+				{
+#if idx64
+					EmitRexString(0x41, "FF 04 11");	// inc dword ptr [r9 + edx]
+#else
+					EmitString("FF 82");			// inc dword ptr [edx + 0x12345678]
+					Emit4((intptr_t) vm->dataBase);
+#endif
+				}
+				else
+				{
+#if idx64
+					EmitRexString(0x41, "8B 04 11");	// mov eax, dword ptr [r9 + edx]
+#else
+					EmitString("8B 82");			// mov eax, dword ptr [edx + 0x12345678]
+					Emit4((intptr_t) vm->dataBase);
+#endif
+					EmitString("05");			// add eax, v
+					Emit4(v);
+
+					if (oc0 == oc1 && pop0 == OP_LOCAL && pop1 == OP_LOCAL)
+					{
+#if idx64
+						EmitRexString(0x41, "89 04 11");	// mov dword ptr [r9 + edx], eax
+#else
+						EmitString("89 82");			// mov dword ptr [edx + 0x12345678], eax
+						Emit4((intptr_t) vm->dataBase);
+#endif
+					}
+					else
+					{
+						EmitCommand(LAST_COMMAND_SUB_BL_1);	// sub bl, 1
+						EmitString("8B 14 9F");			// mov edx, dword ptr [edi + ebx * 4]
+						MASK_REG("E2", vm->dataMask);		// and edx, 0x12345678
+#if idx64
+						EmitRexString(0x41, "89 04 11");	// mov dword ptr [r9 + edx], eax
+#else
+						EmitString("89 82");			// mov dword ptr [edx + 0x12345678], eax
+						Emit4((intptr_t) vm->dataBase);
+#endif
+					}
+				}
+
+				EmitCommand(LAST_COMMAND_SUB_BL_1);		// sub bl, 1
+				pc++;						// OP_ADD
+				pc++;						// OP_STORE
+				instruction += 3;
+				break;
+			}
+
+			if(code[pc] == OP_CONST && code[pc+5] == OP_SUB && code[pc+6] == OP_STORE4)
+			{
+				if(oc0 == oc1 && pop0 == OP_LOCAL && pop1 == OP_LOCAL)
+				{
+					compiledOfs -= 12;
+					vm->instructionPointers[instruction - 1] = compiledOfs;
+				}
+
+				pc++;					// OP_CONST
+				v = Constant4();
+
+				EmitMovEDXStack(vm, vm->dataMask);
+				if(v == 1 && oc0 == oc1 && pop0 == OP_LOCAL && pop1 == OP_LOCAL)
+				{
+#if idx64
+					EmitRexString(0x41, "FF 0C 11");	// dec dword ptr [r9 + edx]
+#else
+					EmitString("FF 8A");			// dec dword ptr [edx + 0x12345678]
+					Emit4((intptr_t) vm->dataBase);
+#endif
+				}
+				else
 				{
 #if idx64
 					EmitRexString(0x41, "8B 04 11");	// mov eax, dword ptr [r9 + edx]
@@ -1655,49 +2769,7 @@ void VM_Compile(vm_t *vm, vmHeader_t *header)
 	}
 	}
 
-	// copy to an exact sized buffer with the appropriate permission bits
-	vm->codeLength = compiledOfs;
-#ifdef VM_X86_MMAP
-	vm->codeBase = (byte *)mmap(NULL, compiledOfs, PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
-	if(vm->codeBase == MAP_FAILED)
-		Com_Error(ERR_FATAL, "VM_CompileX86: can't mmap memory");
-#elif _WIN32
-	// allocate memory with EXECUTE permissions under windows.
-	vm->codeBase = (byte*)VirtualAlloc(NULL, compiledOfs, MEM_COMMIT, PAGE_EXECUTE_READWRITE);
-	if(!vm->codeBase)
-		Com_Error(ERR_FATAL, "VM_CompileX86: VirtualAlloc failed");
-#else
-	vm->codeBase = malloc(compiledOfs);
-	if(!vm->codeBase)
-	        Com_Error(ERR_FATAL, "VM_CompileX86: malloc failed");
-#endif
-
-	Com_Memcpy( vm->codeBase, buf, compiledOfs );
-
-#ifdef VM_X86_MMAP
-	if(mprotect(vm->codeBase, compiledOfs, PROT_READ|PROT_EXEC))
-		Com_Error(ERR_FATAL, "VM_CompileX86: mprotect failed");
-#elif _WIN32
-	{
-		DWORD oldProtect = 0;
-
-		// remove write permissions.
-		if(!VirtualProtect(vm->codeBase, compiledOfs, PAGE_EXECUTE_READ, &oldProtect))
-			Com_Error(ERR_FATAL, "VM_CompileX86: VirtualProtect failed");
-	}
-#endif
-
-	Z_Free( code );
-	Z_Free( buf );
-	Z_Free( jused );
-	Com_Printf( "VM file %s compiled to %i bytes of code\n", vm->name, compiledOfs );
-
-	vm->destroy = VM_Destroy_Compiled;
-
-	// offset all the instruction pointers for the new location
-	for ( i = 0 ; i < header->instructionCount ; i++ ) {
-		vm->instructionPointers[i] += (intptr_t) vm->codeBase;
-	}
+	VM_EndCompile(vm, header);
 }
 
 void VM_Destroy_Compiled(vm_t* self)
@@ -1725,7 +2797,8 @@ extern "C" uint8_t qvmcall64(int *programStack, int *opStack, intptr_t *instruct
 
 int VM_CallCompiled(vm_t *vm, int *args)
 {
-	byte	stack[OPSTACK_SIZE + 15];
+	// tier 2 writes its cached entries past the opStack top before moving bl
+	byte	stack[OPSTACK_SIZE + 4 * OPT_MAX_DEPTH + 15];
 	void	*entryPoint;
 	int		programStack, stackOnEntry;
 	byte	*image;
@@ -1817,3 +2890,205 @@ int VM_CallCompiled(vm_t *vm, int *args)
 
 	return opStack[opStackOfs];
 }
+
+#ifdef VM_SAMPLING
+/*
+==============================================================================
+
+Sampling profiler for compiled code
+
+Every OP_ENTER and the helper procedures start with push ebp / mov ebp, esp,
+so the native frame pointer chain of compiled code can be walked like a
+regular call stack. A SIGPROF handler does that and records the code offsets
+it finds, DoSyscall keeps the frames of the syscalls that are in progress so
+samples taken in the engine or in a nested vm call can continue below them.
+
+==============================================================================
+*/
+
+vmSampler_t		vm_sampler;
+
+static pthread_t		vm_sampleThread;
+static byte			*vm_sampleStackTop;
+static struct sigaction	vm_sampleOldAction;
+
+static ID_INLINE qboolean VM_SampleInCode(const vm_t *vm, intptr_t pc)
+{
+	return (qboolean)(pc >= (intptr_t)vm->codeBase && pc < (intptr_t)vm->codeBase + vm->codeLength);
+}
+
+static void VM_SampleSignal(int signum, siginfo_t *info, void *context)
+{
+	const ucontext_t	*uc = (const ucontext_t *)context;
+	vmSampler_t	*s = &vm_sampler;
+	vm_t		*vm = s->vm;
+	vmSample_t	*sample;
+	intptr_t	*fp, *next;
+	intptr_t	pc, sp, ret;
+	int			level;
+
+	if(!vm)
+		return;
+
+	// the timer is per process, ticks that land on a job thread are lost
+	if(!pthread_equal(pthread_self(), vm_sampleThread))
+	{
+		s->otherThreadSamples++;
+		return;
+	}
+
+	if(s->numSamples >= s->maxSamples)
+	{
+		s->droppedSamples++;
+		return;
+	}
+
+#if idx64
+	pc = uc->uc_mcontext.gregs[REG_RIP];
+	sp = uc->uc_mcontext.gregs[REG_RSP];
+	fp = (intptr_t *)uc->uc_mcontext.gregs[REG_RBP];
+#else
+	pc = uc->uc_mcontext.gregs[REG_EIP];
+	sp = uc->uc_mcontext.gregs[REG_ESP];
+	fp = (intptr_t *)uc->uc_mcontext.gregs[REG_EBP];
+#endif
+
+	sample = &s->samples[s->numSamples];
+	sample->depth = 0;
+	level = s->syscallDepth;
+	if(level > VM_SAMPLE_LEVELS)
+		level = VM_SAMPLE_LEVELS;
+
+	if(VM_SampleInCode(vm, pc))
+	{
+		const byte	*ins = (const byte *)pc;
+
+		sample->frames[sample->depth++] = (int)(pc - (intptr_t)vm->codeBase);
+
+		// between push ebp and mov ebp, esp or pop ebp and ret ebp already
+		// is the caller's frame, the return address is on top of the stack
+		ret = 0;
+		if(ins[0] == 0x55 || ins[0] == 0xC3)
+			ret = ((intptr_t *)sp)[0];
+		else if(ins[idx64] == 0x89 && ins[idx64 + 1] == 0xE5 && (!idx64 || ins[0] == 0x48))
+			ret = ((intptr_t *)sp)[1];
+
+		if(ret && VM_SampleInCode(vm, ret))
+			sample->frames[sample->depth++] = (int)(ret - 1 - (intptr_t)vm->codeBase);
+	}
+	else if(level)
+	{
+		// somewhere below a syscall
+		level--;
+		sample->frames[sample->depth++] = s->syscallNum[level];
+		fp = (intptr_t *)s->syscallFrame[level];
+	}
+	else
+	{
+		s->engineSamples++;
+		return;
+	}
+
+	while(sample->depth < VM_SAMPLE_DEPTH)
+	{
+		// the frame pointer is only trusted while it stays on this thread's stack
+		if((intptr_t)fp < sp || (byte *)(fp + 2) > vm_sampleStackTop || ((intptr_t)fp & (sizeof(intptr_t) - 1)))
+			break;
+
+		ret = fp[1];
+		if(!VM_SampleInCode(vm, ret))
+		{
+			// back in VM_CallCompiled, continue in the code that made the syscall
+			if(!level)
+				break;
+
+			level--;
+			sample->frames[sample->depth++] = s->syscallNum[level];
+			fp = (intptr_t *)s->syscallFrame[level];
+			continue;
+		}
+
+		// point into the call instruction rather than past it
+		sample->frames[sample->depth++] = (int)(ret - 1 - (intptr_t)vm->codeBase);
+
+		next = (intptr_t *)fp[0];
+		if(next <= fp)
+			break;
+		fp = next;
+	}
+
+	s->numSamples++;
+}
+
+/*
+=================
+VM_StartSampling
+Samples the call stack of a compiled vm hz times per second of cpu time
+=================
+*/
+qboolean VM_StartSampling(vm_t *vm, int hz, int maxSamples)
+{
+	struct sigaction	action;
+	struct itimerval	timer;
+	pthread_attr_t		attr;
+	void		*stackAddr;
+	size_t		stackSize;
+
+	if(vm_sampler.vm)
+		VM_StopSampling();
+	if(vm_sampler.samples)
+		Z_Free(vm_sampler.samples);
+
+	// the vm runs on the main thread, so that's the stack the frames are on
+	if(pthread_getattr_np(pthread_self(), &attr))
+	{
+		Com_Printf(S_COLOR_YELLOW "VM_StartSampling: couldn't get the stack bounds\n");
+		return qfalse;
+	}
+	pthread_attr_getstack(&attr, &stackAddr, &stackSize);
+	pthread_attr_destroy(&attr);
+
+	vm_sampleThread = pthread_self();
+	vm_sampleStackTop = (byte *)stackAddr + stackSize;
+
+	Com_Memset(&vm_sampler, 0, sizeof(vm_sampler));
+	vm_sampler.samples = (vmSample_t *)Z_Malloc(maxSamples * sizeof(vmSample_t), TAG_VM, qfalse);
+	vm_sampler.maxSamples = maxSamples;
+	vm_sampler.startTime = Sys_Milliseconds();
+
+	Com_Memset(&action, 0, sizeof(action));
+	action.sa_sigaction = VM_SampleSignal;
+	action.sa_flags = SA_SIGINFO | SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGPROF, &action, &vm_sampleOldAction);
+
+	// the handler only looks at the vm once it's set
+	vm_sampler.vm = vm;
+
+	timer.it_interval.tv_sec = 0;
+	timer.it_interval.tv_usec = 1000000 / hz;
+	timer.it_value = timer.it_interval;
+	setitimer(ITIMER_PROF, &timer, NULL);
+
+	return qtrue;
+}
+
+/*
+=================
+VM_StopSampling
+Stops the timer, the samples stay in vm_sampler until they are freed or
+sampling is started again
+=================
+*/
+void VM_StopSampling(void)
+{
+	struct itimerval	timer;
+
+	Com_Memset(&timer, 0, sizeof(timer));
+	setitimer(ITIMER_PROF, &timer, NULL);
+	sigaction(SIGPROF, &vm_sampleOldAction, NULL);
+
+	vm_sampler.vm = NULL;
+	vm_sampler.syscallDepth = 0;
+}
+#endif
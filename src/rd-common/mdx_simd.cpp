@@ -0,0 +1,420 @@
+// Filename:-	mdx_simd.cpp
+//
+// Ghoul2 animation kernels, see mdx_simd.h
+
+#include "mdx_simd.h"
+#include "matcomp.h"
+
+#if id386 || idx64
+#ifdef _MSC_VER
+#include <intrin.h>
+#define MDX_TARGET_AVX2
+#else
+#include <immintrin.h>
+#define MDX_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+#endif
+
+/*
+================================================================================
+ Scalar reference
+================================================================================
+*/
+
+static void MDX_Multiply_Scalar( mdxaBone_t *out, const mdxaBone_t *in2, const mdxaBone_t *in )
+{
+	mdxaBone_t	res;
+	int			i;
+
+	// in2 and in may be out
+	for ( i = 0; i < 3; i++ )
+	{
+		res.matrix[i][0] = (in2->matrix[i][0] * in->matrix[0][0]) + (in2->matrix[i][1] * in->matrix[1][0]) + (in2->matrix[i][2] * in->matrix[2][0]);
+		res.matrix[i][1] = (in2->matrix[i][0] * in->matrix[0][1]) + (in2->matrix[i][1] * in->matrix[1][1]) + (in2->matrix[i][2] * in->matrix[2][1]);
+		res.matrix[i][2] = (in2->matrix[i][0] * in->matrix[0][2]) + (in2->matrix[i][1] * in->matrix[1][2]) + (in2->matrix[i][2] * in->matrix[2][2]);
+		res.matrix[i][3] = (in2->matrix[i][0] * in->matrix[0][3]) + (in2->matrix[i][1] * in->matrix[1][3]) + (in2->matrix[i][2] * in->matrix[2][3]) + in2->matrix[i][3];
+	}
+	*out = res;
+}
+
+static void MDX_Blend_Scalar( mdxaBone_t *out, const mdxaBone_t *from, const mdxaBone_t *to, float frac )
+{
+	const float	*a = &from->matrix[0][0];
+	const float	*b = &to->matrix[0][0];
+	float		*o = &out->matrix[0][0];
+	const float	frontlerp = 1.0f - frac;
+	int			j;
+
+	for ( j = 0 ; j < 12 ; j++ )
+	{
+		o[j] = (frac * a[j]) + (frontlerp * b[j]);
+	}
+}
+
+static void MDX_UnCompressQuat_Scalar( mdxaBone_t *out, const unsigned char *comp )
+{
+	MC_UnCompressQuat( out->matrix, comp );
+}
+
+static void MDX_Skin_Scalar( const mdxmVertex_t *v, int numVerts, const mdxaBone_t * const *bones, int numBones, vec4_t *xyz, vec4_t *normal )
+{
+	int j, k;
+
+	for ( j = 0; j < numVerts; j++, v++ )
+	{
+		const int iNumWeights = G2_GetVertWeights( v );
+
+		VectorClear( xyz[j] );
+		VectorClear( normal[j] );
+
+		float fTotalWeight = 0.0f;
+		for ( k = 0 ; k < iNumWeights ; k++ )
+		{
+			int		iBoneIndex	= G2_GetVertBoneIndex( v, k );
+			float	fBoneWeight	= G2_GetVertBoneWeight( v, k, fTotalWeight, iNumWeights );
+
+			const mdxaBone_t &bone = *bones[iBoneIndex];
+
+			xyz[j][0] += fBoneWeight * ( DotProduct( bone.matrix[0], v->vertCoords ) + bone.matrix[0][3] );
+			xyz[j][1] += fBoneWeight * ( DotProduct( bone.matrix[1], v->vertCoords ) + bone.matrix[1][3] );
+			xyz[j][2] += fBoneWeight * ( DotProduct( bone.matrix[2], v->vertCoords ) + bone.matrix[2][3] );
+
+			normal[j][0] += fBoneWeight * DotProduct( bone.matrix[0], v->normal );
+			normal[j][1] += fBoneWeight * DotProduct( bone.matrix[1], v->normal );
+			normal[j][2] += fBoneWeight * DotProduct( bone.matrix[2], v->normal );
+		}
+	}
+}
+
+#if id386 || idx64
+/*
+================================================================================
+ SSE2
+
+ Bit exact with the scalar versions, except for skinning which sums in a
+ different order.
+================================================================================
+*/
+
+static void MDX_Multiply_SSE2( mdxaBone_t *out, const mdxaBone_t *in2, const mdxaBone_t *in )
+{
+	const __m128 r0 = _mm_loadu_ps( in->matrix[0] );
+	const __m128 r1 = _mm_loadu_ps( in->matrix[1] );
+	const __m128 r2 = _mm_loadu_ps( in->matrix[2] );
+	int i;
+
+	for ( i = 0; i < 3; i++ )
+	{
+		const float *m = in2->matrix[i];
+		__m128 row = _mm_mul_ps( _mm_set1_ps( m[0] ), r0 );
+
+		row = _mm_add_ps( row, _mm_mul_ps( _mm_set1_ps( m[1] ), r1 ) );
+		row = _mm_add_ps( row, _mm_mul_ps( _mm_set1_ps( m[2] ), r2 ) );
+		row = _mm_add_ps( row, _mm_set_ps( m[3], 0.0f, 0.0f, 0.0f ) );
+		_mm_storeu_ps( out->matrix[i], row );
+	}
+}
+
+static void MDX_Blend_SSE2( mdxaBone_t *out, const mdxaBone_t *from, const mdxaBone_t *to, float frac )
+{
+	const __m128 back = _mm_set1_ps( frac );
+	const __m128 front = _mm_set1_ps( 1.0f - frac );
+	int i;
+
+	for ( i = 0; i < 3; i++ )
+	{
+		_mm_storeu_ps( out->matrix[i], _mm_add_ps( _mm_mul_ps( back, _mm_loadu_ps( from->matrix[i] ) ),
+			_mm_mul_ps( front, _mm_loadu_ps( to->matrix[i] ) ) ) );
+	}
+}
+
+static void MDX_UnCompressQuat_SSE2( mdxaBone_t *out, const unsigned char *comp )
+{
+	const __m128i zero = _mm_setzero_si128();
+	float diag[4], plus[4], minus[4], xlat[4];
+
+	// w x y z, then three translation words - 14 bytes, so read 8 from the start and 8 from the fourth word on
+	__m128 q = _mm_cvtepi32_ps( _mm_unpacklo_epi16( _mm_loadl_epi64( (const __m128i *)comp ), zero ) );
+	__m128 tr = _mm_cvtepi32_ps( _mm_unpacklo_epi16( _mm_loadl_epi64( (const __m128i *)(comp + 6) ), zero ) );
+
+	q = _mm_sub_ps( _mm_div_ps( q, _mm_set1_ps( 16383.0f ) ), _mm_set1_ps( 2.0f ) );
+	tr = _mm_sub_ps( _mm_div_ps( tr, _mm_set1_ps( 64.0f ) ), _mm_set1_ps( 512.0f ) );
+
+	const __m128 t = _mm_add_ps( q, q );							// tw tx ty tz
+	const __m128 sq = _mm_mul_ps( t, q );							// tww txx tyy tzz
+
+	// 1 - ( tyy + tzz ), 1 - ( txx + tzz ), 1 - ( txx + tyy )
+	_mm_storeu_ps( diag, _mm_sub_ps( _mm_set1_ps( 1.0f ), _mm_add_ps(
+		_mm_shuffle_ps( sq, sq, _MM_SHUFFLE( 1, 1, 1, 2 ) ),
+		_mm_shuffle_ps( sq, sq, _MM_SHUFFLE( 2, 2, 3, 3 ) ) ) ) );
+
+	// txy txz tyz, twz twy twx
+	const __m128 p = _mm_mul_ps( _mm_shuffle_ps( t, t, _MM_SHUFFLE( 3, 3, 3, 2 ) ), _mm_shuffle_ps( q, q, _MM_SHUFFLE( 2, 2, 1, 1 ) ) );
+	const __m128 w = _mm_mul_ps( _mm_shuffle_ps( t, t, _MM_SHUFFLE( 1, 1, 2, 3 ) ), _mm_shuffle_ps( q, q, _MM_SHUFFLE( 0, 0, 0, 0 ) ) );
+
+	_mm_storeu_ps( plus, _mm_add_ps( p, w ) );
+	_mm_storeu_ps( minus, _mm_sub_ps( p, w ) );
+	_mm_storeu_ps( xlat, tr );
+
+	out->matrix[0][0] = diag[0];
+	out->matrix[0][1] = minus[0];
+	out->matrix[0][2] = plus[1];
+	out->matrix[0][3] = xlat[1];
+	out->matrix[1][0] = plus[0];
+	out->matrix[1][1] = diag[1];
+	out->matrix[1][2] = minus[2];
+	out->matrix[1][3] = xlat[2];
+	out->matrix[2][0] = minus[1];
+	out->matrix[2][1] = plus[2];
+	out->matrix[2][2] = diag[2];
+	out->matrix[2][3] = xlat[3];
+}
+
+static void MDX_Skin_SSE2( const mdxmVertex_t *v, int numVerts, const mdxaBone_t * const *bones, int numBones, vec4_t *xyz, vec4_t *normal )
+{
+	__m128	cols[32][4];
+
+	assert( numBones <= 32 );
+	int		j, k;
+
+	// use transposed bone matrixes for faster calculations, only the referenced ones are there
+	for ( j = 0; j < numBones; j++ )
+	{
+		cols[j][0] = _mm_loadu_ps( bones[j]->matrix[0] );
+		cols[j][1] = _mm_loadu_ps( bones[j]->matrix[1] );
+		cols[j][2] = _mm_loadu_ps( bones[j]->matrix[2] );
+		cols[j][3] = _mm_setzero_ps();
+
+		_MM_TRANSPOSE4_PS( cols[j][0], cols[j][1], cols[j][2], cols[j][3] );
+	}
+
+	for ( j = 0; j < numVerts; j++, v++ )
+	{
+		const int iNumWeights = G2_GetVertWeights( v );
+
+		__m128 matrix[4] = {
+			_mm_setzero_ps(),
+			_mm_setzero_ps(),
+			_mm_setzero_ps(),
+			_mm_setzero_ps()
+		};
+
+		// calculate weighted bone matrix
+		float fTotalWeight = 0.0f;
+		for ( k = 0 ; k < iNumWeights ; k++ )
+		{
+			int		iBoneIndex	= G2_GetVertBoneIndex( v, k );
+			float	fBoneWeight	= G2_GetVertBoneWeight( v, k, fTotalWeight, iNumWeights );
+			__m128	weight = _mm_set_ps1( fBoneWeight );
+
+			matrix[0] = _mm_add_ps( matrix[0], _mm_mul_ps( weight, cols[iBoneIndex][0] ) );
+			matrix[1] = _mm_add_ps( matrix[1], _mm_mul_ps( weight, cols[iBoneIndex][1] ) );
+			matrix[2] = _mm_add_ps( matrix[2], _mm_mul_ps( weight, cols[iBoneIndex][2] ) );
+			matrix[3] = _mm_add_ps( matrix[3], _mm_mul_ps( weight, cols[iBoneIndex][3] ) );
+		}
+
+		{
+			__m128 pos[4] = {
+				_mm_mul_ps( matrix[0], _mm_set_ps1( v->vertCoords[0] ) ),
+				_mm_mul_ps( matrix[1], _mm_set_ps1( v->vertCoords[1] ) ),
+				_mm_mul_ps( matrix[2], _mm_set_ps1( v->vertCoords[2] ) ),
+				matrix[3] // matrix[3] * 1 - translation
+			};
+
+			__m128 result = _mm_add_ps( _mm_add_ps( pos[0], pos[1] ), _mm_add_ps( pos[2], pos[3] ) );
+			_mm_storeu_ps( xyz[j], result ); // [3] = 0
+		}
+
+		{
+			__m128 norm[3] = {
+				_mm_mul_ps( matrix[0], _mm_set_ps1( v->normal[0] ) ),
+				_mm_mul_ps( matrix[1], _mm_set_ps1( v->normal[1] ) ),
+				_mm_mul_ps( matrix[2], _mm_set_ps1( v->normal[2] ) ),
+				// no translation
+			};
+
+			__m128 result = _mm_add_ps( _mm_add_ps( norm[0], norm[1] ), norm[2] );
+			_mm_storeu_ps( normal[j], result );
+		}
+	}
+}
+
+/*
+================================================================================
+ AVX2 + FMA
+
+ Skinning keeps two columns of the weighted matrix in each 256 bit register,
+ so a weight costs two fused multiply-adds instead of four multiplies and adds.
+================================================================================
+*/
+
+MDX_TARGET_AVX2 static void MDX_Multiply_AVX2( mdxaBone_t *out, const mdxaBone_t *in2, const mdxaBone_t *in )
+{
+	const __m128 r0 = _mm_loadu_ps( in->matrix[0] );
+	const __m128 r1 = _mm_loadu_ps( in->matrix[1] );
+	const __m128 r2 = _mm_loadu_ps( in->matrix[2] );
+	int i;
+
+	for ( i = 0; i < 3; i++ )
+	{
+		const float *m = in2->matrix[i];
+		__m128 row = _mm_fmadd_ps( _mm_set1_ps( m[0] ), r0, _mm_set_ps( m[3], 0.0f, 0.0f, 0.0f ) );
+
+		row = _mm_fmadd_ps( _mm_set1_ps( m[1] ), r1, row );
+		row = _mm_fmadd_ps( _mm_set1_ps( m[2] ), r2, row );
+		_mm_storeu_ps( out->matrix[i], row );
+	}
+}
+
+MDX_TARGET_AVX2 static void MDX_Blend_AVX2( mdxaBone_t *out, const mdxaBone_t *from, const mdxaBone_t *to, float frac )
+{
+	const __m256 back = _mm256_set1_ps( frac );
+	const __m256 front = _mm256_set1_ps( 1.0f - frac );
+	const __m128 back4 = _mm256_castps256_ps128( back );
+	const __m128 front4 = _mm256_castps256_ps128( front );
+
+	_mm256_storeu_ps( out->matrix[0], _mm256_fmadd_ps( back, _mm256_loadu_ps( from->matrix[0] ),
+		_mm256_mul_ps( front, _mm256_loadu_ps( to->matrix[0] ) ) ) );
+	_mm_storeu_ps( out->matrix[2], _mm_fmadd_ps( back4, _mm_loadu_ps( from->matrix[2] ),
+		_mm_mul_ps( front4, _mm_loadu_ps( to->matrix[2] ) ) ) );
+}
+
+MDX_TARGET_AVX2 static inline __m256 MDX_Pair_AVX2( __m128 lo, __m128 hi )
+{
+	return _mm256_insertf128_ps( _mm256_castps128_ps256( lo ), hi, 1 );
+}
+
+MDX_TARGET_AVX2 static void MDX_Skin_AVX2( const mdxmVertex_t *v, int numVerts, const mdxaBone_t * const *bones, int numBones, vec4_t *xyz, vec4_t *normal )
+{
+	__m256	cols01[32], cols23[32];
+
+	assert( numBones <= 32 );
+	int		j, k;
+
+	for ( j = 0; j < numBones; j++ )
+	{
+		__m128 c0 = _mm_loadu_ps( bones[j]->matrix[0] );
+		__m128 c1 = _mm_loadu_ps( bones[j]->matrix[1] );
+		__m128 c2 = _mm_loadu_ps( bones[j]->matrix[2] );
+		__m128 c3 = _mm_setzero_ps();
+
+		_MM_TRANSPOSE4_PS( c0, c1, c2, c3 );
+		cols01[j] = MDX_Pair_AVX2( c0, c1 );
+		cols23[j] = MDX_Pair_AVX2( c2, c3 );
+	}
+
+	const __m256 one = _mm256_set1_ps( 1.0f );
+	const __m256 zero = _mm256_setzero_ps();
+
+	for ( j = 0; j < numVerts; j++, v++ )
+	{
+		const int iNumWeights = G2_GetVertWeights( v );
+		__m256 m01 = _mm256_setzero_ps();
+		__m256 m23 = _mm256_setzero_ps();
+
+		// calculate weighted bone matrix
+		float fTotalWeight = 0.0f;
+		for ( k = 0 ; k < iNumWeights ; k++ )
+		{
+			int		iBoneIndex	= G2_GetVertBoneIndex( v, k );
+			__m256	weight		= _mm256_set1_ps( G2_GetVertBoneWeight( v, k, fTotalWeight, iNumWeights ) );
+
+			m01 = _mm256_fmadd_ps( weight, cols01[iBoneIndex], m01 );
+			m23 = _mm256_fmadd_ps( weight, cols23[iBoneIndex], m23 );
+		}
+
+		// column 0 * x + column 1 * y | column 2 * z + column 3
+		__m256 pos = _mm256_fmadd_ps( m01, _mm256_blend_ps( _mm256_set1_ps( v->vertCoords[0] ), _mm256_set1_ps( v->vertCoords[1] ), 0xf0 ),
+			_mm256_mul_ps( m23, _mm256_blend_ps( _mm256_set1_ps( v->vertCoords[2] ), one, 0xf0 ) ) );
+		__m256 norm = _mm256_fmadd_ps( m01, _mm256_blend_ps( _mm256_set1_ps( v->normal[0] ), _mm256_set1_ps( v->normal[1] ), 0xf0 ),
+			_mm256_mul_ps( m23, _mm256_blend_ps( _mm256_set1_ps( v->normal[2] ), zero, 0xf0 ) ) );
+
+		_mm_storeu_ps( xyz[j], _mm_add_ps( _mm256_castps256_ps128( pos ), _mm256_extractf128_ps( pos, 1 ) ) );
+		_mm_storeu_ps( normal[j], _mm_add_ps( _mm256_castps256_ps128( norm ), _mm256_extractf128_ps( norm, 1 ) ) );
+	}
+}
+
+static qboolean MDX_CPUHasAVX2( void )
+{
+#ifdef _MSC_VER
+	int regs[4];
+
+	__cpuid( regs, 0 );
+	if ( regs[0] < 7 )
+		return qfalse;
+
+	// the OS has to save the ymm registers too
+	__cpuid( regs, 1 );
+	if ( !(regs[2] & (1 << 27)) || !(regs[2] & (1 << 28)) || !(regs[2] & (1 << 12)) )
+		return qfalse;
+	if ( (_xgetbv( 0 ) & 6) != 6 )
+		return qfalse;
+
+	__cpuidex( regs, 7, 0 );
+	return (regs[1] & (1 << 5)) ? qtrue : qfalse;
+#else
+	__builtin_cpu_init();
+	return ( __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" ) ) ? qtrue : qfalse;
+#endif
+}
+#endif // id386 || idx64
+
+/*
+================================================================================
+ Selection
+================================================================================
+*/
+
+static const mdxKernels_t mdxKernelSets[MDX_SIMD_MAX] = {
+	{ MDX_SIMD_SCALAR, "scalar", MDX_Multiply_Scalar, MDX_Blend_Scalar, MDX_UnCompressQuat_Scalar, MDX_Skin_Scalar },
+#if id386 || idx64
+	{ MDX_SIMD_SSE2, "SSE2", MDX_Multiply_SSE2, MDX_Blend_SSE2, MDX_UnCompressQuat_SSE2, MDX_Skin_SSE2 },
+	// decompression doesn't get any wider
+	{ MDX_SIMD_AVX2, "AVX2", MDX_Multiply_AVX2, MDX_Blend_AVX2, MDX_UnCompressQuat_SSE2, MDX_Skin_AVX2 },
+#endif
+};
+
+#if id386 || idx64
+mdxKernels_t mdxKernels = mdxKernelSets[MDX_SIMD_SSE2];
+#else
+mdxKernels_t mdxKernels = mdxKernelSets[MDX_SIMD_SCALAR];
+#endif
+
+mdxSimd_t MDX_SupportedSimd( void )
+{
+#if id386 || idx64
+	static int supported = -1;
+
+	if ( supported < 0 )
+	{
+		supported = MDX_CPUHasAVX2() ? MDX_SIMD_AVX2 : MDX_SIMD_SSE2;
+	}
+	return (mdxSimd_t)supported;
+#else
+	return MDX_SIMD_SCALAR;
+#endif
+}
+
+const mdxKernels_t *MDX_GetKernels( mdxSimd_t simd )
+{
+	if ( simd < MDX_SIMD_SCALAR || simd > MDX_SupportedSimd() )
+	{
+		return NULL;
+	}
+	return &mdxKernelSets[simd];
+}
+
+mdxSimd_t MDX_SelectKernels( int simd )
+{
+	if ( simd > MDX_SupportedSimd() )
+	{
+		simd = MDX_SupportedSimd();
+	}
+	if ( simd < MDX_SIMD_SCALAR )
+	{
+		simd = MDX_SIMD_SCALAR;
+	}
+
+	mdxKernels = mdxKernelSets[simd];
+	return (mdxSimd_t)simd;
+}
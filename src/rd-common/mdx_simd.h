@@ -0,0 +1,49 @@
+// Filename:-	mdx_simd.h
+//
+// Ghoul2 animation kernels - bone matrix compose, frame lerp, bone decompression
+// and vertex skinning. One set for each instruction set, r_ghoul2Simd picks the
+// one in use at startup. The scalar set is the reference the others are checked
+// against.
+
+#ifndef MDX_SIMD_H
+#define MDX_SIMD_H
+
+#include "../qcommon/q_shared.h"
+#ifndef MDXABONEDEF
+#define MDXABONEDEF
+#endif
+#include "mdx_format.h"
+
+typedef enum {
+	MDX_SIMD_SCALAR,
+	MDX_SIMD_SSE2,
+	MDX_SIMD_AVX2,		// with FMA
+
+	MDX_SIMD_MAX
+} mdxSimd_t;
+
+typedef struct {
+	mdxSimd_t	simd;
+	const char	*name;
+
+	// out = in2 * in, the rows being 3x4 matrices with an implied 0 0 0 1 row
+	void		(*multiply)( mdxaBone_t *out, const mdxaBone_t *in2, const mdxaBone_t *in );
+
+	// out = from * frac + to * ( 1 - frac ), all twelve floats
+	void		(*blend)( mdxaBone_t *out, const mdxaBone_t *from, const mdxaBone_t *to, float frac );
+
+	// matrix of a compressed quaternion bone, as MC_UnCompressQuat
+	void		(*unCompressQuat)( mdxaBone_t *out, const unsigned char *comp );
+
+	// deform numVerts vertexes by their weighted bones, bones[] being the numBones bone references of the surface
+	void		(*skin)( const mdxmVertex_t *v, int numVerts, const mdxaBone_t * const *bones, int numBones, vec4_t *xyz, vec4_t *normal );
+} mdxKernels_t;
+
+// the set in use
+extern mdxKernels_t	mdxKernels;
+
+mdxSimd_t			MDX_SupportedSimd( void );
+const mdxKernels_t	*MDX_GetKernels( mdxSimd_t simd );		// NULL if the CPU can't run them
+mdxSimd_t			MDX_SelectKernels( int simd );			// best supported up to simd, returns what it got
+
+#endif // MDX_SIMD_H
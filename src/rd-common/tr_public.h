@@ -6,7 +6,7 @@
 #include "../qcommon/qcommon.h"
 #include "../ghoul2/ghoul2_shared.h"
 
-#define	REF_API_VERSION		8
+#define	REF_API_VERSION		11
 
 typedef enum
 {
@@ -246,6 +246,11 @@ typedef struct {
 	// milliseconds should only be used for profiling, never
 	// for anything game related.  Get time from the refdef
 	int				(*Milliseconds)						( void );
+	int64_t			(*Microseconds)						( void );
+
+	// run func for every index on the job threads, see Com_ParallelFor
+	void			(*ParallelFor)						( int count, int numThreads, jobFunc_t func, void *data );
+	int				(*JobMaxThreads)					( void );
 
 	// stack based memory allocation for per-level things that
 	// won't be freed
@@ -304,6 +309,7 @@ typedef struct {
 	int				(*FS_Write)							( const void *buffer, int len, fileHandle_t f );
 	void			(*FS_WriteFile)						( const char *qpath, const void *buffer, int size );
 	qboolean		(*FS_FileExists)					( const char *file );
+	qboolean		(*FS_PrefetchFile)					( const char *file );
 
 
 	void			(*CM_BoxTrace)						( trace_t *results, const vec3_t start, const vec3_t end, const vec3_t mins, const vec3_t maxs, clipHandle_t model, int brushmask, qboolean capsule );	
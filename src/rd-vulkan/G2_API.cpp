@@ -56,11 +56,16 @@ CGhoul2Info_v *G2API_GetGhoul2Model(g2handle_t g2h) {
 
 void G2API_FixGhoul2InfoLeaks(bool ricksCrazyOnServer)
 {
+	for (CGhoul2Info_m::iterator it = ghoultable[ricksCrazyOnServer].begin(); it != ghoultable[ricksCrazyOnServer].end(); ++it)
+	{
+		G2_FreeCollisionCache(it->first);
+	}
 	ghoultable[ricksCrazyOnServer].clear();
 	maxModelIndex[ricksCrazyOnServer] = 0;
 }
 
 void G2API_CleanGhoul2Models(g2handle_t *g2hPtr) {
+	G2_FreeCollisionCache(*g2hPtr);
 	ghoultable[RicksCrazyOnServer].erase(*g2hPtr);
 	*g2hPtr = 0;
 }
@@ -1009,6 +1014,23 @@ static int QDECL QsortDistance( const void *a, const void *b ) {
 }
 
 
+// traces kept by "ghoul2tracebench record", to be run again against both collision paths
+typedef struct {
+	g2handle_t	g2h;
+	bool		onServer;
+	vec3_t		angles, position;
+	vec3_t		rayStart, rayEnd;
+	vec3_t		scale;
+	int			frameNumber;
+	int			entNum;
+	int			traceFlags;
+	int			useLod;
+	float		fRadius;
+} g2RecordedTrace_t;
+
+static std::vector<g2RecordedTrace_t>	g2RecordedTraces;
+static size_t							g2RecordTraces;		// how many more to keep
+
 void G2API_CollisionDetect(CollisionRecord_t *collRecMap, g2handle_t g2h, const vec3_t angles, const vec3_t position, int frameNumber, int entNum, const vec3_t rayStart, const vec3_t rayEnd, const vec3_t scale, CMiniHeap *G2VertSpace, int traceFlags, int useLod, float fRadius)
 {
 
@@ -1016,21 +1038,54 @@ void G2API_CollisionDetect(CollisionRecord_t *collRecMap, g2handle_t g2h, const
 
 	if (ghoul2)
 	{
-		vec3_t	transRayStart, transRayEnd;
+		vec3_t				transRayStart, transRayEnd;
+		CG2CollisionCache	*cache = NULL;
 
-		// make sure we have transformed the whole skeletons for each model
-		G2_ConstructGhoulSkeleton(*ghoul2, frameNumber, NULL, true, angles, position, scale, false);
+		if (g2RecordTraces)
+		{
+			g2RecordedTrace_t rec;
+
+			rec.g2h = g2h;
+			rec.onServer = RicksCrazyOnServer;
+			VectorCopy(angles, rec.angles);
+			VectorCopy(position, rec.position);
+			VectorCopy(rayStart, rec.rayStart);
+			VectorCopy(rayEnd, rec.rayEnd);
+			VectorCopy(scale, rec.scale);
+			rec.frameNumber = frameNumber;
+			rec.entNum = entNum;
+			rec.traceFlags = traceFlags;
+			rec.useLod = useLod;
+			rec.fRadius = fRadius;
+			g2RecordedTraces.push_back(rec);
+
+			if (!--g2RecordTraces)
+			{
+				ri.Printf(PRINT_ALL, "ghoul2tracebench: recorded %i traces\n", (int)g2RecordedTraces.size());
+			}
+		}
 
-		// pre generate the world matrix - used to transform the incoming ray
-		G2_GenerateWorldMatrix(angles, position);
+		if (r_ghoul2TraceCache->integer)
+		{
+			// skeletons and vertexes are kept for the instance until something they depend on changes
+			cache = G2_CacheCollisionModel(g2h, *ghoul2, frameNumber, angles, position, scale, useLod);
+		}
+		else
+		{
+			// make sure we have transformed the whole skeletons for each model
+			G2_ConstructGhoulSkeleton(*ghoul2, frameNumber, NULL, true, angles, position, scale, false);
 
 #ifdef G2_COLLISION_ENABLED
-		//G2VertSpace->ResetHeap();
-		ri.GetG2VertSpaceServer()->ResetHeap();
+			//G2VertSpace->ResetHeap();
+			ri.GetG2VertSpaceServer()->ResetHeap();
 #endif
 
-		// now having done that, time to build the model
-		G2_TransformModel(*ghoul2, frameNumber, scale, ri.GetG2VertSpaceServer(), useLod);
+			// now having done that, time to build the model
+			G2_TransformModel(*ghoul2, frameNumber, scale, ri.GetG2VertSpaceServer(), useLod);
+		}
+
+		// pre generate the world matrix - used to transform the incoming ray
+		G2_GenerateWorldMatrix(angles, position);
 
 		// model is built. Lets check to see if any triangles are actually hit.
 		// first up, translate the ray to model space
@@ -1038,7 +1093,7 @@ void G2API_CollisionDetect(CollisionRecord_t *collRecMap, g2handle_t g2h, const
 		TransformAndTranslatePoint(rayEnd, transRayEnd, &worldMatrixInv);
 
 		// now walk each model and check the ray against each poly - sigh, this is SO expensive. I wish there was a better way to do this.
-		G2_TraceModels(*ghoul2, transRayStart, transRayEnd, collRecMap, entNum, traceFlags, useLod, fRadius);
+		G2_TraceModels(*ghoul2, transRayStart, transRayEnd, collRecMap, entNum, traceFlags, useLod, fRadius, cache);
 #ifdef G2_COLLISION_ENABLED
 		int i;
 		for ( i = 0; i < MAX_G2_COLLISIONS && collRecMap[i].mEntityNum != -1; i ++ );
@@ -1056,6 +1111,141 @@ void G2API_CollisionDetect(CollisionRecord_t *collRecMap, g2handle_t g2h, const
 	}
 }
 
+// what a replayed trace found, enough to tell the two collision paths apart
+typedef struct {
+	int		numHits;
+	int		surfaceIndex;
+	int		polyIndex;
+	float	distance;
+} g2TraceResult_t;
+
+// run all recorded traces with r_ghoul2TraceCache set to cache, returns the time they took
+static int64_t G2_ReplayTraces(const char *cache, std::vector<g2TraceResult_t> &results)
+{
+	CollisionRecord_t	collRecMap[MAX_G2_COLLISIONS];
+	const bool			savedOnServer = RicksCrazyOnServer;
+	int64_t				start, usec;
+	size_t				i;
+	int					j;
+
+	ri.Cvar_Set("r_ghoul2TraceCache", cache);
+
+	// start cold, every instance builds its skeletons and vertexes on its first trace
+	for (i = 0; i < g2RecordedTraces.size(); i++)
+	{
+		G2_FreeCollisionCache(g2RecordedTraces[i].g2h);
+	}
+
+	results.resize(g2RecordedTraces.size());
+
+	usec = 0;
+	for (i = 0; i < g2RecordedTraces.size(); i++)
+	{
+		const g2RecordedTrace_t	&rec = g2RecordedTraces[i];
+		g2TraceResult_t			&res = results[i];
+
+		memset(&res, 0, sizeof(res));
+		res.surfaceIndex = res.polyIndex = -1;
+
+		RicksCrazyOnServer = rec.onServer;
+		if (!G2API_GetGhoul2Model(rec.g2h))
+		{
+			continue;
+		}
+
+		for (j = 0; j < MAX_G2_COLLISIONS; j++)
+		{
+			collRecMap[j].mEntityNum = -1;
+		}
+
+		start = ri.Microseconds();
+		G2API_CollisionDetect(collRecMap, rec.g2h, rec.angles, rec.position, rec.frameNumber, rec.entNum, rec.rayStart, rec.rayEnd,
+			rec.scale, NULL, rec.traceFlags, rec.useLod, rec.fRadius);
+		usec += ri.Microseconds() - start;
+
+		for (j = 0; j < MAX_G2_COLLISIONS && collRecMap[j].mEntityNum != -1; j++);
+		res.numHits = j;
+		if (j)
+		{
+			res.surfaceIndex = collRecMap[0].mSurfaceIndex;
+			res.polyIndex = collRecMap[0].mPolyIndex;
+			res.distance = collRecMap[0].mDistance;
+		}
+	}
+
+	RicksCrazyOnServer = savedOnServer;
+	return usec;
+}
+
+/*
+==============
+R_Ghoul2TraceBench_f
+
+ghoul2tracebench record [count]
+ghoul2tracebench
+
+The first form keeps the next count ghoul2 traces of the running game, the second runs them all again, first
+building the skeletons and vertexes for every trace as before r_ghoul2TraceCache, then through the cache and
+the triangle trees. The time per trace of both is printed, and how many traces didn't find the same hits.
+The instances are used as they are when the traces are run again, so do it while the game is still going.
+==============
+*/
+void R_Ghoul2TraceBench_f( void )
+{
+	std::vector<g2TraceResult_t>	uncached, cached;
+	char							saved[MAX_CVAR_VALUE_STRING];
+	int64_t							uncachedUsec, cachedUsec;
+	int								mismatches;
+	size_t							i;
+
+	if (ri.Cmd_Argc() > 1)
+	{
+		if (Q_stricmp(ri.Cmd_Argv(1), "record"))
+		{
+			ri.Printf(PRINT_ALL, "usage: ghoul2tracebench [record [count]]\n");
+			return;
+		}
+		g2RecordedTraces.clear();
+		g2RecordTraces = ri.Cmd_Argc() > 2 ? Com_Clampi(1, 1 << 20, atoi(ri.Cmd_Argv(2))) : 4096;
+		ri.Printf(PRINT_ALL, "ghoul2tracebench: recording the next %i traces\n", (int)g2RecordTraces);
+		return;
+	}
+
+	if (g2RecordTraces)
+	{
+		ri.Printf(PRINT_ALL, "ghoul2tracebench: still recording, %i traces to go\n", (int)g2RecordTraces);
+		return;
+	}
+	if (g2RecordedTraces.empty())
+	{
+		ri.Printf(PRINT_ALL, "ghoul2tracebench: nothing recorded, use ghoul2tracebench record first\n");
+		return;
+	}
+
+	Q_strncpyz(saved, r_ghoul2TraceCache->string, sizeof(saved));
+
+	uncachedUsec = G2_ReplayTraces("0", uncached);
+	cachedUsec = G2_ReplayTraces("1", cached);
+
+	ri.Cvar_Set("r_ghoul2TraceCache", saved);
+
+	mismatches = 0;
+	for (i = 0; i < g2RecordedTraces.size(); i++)
+	{
+		if (uncached[i].numHits != cached[i].numHits || uncached[i].surfaceIndex != cached[i].surfaceIndex ||
+			uncached[i].polyIndex != cached[i].polyIndex || uncached[i].distance != cached[i].distance)
+		{
+			mismatches++;
+		}
+	}
+
+	ri.Printf(PRINT_ALL, "ghoul2tracebench: %i traces\n", (int)g2RecordedTraces.size());
+	ri.Printf(PRINT_ALL, "uncached: %8.3f usec/trace\n", (double)uncachedUsec / g2RecordedTraces.size());
+	ri.Printf(PRINT_ALL, "  cached: %8.3f usec/trace, %.2fx\n", (double)cachedUsec / g2RecordedTraces.size(),
+		(double)Q_max(uncachedUsec, (int64_t)1) / Q_max(cachedUsec, (int64_t)1));
+	ri.Printf(PRINT_ALL, "%i traces with different hits\n", mismatches);
+}
+
 qboolean G2API_SetGhoul2ModelFlags(CGhoul2Info *ghlInfo, const int flags)
 {
   	if (ghlInfo)
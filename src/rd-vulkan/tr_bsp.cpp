@@ -1878,6 +1878,17 @@ static	void R_LoadShaders( const lump_t *l, world_t &worldData ) {
 		out[i].surfaceFlags = LittleLong( out[i].surfaceFlags );
 		out[i].contentFlags = LittleLong( out[i].contentFlags );
 	}
+
+	// start inflating the images of shaders without a script, in the
+	// order R_LoadImage tries the extensions
+	for ( i=0 ; i<count ; i++ ) {
+		char	name[MAX_QPATH];
+
+		COM_StripExtension( out[i].shader, name, sizeof( name ) );
+		if ( !ri.FS_PrefetchFile( va( "%s.jpg", name ) ) && !ri.FS_PrefetchFile( va( "%s.png", name ) ) ) {
+			ri.FS_PrefetchFile( va( "%s.tga", name ) );
+		}
+	}
 }
 
 /*
@@ -15,6 +15,7 @@
 #endif
 #include "../ghoul2/G2_local.h"
 #include "../rd-common/matcomp.h"
+#include "../rd-common/mdx_simd.h"
 
 #define	LL(x) x=LittleLong(x)
 
@@ -411,21 +412,7 @@ void G2_CreateMatrixFromQuaterion(mdxaBone_t *mat, vec4_t quat)
 // nasty little matrix multiply going on here..
 void Multiply_3x4Matrix(mdxaBone_t *out, const mdxaBone_t *in2, const mdxaBone_t *in)
 {
-	// first row of out
-	out->matrix[0][0] = (in2->matrix[0][0] * in->matrix[0][0]) + (in2->matrix[0][1] * in->matrix[1][0]) + (in2->matrix[0][2] * in->matrix[2][0]);
-	out->matrix[0][1] = (in2->matrix[0][0] * in->matrix[0][1]) + (in2->matrix[0][1] * in->matrix[1][1]) + (in2->matrix[0][2] * in->matrix[2][1]);
-	out->matrix[0][2] = (in2->matrix[0][0] * in->matrix[0][2]) + (in2->matrix[0][1] * in->matrix[1][2]) + (in2->matrix[0][2] * in->matrix[2][2]);
-	out->matrix[0][3] = (in2->matrix[0][0] * in->matrix[0][3]) + (in2->matrix[0][1] * in->matrix[1][3]) + (in2->matrix[0][2] * in->matrix[2][3]) + in2->matrix[0][3];
-	// second row of outf out
-	out->matrix[1][0] = (in2->matrix[1][0] * in->matrix[0][0]) + (in2->matrix[1][1] * in->matrix[1][0]) + (in2->matrix[1][2] * in->matrix[2][0]);
-	out->matrix[1][1] = (in2->matrix[1][0] * in->matrix[0][1]) + (in2->matrix[1][1] * in->matrix[1][1]) + (in2->matrix[1][2] * in->matrix[2][1]);
-	out->matrix[1][2] = (in2->matrix[1][0] * in->matrix[0][2]) + (in2->matrix[1][1] * in->matrix[1][2]) + (in2->matrix[1][2] * in->matrix[2][2]);
-	out->matrix[1][3] = (in2->matrix[1][0] * in->matrix[0][3]) + (in2->matrix[1][1] * in->matrix[1][3]) + (in2->matrix[1][2] * in->matrix[2][3]) + in2->matrix[1][3];
-	// third row of out  out
-	out->matrix[2][0] = (in2->matrix[2][0] * in->matrix[0][0]) + (in2->matrix[2][1] * in->matrix[1][0]) + (in2->matrix[2][2] * in->matrix[2][0]);
-	out->matrix[2][1] = (in2->matrix[2][0] * in->matrix[0][1]) + (in2->matrix[2][1] * in->matrix[1][1]) + (in2->matrix[2][2] * in->matrix[2][1]);
-	out->matrix[2][2] = (in2->matrix[2][0] * in->matrix[0][2]) + (in2->matrix[2][1] * in->matrix[1][2]) + (in2->matrix[2][2] * in->matrix[2][2]);
-	out->matrix[2][3] = (in2->matrix[2][0] * in->matrix[0][3]) + (in2->matrix[2][1] * in->matrix[1][3]) + (in2->matrix[2][2] * in->matrix[2][3]) + in2->matrix[2][3];
+	mdxKernels.multiply(out, in2, in);
 }
 
 
@@ -442,7 +429,7 @@ static int G2_GetBonePoolIndex(	const mdxaHeader_t *pMDXAHeader, int iFrame, int
 /*static inline*/ void UnCompressBone(float mat[3][4], int iBoneIndex, const mdxaHeader_t *pMDXAHeader, int iFrame)
 {
 	const mdxaCompQuatBone_t *pCompBonePool = (const mdxaCompQuatBone_t *) ((const byte *)pMDXAHeader + pMDXAHeader->ofsCompBonePool);
-	MC_UnCompressQuat(mat, pCompBonePool[ G2_GetBonePoolIndex( pMDXAHeader, iFrame, iBoneIndex ) ].Comp);
+	mdxKernels.unCompressQuat((mdxaBone_t *)mat, pCompBonePool[ G2_GetBonePoolIndex( pMDXAHeader, iFrame, iBoneIndex ) ].Comp);
 }
 
 #define DEBUG_G2_TIMING (0)
@@ -455,7 +442,7 @@ void G2_TransformBone (CTransformBone &TB)
 	mdxaSkel_t		*skel;
 	mdxaSkelOffsets_t *offsets;
 	boneInfo_v		&boneList = TB.rootBoneList;
-	int				i, j, boneListIndex;
+	int				i, boneListIndex;
 	int				angleOverride = 0;
 
 #if DEBUG_G2_TIMING
@@ -768,7 +755,6 @@ void G2_TransformBone (CTransformBone &TB)
 	if (TB.blendMode)
 	{
 		const float backlerp = TB.blendFrame - (int)TB.blendFrame;
-		const float frontlerp = 1.0f - backlerp;
 
 		// figure out where the location of the blended animation data is
 //		const mdxaFrame_t	*bFrame =	(mdxaFrame_t *)((byte *)TB.header + TB.header->ofsFrames + (int)TB.blendFrame * TB.frameSize );
@@ -779,11 +765,7 @@ void G2_TransformBone (CTransformBone &TB)
 			UnCompressBone(tbone[3].matrix,TB.child, TB.header, TB.blendFrame);
 			UnCompressBone(tbone[4].matrix,TB.child, TB.header, TB.blendOldFrame);
 
-		for ( j = 0 ; j < 12 ; j++ )
-		{
-			((float *)&tbone[5])[j] = (backlerp * ((float *)&tbone[3])[j])
-				+ (frontlerp * ((float *)&tbone[4])[j]);
-		}
+		mdxKernels.blend(&tbone[5], &tbone[3], &tbone[4], backlerp);
 	}
 
 	// figure out where the location of the bone animation data is
@@ -804,12 +786,7 @@ void G2_TransformBone (CTransformBone &TB)
 		// blend in the other frame if we need to
 		if (TB.blendMode)
 		{
-		float blendFrontlerp = 1.0f - TB.blendLerp;
-	  		for ( j = 0 ; j < 12 ; j++ )
-			{
-  				((float *)&tbone[2])[j] = (TB.blendLerp * ((float *)&tbone[2])[j])
-					+ (blendFrontlerp * ((float *)&tbone[5])[j]);
-			}
+			mdxKernels.blend(&tbone[2], &tbone[2], &tbone[5], TB.blendLerp);
 		}
 
   		if (TB.rootBone)
@@ -820,7 +797,6 @@ void G2_TransformBone (CTransformBone &TB)
   	}
 	else
   	{
-		const float frontlerp = 1.0f - TB.backlerp;
 		// figure out where the location of the bone animation data is
 		assert (TB.header->numFrames > TB.newFrame);//validate the frame we're about to grab
 //		const mdxaFrame_t	*aFrame = (mdxaFrame_t *)((byte *)TB.header + TB.header->ofsFrames + TB.newFrame * TB.frameSize );
@@ -830,21 +806,12 @@ void G2_TransformBone (CTransformBone &TB)
 		UnCompressBone(tbone[0].matrix,TB.child, TB.header, TB.newFrame);
 		UnCompressBone(tbone[1].matrix,TB.child, TB.header, TB.currentFrame);
 
-		for ( j = 0 ; j < 12 ; j++ )
-		{
-			((float *)&tbone[2])[j] = (TB.backlerp * ((float *)&tbone[0])[j])
-				+ (frontlerp * ((float *)&tbone[1])[j]);
-		}
+		mdxKernels.blend(&tbone[2], &tbone[0], &tbone[1], TB.backlerp);
 
 		// blend in the other frame if we need to
 		if (TB.blendMode)
 		{
-			const float blendFrontlerp = 1.0f - TB.blendLerp;
-			for ( j = 0 ; j < 12 ; j++ )
-			{
-				((float *)&tbone[2])[j] = (TB.blendLerp * ((float *)&tbone[2])[j])
-					+ (blendFrontlerp * ((float *)&tbone[5])[j]);
-			}
+			mdxKernels.blend(&tbone[2], &tbone[2], &tbone[5], TB.blendLerp);
 		}
 
 		if (TB.rootBone)
@@ -896,12 +863,7 @@ void G2_TransformBone (CTransformBone &TB)
 				Multiply_3x4Matrix(&temp, &boneOverride.newMatrix,&skel->BasePoseMatInv);
 
 				// now do the blend into the destination
-				const float blendFrontlerp = 1.0f - blendLerp;
-				for ( j = 0 ; j < 12 ; j++ )
-				{
-					((float *)&bone)[j] = (blendLerp * ((float *)&temp)[j])
-						+ (blendFrontlerp * ((float *)&firstPass)[j]);
-				}
+				mdxKernels.blend(&bone, &temp, &firstPass, blendLerp);
 			}
 			else
 			{
@@ -1278,13 +1240,164 @@ void G2_ProcessGeneratedSurfaceBolts(CGhoul2Info &ghoul2, mdxaBone_v &bonePtr, m
 	}
 }
 
+// deform the vertexes of a surface by the lerped bones - xyz and normal get surface->numVerts entries each
+static void G2_SkinSurface(const mdxmSurface_t *surface, const mdxaBone_v &bonePtr, vec4_t *xyz, vec4_t *normal)
+{
+	const mdxaBone_t *bones[32];
+	int				 j;
+
+	const int *piBoneRefs = (const int*) ((const byte*)surface + surface->ofsBoneReferences);
+	const mdxmVertex_t 	*v = (const mdxmVertex_t *) ((const byte *)surface + surface->ofsVerts);
+
+	// gather the referenced bones, the vertexes index into these
+	assert( surface->numBoneReferences <= 32 );
+	for ( j = 0; j < surface->numBoneReferences; j++ )
+	{
+		bones[j] = &bonePtr[piBoneRefs[j]].second;
+	}
+
+	mdxKernels.skin( v, surface->numVerts, bones, surface->numBoneReferences, xyz, normal );
+}
+
 #ifndef DEDICATED
+/*
+==============================================================
+
+Per frame skinning
+
+With r_ghoul2Threads set, RenderSurfaces queues every surface it adds and
+R_SkinGhoulSurfaces deforms them all on the job threads once the entities of
+a view are in. RB_SurfaceGhoul only copies the result into tess then. The
+vertexes stay valid until the commands of the frame have been issued, the
+buffers grow between frames to what the last one needed.
+
+==============================================================
+*/
+
+#define MAX_G2_SKINS		16384
+#define MAX_G2_SKIN_VERTS	(1024*1024)		// positions and normals, 16 bytes each
+
+static struct {
+	g2Skin_t	*skins;
+	int			maxSkins;
+	int			numSkins;
+	int			numSkinned;		// skins before this one are done
+
+	vec4_t		*verts;
+	int			maxVerts;
+	int			numVerts;
+
+	int			wantSkins;		// what this frame asked for, including what didn't fit
+	int			wantVerts;
+} g2Skins;
+
+// returns the skin already queued for this surface or queues a new one. NULL leaves the skinning to the back end
+static g2Skin_t *G2_QueueSkin(g2Skin_t *skin, mdxmSurface_t *surface, mdxaBone_v *bonePtr)
+{
+	if (skin || r_ghoul2Threads->integer < 2)
+	{
+		return skin;
+	}
+
+	g2Skins.wantSkins++;
+	g2Skins.wantVerts += surface->numVerts * 2;
+	if (g2Skins.numSkins >= g2Skins.maxSkins || g2Skins.numVerts + surface->numVerts * 2 > g2Skins.maxVerts)
+	{
+		return NULL;
+	}
+
+	skin = &g2Skins.skins[g2Skins.numSkins++];
+	skin->surface = surface;
+	skin->bonePtr = bonePtr;
+	skin->xyz = g2Skins.verts + g2Skins.numVerts;
+	g2Skins.numVerts += surface->numVerts * 2;
+
+	return skin;
+}
+
+static void R_SkinGhoulSurfaceJob(void *data, int index, int threadNum)
+{
+	g2Skin_t *skin = (g2Skin_t *)data + index;
+
+	G2_SkinSurface(skin->surface, *skin->bonePtr, skin->xyz, skin->xyz + skin->surface->numVerts);
+}
+
+/*
+==============
+R_SkinGhoulSurfaces
+
+Deforms everything queued since the last call, called once all entities of a view have been added.
+==============
+*/
+void R_SkinGhoulSurfaces( void )
+{
+	int count = g2Skins.numSkins - g2Skins.numSkinned;
+
+	if (count <= 0)
+	{
+		return;
+	}
+
+	ri.ParallelFor(count, r_ghoul2Threads->integer, R_SkinGhoulSurfaceJob, g2Skins.skins + g2Skins.numSkinned);
+	g2Skins.numSkinned = g2Skins.numSkins;
+}
+
+/*
+==============
+R_ResetGhoulSkins
+
+Called at the start of every frame, when nothing refers to the skinned vertexes any more.
+==============
+*/
+void R_ResetGhoulSkins( void )
+{
+	if (g2Skins.wantSkins > g2Skins.maxSkins && g2Skins.maxSkins < MAX_G2_SKINS)
+	{
+		g2Skins.maxSkins = Com_Clampi(1024, MAX_G2_SKINS, g2Skins.wantSkins + g2Skins.wantSkins / 2);
+		if (g2Skins.skins)
+		{
+			Z_Free(g2Skins.skins);
+		}
+		g2Skins.skins = (g2Skin_t *)Z_Malloc(g2Skins.maxSkins * sizeof(g2Skin_t), TAG_GHOUL2, qfalse);
+	}
+
+	if (g2Skins.wantVerts > g2Skins.maxVerts && g2Skins.maxVerts < MAX_G2_SKIN_VERTS)
+	{
+		g2Skins.maxVerts = Com_Clampi(65536, MAX_G2_SKIN_VERTS, g2Skins.wantVerts + g2Skins.wantVerts / 2);
+		if (g2Skins.verts)
+		{
+			Z_Free(g2Skins.verts);
+		}
+		g2Skins.verts = (vec4_t *)Z_Malloc(g2Skins.maxVerts * sizeof(vec4_t), TAG_GHOUL2, qfalse);
+	}
+
+	g2Skins.numSkins = 0;
+	g2Skins.numSkinned = 0;
+	g2Skins.numVerts = 0;
+	g2Skins.wantSkins = 0;
+	g2Skins.wantVerts = 0;
+}
+
+void R_FreeGhoulSkins( void )
+{
+	if (g2Skins.skins)
+	{
+		Z_Free(g2Skins.skins);
+	}
+	if (g2Skins.verts)
+	{
+		Z_Free(g2Skins.verts);
+	}
+	memset(&g2Skins, 0, sizeof(g2Skins));
+}
+
 // set up each surface ready for rendering in the back end
 void RenderSurfaces(CRenderSurface &RS)
 {
 	int			i;
 	shader_t	*shader = 0;
 	int			offFlags = 0;
+	g2Skin_t	*skin = NULL;
 
 	// back track and get the surfinfo struct for this surface
 	mdxmSurface_t			*surface = (mdxmSurface_t *)G2_FindSurface((void *)RS.currentModel, RS.surfaceNum, RS.lod);
@@ -1342,6 +1455,7 @@ void RenderSurfaces(CRenderSurface &RS)
 			CRenderableSurface *newSurf = new CRenderableSurface;
 			newSurf->surfaceData = surface;
 			newSurf->boneList = &RS.bonePtr;
+			newSurf->skin = skin = G2_QueueSkin(skin, surface, &RS.bonePtr);
 			R_AddDrawSurf( (surfaceType_t *)newSurf, tr.shadowShader, 0, qfalse );
 		}
 
@@ -1354,6 +1468,7 @@ void RenderSurfaces(CRenderSurface &RS)
 			CRenderableSurface *newSurf = new CRenderableSurface;
 			newSurf->surfaceData = surface;
 			newSurf->boneList = &RS.bonePtr;
+			newSurf->skin = skin = G2_QueueSkin(skin, surface, &RS.bonePtr);
 			R_AddDrawSurf( (surfaceType_t *)newSurf, tr.projectionShadowShader, 0, qfalse );
 		}
 
@@ -1363,6 +1478,7 @@ void RenderSurfaces(CRenderSurface &RS)
 			CRenderableSurface *newSurf = new CRenderableSurface;
 			newSurf->surfaceData = surface;
 			newSurf->boneList = &RS.bonePtr;
+			newSurf->skin = skin = G2_QueueSkin(skin, surface, &RS.bonePtr);
 			R_AddDrawSurf( (surfaceType_t *)newSurf, shader, RS.fogNum, qfalse );
 		}
 	}
@@ -1452,6 +1568,64 @@ void ProcessModelBoltSurfaces(int surfaceNum, surfaceInfo_v &rootSList,
 	}
 }
 
+// Same walk as RenderSurfaces without adding anything to draw - puts the bolts exactly where RenderSurfaces will, using the
+// surfaces of this lod
+static void G2_ProcessLodBoltSurfaces(int surfaceNum, surfaceInfo_v &rootSList,
+					mdxaBone_v &bonePtr, model_t *currentModel, int lod, boltInfo_v &boltList)
+{
+	int			i;
+	int			offFlags = 0;
+
+	// back track and get the surfinfo struct for this surface
+	mdxmSurface_t			*surface = (mdxmSurface_t *)G2_FindSurface((void *)currentModel, surfaceNum, lod);
+	mdxmHierarchyOffsets_t	*surfIndexes = (mdxmHierarchyOffsets_t *)((byte *)currentModel->data.glm->header + sizeof(mdxmHeader_t));
+	mdxmSurfHierarchy_t		*surfInfo = (mdxmSurfHierarchy_t *)((byte *)surfIndexes + surfIndexes->offsets[surface->thisSurfaceIndex]);
+
+	// see if we have an override surface in the surface list
+	surfaceInfo_t	*surfOverride = G2_FindOverrideSurface(surfaceNum, rootSList);
+
+	// really, we should use the default flags for this surface unless it's been overriden
+	offFlags = surfInfo->flags;
+
+	// set the off flags if we have some
+	if (surfOverride)
+	{
+		offFlags = surfOverride->offFlags;
+	}
+
+	// is this surface considered a bolt surface?
+	if (offFlags & G2SURFACEFLAG_ISBOLT)
+	{
+		// well alrighty then. Lets see if there is a bolt that is attempting to use it
+		int boltNum = G2_Find_Bolt_Surface_Num(boltList, surfaceNum, 0);
+		// yes - ok, processing time.
+		if (boltNum != -1)
+		{
+			mdxmSurface_t *processSurface = surface;
+
+			if (surface->numVerts == 0) {
+				// same JKA workaround as in RenderSurfaces
+				processSurface = (mdxmSurface_t *)G2_FindSurface((void *)currentModel, surfaceNum, 0);
+			}
+
+			G2_ProcessSurfaceBolt(bonePtr, processSurface, boltNum, boltList, surfOverride, currentModel);
+		}
+	}
+
+	// if we are turning off all descendants, then stop this recursion now
+	if (offFlags & G2SURFACEFLAG_NODESCENDANTS)
+	{
+		return;
+	}
+
+	// now recursively call for the children
+	for (i=0; i< surfInfo->numChildren; i++)
+	{
+		G2_ProcessLodBoltSurfaces(surfInfo->childIndexes[i], rootSList, bonePtr, currentModel, lod, boltList);
+	}
+}
+
+
 
 // build the used bone list so when doing bone transforms we can determine if we need to do it or not
 void G2_ConstructUsedBoneList(CConstructBoneList &CBL)
@@ -1611,6 +1785,113 @@ const static mdxaBone_t		identityMatrix = {
 	{ 0.0f, 0.0f, 1.0f, 0.0f }
 }};
 
+// decide what to do about the root matrix - either we aren't bolted to anything, or we use the bolt on the model we are
+// attached to, so our model is offset correctly for the bone bolt
+static void G2_ModelRootMatrix(CGhoul2Info_v &ghoul2, int i, mdxaBone_t &rootMatrix)
+{
+	if (ghoul2[i].mModelBoltLink == -1)
+	{
+		rootMatrix = identityMatrix;
+	}
+	else
+	{
+		unsigned boltMod = (ghoul2[i].mModelBoltLink >> MODEL_SHIFT) & MODEL_AND;
+		unsigned boltNum = (ghoul2[i].mModelBoltLink >> BOLT_SHIFT) & BOLT_AND;
+
+		if (boltMod >= ghoul2.size() || boltNum >= ghoul2[boltMod].mBltlist.size())
+			rootMatrix = identityMatrix;
+		else
+			rootMatrix = ghoul2[boltMod].mBltlist[boltNum].position;
+	}
+}
+
+// pre-transform all the bones of one model, then smooth and unsquash them. boneUsedList needs room for every bone of the
+// animation - it gets filled in here
+static void G2_TransformModelBones(CGhoul2Info &ghoul2, model_t *currentModel, model_t *animModel, int *boneUsedList,
+								   mdxaBone_t &rootMatrix, int frameNum)
+{
+	mdxaHeader_t	*aHeader = animModel->data.gla;
+
+	// construct a list of all bones used by this model - this makes the bone transform go a bit faster since it will dump out bones
+	// that aren't being used. - NOTE this will screw up any models that have surfaces turned off where the lower surfaces aren't.
+	memset(boneUsedList, 0, (aHeader->numBones * 4));
+
+	CConstructBoneList	CBL(ghoul2.mSurfaceRoot,
+		boneUsedList,
+		ghoul2.mSlist,
+		currentModel,
+		ghoul2.mBlist
+		);
+
+	G2_ConstructUsedBoneList(CBL);
+
+	if (!ghoul2.mSurfaceRoot)
+	{
+		// make sure the root bone is marked as being referenced
+		boneUsedList[0] =1;
+	}
+
+	if (ghoul2.mTempBoneList.size() != (size_t)aHeader->numBones+1)
+	{
+		ghoul2.mTempBoneList.resize(aHeader->numBones+1);
+		int k;
+		for (k=0;k<aHeader->numBones;k++)
+		{
+			ghoul2.mTempBoneList[k].first=-10000; //reset it to an invalid time
+		}
+	}
+
+	mdxaBone_v oldBones;
+	if (r_Ghoul2AnimSmooth&&r_Ghoul2AnimSmooth->value>0.005f&&r_Ghoul2AnimSmooth->value<0.995f)
+	{
+		oldBones=ghoul2.mTempBoneList;
+	}
+	// pre-transform all the bones of this model
+	G2_TransformGhoulBones( aHeader, boneUsedList, ghoul2.mBlist, ghoul2.mTempBoneList, ghoul2.mBltlist, rootMatrix, ghoul2, frameNum, aHeader->numBones);
+	if (oldBones.size())
+	{
+		int b;
+		for (b=0;b<aHeader->numBones;b++)
+		{
+			if (r_Ghoul2AnimSmooth&&r_Ghoul2AnimSmooth->value>0.005f&&r_Ghoul2AnimSmooth->value<0.995f)
+			{
+				if (tr.refdef.time-ghoul2.mTempBoneList[b].first<200&&tr.refdef.time-ghoul2.mTempBoneList[b].first>-200)
+				{
+					int k;
+					float *oldM=&oldBones[b].second.matrix[0][0];
+					float *newM=&ghoul2.mTempBoneList[b].second.matrix[0][0];
+					for (k=0;k<12;k++,oldM++,newM++)
+					{
+						*newM=r_Ghoul2AnimSmooth->value*(*oldM-*newM)+*newM;
+					}
+				}
+				ghoul2.mTempBoneList[b].first=tr.refdef.time;
+			}
+		}
+	}
+
+	if (r_Ghoul2UnSqashAfterSmooth&&r_Ghoul2UnSqashAfterSmooth->value>0.5f)
+	{
+		mdxaSkelOffsets_t *offsets = (mdxaSkelOffsets_t *)((byte *)aHeader + sizeof(mdxaHeader_t));
+		int b;
+		for (b=0;b<aHeader->numBones;b++)
+		{
+			mdxaSkel_t		*skel= (mdxaSkel_t *)((byte *)aHeader + sizeof(mdxaHeader_t) + offsets->offsets[b]);
+			mdxaBone_t tempMatrix;
+			Multiply_3x4Matrix(&tempMatrix,&ghoul2.mTempBoneList[b].second, &skel->BasePoseMat);
+			float maxl;
+			maxl=VectorLength(&skel->BasePoseMat.matrix[0][0]);
+			VectorNormalize(&tempMatrix.matrix[0][0]);
+			VectorNormalize(&tempMatrix.matrix[1][0]);
+			VectorNormalize(&tempMatrix.matrix[2][0]);
+
+			VectorScale(&tempMatrix.matrix[0][0],maxl,&tempMatrix.matrix[0][0]);
+			VectorScale(&tempMatrix.matrix[1][0],maxl,&tempMatrix.matrix[1][0]);
+			VectorScale(&tempMatrix.matrix[2][0],maxl,&tempMatrix.matrix[2][0]);
+			Multiply_3x4Matrix(&ghoul2.mTempBoneList[b].second,&tempMatrix,&skel->BasePoseMatInv);
+		}
+	}
+}
 
 /*
 ==============
@@ -1620,7 +1901,6 @@ R_AddGHOULSurfaces
 
 void R_AddGhoulSurfaces( trRefEntity_t *ent ) {
 #ifndef DEDICATED
-	mdxaHeader_t	*aHeader;
 	shader_t		*cust_shader = 0;
 	int				fogNum = 0;
 	qboolean		personalModel;
@@ -1741,7 +2021,6 @@ void R_AddGhoulSurfaces( trRefEntity_t *ent ) {
 		{
 			currentModel = R_GetModelByHandle(ghoul2[i].mModel);
 			animModel =  R_GetModelByHandle(currentModel->data.glm->header->animIndex);
-			aHeader = animModel->data.gla;
  #ifndef DEDICATED
 			//
 			// figure out whether we should be using a custom shader for this model
@@ -1776,113 +2055,15 @@ void R_AddGhoulSurfaces( trRefEntity_t *ent ) {
 
 				ghoul2[i].mSkelFrameNum = tr.refdef.time;
 
-				// construct a list of all bones used by this model - this makes the bone transform go a bit faster since it will dump out bones
-				// that aren't being used. - NOTE this will screw up any models that have surfaces turned off where the lower surfaces aren't.
 				boneUsedList = (int *)Z_Malloc(animModel->data.gla->numBones * 4, TAG_GHOUL2, qtrue);
-				memset(boneUsedList, 0, (animModel->data.gla->numBones * 4));
-
-				CConstructBoneList	CBL(ghoul2[i].mSurfaceRoot,
-					boneUsedList,
-					ghoul2[i].mSlist,
-					currentModel,
-					ghoul2[i].mBlist
-					);
-
-				G2_ConstructUsedBoneList(CBL);
-
-				if (!ghoul2[i].mSurfaceRoot)
-				{
-					// make sure the root bone is marked as being referenced
-					boneUsedList[0] =1;
-				}
-
-				if (ghoul2[i].mTempBoneList.size() != (size_t)animModel->data.gla->numBones+1)
-				{
-					ghoul2[i].mTempBoneList.resize(animModel->data.gla->numBones+1);
-					int k;
-					for (k=0;k<animModel->data.gla->numBones;k++)
-					{
-						ghoul2[i].mTempBoneList[k].first=-10000; //reset it to an invalid time
-					}
-				}
 
 				// if this is the root model, and we have a new root matrix because the model has a new origin, use that
 				if (!setNewOrigin || j)
 				{
-					// decide what to do about the root matrix
-					if (ghoul2[i].mModelBoltLink == -1)
-					{
-						// we aren't bolted to anything
-						rootMatrix = identityMatrix;
-					}
-					// yes we are bolted to another model, better use the bolt as the root matrix then, so our model is offset correctly for the bone bolt
-					else
-					{
-						unsigned boltMod = (ghoul2[i].mModelBoltLink >> MODEL_SHIFT) & MODEL_AND;
-						unsigned boltNum = (ghoul2[i].mModelBoltLink >> BOLT_SHIFT) & BOLT_AND;
-
-						if (boltMod >= ghoul2.size() || boltNum >= ghoul2[boltMod].mBltlist.size())
-							rootMatrix = identityMatrix;
-						else
-							rootMatrix = ghoul2[boltMod].mBltlist[boltNum].position;
-					}
+					G2_ModelRootMatrix(ghoul2, i, rootMatrix);
 				}
 
-				mdxaBone_v oldBones;
-				if (r_Ghoul2AnimSmooth&&r_Ghoul2AnimSmooth->value>0.005f&&r_Ghoul2AnimSmooth->value<0.995f)
-				{
-					oldBones=ghoul2[i].mTempBoneList;
-				}
-				// pre-transform all the bones of this model
-				G2_TransformGhoulBones( aHeader, boneUsedList, ghoul2[i].mBlist, ghoul2[i].mTempBoneList, ghoul2[i].mBltlist, rootMatrix, ghoul2[i], tr.refdef.time, animModel->data.gla->numBones);
-				if (oldBones.size())
-				{
-					int b;
-					for (b=0;b<animModel->data.gla->numBones;b++)
-					{
-						if (r_Ghoul2AnimSmooth&&r_Ghoul2AnimSmooth->value>0.005f&&r_Ghoul2AnimSmooth->value<0.995f)
-						{
-							if (tr.refdef.time-ghoul2[i].mTempBoneList[b].first<200&&tr.refdef.time-ghoul2[i].mTempBoneList[b].first>-200)
-							{
-								int k;
-								float *oldM=&oldBones[b].second.matrix[0][0];
-								float *newM=&ghoul2[i].mTempBoneList[b].second.matrix[0][0];
-								for (k=0;k<12;k++,oldM++,newM++)
-								{
-									*newM=r_Ghoul2AnimSmooth->value*(*oldM-*newM)+*newM;
-								}
-							}
-							ghoul2[i].mTempBoneList[b].first=tr.refdef.time;
-						}
-					}
-				}
-
-				if (r_Ghoul2UnSqashAfterSmooth&&r_Ghoul2UnSqashAfterSmooth->value>0.5f)
-				{
-					mdxaSkelOffsets_t *offsets = (mdxaSkelOffsets_t *)((byte *)aHeader + sizeof(mdxaHeader_t));
-					int b;
-					for (b=0;b<animModel->data.gla->numBones;b++)
-					{
-						if (!boneUsedList)
-						{
-							continue;
-						}
-						mdxaSkel_t		*skel= (mdxaSkel_t *)((byte *)aHeader + sizeof(mdxaHeader_t) + offsets->offsets[b]);
-						mdxaBone_t tempMatrix;
-						Multiply_3x4Matrix(&tempMatrix,&ghoul2[i].mTempBoneList[b].second, &skel->BasePoseMat);
-						float maxl;
-						maxl=VectorLength(&skel->BasePoseMat.matrix[0][0]);
-						VectorNormalize(&tempMatrix.matrix[0][0]);
-						VectorNormalize(&tempMatrix.matrix[1][0]);
-						VectorNormalize(&tempMatrix.matrix[2][0]);
-
-						VectorScale(&tempMatrix.matrix[0][0],maxl,&tempMatrix.matrix[0][0]);
-						VectorScale(&tempMatrix.matrix[1][0],maxl,&tempMatrix.matrix[1][0]);
-						VectorScale(&tempMatrix.matrix[2][0],maxl,&tempMatrix.matrix[2][0]);
-						Multiply_3x4Matrix(&ghoul2[i].mTempBoneList[b].second,&tempMatrix,&skel->BasePoseMatInv);
-					}
-
-				}
+				G2_TransformModelBones(ghoul2[i], currentModel, animModel, boneUsedList, rootMatrix, tr.refdef.time);
 
 				Z_Free(boneUsedList);
 			}
@@ -1927,7 +2108,6 @@ G2_ConstructGhoulSkeleton - builds a complete skeleton for all ghoul models in a
 ==============
 */
 void G2_ConstructGhoulSkeleton( CGhoul2Info_v &ghoul2, const int frameNum, const qhandle_t *modelPointerList, bool checkForNewOrigin, const vec3_t angles, const vec3_t position, const vec3_t scale, bool modelSet) {
-	mdxaHeader_t	*aHeader;
 	int				i, j;
 	int				*boneUsedList;
 	model_t			*currentModel;
@@ -2012,143 +2192,529 @@ void G2_ConstructGhoulSkeleton( CGhoul2Info_v &ghoul2, const int frameNum, const
 				currentModel = R_GetModelByHandle(RE_RegisterModel(psFilename));
 			}
 			animModel =  R_GetModelByHandle(currentModel->data.glm->header->animIndex);
-			aHeader = animModel->data.gla;
 
 			ghoul2[i].mSkelFrameNum = frameNum;
 
-			// construct a list of all bones used by this model - this makes the bone transform go a bit faster since it will dump out bones
-			// that aren't being used. - NOTE this will screw up any models that have surfaces turned off where the lower surfaces aren't.
 			boneUsedList = (int *)Z_Malloc(animModel->data.gla->numBones * 4, TAG_GHOUL2, qtrue);
-			memset(boneUsedList, 0, (animModel->data.gla->numBones * 4));
 
-			CConstructBoneList	CBL(
-			ghoul2[i].mSurfaceRoot,
-			boneUsedList,
-			ghoul2[i].mSlist,
-			currentModel,
-			ghoul2[i].mBlist
-			);
+			// if this is the root model, and we have a new root matrix because the model has a new origin, use that
+			if (!setNewOrigin || j)
+			{
+				G2_ModelRootMatrix(ghoul2, i, rootMatrix);
+			}
+
+			G2_TransformModelBones(ghoul2[i], currentModel, animModel, boneUsedList, rootMatrix, frameNum);
+
+			Z_Free(boneUsedList);
+
+			// call function that will go through the main model and generate all the bolts required
+			ProcessModelBoltSurfaces(ghoul2[i].mSurfaceRoot, ghoul2[i].mSlist, ghoul2[i].mTempBoneList, currentModel, 0, ghoul2[i].mBltlist);
+
+			// go through all the generated surfaces and create their bolt info if we need it.
+			G2_ProcessGeneratedSurfaceBolts(ghoul2[i], ghoul2[i].mTempBoneList, currentModel);
+
+		}
+	}
+	Z_Free(modelList);
+	return;
+}
+
+/*
+==============
+G2_BuildGhoulSkeleton
+
+Transforms every model of the instance that hasn't been built for frameNum yet and puts the bolts where
+RenderSurfaces will, so models bolted on further down the list get the same root matrix as on the serial path.
+ent decides the lod, lod 0 without one. This is what runs on the job threads - no zone memory, no printing.
+==============
+*/
+static void G2_BuildGhoulSkeleton(CGhoul2Info_v &ghoul2, trRefEntity_t *ent, int frameNum)
+{
+	static thread_local std::vector<int>	modelList;
+	static thread_local std::vector<int>	boneUsedList;
+	model_t			*currentModel;
+	model_t			*animModel;
+	mdxaBone_t		rootMatrix;
+	int				i, j, whichLod;
+	int				modelCount;
+
+	// order sort the ghoul 2 models so bolt ons get bolted to the right model
+	modelList.resize(ghoul2.size());
+	G2_Sort_Models(ghoul2, modelList.data(), (int)modelList.size(), &modelCount);
+
+	for (j=0; j<modelCount; j++)
+	{
+		i = modelList[j];
+
+		if ((ghoul2[i].mFlags & GHOUL2_NOMODEL) || ghoul2[i].mSkelFrameNum == frameNum)
+		{
+			continue;
+		}
+
+		currentModel = R_GetModelByHandle(ghoul2[i].mModel);
+		animModel =  R_GetModelByHandle(currentModel->data.glm->header->animIndex);
+
+		ghoul2[i].mSkelFrameNum = frameNum;
+
+		boneUsedList.resize(animModel->data.gla->numBones);
+		G2_ModelRootMatrix(ghoul2, i, rootMatrix);
+		G2_TransformModelBones(ghoul2[i], currentModel, animModel, boneUsedList.data(), rootMatrix, frameNum);
 
-			G2_ConstructUsedBoneList(CBL);
+		whichLod = 0;
+#ifndef DEDICATED
+		if (ent)
+		{
+			whichLod = G2_ComputeLOD(ent, currentModel, ghoul2[i].mLodBias);
+		}
+#endif
+		if (ghoul2[i].mFlags & GHOUL2_NORENDER)
+		{
+			ProcessModelBoltSurfaces(ghoul2[i].mSurfaceRoot, ghoul2[i].mSlist, ghoul2[i].mTempBoneList, currentModel, whichLod, ghoul2[i].mBltlist);
+		}
+		else
+		{
+			G2_ProcessLodBoltSurfaces(ghoul2[i].mSurfaceRoot, ghoul2[i].mSlist, ghoul2[i].mTempBoneList, currentModel, whichLod, ghoul2[i].mBltlist);
+		}
+
+		// go through all the generated surfaces and create their bolt info if we need it.
+		G2_ProcessGeneratedSurfaceBolts(ghoul2[i], ghoul2[i].mTempBoneList, currentModel);
+	}
+}
+
+typedef struct {
+	CGhoul2Info_v	**instances;
+	model_t			*model;
+	int				frameNum;
+	vec4_t			*scratch;		// maxVerts * 2 for every thread
+	int				maxVerts;
+	mdxmSurface_t	*largest;		// the one with maxVerts
+	int				numVerts[MAX_JOB_THREADS];
+} g2Bench_t;
+
+// skin every surface of lod 0 RenderSurfaces would add, returns how many vertexes that were
+static int G2_BenchSkinSurfaces(int surfaceNum, CGhoul2Info &ghoul2, model_t *currentModel, vec4_t *xyz)
+{
+	mdxmSurface_t			*surface = (mdxmSurface_t *)G2_FindSurface((void *)currentModel, surfaceNum, 0);
+	mdxmHierarchyOffsets_t	*surfIndexes = (mdxmHierarchyOffsets_t *)((byte *)currentModel->data.glm->header + sizeof(mdxmHeader_t));
+	mdxmSurfHierarchy_t		*surfInfo = (mdxmSurfHierarchy_t *)((byte *)surfIndexes + surfIndexes->offsets[surface->thisSurfaceIndex]);
+	surfaceInfo_t			*surfOverride = G2_FindOverrideSurface(surfaceNum, ghoul2.mSlist);
+	int						offFlags = surfOverride ? surfOverride->offFlags : surfInfo->flags;
+	int						numVerts = 0;
+	int						i;
+
+	if (!offFlags)
+	{
+		G2_SkinSurface(surface, ghoul2.mTempBoneList, xyz, xyz + surface->numVerts);
+		numVerts = surface->numVerts;
+	}
+
+	if (offFlags & G2SURFACEFLAG_NODESCENDANTS)
+	{
+		return numVerts;
+	}
+
+	for (i=0; i< surfInfo->numChildren; i++)
+	{
+		numVerts += G2_BenchSkinSurfaces(surfInfo->childIndexes[i], ghoul2, currentModel, xyz);
+	}
+	return numVerts;
+}
+
+static void R_Ghoul2BenchJob(void *data, int index, int threadNum)
+{
+	g2Bench_t		*bench = (g2Bench_t *)data;
+	CGhoul2Info_v	&ghoul2 = *bench->instances[index];
 
-			if (!ghoul2[i].mSurfaceRoot)
+	G2_BuildGhoulSkeleton(ghoul2, NULL, bench->frameNum);
+	bench->numVerts[threadNum] += G2_BenchSkinSurfaces(ghoul2[0].mSurfaceRoot, ghoul2[0], bench->model,
+		bench->scratch + threadNum * bench->maxVerts * 2);
+}
+
+/*
+==============
+R_Ghoul2BenchKernels
+
+Runs the frames again on one thread with each set of animation kernels the CPU supports and compares the bones of
+the first copy and its largest surface to what the scalar kernels gave. A set fails when a float is further off than
+G2BENCH_TOLERANCE relative to its size, at least 1. The last line is "ghoul2bench: PASS" or "ghoul2bench: FAIL".
+==============
+*/
+#define G2BENCH_TOLERANCE	1e-4f
+
+static float R_Ghoul2BenchError(float ref, float value)
+{
+	return fabsf(ref - value) / Q_max(1.0f, fabsf(ref));
+}
+
+static void R_Ghoul2BenchKernels(g2Bench_t *bench, int count, int frames, int startTime)
+{
+	const mdxSimd_t	selected = mdxKernels.simd;
+	CGhoul2Info		&check = (*bench->instances[0])[0];
+	mdxaBone_v		refBones;
+	vec4_t			*ref, *xyz;
+	int				simd, numVerts, frameNum;
+	int				i, n, f;
+	int64_t			start, usec, scalarUsec;
+	float			error;
+	qboolean		pass;
+
+	numVerts = bench->largest ? bench->largest->numVerts : 0;
+	ref = (vec4_t *)Z_Malloc(numVerts * 2 * sizeof(vec4_t) + sizeof(vec4_t), TAG_TEMP_WORKSPACE, qfalse);
+	xyz = bench->scratch;
+	scalarUsec = 1;
+	pass = qtrue;
+
+	for (simd = MDX_SIMD_SCALAR; simd < MDX_SIMD_MAX; simd++)
+	{
+		if (!MDX_GetKernels((mdxSimd_t)simd))
+		{
+			continue;
+		}
+		MDX_SelectKernels(simd);
+
+		// start over so the anim smoothing sees the same history every time
+		for (n=0; n<count; n++)
+		{
+			(*bench->instances[n])[0].mTempBoneList.clear();
+			(*bench->instances[n])[0].mSkelFrameNum = -1;
+		}
+
+		frameNum = startTime;
+		start = ri.Microseconds();
+		for (f=0; f<frames; f++)
+		{
+			frameNum += 16;
+			tr.refdef.time = frameNum;
+			bench->frameNum = frameNum;
+			ri.ParallelFor(count, 1, R_Ghoul2BenchJob, bench);
+		}
+		usec = Q_max(ri.Microseconds() - start, (int64_t)1);
+
+		if (numVerts)
+		{
+			G2_SkinSurface(bench->largest, check.mTempBoneList, xyz, xyz + numVerts);
+		}
+
+		if (simd == MDX_SIMD_SCALAR)
+		{
+			refBones = check.mTempBoneList;
+			memcpy(ref, xyz, numVerts * 2 * sizeof(vec4_t));
+			scalarUsec = usec;
+		}
+
+		error = 0.0f;
+		for (i=0; i<(int)refBones.size() && i<(int)check.mTempBoneList.size(); i++)
+		{
+			const float *a = &refBones[i].second.matrix[0][0];
+			const float *b = &check.mTempBoneList[i].second.matrix[0][0];
+
+			for (n=0; n<12; n++)
 			{
-				// make sure the root bone is marked as being referenced
-				boneUsedList[0] =1;
+				error = Q_max(error, R_Ghoul2BenchError(a[n], b[n]));
 			}
-
-			if (ghoul2[i].mTempBoneList.size() != (size_t)animModel->data.gla->numBones+1)
+		}
+		for (i=0; i<numVerts * 2; i++)
+		{
+			for (n=0; n<3; n++)
 			{
-				ghoul2[i].mTempBoneList.resize(animModel->data.gla->numBones+1);
-				int k;
-				for (k=0;k<animModel->data.gla->numBones;k++)
-				{
-					ghoul2[i].mTempBoneList[k].first=-10000; //reset it to an invalid time
-				}
+				error = Q_max(error, R_Ghoul2BenchError(ref[i][n], xyz[i][n]));
 			}
+		}
 
-			// decide what to do about the root matrix
+		if (error > G2BENCH_TOLERANCE)
+		{
+			pass = qfalse;
+		}
 
-			// if this is the root model, and we have a new root matrix because the model has a new origin, use that
-			if (!setNewOrigin || j)
-			{
-				if (ghoul2[i].mModelBoltLink == -1)
-				{
-					// we aren't bolted to anything
-					rootMatrix = identityMatrix;
-				}
-				// yes we are bolted to another model, better use the bolt as the root matrix then, so our model is offset correctly for the bone bolt
-				else
-				{
-					unsigned	boltMod = (ghoul2[i].mModelBoltLink >> MODEL_SHIFT) & MODEL_AND;
-					unsigned	boltNum = (ghoul2[i].mModelBoltLink >> BOLT_SHIFT) & BOLT_AND;
+		ri.Printf(PRINT_ALL, "%-6s kernels: %7.3f ms/frame, %.2fx, max error %g, %s\n", mdxKernels.name,
+			usec / 1000.0 / frames, (double)scalarUsec / usec, error, error > G2BENCH_TOLERANCE ? "FAIL" : "ok");
+	}
 
-					if (boltMod >= ghoul2.size() || boltNum >= ghoul2[boltMod].mBltlist.size())
-						rootMatrix = identityMatrix;
-					else
-						rootMatrix = ghoul2[boltMod].mBltlist[boltNum].position;
-				}
-			}
+	ri.Printf(PRINT_ALL, "ghoul2bench: %s, largest error allowed %g\n", pass ? "PASS" : "FAIL", G2BENCH_TOLERANCE);
 
-			mdxaBone_v oldBones;
-			if (r_Ghoul2AnimSmooth&&r_Ghoul2AnimSmooth->value>0.005f&&r_Ghoul2AnimSmooth->value<0.995f)
+	MDX_SelectKernels(selected);
+	Z_Free(ref);
+}
+
+/*
+==============
+R_Ghoul2Bench_f
+
+ghoul2bench <model> [count] [frames]
+
+Animates count copies of a ghoul2 model without drawing anything. Every frame builds all skeletons and skins
+all surfaces of lod 0, once for each thread count up to the job threads, and the time per frame is printed.
+Then the same on one thread for each set of animation kernels, see R_Ghoul2BenchKernels.
+==============
+*/
+void R_Ghoul2Bench_f( void )
+{
+	g2Bench_t		bench;
+	g2handle_t		*handles;
+	model_t			*model, *animModel;
+	mdxaSkel_t		*rootSkel;
+	char			name[MAX_QPATH];
+	int				count, frames, maxThreads, threads;
+	int				savedTime, frameNum;
+	int				i, n, f;
+	int64_t			start, usec, firstUsec;
+
+	if (ri.Cmd_Argc() < 2)
+	{
+		ri.Printf(PRINT_ALL, "usage: ghoul2bench <model> [count] [frames]\n");
+		return;
+	}
+
+	Q_strncpyz(name, ri.Cmd_Argv(1), sizeof(name));
+	count = ri.Cmd_Argc() > 2 ? Com_Clampi(1, 1024, atoi(ri.Cmd_Argv(2))) : 32;
+	frames = ri.Cmd_Argc() > 3 ? Com_Clampi(1, 10000, atoi(ri.Cmd_Argv(3))) : 100;
+
+	model = R_GetModelByHandle(RE_RegisterModel(name));
+	if (model->type != MOD_MDXM)
+	{
+		ri.Printf(PRINT_ALL, "ghoul2bench: %s is not a ghoul2 model\n", name);
+		return;
+	}
+	animModel = R_GetModelByHandle(model->data.glm->header->animIndex);
+	rootSkel = (mdxaSkel_t *)((byte *)animModel->data.gla + sizeof(mdxaHeader_t) + ((mdxaSkelOffsets_t *)((byte *)animModel->data.gla + sizeof(mdxaHeader_t)))->offsets[0]);
+
+	memset(&bench, 0, sizeof(bench));
+	bench.model = model;
+
+	// the largest surface of lod 0 decides the scratch space
+	for (i=0; i<model->data.glm->header->numSurfaces; i++)
+	{
+		mdxmSurface_t *surface = (mdxmSurface_t *)G2_FindSurface((void *)model, i, 0);
+		if (surface->numVerts > bench.maxVerts)
+		{
+			bench.maxVerts = surface->numVerts;
+			bench.largest = surface;
+		}
+	}
+
+	maxThreads = Com_Clampi(1, MAX_JOB_THREADS, ri.JobMaxThreads());
+	savedTime = tr.refdef.time;
+
+	handles = (g2handle_t *)Z_Malloc(count * sizeof(g2handle_t), TAG_TEMP_WORKSPACE, qtrue);
+	bench.instances = (CGhoul2Info_v **)Z_Malloc(count * sizeof(CGhoul2Info_v *), TAG_TEMP_WORKSPACE, qtrue);
+	bench.scratch = (vec4_t *)Z_Malloc(maxThreads * bench.maxVerts * 2 * sizeof(vec4_t) + sizeof(vec4_t), TAG_TEMP_WORKSPACE, qfalse);
+
+	// spread the copies over the animation so they don't all share one pose
+	for (n=0; n<count; n++)
+	{
+		if (G2API_InitGhoul2Model(&handles[n], name, 0, 0, 0, 0, 0) < 0)
+		{
+			break;
+		}
+		G2API_SetBoneAnim(handles[n], 0, rootSkel->name, 0, Q_max(1, animModel->data.gla->numFrames), BONE_ANIM_OVERRIDE_LOOP, 1.0f,
+			savedTime - n * 137, -1.0f, 0);
+		bench.instances[n] = G2API_GetGhoul2Model(handles[n]);
+	}
+
+	if (n == count)
+	{
+		ri.Printf(PRINT_ALL, "ghoul2bench: %i x %s, %i frames\n", count, name, frames);
+
+		frameNum = savedTime;
+		firstUsec = 0;
+		for (threads = 1; ; threads *= 2)
+		{
+			if (threads > maxThreads)
 			{
-				oldBones=ghoul2[i].mTempBoneList;
+				threads = maxThreads;
 			}
-			// pre-transform all the bones of this model
-			G2_TransformGhoulBones( aHeader, boneUsedList, ghoul2[i].mBlist, ghoul2[i].mTempBoneList, ghoul2[i].mBltlist, rootMatrix, ghoul2[i], frameNum, animModel->data.gla->numBones);
+			memset(bench.numVerts, 0, sizeof(bench.numVerts));
 
-			if (oldBones.size())
+			start = ri.Microseconds();
+			for (f=0; f<frames; f++)
 			{
-				int b;
-				for (b=0;b<animModel->data.gla->numBones;b++)
-				{
-					if (r_Ghoul2AnimSmooth&&r_Ghoul2AnimSmooth->value>0.005f&&r_Ghoul2AnimSmooth->value<0.995f)
-					{
-						if (tr.refdef.time-ghoul2[i].mTempBoneList[b].first<200&&tr.refdef.time-ghoul2[i].mTempBoneList[b].first>-200)
-						{
-							int k;
-							float *oldM=&oldBones[b].second.matrix[0][0];
-							float *newM=&ghoul2[i].mTempBoneList[b].second.matrix[0][0];
-							for (k=0;k<12;k++,oldM++,newM++)
-							{
-								*newM=r_Ghoul2AnimSmooth->value*(*oldM-*newM)+*newM;
-							}
-						}
-						ghoul2[i].mTempBoneList[b].first=tr.refdef.time;
-					}
-				}
+				frameNum += 16;
+				tr.refdef.time = frameNum;
+				bench.frameNum = frameNum;
+				ri.ParallelFor(count, threads, R_Ghoul2BenchJob, &bench);
+			}
+			usec = ri.Microseconds() - start;
+			if (!firstUsec)
+			{
+				firstUsec = Q_max(usec, (int64_t)1);
 			}
 
-			if (r_Ghoul2UnSqashAfterSmooth&&r_Ghoul2UnSqashAfterSmooth->value>0.5f)
+			for (i=1; i<MAX_JOB_THREADS; i++)
 			{
-				mdxaSkelOffsets_t *offsets = (mdxaSkelOffsets_t *)((byte *)aHeader + sizeof(mdxaHeader_t));
-				int b;
-				for (b=0;b<animModel->data.gla->numBones;b++)
-				{
-					if (!boneUsedList)
-					{
-						continue;
-					}
-					mdxaSkel_t		*skel= (mdxaSkel_t *)((byte *)aHeader + sizeof(mdxaHeader_t) + offsets->offsets[b]);
-					mdxaBone_t tempMatrix;
-					Multiply_3x4Matrix(&tempMatrix,&ghoul2[i].mTempBoneList[b].second, &skel->BasePoseMat);
-					float maxl;
-					maxl=VectorLength(&skel->BasePoseMat.matrix[0][0]);
-					VectorNormalize(&tempMatrix.matrix[0][0]);
-					VectorNormalize(&tempMatrix.matrix[1][0]);
-					VectorNormalize(&tempMatrix.matrix[2][0]);
-
-					VectorScale(&tempMatrix.matrix[0][0],maxl,&tempMatrix.matrix[0][0]);
-					VectorScale(&tempMatrix.matrix[1][0],maxl,&tempMatrix.matrix[1][0]);
-					VectorScale(&tempMatrix.matrix[2][0],maxl,&tempMatrix.matrix[2][0]);
-					Multiply_3x4Matrix(&ghoul2[i].mTempBoneList[b].second,&tempMatrix,&skel->BasePoseMatInv);
-				}
+				bench.numVerts[0] += bench.numVerts[i];
+			}
+			ri.Printf(PRINT_ALL, "%2i thread%s: %7.3f ms/frame, %.2fx, %i vertexes per frame\n", threads, threads == 1 ? " " : "s",
+				usec / 1000.0 / frames, (double)firstUsec / Q_max(usec, (int64_t)1), bench.numVerts[0] / frames);
 
+			if (threads == maxThreads)
+			{
+				break;
 			}
+		}
 
-			Z_Free(boneUsedList);
+		R_Ghoul2BenchKernels(&bench, count, frames, savedTime);
+	}
+	else
+	{
+		ri.Printf(PRINT_ALL, "ghoul2bench: couldn't create %s\n", name);
+	}
 
-			// call function that will go through the main model and generate all the bolts required
-			ProcessModelBoltSurfaces(ghoul2[i].mSurfaceRoot, ghoul2[i].mSlist, ghoul2[i].mTempBoneList, currentModel, 0, ghoul2[i].mBltlist);
+	for (n=0; n<count; n++)
+	{
+		if (handles[n])
+		{
+			G2API_CleanGhoul2Models(&handles[n]);
+		}
+	}
+	tr.refdef.time = savedTime;
 
-			// go through all the generated surfaces and create their bolt info if we need it.
-			G2_ProcessGeneratedSurfaceBolts(ghoul2[i], ghoul2[i].mTempBoneList, currentModel);
+	Z_Free(bench.scratch);
+	Z_Free(bench.instances);
+	Z_Free(handles);
+}
+
+#ifndef DEDICATED
+typedef struct {
+	trRefEntity_t	*ent;
+	CGhoul2Info_v	*ghoul2;
+} g2SkeletonJob_t;
+
+// by instance, then in entity order
+static int G2_CompareSkeletonJobs(const void *a, const void *b)
+{
+	const g2SkeletonJob_t *ja = (const g2SkeletonJob_t *)a;
+	const g2SkeletonJob_t *jb = (const g2SkeletonJob_t *)b;
+
+	if (ja->ghoul2 != jb->ghoul2)
+	{
+		return ja->ghoul2 < jb->ghoul2 ? -1 : 1;
+	}
+	if (ja->ent != jb->ent)
+	{
+		return ja->ent < jb->ent ? -1 : 1;
+	}
+	return 0;
+}
 
+// a model setting a new origin needs the recursive skeleton R_AddGhoulSurfaces builds for it
+static bool G2_SetsNewOrigin(CGhoul2Info_v &ghoul2)
+{
+	for (size_t i = 0; i < ghoul2.size(); i++)
+	{
+		if (ghoul2[i].mModelindex != -1 && (ghoul2[i].mFlags & GHOUL2_NEWORIGIN) &&
+			(unsigned)ghoul2[i].mNewOrigin < ghoul2[i].mBltlist.size())
+		{
+			return true;
 		}
 	}
-	Z_Free(modelList);
-	return;
+	return false;
+}
+
+static void R_BuildGhoulSkeletonJob(void *data, int index, int threadNum)
+{
+	g2SkeletonJob_t *job = (g2SkeletonJob_t *)data + index;
+
+	G2_BuildGhoulSkeleton(*job->ghoul2, job->ent, tr.refdef.time);
+}
+
+/*
+==============
+R_BuildGhoulSkeletons
+
+With r_ghoul2Threads set, builds the skeletons of all ghoul2 entities in view on the job threads before
+R_AddEntitySurfaces walks them, R_AddGhoulSurfaces then finds them done. Entities sharing an instance
+are built once, for the first of them, like the serial path does.
+==============
+*/
+void R_BuildGhoulSkeletons( void )
+{
+	static g2SkeletonJob_t	jobs[MAX_ENTITIES];
+	trRefEntity_t	*ent;
+	CGhoul2Info_v	*ghoul2;
+	model_t			*model;
+	float			largestScale;
+	int				i, j, numJobs;
+
+	if (r_ghoul2Threads->integer < 2)
+	{
+		return;
+	}
+
+	numJobs = 0;
+	for (i = 0; i < tr.refdef.num_entities; i++)
+	{
+		ent = &tr.refdef.entities[i];
+
+		// the same entities R_AddEntitySurfaces hands to R_AddGhoulSurfaces
+		if (ent->e.reType != RT_MODEL || !ent->e.ghoul2)
+		{
+			continue;
+		}
+		if ((ent->e.renderfx & RF_FIRST_PERSON) && tr.viewParms.portalView != PV_NONE)
+		{
+			continue;
+		}
+		model = R_GetModelByHandle(ent->e.hModel);
+		if (!model || (model->type != MOD_MDXM && model->type != MOD_BAD))
+		{
+			continue;
+		}
+		if (model->type == MOD_BAD &&
+			(((ent->e.renderfx & RF_THIRD_PERSON) && tr.viewParms.portalView == PV_NONE) || !G2API_HaveWeGhoul2Models(ent->e.ghoul2)))
+		{
+			continue;
+		}
+
+		ghoul2 = G2API_GetGhoul2Model(ent->e.ghoul2);
+		if (!ghoul2 || ghoul2->empty())
+		{
+			continue;
+		}
+		if (r_noServerGhoul2->integer && !((*ghoul2)[0].mCreationID & WF_CLIENTONLY))
+		{
+			continue;
+		}
+		if (G2_SetsNewOrigin(*ghoul2))
+		{
+			continue;
+		}
+
+		// cull like R_GCullModel does - tr.ori isn't set up for this entity yet, but its origin is all it would add
+		largestScale = Q_max(ent->e.modelScale[0], Q_max(ent->e.modelScale[1], ent->e.modelScale[2]));
+		if (!largestScale)
+		{
+			largestScale = 1;
+		}
+		if (R_CullPointAndRadius(ent->e.origin, ent->e.radius * largestScale) == CULL_OUT)
+		{
+			continue;
+		}
+
+		jobs[numJobs].ent = ent;
+		jobs[numJobs].ghoul2 = ghoul2;
+		numJobs++;
+	}
+
+	qsort(jobs, numJobs, sizeof(jobs[0]), G2_CompareSkeletonJobs);
+	for (i = j = 0; i < numJobs; i++)
+	{
+		if (!j || jobs[i].ghoul2 != jobs[j-1].ghoul2)
+		{
+			jobs[j++] = jobs[i];
+		}
+	}
+	numJobs = j;
+
+	ri.ParallelFor(numJobs, r_ghoul2Threads->integer, R_BuildGhoulSkeletonJob, jobs);
 }
 
-#ifndef DEDICATED
 /*
 ==============
 RB_SurfaceGhoul
 ==============
 */
 void RB_SurfaceGhoul( CRenderableSurface *surf ) {
-	int				 j, k;
+	int				 j;
 
 	// grab the pointer to the surface info within the loaded mesh file
 	mdxmSurface_t	*surface = (mdxmSurface_t *)surf->surfaceData;
@@ -2156,6 +2722,9 @@ void RB_SurfaceGhoul( CRenderableSurface *surf ) {
 	// point us at the bone structure that should have been pre-computed
 	mdxaBone_v &bonePtr = *((mdxaBone_v *)surf->boneList);
 
+	// and at the skinned vertexes if R_SkinGhoulSurfaces did those too
+	const g2Skin_t	*skin = surf->skin;
+
 	// NOTE: This is required because a ghoul model might need to be rendered twice a frame (don't cringe,
 	// it's not THAT bad), so we only delete it when doing the glow pass. Warning though, this assumes that
 	// the glow is rendered _second_!!! If that changes, change this!
@@ -2194,109 +2763,18 @@ void RB_SurfaceGhoul( CRenderableSurface *surf ) {
 #endif
 
 
-	// whip through and actually transform each vertex
+	// whip through and actually transform each vertex - unless the job threads did already
 
-	const int *piBoneRefs = (int*) ((byte*)surface + surface->ofsBoneReferences);
 	const int numVerts = surface->numVerts;
 	const mdxmVertex_t 	*v = (mdxmVertex_t *) ((byte *)surface + surface->ofsVerts);
 	const mdxmVertexTexCoord_t *pTexCoords = (const mdxmVertexTexCoord_t *) &v[numVerts];
 
-	int baseVert = tess.numVertexes;
-
-#if id386 || idx64
-	// SSE2 version
-    __m128 bones[32][4];
-
-	// precache referenced bones
-	assert( surface->numBoneReferences <= 32 );
-    for ( j = 0; j < surface->numBoneReferences; j++ )
-    {
-		const mdxaBone_t &bone = bonePtr[piBoneRefs[j]].second;
-
-		bones[j][0] = _mm_loadu_ps( bone.matrix[0] );
-		bones[j][1] = _mm_loadu_ps( bone.matrix[1] );
-		bones[j][2] = _mm_loadu_ps( bone.matrix[2] );
-		bones[j][3] = _mm_setzero_ps();
-
-		// use transposed bone matrix for faster calculations
-		_MM_TRANSPOSE4_PS( bones[j][0], bones[j][1], bones[j][2], bones[j][3] );
-    }
-
-	for ( j = 0; j < numVerts; j++, baseVert++, v++ )
-	{
-		const int iNumWeights = G2_GetVertWeights( v );
-
-		__m128 matrix[4] = {
-			_mm_setzero_ps(),
-			_mm_setzero_ps(),
-			_mm_setzero_ps(),
-			_mm_setzero_ps()
-		};
-
-		// calculate weighted bone matrix
-		float fTotalWeight = 0.0f;
-		for ( k = 0 ; k < iNumWeights ; k++ )
-		{
-			int		iBoneIndex	= G2_GetVertBoneIndex( v, k );
-			float	fBoneWeight	= G2_GetVertBoneWeight( v, k, fTotalWeight, iNumWeights );
-			__m128	weight = _mm_set_ps1( fBoneWeight );
-
-			matrix[0] = _mm_add_ps( matrix[0], _mm_mul_ps( weight, bones[iBoneIndex][0] ) );
-			matrix[1] = _mm_add_ps( matrix[1], _mm_mul_ps( weight, bones[iBoneIndex][1] ) );
-			matrix[2] = _mm_add_ps( matrix[2], _mm_mul_ps( weight, bones[iBoneIndex][2] ) );
-			matrix[3] = _mm_add_ps( matrix[3], _mm_mul_ps( weight, bones[iBoneIndex][3] ) );
-		}
-
-		{
-			__m128 xyz[4] = {
-				_mm_mul_ps( matrix[0], _mm_set_ps1( v->vertCoords[0] ) ),
-				_mm_mul_ps( matrix[1], _mm_set_ps1( v->vertCoords[1] ) ),
-				_mm_mul_ps( matrix[2], _mm_set_ps1( v->vertCoords[2] ) ),
-				matrix[3] // matrix[3] * 1 - translation
-			};
-
-			__m128 result = _mm_add_ps( _mm_add_ps( xyz[0], xyz[1] ), _mm_add_ps( xyz[2], xyz[3] ) );
-			_mm_store_ps( tess.xyz[baseVert], result ); // [3] = 0
-		}
-
-		{
-			__m128 norm[3] = {
-				_mm_mul_ps( matrix[0], _mm_set_ps1( v->normal[0] ) ),
-				_mm_mul_ps( matrix[1], _mm_set_ps1( v->normal[1] ) ),
-				_mm_mul_ps( matrix[2], _mm_set_ps1( v->normal[2] ) ),
-				// no translation
-			};
-
-			__m128 result = _mm_add_ps( _mm_add_ps( norm[0], norm[1] ), norm[2] );
-			_mm_store_ps( tess.normal[baseVert], result );
-		}
-	}
-#else // id386 || idx64
-	for ( j = 0; j < numVerts; j++, baseVert++, v++ )
-	{
-		const int iNumWeights = G2_GetVertWeights( v );
-//		const mdxmWeight_t	*w = v->weights;
-		VectorClear( tess.xyz[baseVert]);
-		VectorClear( tess.normal[baseVert]);
-
-		float fTotalWeight = 0.0f;
-		for ( k = 0 ; k < iNumWeights ; k++ )
-		{
-			int		iBoneIndex	= G2_GetVertBoneIndex( v, k );
-			float	fBoneWeight	= G2_GetVertBoneWeight( v, k, fTotalWeight, iNumWeights );
-
-			mdxaBone_t &bone = bonePtr[piBoneRefs[iBoneIndex]].second;
-
-			tess.xyz[baseVert][0] += fBoneWeight * ( DotProduct( bone.matrix[0], v->vertCoords ) + bone.matrix[0][3] );
-			tess.xyz[baseVert][1] += fBoneWeight * ( DotProduct( bone.matrix[1], v->vertCoords ) + bone.matrix[1][3] );
-			tess.xyz[baseVert][2] += fBoneWeight * ( DotProduct( bone.matrix[2], v->vertCoords ) + bone.matrix[2][3] );
-
-			tess.normal[baseVert][0] += fBoneWeight * DotProduct( bone.matrix[0], v->normal );
-			tess.normal[baseVert][1] += fBoneWeight * DotProduct( bone.matrix[1], v->normal );
-			tess.normal[baseVert][2] += fBoneWeight * DotProduct( bone.matrix[2], v->normal );
-		}
+	if ( skin ) {
+		Com_Memcpy( tess.xyz[tess.numVertexes], skin->xyz, numVerts * sizeof( vec4_t ) );
+		Com_Memcpy( tess.normal[tess.numVertexes], skin->xyz + numVerts, numVerts * sizeof( vec4_t ) );
+	} else {
+		G2_SkinSurface( surface, bonePtr, &tess.xyz[tess.numVertexes], &tess.normal[tess.numVertexes] );
 	}
-#endif // id386 || idx64
 
 	// assumes mdxmVertexTexCoord_t consists only of vec2_t
 	Com_Memcpy( tess.texCoords[0][tess.numVertexes], pTexCoords, numVerts * sizeof( vec2_t ) );
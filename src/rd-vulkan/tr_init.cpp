@@ -30,6 +30,7 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 #include "tr_WorldEffects.h"
 #include "qcommon/MiniHeap.h"
 #include "ghoul2/G2_local.h"
+#include "../rd-common/mdx_simd.h"
 
 glconfig_t	glConfig;
 glconfigExt_t glConfigExt;
@@ -183,6 +184,8 @@ cvar_t	*r_patchStitching;
 // Vulkan
 cvar_t	*r_defaultImage;
 cvar_t	*r_device;
+cvar_t	*r_pipelineCache;
+cvar_t	*r_pipelineThreads;
 //cvar_t	*r_stencilbits;
 cvar_t	*r_ext_multisample;
 cvar_t	*r_ext_supersample;
@@ -236,6 +239,9 @@ cvar_t	*r_noPrecacheGLA;
 #endif
 
 cvar_t	*r_noServerGhoul2;
+cvar_t	*r_ghoul2Threads;
+cvar_t	*r_ghoul2Simd;
+cvar_t	*r_ghoul2TraceCache;
 cvar_t	*r_Ghoul2AnimSmooth=0;
 cvar_t	*r_Ghoul2UnSqashAfterSmooth=0;
 //cvar_t	*r_Ghoul2UnSqash;
@@ -764,6 +770,8 @@ static consoleCommand_t	commands[] = {
 	{ "imagecacheinfo",		RE_RegisterImages_Info_f },
 	{ "modellist",			R_Modellist_f },
 	{ "modelcacheinfo",		RE_RegisterModels_Info_f },
+	{ "ghoul2bench",		R_Ghoul2Bench_f },
+	{ "ghoul2tracebench",	R_Ghoul2TraceBench_f },
 	{ "r_cleardecals",		RE_ClearDecals },
 	{ "remapSky",			R_RemapSkyShader_f },
 	{ "clearRemaps",		R_ClearRemaps_f },
@@ -919,6 +927,8 @@ void R_Register( void )
 	r_device							= ri.Cvar_Get("r_device",							"-1",						CVAR_ARCHIVE_ND | CVAR_LATCH );
 	//ri.Cvar_CheckRange(r_device, -2, 8, qtrue);
 	r_device->modified					= qfalse;
+	r_pipelineCache						= ri.Cvar_Get("r_pipelineCache",					"1",						CVAR_ARCHIVE_ND | CVAR_LATCH );
+	r_pipelineThreads					= ri.Cvar_Get("r_pipelineThreads",					"2",						CVAR_ARCHIVE_ND | CVAR_LATCH );
 
 	//r_stencilbits						= ri.Cvar_Get("r_stencilbits",						"8",						CVAR_ARCHIVE_ND | CVAR_LATCH);
 	r_ext_multisample					= ri.Cvar_Get("r_ext_multisample",					"0",						CVAR_ARCHIVE_ND | CVAR_LATCH);
@@ -983,6 +993,9 @@ Ghoul2 Insert Start
 	r_noServerGhoul2					= ri.Cvar_Get( "r_noserverghoul2",					"0",						CVAR_CHEAT );
 	r_Ghoul2AnimSmooth					= ri.Cvar_Get( "r_ghoul2animsmooth",				"0.3",						CVAR_NONE );
 	r_Ghoul2UnSqashAfterSmooth			= ri.Cvar_Get( "r_ghoul2unsqashaftersmooth",		"1",						CVAR_NONE );
+	r_ghoul2Threads						= ri.Cvar_Get( "r_ghoul2Threads",					"0",						CVAR_ARCHIVE_ND );
+	r_ghoul2Simd						= ri.Cvar_Get( "r_ghoul2Simd",						"1",						CVAR_ARCHIVE_ND );
+	r_ghoul2TraceCache					= ri.Cvar_Get( "r_ghoul2TraceCache",				"1",						CVAR_ARCHIVE_ND );
 	broadsword							= ri.Cvar_Get( "broadsword",						"0",						CVAR_ARCHIVE_ND );
 	broadsword_kickbones				= ri.Cvar_Get( "broadsword_kickbones",				"1",						CVAR_NONE );
 	broadsword_kickorigin				= ri.Cvar_Get( "broadsword_kickorigin",				"1",						CVAR_NONE );
@@ -995,6 +1008,8 @@ Ghoul2 Insert Start
 	broadsword_effcorr					= ri.Cvar_Get( "broadsword_effcorr",				"1",						CVAR_NONE );
 	broadsword_ragtobase				= ri.Cvar_Get( "broadsword_ragtobase",				"2",						CVAR_NONE );
 	broadsword_dircap					= ri.Cvar_Get( "broadsword_dircap",					"64",						CVAR_NONE );
+
+	MDX_SelectKernels( r_ghoul2Simd->integer );
 /*
 Ghoul2 Insert End
 */
@@ -1164,6 +1179,8 @@ void RE_Shutdown( qboolean destroyWindow, qboolean restarting ) {
 	R_ShutdownWorldEffects();
 #endif
 	R_ShutdownFonts();
+	R_FreeGhoulSkins();
+	G2_FreeCollisionCaches();
 
 	// contains vulkan resources/state, reinitialized on a map change.
 	//if (tr.registered) {
@@ -1972,6 +1972,8 @@ extern cvar_t	*r_patchStitching;
 // Vulkan
 extern cvar_t	*r_defaultImage;
 extern cvar_t	*r_device;
+extern cvar_t	*r_pipelineCache;
+extern cvar_t	*r_pipelineThreads;
 extern cvar_t	*r_ext_multisample;
 extern cvar_t	*r_ext_supersample;
 extern cvar_t	*r_ext_alpha_to_coverage;
@@ -2011,6 +2013,9 @@ extern	cvar_t	*r_noPrecacheGLA;
 #endif
 
 extern	cvar_t	*r_noServerGhoul2;
+extern	cvar_t	*r_ghoul2Threads;
+extern	cvar_t	*r_ghoul2Simd;
+extern	cvar_t	*r_ghoul2TraceCache;
 /*
 Ghoul2 Insert End
 */
@@ -2375,6 +2380,13 @@ ANIMATED MODELS
 /*
 Ghoul2 Insert Start
 */
+// a surface skinned on the job threads, shared by all the CRenderableSurfaces added for it
+typedef struct g2Skin_s {
+	const mdxmSurface_t	*surface;
+	const mdxaBone_v	*bonePtr;
+	vec4_t				*xyz;			// surface->numVerts positions followed by as many normals
+} g2Skin_t;
+
 class CRenderableSurface
 {
 public:
@@ -2384,6 +2396,7 @@ public:
 	mdxmVBOMesh_t	*vboMesh;
 #endif
 	mdxmSurface_t	*surfaceData;	// pointer to surface data loaded into file - only used by client renderer DO NOT USE IN GAME SIDE - if there is a vid restart this will be out of wack on the game
+	g2Skin_t		*skin;			// already skinned vertexes for this frame, NULL to skin in the back end
 
 CRenderableSurface():
 	ident(SF_MDX),
@@ -2391,12 +2404,19 @@ CRenderableSurface():
 #ifdef USE_VBO_GHOUL2
 	vboMesh(nullptr),
 #endif
-	surfaceData(0)
+	surfaceData(0),
+	skin(0)
 	{}
 };
 
 void	R_AddGhoulSurfaces( trRefEntity_t *ent );
 void	RB_SurfaceGhoul( CRenderableSurface *surface );
+void	R_BuildGhoulSkeletons( void );
+void	R_SkinGhoulSurfaces( void );
+void	R_ResetGhoulSkins( void );
+void	R_FreeGhoulSkins( void );
+void	R_Ghoul2Bench_f( void );
+void	R_Ghoul2TraceBench_f( void );
 /*
 Ghoul2 Insert End
 */
@@ -1487,6 +1487,8 @@ static void R_AddEntitySurfaces( void ) {
 		return;
 	}
 
+	R_BuildGhoulSkeletons();
+
 	for (tr.currentEntityNum = 0;
 		tr.currentEntityNum < tr.refdef.num_entities;
 		tr.currentEntityNum++) {
@@ -1595,6 +1597,7 @@ static void R_AddEntitySurfaces( void ) {
 		}
 	}
 
+	R_SkinGhoulSurfaces();
 }
 
 
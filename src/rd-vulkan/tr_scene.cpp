@@ -76,6 +76,8 @@ void R_InitNextFrame( void ) {
 
 	r_numpolyverts = 0;
 
+	R_ResetGhoulSkins();
+
 	//r_frameCount++;
 }
 
@@ -1327,6 +1327,8 @@ void vk_release_resources( void ) {
 
     // vk_destroy_samplers();
 
+    vk_wait_pipelines();
+
     for (i = vk.pipelines_world_base; i < vk.pipelines_count; i++) {
         for (j = 0; j < RENDER_PASS_COUNT; j++) {
             if (vk.pipelines[i].handle[j] != VK_NULL_HANDLE) {
@@ -1339,6 +1341,12 @@ void vk_release_resources( void ) {
     }
     vk.pipelines_count = vk.pipelines_world_base;
 
+    // persistent pipelines may have got a world pipeline as fallback
+    for (i = 0; i < vk.pipelines_world_base; i++) {
+        if (vk.pipelines[i].fallback > vk.pipelines_world_base)
+            vk.pipelines[i].fallback = 0;
+    }
+
     VK_CHECK(qvkResetDescriptorPool(vk.device, vk.descriptor_pool, 0));
 
     if (vk_world.num_image_chunks > 1) {
@@ -434,6 +434,8 @@ void GfxInfo_f( void )
 }
 
 void vk_info_f( void ) {
+    vk_pipeline_cache_info();
+
 #ifdef USE_VK_STATS
     ri.Printf(PRINT_ALL, "max_vertex_usage: %iKb\n", (int)((vk.stats.vertex_buffer_max + 1023) / 1024));
     ri.Printf(PRINT_ALL, "max_push_size: %ib\n", vk.stats.push_size_max);
@@ -594,12 +594,7 @@ void vk_initialize( void )
 	vk_create_storage_buffer( &vk.storage, MAX_FLARES * vk.storage_alignment, "storage (flares)" );
 	vk_create_shader_modules();
 
-	{
-		VkPipelineCacheCreateInfo ci;
-		Com_Memset(&ci, 0, sizeof(ci));
-		ci.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
-		VK_CHECK(qvkCreatePipelineCache(vk.device, &ci, VK_NULL_HANDLE, &vk.pipelineCache));
-	}
+	vk_create_pipeline_cache( &props );
 
 	vk.renderPassIndex = RENDER_PASS_MAIN; // default render pass
 	vk.initSwapchainLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
@@ -630,11 +625,13 @@ void vk_shutdown( void )
 
 	vk_destroy_framebuffers();
 	vk_destroy_pipelines( qtrue ); // reset counter
+	vk_shutdown_pipeline_workers();
 	vk_destroy_render_passes();
 	vk_destroy_attachments();
 	vk_destroy_swapchain();
 
 	if (vk.pipelineCache != VK_NULL_HANDLE) {
+		vk_save_pipeline_cache();
 		qvkDestroyPipelineCache(vk.device, vk.pipelineCache, NULL);
 		vk.pipelineCache = VK_NULL_HANDLE;
 	}
@@ -130,6 +130,7 @@ PFN_vkFreeDescriptorSets						qvkFreeDescriptorSets;
 PFN_vkFreeMemory								qvkFreeMemory;
 PFN_vkGetBufferMemoryRequirements				qvkGetBufferMemoryRequirements;
 PFN_vkGetDeviceQueue							qvkGetDeviceQueue;
+PFN_vkGetPipelineCacheData						qvkGetPipelineCacheData;
 PFN_vkGetImageMemoryRequirements				qvkGetImageMemoryRequirements;
 PFN_vkGetImageSubresourceLayout					qvkGetImageSubresourceLayout;
 PFN_vkInvalidateMappedMemoryRanges				qvkInvalidateMappedMemoryRanges;
@@ -1043,6 +1044,7 @@ __initStart:
 	INIT_DEVICE_FUNCTION(vkFreeMemory)
 	INIT_DEVICE_FUNCTION(vkGetBufferMemoryRequirements)
 	INIT_DEVICE_FUNCTION(vkGetDeviceQueue)
+	INIT_DEVICE_FUNCTION(vkGetPipelineCacheData)
 	INIT_DEVICE_FUNCTION(vkGetImageMemoryRequirements)
 	INIT_DEVICE_FUNCTION(vkGetImageSubresourceLayout)
 	INIT_DEVICE_FUNCTION(vkInvalidateMappedMemoryRanges)
@@ -1175,6 +1177,7 @@ void vk_deinit_library( void )
 	qvkFreeMemory = NULL;
 	qvkGetBufferMemoryRequirements = NULL;
 	qvkGetDeviceQueue = NULL;
+	qvkGetPipelineCacheData = NULL;
 	qvkGetImageMemoryRequirements = NULL;
 	qvkGetImageSubresourceLayout = NULL;
 	qvkInvalidateMappedMemoryRanges = NULL;
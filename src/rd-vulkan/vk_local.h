@@ -393,6 +393,7 @@ extern PFN_vkFreeDescriptorSets					    	qvkFreeDescriptorSets;
 extern PFN_vkFreeMemory							    	qvkFreeMemory;
 extern PFN_vkGetBufferMemoryRequirements				qvkGetBufferMemoryRequirements;
 extern PFN_vkGetDeviceQueue						    	qvkGetDeviceQueue;
+extern PFN_vkGetPipelineCacheData						qvkGetPipelineCacheData;
 extern PFN_vkGetImageMemoryRequirements			    	qvkGetImageMemoryRequirements;
 extern PFN_vkGetImageSubresourceLayout					qvkGetImageSubresourceLayout;
 extern PFN_vkInvalidateMappedMemoryRanges				qvkInvalidateMappedMemoryRanges;
@@ -489,8 +490,16 @@ typedef struct {
 typedef struct VK_Pipeline {
 	Vk_Pipeline_Def def;
 	VkPipeline		handle[RENDER_PASS_COUNT];
+	uint32_t		pending;		// (1 << renderPass_t) mask of handles the workers are building
+	uint32_t		fallback;		// index + 1 of the pipeline drawn meanwhile, 0 if not looked up yet
 } VK_Pipeline_t;
 
+// pipeline definition built in this or a previous session, kept in the pipeline cache file
+typedef struct VK_Pipeline_Record {
+	Vk_Pipeline_Def def;
+	uint32_t		passes;			// (1 << renderPass_t) mask
+} VK_Pipeline_Record_t;
+
 typedef struct vktcMod_s {
 	vec4_t	matrix;
 	vec4_t	offTurb;
@@ -952,6 +961,22 @@ typedef struct {
 	uint32_t	pipelines_world_base;
 	int32_t		pipeline_create_count;
 
+	// persistent pipeline cache, see vk_create_pipeline_cache()
+	struct {
+		VK_Pipeline_Record_t records[MAX_VK_PIPELINES];
+		uint32_t	num_records;
+		qboolean	prewarm;		// build recorded pipelines in vk_create_pipelines()
+		uint32_t	loaded_size;
+		uint32_t	create_count;
+		int64_t		create_usec;
+		int64_t		create_usec_max;
+		uint32_t	prewarm_count;
+		int64_t		prewarm_usec;
+		uint32_t	async_count;	// built by the pipeline workers
+		uint32_t	fallback_count;	// drawn with their fallback until ready
+		uint32_t	wait_count;		// main thread had to wait for the workers
+	} pipeline_cache;
+
 	
 	// shader modules.
 	struct {
@@ -1112,6 +1137,11 @@ void		vk_create_descriptor_layout( void );
 void		vk_create_pipeline_layout( void );
 void		vk_destroy_pipelines( qboolean reset );
 void		vk_update_post_process_pipelines( void );
+void		vk_create_pipeline_cache( const VkPhysicalDeviceProperties *props );
+void		vk_save_pipeline_cache( void );
+void		vk_pipeline_cache_info( void );
+void		vk_wait_pipelines( void );
+void		vk_shutdown_pipeline_workers( void );
 
 // swapchain
 void		vk_restart_swapchain( const char *funcname );
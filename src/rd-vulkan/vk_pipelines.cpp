@@ -23,6 +23,11 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 
 #include "tr_local.h"
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 #define ALLOC_SPEC_ENTRY( arr, index, struct_type, struct_data, member ) \
     arr[index].constantID = (index); \
     arr[index].offset = offsetof(struct_type, member); \
@@ -34,13 +39,14 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 #define INIT_SPEC_ENTRY_FRAG( index, member ) \
     ALLOC_SPEC_ENTRY( frag_spec_entries, index, struct FragSpecData, frag_spec_data, member )
 
-static VkVertexInputBindingDescription bindings[10];
-static VkVertexInputAttributeDescription attribs[8];
-static uint32_t num_binds;
-static uint32_t num_attrs;
+// pipelines are also built on the worker threads, see vk_queue_pipeline()
+static thread_local VkVertexInputBindingDescription bindings[10];
+static thread_local VkVertexInputAttributeDescription attribs[8];
+static thread_local uint32_t num_binds;
+static thread_local uint32_t num_attrs;
 #ifdef USE_VBO
-static qboolean is_ghoul2_vbo;
-static qboolean is_mdv_vbo;
+static thread_local qboolean is_ghoul2_vbo;
+static thread_local qboolean is_mdv_vbo;
 #endif
 
 static void vk_push_layout_binding( VkDescriptorSetLayoutBinding *bind, VkDescriptorType type,
@@ -249,7 +255,7 @@ static void vk_push_attr( uint32_t location, uint32_t binding, VkFormat format )
 // descriptions as part of graphics pipeline creation	
 // A vertex binding describes at which rate to load data
 // from memory throughout the vertices
-static void vk_push_vertex_input_binding_attribute( const Vk_Pipeline_Def *def ) {
+static qboolean vk_push_vertex_input_binding_attribute( const Vk_Pipeline_Def *def ) {
     num_binds = num_attrs = 0; // reset
 #ifdef USE_VBO
     is_ghoul2_vbo = def->vbo_ghoul2;
@@ -274,7 +280,7 @@ static void vk_push_vertex_input_binding_attribute( const Vk_Pipeline_Def *def )
         vk_push_attr( 3, 3, VK_FORMAT_R8G8B8A8_UNORM );
         vk_push_attr( 4, 4, VK_FORMAT_R32G32_SFLOAT );
         vk_push_attr( 5, 5, VK_FORMAT_R32G32_SFLOAT );
-        return;
+        return qtrue;
     }
 #endif
     switch ( def->shader_type ) {
@@ -523,8 +529,7 @@ static void vk_push_vertex_input_binding_attribute( const Vk_Pipeline_Def *def )
             break;
 
         default:
-            ri.Error(ERR_DROP, "%s: invalid shader type - %i", __func__, def->shader_type);
-            break;
+            return qfalse;
     }
 
 #if defined(USE_VBO)
@@ -581,9 +586,10 @@ static void vk_push_vertex_input_binding_attribute( const Vk_Pipeline_Def *def )
         }
     }
 #endif
+    return qtrue;
 }
 
-static void vk_set_pipeline_color_blend_attachment_factor( const Vk_Pipeline_Def *def, 
+static qboolean vk_set_pipeline_color_blend_attachment_factor( const Vk_Pipeline_Def *def, 
     VkPipelineColorBlendAttachmentState *attachment_blend_state ) 
 {
     // source
@@ -649,9 +655,9 @@ static void vk_set_pipeline_color_blend_attachment_factor( const Vk_Pipeline_Def
             attachment_blend_state->dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_DST_ALPHA;
             break;
         default:
-            ri.Error(ERR_DROP, "create_pipeline: invalid dst blend state bits\n");
-            break;
+            return qfalse;
     }
+    return qtrue;
 }
 
 static void set_shader_stage_desc( VkPipelineShaderStageCreateInfo *desc, VkShaderStageFlagBits stage, VkShaderModule shader_module, const char *entry ) {
@@ -664,7 +670,21 @@ static void set_shader_stage_desc( VkPipelineShaderStageCreateInfo *desc, VkShad
     desc->pSpecializationInfo = NULL;
 }
 
-VkPipeline vk_create_pipeline( const Vk_Pipeline_Def *def, renderPass_t renderPassIndex, uint32_t def_index )
+// raised right away on the render thread, the pipeline workers pass it on in the job
+static VkPipeline vk_pipeline_error( VkResult *result, const char **error, const char *msg, int value )
+{
+    if ( !result )
+        ri.Error( ERR_DROP, "create_pipeline: %s %i\n", msg, value );
+
+    *result = VK_ERROR_INITIALIZATION_FAILED;
+    *error = msg;
+    return VK_NULL_HANDLE;
+}
+
+// safe to call from the pipeline workers, vk_create_pipeline() does the bookkeeping.
+// The workers pass result and error, a bad definition or a failed
+// vkCreateGraphicsPipelines then returns VK_NULL_HANDLE instead of an error
+static VkPipeline vk_build_pipeline( const Vk_Pipeline_Def *def, renderPass_t renderPassIndex, uint32_t def_index, VkResult *result, const char **error )
 {
     VkPipeline  pipeline;
     VkShaderModule *vs_module = NULL;
@@ -681,6 +701,7 @@ VkPipeline vk_create_pipeline( const Vk_Pipeline_Def *def, renderPass_t renderPa
     VkPipelineDynamicStateCreateInfo dynamic_state;
     VkDynamicState dynamic_state_array[3] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR, VK_DYNAMIC_STATE_DEPTH_BIAS };
     VkGraphicsPipelineCreateInfo create_info;
+    char name[64];
 
 #ifdef USE_VBO_SS
     typedef struct {
@@ -899,8 +920,7 @@ VkPipeline vk_create_pipeline( const Vk_Pipeline_Def *def, renderPass_t renderPa
             break;
 
         default:
-            ri.Error(ERR_DROP, "create_pipeline: unknown shader type %i\n", def->shader_type);
-            return 0;
+            return vk_pipeline_error( result, error, "unknown shader type", def->shader_type );
     }
 
 #ifdef USE_VBO_SS
@@ -1151,7 +1171,8 @@ VkPipeline vk_create_pipeline( const Vk_Pipeline_Def *def, renderPass_t renderPa
     shader_stages[1].pSpecializationInfo = &frag_spec_info;     
 
     // vertex input state (binding and attributes)
-    vk_push_vertex_input_binding_attribute( def );
+    if ( !vk_push_vertex_input_binding_attribute( def ) )
+        return vk_pipeline_error( result, error, "invalid shader type", def->shader_type );
 
     vertex_input_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
     vertex_input_state.pNext = NULL;
@@ -1210,8 +1231,7 @@ VkPipeline vk_create_pipeline( const Vk_Pipeline_Def *def, renderPass_t renderPa
             rasterization_state.cullMode = (def->mirror ? VK_CULL_MODE_BACK_BIT : VK_CULL_MODE_FRONT_BIT);
             break;
         default:
-            ri.Error(ERR_DROP, "create_pipeline: invalid face culling mode %i\n", def->face_culling);
-            break;
+            return vk_pipeline_error( result, error, "invalid face culling mode", def->face_culling );
     }
 
     // how fragments are generated for geometry.
@@ -1311,7 +1331,8 @@ VkPipeline vk_create_pipeline( const Vk_Pipeline_Def *def, renderPass_t renderPa
     if ( attachment_blend_state.blendEnable )
     {
         // set color blend factor.
-        vk_set_pipeline_color_blend_attachment_factor(def, &attachment_blend_state);
+        if ( !vk_set_pipeline_color_blend_attachment_factor( def, &attachment_blend_state ) )
+            return vk_pipeline_error( result, error, "invalid dst blend state bits", def->state_bits & GLS_DSTBLEND_BITS );
 
         attachment_blend_state.srcAlphaBlendFactor = attachment_blend_state.srcColorBlendFactor;
         attachment_blend_state.dstAlphaBlendFactor = attachment_blend_state.dstColorBlendFactor;
@@ -1385,10 +1406,40 @@ VkPipeline vk_create_pipeline( const Vk_Pipeline_Def *def, renderPass_t renderPa
     create_info.basePipelineHandle = VK_NULL_HANDLE;
     create_info.basePipelineIndex = -1;
 
-    VK_CHECK( qvkCreateGraphicsPipelines( vk.device, vk.pipelineCache, 1, &create_info, NULL, &pipeline ) );
-    VK_SET_OBJECT_NAME( pipeline, va( "pipeline def#%i, pass#%i", def_index, renderPassIndex ), VK_DEBUG_REPORT_OBJECT_TYPE_PIPELINE_EXT );
+    if ( result ) {
+        *result = qvkCreateGraphicsPipelines( vk.device, vk.pipelineCache, 1, &create_info, NULL, &pipeline );
+        if ( *result < 0 ) {
+            *error = NULL;
+            return VK_NULL_HANDLE;
+        }
+    } else {
+        VK_CHECK( qvkCreateGraphicsPipelines( vk.device, vk.pipelineCache, 1, &create_info, NULL, &pipeline ) );
+    }
+    Com_sprintf( name, sizeof( name ), "pipeline def#%i, pass#%i", def_index, renderPassIndex );
+    VK_SET_OBJECT_NAME( pipeline, name, VK_DEBUG_REPORT_OBJECT_TYPE_PIPELINE_EXT );
+
+    return pipeline;
+}
+
+static void vk_count_pipeline( int64_t usec )
+{
     vk.pipeline_create_count++;
 
+    vk.pipeline_cache.create_count++;
+    vk.pipeline_cache.create_usec += usec;
+    if ( usec > vk.pipeline_cache.create_usec_max )
+        vk.pipeline_cache.create_usec_max = usec;
+}
+
+VkPipeline vk_create_pipeline( const Vk_Pipeline_Def *def, renderPass_t renderPassIndex, uint32_t def_index )
+{
+    VkPipeline pipeline;
+    int64_t start;
+
+    start = ri.Microseconds();
+    pipeline = vk_build_pipeline( def, renderPassIndex, def_index, NULL, NULL );
+    vk_count_pipeline( ri.Microseconds() - start );
+
     return pipeline;
 }
 
@@ -1673,7 +1724,7 @@ static void vk_create_post_process_pipeline( int program_index, uint32_t width,
     create_info.basePipelineHandle = VK_NULL_HANDLE;
     create_info.basePipelineIndex = -1;
 
-    VK_CHECK( qvkCreateGraphicsPipelines( vk.device, VK_NULL_HANDLE, 1, &create_info, NULL, pipeline ) );
+    VK_CHECK( qvkCreateGraphicsPipelines( vk.device, vk.pipelineCache, 1, &create_info, NULL, pipeline ) );
     VK_SET_OBJECT_NAME( *pipeline, pipeline_name, VK_DEBUG_REPORT_OBJECT_TYPE_PIPELINE_EXT );
 }
 
@@ -1865,10 +1916,531 @@ static void vk_create_blur_pipeline( char *name, int program_index, uint32_t ind
     create_info.basePipelineHandle = VK_NULL_HANDLE;
     create_info.basePipelineIndex = -1;
 
-    VK_CHECK( qvkCreateGraphicsPipelines( vk.device, VK_NULL_HANDLE, 1, &create_info, NULL, pipeline ) );
+    VK_CHECK( qvkCreateGraphicsPipelines( vk.device, vk.pipelineCache, 1, &create_info, NULL, pipeline ) );
     VK_SET_OBJECT_NAME( *pipeline, va( "%s %s blur pipeline %i", name, horizontal_pass ? "horizontal" : "vertical", index / 2 + 1 ), VK_DEBUG_REPORT_OBJECT_TYPE_PIPELINE_EXT );
 }
 
+/*
+====================
+Pipeline cache
+
+The driver's pipeline cache is kept in PIPELINE_CACHE_FILE together with every
+pipeline definition built in the session, so the next start can hand the compiled
+pipelines back to the driver and, with r_pipelineCache 2, build the recorded
+definitions before the first map. The driver data is dropped when the device or
+driver changes, the definitions are not.
+====================
+*/
+#define PIPELINE_CACHE_FILE		"vkpipelines.cache"
+#define PIPELINE_CACHE_IDENT	(('C'<<24)+('P'<<16)+('K'<<8)+'V')
+#define PIPELINE_CACHE_VERSION	1
+
+typedef struct {
+	int32_t		ident;
+	int32_t		version;
+	uint32_t	recordSize;				// sizeof( VK_Pipeline_Record_t )
+	uint32_t	numRecords;
+	uint32_t	vendorID;
+	uint32_t	deviceID;
+	uint32_t	driverVersion;
+	byte		uuid[VK_UUID_SIZE];		// VkPhysicalDeviceProperties::pipelineCacheUUID
+	uint32_t	dataSize;				// vkGetPipelineCacheData() blob after the records
+	uint32_t	checksum;				// of everything after the header
+} vkPipelineCacheHeader_t;
+
+static uint32_t vk_pipeline_cache_checksum( const byte *data, size_t size )
+{
+	uint32_t hash = 2166136261u;
+	size_t i;
+
+	for ( i = 0; i < size; i++ ) {
+		hash ^= data[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static void vk_record_pipeline( const Vk_Pipeline_Def *def, renderPass_t pass )
+{
+	VK_Pipeline_Record_t *rec;
+	uint32_t i;
+
+	for ( i = 0; i < vk.pipeline_cache.num_records; i++ ) {
+		rec = &vk.pipeline_cache.records[i];
+		if ( memcmp( &rec->def, def, sizeof( *def ) ) == 0 ) {
+			rec->passes |= 1 << pass;
+			return;
+		}
+	}
+
+	if ( vk.pipeline_cache.num_records < ARRAY_LEN( vk.pipeline_cache.records ) ) {
+		rec = &vk.pipeline_cache.records[vk.pipeline_cache.num_records++];
+		rec->def = *def;
+		rec->passes = 1 << pass;
+	}
+}
+
+static qboolean vk_pipeline_cache_valid( const vkPipelineCacheHeader_t *header, int size )
+{
+	if ( size < (int)sizeof( *header ) )
+		return qfalse;
+
+	if ( header->ident != PIPELINE_CACHE_IDENT || header->version != PIPELINE_CACHE_VERSION )
+		return qfalse;
+
+	if ( header->recordSize != sizeof( VK_Pipeline_Record_t ) || header->numRecords > ARRAY_LEN( vk.pipeline_cache.records ) )
+		return qfalse;
+
+	if ( sizeof( *header ) + header->numRecords * sizeof( VK_Pipeline_Record_t ) + header->dataSize != (size_t)size )
+		return qfalse;
+
+	return ( vk_pipeline_cache_checksum( (const byte *)( header + 1 ), size - sizeof( *header ) ) == header->checksum ) ? qtrue : qfalse;
+}
+
+void vk_create_pipeline_cache( const VkPhysicalDeviceProperties *props )
+{
+	VkPipelineCacheCreateInfo ci;
+	const vkPipelineCacheHeader_t *header;
+	void *buffer = NULL;
+	size_t recordsSize;
+	int size = 0;
+
+	Com_Memset( &vk.pipeline_cache, 0, sizeof( vk.pipeline_cache ) );
+
+	Com_Memset( &ci, 0, sizeof( ci ) );
+	ci.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+	if ( r_pipelineCache->integer )
+		size = ri.FS_ReadFile( PIPELINE_CACHE_FILE, &buffer );
+
+	if ( buffer ) {
+		header = (const vkPipelineCacheHeader_t *)buffer;
+
+		if ( !vk_pipeline_cache_valid( header, size ) ) {
+			ri.Printf( PRINT_WARNING, "vk_create_pipeline_cache: ignoring outdated or damaged %s\n", PIPELINE_CACHE_FILE );
+		}
+		else {
+			recordsSize = header->numRecords * sizeof( VK_Pipeline_Record_t );
+			Com_Memcpy( vk.pipeline_cache.records, header + 1, recordsSize );
+			vk.pipeline_cache.num_records = header->numRecords;
+			vk.pipeline_cache.prewarm = ( r_pipelineCache->integer > 1 && header->numRecords ) ? qtrue : qfalse;
+
+			// compiled pipelines are only good for the device and driver that built them
+			if ( header->vendorID != props->vendorID || header->deviceID != props->deviceID || header->driverVersion != props->driverVersion
+				|| memcmp( header->uuid, props->pipelineCacheUUID, VK_UUID_SIZE ) != 0 ) {
+				ri.Printf( PRINT_ALL, "...device or driver changed, discarding cached pipelines\n" );
+			}
+			else if ( header->dataSize ) {
+				ci.initialDataSize = header->dataSize;
+				ci.pInitialData = (const byte *)( header + 1 ) + recordsSize;
+			}
+		}
+	}
+
+	if ( ci.initialDataSize && qvkCreatePipelineCache( vk.device, &ci, NULL, &vk.pipelineCache ) == VK_SUCCESS ) {
+		vk.pipeline_cache.loaded_size = (uint32_t)ci.initialDataSize;
+		ri.Printf( PRINT_ALL, "...loaded %i pipeline definitions, %i KB of cached pipelines\n",
+			vk.pipeline_cache.num_records, (int)( ci.initialDataSize / 1024 ) );
+	}
+	else {
+		ci.initialDataSize = 0;
+		ci.pInitialData = NULL;
+		VK_CHECK( qvkCreatePipelineCache( vk.device, &ci, NULL, &vk.pipelineCache ) );
+	}
+
+	if ( buffer )
+		ri.FS_FreeFile( buffer );
+}
+
+void vk_save_pipeline_cache( void )
+{
+	VkPhysicalDeviceProperties props;
+	vkPipelineCacheHeader_t *header;
+	size_t recordsSize, dataSize;
+	byte *buffer;
+
+	if ( !r_pipelineCache->integer || vk.pipelineCache == VK_NULL_HANDLE )
+		return;
+
+	if ( qvkGetPipelineCacheData( vk.device, vk.pipelineCache, &dataSize, NULL ) != VK_SUCCESS )
+		return;
+
+	recordsSize = vk.pipeline_cache.num_records * sizeof( VK_Pipeline_Record_t );
+	buffer = (byte *)ri.Z_Malloc( sizeof( *header ) + recordsSize + dataSize, TAG_TEMP_WORKSPACE, qfalse );
+
+	if ( qvkGetPipelineCacheData( vk.device, vk.pipelineCache, &dataSize, buffer + sizeof( *header ) + recordsSize ) != VK_SUCCESS )
+		dataSize = 0;
+
+	vk_get_vulkan_properties( &props );
+
+	header = (vkPipelineCacheHeader_t *)buffer;
+	Com_Memset( header, 0, sizeof( *header ) );
+	header->ident = PIPELINE_CACHE_IDENT;
+	header->version = PIPELINE_CACHE_VERSION;
+	header->recordSize = sizeof( VK_Pipeline_Record_t );
+	header->numRecords = vk.pipeline_cache.num_records;
+	header->vendorID = props.vendorID;
+	header->deviceID = props.deviceID;
+	header->driverVersion = props.driverVersion;
+	Com_Memcpy( header->uuid, props.pipelineCacheUUID, VK_UUID_SIZE );
+	header->dataSize = (uint32_t)dataSize;
+
+	Com_Memcpy( header + 1, vk.pipeline_cache.records, recordsSize );
+	header->checksum = vk_pipeline_cache_checksum( (const byte *)( header + 1 ), recordsSize + dataSize );
+
+	ri.FS_WriteFile( PIPELINE_CACHE_FILE, buffer, (int)( sizeof( *header ) + recordsSize + dataSize ) );
+	ri.Printf( PRINT_ALL, "...saved %i pipeline definitions, %i KB of cached pipelines\n",
+		vk.pipeline_cache.num_records, (int)( dataSize / 1024 ) );
+
+	ri.Z_Free( buffer );
+}
+
+// definitions come from a file and may have been recorded on a device with other features
+static qboolean vk_pipeline_record_valid( const Vk_Pipeline_Def *def )
+{
+	if ( (uint32_t)def->shader_type > TYPE_BLEND3_DST_COLOR_SRC_ALPHA_ENV )
+		return qfalse;
+
+	if ( def->shader_type == TYPE_DOT && !vk.fragmentStores )
+		return qfalse;
+
+	if ( def->line_width > 1 && !vk.wideLines )
+		return qfalse;
+
+	return qtrue;
+}
+
+static void vk_prewarm_pipelines( void )
+{
+	const VK_Pipeline_Record_t *rec;
+	VkPipeline pipeline;
+	int64_t start;
+	uint32_t i, pass;
+
+	vk.pipeline_cache.prewarm = qfalse;
+
+	start = ri.Microseconds();
+
+	for ( i = 0; i < vk.pipeline_cache.num_records; i++ ) {
+		rec = &vk.pipeline_cache.records[i];
+
+		if ( !vk_pipeline_record_valid( &rec->def ) )
+			continue;
+
+		for ( pass = 0; pass < RENDER_PASS_COUNT; pass++ ) {
+			if ( !( rec->passes & ( 1 << pass ) ) )
+				continue;
+
+			if ( pass == RENDER_PASS_SCREENMAP && vk.render_pass.screenmap == VK_NULL_HANDLE )
+				continue;
+
+			if ( pass == RENDER_PASS_REFRACTION && vk.render_pass.refraction.extract == VK_NULL_HANDLE )
+				continue;
+
+			// only the pipeline cache is kept, the handle is built again on first use
+			pipeline = vk_create_pipeline( &rec->def, (renderPass_t)pass, i );
+			qvkDestroyPipeline( vk.device, pipeline, NULL );
+			vk.pipeline_create_count--;
+			vk.pipeline_cache.prewarm_count++;
+		}
+	}
+
+	vk.pipeline_cache.prewarm_usec = ri.Microseconds() - start;
+
+	ri.Printf( PRINT_ALL, "...prewarmed %i pipelines in %i msec\n",
+		vk.pipeline_cache.prewarm_count, (int)( vk.pipeline_cache.prewarm_usec / 1000 ) );
+}
+
+/*
+====================
+Pipeline workers
+
+With r_pipelineThreads set, pipelines are built on worker threads as soon as
+FinishShader asks for them or a draw needs one that does not exist yet.
+Multi-texture and blend stages are drawn with a plain single texture pipeline
+of the same state until their own pipeline is ready, anything else waits for
+its pipeline or builds it on the spot.
+A build that fails on a worker is raised on the render thread once the job
+is collected.
+====================
+*/
+#define MAX_PIPELINE_THREADS	8
+#define MAX_PIPELINE_JOBS		1024
+
+typedef struct {
+	uint32_t		index;
+	renderPass_t	pass;
+	Vk_Pipeline_Def	def;
+	qboolean		stolen;			// built by the main thread instead
+	VkPipeline		handle;			// VK_NULL_HANDLE if the build failed
+	VkResult		result;
+	const char		*error;			// bad definition, NULL if vkCreateGraphicsPipelines failed
+	int64_t			usec;
+} vkPipelineJob_t;
+
+static struct {
+	std::mutex				mutex;
+	std::condition_variable	cvWork;
+	std::condition_variable	cvDone;
+	std::thread				*threads[MAX_PIPELINE_THREADS];
+	int						numThreads;
+	qboolean				shutdown;
+
+	vkPipelineJob_t			queue[MAX_PIPELINE_JOBS];
+	uint32_t				head;			// next free queue slot
+	uint32_t				tail;			// next job to take
+	int						busy;			// jobs taken but not in done[] yet
+	vkPipelineJob_t			done[MAX_PIPELINE_JOBS];
+	std::atomic<uint32_t>	numDone;
+} vk_workers;
+
+static void vk_pipeline_worker( void )
+{
+	std::unique_lock<std::mutex> lk( vk_workers.mutex );
+	vkPipelineJob_t job;
+	int64_t start;
+
+	while ( 1 ) {
+		while ( !vk_workers.shutdown && vk_workers.tail == vk_workers.head ) {
+			vk_workers.cvWork.wait( lk );
+		}
+		if ( vk_workers.shutdown ) {
+			return;
+		}
+
+		job = vk_workers.queue[vk_workers.tail++ % MAX_PIPELINE_JOBS];
+		vk_workers.busy++;
+		lk.unlock();
+
+		if ( !job.stolen ) {
+			start = ri.Microseconds();
+			job.handle = vk_build_pipeline( &job.def, job.pass, job.index, &job.result, &job.error );
+			job.usec = ri.Microseconds() - start;
+		}
+
+		lk.lock();
+		vk_workers.busy--;
+		if ( !job.stolen ) {
+			vk_workers.done[vk_workers.numDone++] = job;
+		}
+		vk_workers.cvDone.notify_all();
+	}
+}
+
+// lk holds vk_workers.mutex, it's released before a failed build is raised
+static void vk_collect_pipelines_locked( std::unique_lock<std::mutex> &lk )
+{
+	const vkPipelineJob_t *job;
+	vkPipelineJob_t failed;
+	VK_Pipeline_t *pipeline;
+	uint32_t i, numDone;
+
+	failed.handle = VK_NULL_HANDLE;
+	failed.result = VK_SUCCESS;
+	failed.error = NULL;
+
+	numDone = vk_workers.numDone;
+	for ( i = 0; i < numDone; i++ ) {
+		job = &vk_workers.done[i];
+		pipeline = &vk.pipelines[job->index];
+		pipeline->pending &= ~( 1 << job->pass );
+		if ( job->handle == VK_NULL_HANDLE ) {
+			if ( failed.result == VK_SUCCESS )
+				failed = *job;
+			continue;
+		}
+		pipeline->handle[job->pass] = job->handle;
+		vk_count_pipeline( job->usec );
+		vk_record_pipeline( &pipeline->def, job->pass );
+		vk.pipeline_cache.async_count++;
+	}
+
+	vk_workers.numDone = 0;
+
+	if ( failed.result != VK_SUCCESS ) {
+		lk.unlock();
+		if ( failed.error )
+			ri.Error( ERR_DROP, "create_pipeline: %s for pipeline def#%i, pass#%i\n", failed.error, failed.index, failed.pass );
+		ri.Error( ERR_DROP, "create_pipeline: vkCreateGraphicsPipelines returned %s for pipeline def#%i, pass#%i\n",
+			vk_result_string( failed.result ), failed.index, failed.pass );
+	}
+}
+
+static void vk_collect_pipelines( void )
+{
+	std::unique_lock<std::mutex> lk( vk_workers.mutex );
+
+	vk_collect_pipelines_locked( lk );
+}
+
+static qboolean vk_queue_pipeline( uint32_t index, renderPass_t pass )
+{
+	VK_Pipeline_t *pipeline = &vk.pipelines[index];
+	vkPipelineJob_t *job;
+
+	if ( r_pipelineThreads->integer <= 0 )
+		return qfalse;
+
+	// start the workers on first use
+	while ( vk_workers.numThreads < r_pipelineThreads->integer && vk_workers.numThreads < MAX_PIPELINE_THREADS ) {
+		vk_workers.threads[vk_workers.numThreads++] = new std::thread( vk_pipeline_worker );
+	}
+
+	{
+		std::lock_guard<std::mutex> lk( vk_workers.mutex );
+
+		// every job has to fit into done[] as well
+		if ( vk_workers.head - vk_workers.tail + vk_workers.busy + vk_workers.numDone >= MAX_PIPELINE_JOBS )
+			return qfalse;
+
+		job = &vk_workers.queue[vk_workers.head++ % MAX_PIPELINE_JOBS];
+		job->index = index;
+		job->pass = pass;
+		job->def = pipeline->def;
+		job->stolen = qfalse;
+		job->handle = VK_NULL_HANDLE;
+		job->result = VK_SUCCESS;
+		job->error = NULL;
+		job->usec = 0;
+	}
+	vk_workers.cvWork.notify_one();
+
+	pipeline->pending |= 1 << pass;
+
+	return qtrue;
+}
+
+// a draw needs a queued pipeline that has no fallback
+static void vk_wait_pipeline( uint32_t index, renderPass_t pass )
+{
+	std::unique_lock<std::mutex> lk( vk_workers.mutex );
+	VK_Pipeline_t *pipeline = &vk.pipelines[index];
+	vkPipelineJob_t *job;
+	uint32_t i;
+
+	vk.pipeline_cache.wait_count++;
+
+	// not taken yet, faster to build it here than to wait for the queue
+	for ( i = vk_workers.tail; i != vk_workers.head; i++ ) {
+		job = &vk_workers.queue[i % MAX_PIPELINE_JOBS];
+		if ( job->index == index && job->pass == pass && !job->stolen ) {
+			job->stolen = qtrue;
+			lk.unlock();
+
+			pipeline->handle[pass] = vk_create_pipeline( &pipeline->def, pass, index );
+			pipeline->pending &= ~( 1 << pass );
+			vk_record_pipeline( &pipeline->def, pass );
+
+			return;
+		}
+	}
+
+	while ( 1 ) {
+		vk_collect_pipelines_locked( lk );
+		if ( !( pipeline->pending & ( 1 << pass ) ) )
+			break;
+		vk_workers.cvDone.wait( lk );
+	}
+}
+
+// pipelines are about to be destroyed or the render passes change
+void vk_wait_pipelines( void )
+{
+	std::unique_lock<std::mutex> lk( vk_workers.mutex );
+
+	while ( vk_workers.tail != vk_workers.head || vk_workers.busy ) {
+		vk_workers.cvDone.wait( lk );
+	}
+
+	vk_collect_pipelines_locked( lk );
+}
+
+void vk_shutdown_pipeline_workers( void )
+{
+	int i;
+
+	if ( !vk_workers.numThreads )
+		return;
+
+	vk_wait_pipelines();
+
+	{
+		std::lock_guard<std::mutex> lk( vk_workers.mutex );
+		vk_workers.shutdown = qtrue;
+	}
+	vk_workers.cvWork.notify_all();
+
+	for ( i = 0; i < vk_workers.numThreads; i++ ) {
+		vk_workers.threads[i]->join();
+		delete vk_workers.threads[i];
+		vk_workers.threads[i] = NULL;
+	}
+
+	vk_workers.numThreads = 0;
+	vk_workers.shutdown = qfalse;
+}
+
+// single texture pipeline with the same state that can stand in while index is
+// being built, index itself if there is none
+static uint32_t vk_fallback_pipeline( uint32_t index )
+{
+	VK_Pipeline_t *pipeline = &vk.pipelines[index];
+	Vk_Pipeline_Def def;
+	int type, env;
+
+	if ( pipeline->fallback )
+		return pipeline->fallback - 1;
+
+	def = pipeline->def;
+	type = def.shader_type;
+	env = ( type - TYPE_GENERIC_BEGIN ) & 1;
+
+	if ( def.surface_sprite_flags || type < TYPE_MULTI_BEGIN || type > TYPE_BLEND3_DST_COLOR_SRC_ALPHA_ENV || vk.pipelines_count >= MAX_VK_PIPELINES ) {
+		pipeline->fallback = index + 1;
+		return index;
+	}
+
+	// keep the vertex arrays the stage uploads
+	switch ( type - env ) {
+		case TYPE_MULTI_TEXTURE_ADD2_IDENTITY:
+		case TYPE_MULTI_TEXTURE_MUL2_IDENTITY:
+			def.shader_type = (Vk_Shader_Type)( TYPE_SINGLE_TEXTURE_IDENTITY + env );
+			break;
+		case TYPE_MULTI_TEXTURE_ADD2_FIXED_COLOR:
+		case TYPE_MULTI_TEXTURE_MUL2_FIXED_COLOR:
+			def.shader_type = (Vk_Shader_Type)( TYPE_SINGLE_TEXTURE_FIXED_COLOR + env );
+			break;
+		default:
+			def.shader_type = (Vk_Shader_Type)( TYPE_SINGLE_TEXTURE + env );
+			break;
+	}
+
+	pipeline->fallback = vk_find_pipeline_ext( 0, &def, qfalse ) + 1;
+
+	return pipeline->fallback - 1;
+}
+
+void vk_pipeline_cache_info( void )
+{
+	ri.Printf( PRINT_ALL, "pipeline cache: %s, %i definitions recorded, %i KB loaded\n",
+		r_pipelineCache->integer ? PIPELINE_CACHE_FILE : "off", vk.pipeline_cache.num_records, (int)( vk.pipeline_cache.loaded_size / 1024 ) );
+
+	if ( vk.pipeline_cache.create_count ) {
+		ri.Printf( PRINT_ALL, "pipelines created: %i in %.1f msec, avg %.2f msec, max %.2f msec\n",
+			vk.pipeline_cache.create_count, vk.pipeline_cache.create_usec / 1000.0,
+			vk.pipeline_cache.create_usec / 1000.0 / vk.pipeline_cache.create_count, vk.pipeline_cache.create_usec_max / 1000.0 );
+	}
+
+	if ( vk.pipeline_cache.prewarm_count ) {
+		ri.Printf( PRINT_ALL, "pipelines prewarmed: %i in %.1f msec\n",
+			vk.pipeline_cache.prewarm_count, vk.pipeline_cache.prewarm_usec / 1000.0 );
+	}
+
+	ri.Printf( PRINT_ALL, "pipeline workers: %i, %i built on workers, %i drawn with fallback, %i waited for\n",
+		vk_workers.numThreads, vk.pipeline_cache.async_count, vk.pipeline_cache.fallback_count, vk.pipeline_cache.wait_count );
+}
+
 static uint32_t vk_alloc_pipeline( const Vk_Pipeline_Def *def ) {
     VK_Pipeline_t* pipeline;
 
@@ -1883,6 +2455,8 @@ static uint32_t vk_alloc_pipeline( const Vk_Pipeline_Def *def ) {
         for (j = 0; j < RENDER_PASS_COUNT; j++) {
             pipeline->handle[j] = VK_NULL_HANDLE;
         }
+        pipeline->pending = 0;
+        pipeline->fallback = 0;
         return vk.pipelines_count++;
     }
 }
@@ -1891,8 +2465,26 @@ VkPipeline vk_gen_pipeline( uint32_t index ) {
     if (index < vk.pipelines_count) {
         VK_Pipeline_t* pipeline = vk.pipelines + index;
 		const renderPass_t pass = vk.renderPassIndex;
+		uint32_t fallback;
+		if ( pipeline->handle[ pass ] == VK_NULL_HANDLE && vk_workers.numDone ) {
+			vk_collect_pipelines();
+		}
 		if ( pipeline->handle[ pass ] == VK_NULL_HANDLE ) {
-			pipeline->handle[ pass ] = vk_create_pipeline( &pipeline->def, pass, index );
+			fallback = ( r_pipelineThreads->integer > 0 ) ? vk_fallback_pipeline( index ) : index;
+			if ( fallback != index ) {
+				if ( pipeline->pending & ( 1 << pass ) )
+					return vk_gen_pipeline( fallback );
+				if ( vk_queue_pipeline( index, pass ) ) {
+					vk.pipeline_cache.fallback_count++;
+					return vk_gen_pipeline( fallback );
+				}
+			}
+			if ( pipeline->pending & ( 1 << pass ) ) {
+				vk_wait_pipeline( index, pass );
+			} else {
+				pipeline->handle[ pass ] = vk_create_pipeline( &pipeline->def, pass, index );
+				vk_record_pipeline( &pipeline->def, pass );
+			}
 		}
 		return pipeline->handle[ pass ];
     }
@@ -1915,8 +2507,13 @@ uint32_t vk_find_pipeline_ext( uint32_t base, const Vk_Pipeline_Def *def, qboole
     index = vk_alloc_pipeline(def);
 
 found:
-    if (use)
-        vk_gen_pipeline(index);
+    if (use) {
+        // get the workers going on it during level load instead of on first sight
+        const VK_Pipeline_t *pipeline = &vk.pipelines[index];
+        const renderPass_t pass = vk.renderPassIndex;
+        if ( pipeline->handle[pass] == VK_NULL_HANDLE && !( pipeline->pending & ( 1 << pass ) ) && !vk_queue_pipeline( index, pass ) )
+            vk_gen_pipeline(index);
+    }
 
     return index;
 }
@@ -2220,6 +2817,9 @@ void vk_create_pipelines( void )
     vk_alloc_persistent_pipelines();
 
     vk.pipelines_world_base = vk.pipelines_count;
+
+    if ( vk.pipeline_cache.prewarm )
+        vk_prewarm_pipelines();
 }
 
 static void vk_create_bloom_pipelines( void )
@@ -2282,6 +2882,8 @@ void vk_destroy_pipelines( qboolean resetCounter )
 {
     uint32_t i, j;
 
+    vk_wait_pipelines();
+
     // Destroy pipelines
     for ( i = 0; i < vk.pipelines_count; i++ ) {
         for ( j = 0; j < RENDER_PASS_COUNT; j++ ) {
@@ -27,9 +27,78 @@
 #include "../server/server.h"
 #include "../ghoul2/G2_local.h"
 
+#include <algorithm>
+#include <map>
+
 extern mdxaBone_t		worldMatrix;
 extern mdxaBone_t		worldMatrixInv;
 
+// triangle trees for the collision cache, see G2_CacheCollisionModel
+#define G2_TREE_LEAF_TRIS	4		// at most this many triangles in a leaf
+#define G2_TREE_MIN_TRIS	16		// surfaces with fewer triangles are tested one by one
+#define G2_TREE_EPSILON		0.01f	// the boxes grow this much so rounding can't lose a hit
+
+typedef struct {
+	vec3_t	mins, maxs;
+	int		first;				// leafs: first entry of tris, nodes: the left child - the right one follows it
+	int		numTris;			// 0 for nodes
+} g2TreeNode_t;
+
+typedef struct {
+	vector<g2TreeNode_t>	nodes;
+	vector<int>				tris;
+	int						generation;		// of the vertexes the boxes fit
+} g2TriTree_t;
+
+// one model of a cached instance - what it looked like when its vertexes were made
+typedef struct {
+	int						modelIndex;
+	int						flags;
+	int						surfaceRoot;
+	int						lodBias;
+	int						newOrigin;
+	char					fileName[MAX_QPATH];
+	boneInfo_v				blist;
+	surfaceInfo_v			slist;
+	size_t					*transformedVertsArray;
+	model_t					*model;
+	int						lod;
+	int						generation;
+	vector<g2TriTree_t>		trees;			// one for each surface, made when it is first traced
+} g2CollisionModel_t;
+
+class CG2CollisionCache
+{
+public:
+	int							frameNum;
+	int							useLod;
+	vec3_t						scale;
+	int							generation;		// goes up every time the vertexes are made again
+	CMiniHeap					*vertSpace;
+	size_t						vertSpaceSize;
+	vector<g2CollisionModel_t>	models;
+
+	CG2CollisionCache():
+	frameNum(0),
+	useLod(0),
+	generation(0),
+	vertSpace(NULL),
+	vertSpaceSize(0)
+	{
+		VectorClear(scale);
+	}
+
+	~CG2CollisionCache()
+	{
+		delete vertSpace;
+	}
+};
+
+typedef map<g2handle_t, CG2CollisionCache> CG2CollisionCache_m;
+
+static CG2CollisionCache_m	g2CollisionCaches;
+static vector<int>			g2TraceTris;		// the triangles a trace has to test, see G2_TraceTriTree
+
 class CTraceSurface
 {
 public:
@@ -48,6 +117,7 @@ public:
 	int					traceFlags;
 	bool				hitOne;
 	float				m_fRadius;
+	g2CollisionModel_t	*collModel;
 
 
 	CTraceSurface(
@@ -64,7 +134,8 @@ public:
 	shader_t			*initcust_shader,
 	size_t				*initTransformedVertsArray,
 	int					inittraceFlags,
-	float				fRadius):
+	float				fRadius,
+	g2CollisionModel_t	*initcollModel):
 
 	surfaceNum(initsurfaceNum),
 	rootSList(initrootSList),
@@ -77,7 +148,8 @@ public:
 	cust_shader(initcust_shader),
 	TransformedVertsArray(initTransformedVertsArray),
 	traceFlags(inittraceFlags),
-	m_fRadius(fRadius)
+	m_fRadius(fRadius),
+	collModel(initcollModel)
 	{
 		VectorCopy(initrayStart, rayStart);
 		VectorCopy(initrayEnd, rayEnd);
@@ -516,6 +588,381 @@ void G2_TransformModel(CGhoul2Info_v &ghoul2, const int frameNum, const vec3_t s
 }
 
 
+/*
+==============================================================
+
+Collision cache
+
+The saber code traces the same few models many times a frame, and every trace used to build the skeleton and
+transform all vertexes of the model again. With r_ghoul2TraceCache an instance keeps its transformed vertexes
+until the frame time, lod or scale of the trace change, or anything in its bone or surface lists does. Every
+surface also gets a tree of boxes over its triangles the first time a ray is traced against it, so a trace
+only tests the triangles whose boxes it crosses. The layout of a tree is made once, later frames only refit
+the boxes to the moved vertexes.
+
+==============================================================
+*/
+
+// how much space G2_TransformModel can need for the vertexes of these models
+static size_t G2_CollisionVertSpace(CGhoul2Info_v &ghoul2, int useLod)
+{
+	size_t	size = 0;
+	int		lod, i;
+
+	for (size_t m = 0; m < ghoul2.size(); m++)
+	{
+		if (ghoul2[m].mModelindex == -1)
+		{
+			continue;
+		}
+		model_t *currentModel = R_GetModelByHandle(RE_RegisterModel(ghoul2[m].mFileName));
+		lod = G2_DecideTraceLod(ghoul2[m], useLod, currentModel);
+
+		size += currentModel->mdxm->numSurfaces * sizeof(size_t);
+		for (i = 0; i < currentModel->mdxm->numSurfaces; i++)
+		{
+			size += ((mdxmSurface_t *)G2_FindSurface((void *)currentModel, i, lod))->numVerts * 5 * 4;
+		}
+	}
+	return size;
+}
+
+// has anything the vertexes depend on changed since they were made? The skeletons must not have been built for
+// another time since either, the bolts G2API_GetBoltMatrix may reuse come from the same build
+static bool G2_SameCollisionModels(const CG2CollisionCache &cache, CGhoul2Info_v &ghoul2, const int frameNum)
+{
+	if (cache.models.size() != ghoul2.size())
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < ghoul2.size(); i++)
+	{
+		const g2CollisionModel_t	&cm = cache.models[i];
+		const CGhoul2Info			&g = ghoul2[i];
+
+		if (cm.modelIndex != g.mModelindex || cm.flags != g.mFlags || cm.surfaceRoot != g.mSurfaceRoot ||
+			cm.lodBias != g.mLodBias || cm.newOrigin != g.mNewOrigin || strcmp(cm.fileName, g.mFileName))
+		{
+			return false;
+		}
+		if (g.mModelindex != -1 && !(g.mFlags & GHOUL2_NOMODEL) && g.mSkelFrameNum != frameNum)
+		{
+			return false;
+		}
+		// both lists are plain numbers, and were taken after the skeleton was made, which changes some of them
+		if (cm.blist.size() != g.mBlist.size() ||
+			(cm.blist.size() && memcmp(&cm.blist[0], &g.mBlist[0], cm.blist.size() * sizeof(boneInfo_t))))
+		{
+			return false;
+		}
+		if (cm.slist.size() != g.mSlist.size() ||
+			(cm.slist.size() && memcmp(&cm.slist[0], &g.mSlist[0], cm.slist.size() * sizeof(surfaceInfo_t))))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static void G2_StoreCollisionModel(g2CollisionModel_t &cm, CGhoul2Info &g, int useLod, int generation)
+{
+	cm.modelIndex = g.mModelindex;
+	cm.flags = g.mFlags;
+	cm.surfaceRoot = g.mSurfaceRoot;
+	cm.lodBias = g.mLodBias;
+	cm.newOrigin = g.mNewOrigin;
+	Q_strncpyz(cm.fileName, g.mFileName, sizeof(cm.fileName));
+	cm.blist = g.mBlist;
+	cm.slist = g.mSlist;
+	cm.transformedVertsArray = g.mTransformedVertsArray;
+	cm.generation = generation;
+
+	if (g.mModelindex == -1)
+	{
+		return;
+	}
+
+	model_t *currentModel = R_GetModelByHandle(RE_RegisterModel(g.mFileName));
+	int lod = G2_DecideTraceLod(g, useLod, currentModel);
+
+	// the trees are only good for the surfaces they were made for
+	if (cm.model != currentModel || cm.lod != lod)
+	{
+		cm.model = currentModel;
+		cm.lod = lod;
+		cm.trees.clear();
+		cm.trees.resize(currentModel->mdxm->numSurfaces);
+	}
+}
+
+/*
+==============
+G2_CacheCollisionModel
+
+Builds the skeletons and vertexes of an instance for a trace, unless the ones of the last trace are still good.
+Returns the cache G2_TraceModels should use.
+==============
+*/
+CG2CollisionCache *G2_CacheCollisionModel(g2handle_t g2h, CGhoul2Info_v &ghoul2, const int frameNum, const vec3_t angles,
+	const vec3_t position, const vec3_t scale, int useLod)
+{
+	CG2CollisionCache	&cache = g2CollisionCaches[g2h];
+	size_t				i;
+
+	if (cache.vertSpace && cache.frameNum == frameNum && cache.useLod == useLod && VectorCompare(cache.scale, scale) &&
+		G2_SameCollisionModels(cache, ghoul2, frameNum))
+	{
+		for (i = 0; i < ghoul2.size(); i++)
+		{
+			ghoul2[i].mTransformedVertsArray = cache.models[i].transformedVertsArray;
+		}
+		return &cache;
+	}
+
+	// make sure we have transformed the whole skeletons for each model
+	G2_ConstructGhoulSkeleton(ghoul2, frameNum, NULL, true, angles, position, scale, false);
+
+	// the instance keeps its own space, the shared one gets reset by every trace
+	const size_t size = G2_CollisionVertSpace(ghoul2, useLod);
+	if (!cache.vertSpace || size > cache.vertSpaceSize)
+	{
+		delete cache.vertSpace;
+		cache.vertSpace = new CMiniHeap(size);
+		cache.vertSpaceSize = size;
+	}
+	cache.vertSpace->ResetHeap();
+
+	G2_TransformModel(ghoul2, frameNum, scale, cache.vertSpace, useLod);
+
+	cache.frameNum = frameNum;
+	cache.useLod = useLod;
+	VectorCopy(scale, cache.scale);
+	cache.generation++;
+
+	cache.models.resize(ghoul2.size());
+	for (i = 0; i < ghoul2.size(); i++)
+	{
+		G2_StoreCollisionModel(cache.models[i], ghoul2[i], useLod, cache.generation);
+	}
+	return &cache;
+}
+
+void G2_FreeCollisionCache(g2handle_t g2h)
+{
+	g2CollisionCaches.erase(g2h);
+}
+
+void G2_FreeCollisionCaches(void)
+{
+	g2CollisionCaches.clear();
+}
+
+static const float *G2_TreeTriVert(const mdxmTriangle_t *tris, const float *verts, int tri, int corner)
+{
+	return &verts[tris[tri].indexes[corner] * 5];
+}
+
+// split the triangles of a node at the middle one along the longest side of their centers until they are few enough
+static void G2_BuildTreeNode(g2TriTree_t &tree, int nodeNum, const vector<float> &centers, int first, int numTris)
+{
+	vec3_t	mins, maxs;
+	int		axis, i;
+
+	ClearBounds(mins, maxs);
+	for (i = first; i < first + numTris; i++)
+	{
+		AddPointToBounds(&centers[tree.tris[i] * 3], mins, maxs);
+	}
+
+	axis = 0;
+	for (i = 1; i < 3; i++)
+	{
+		if (maxs[i] - mins[i] > maxs[axis] - mins[axis])
+		{
+			axis = i;
+		}
+	}
+
+	if (numTris <= G2_TREE_LEAF_TRIS || maxs[axis] - mins[axis] <= 0.0f)
+	{
+		tree.nodes[nodeNum].first = first;
+		tree.nodes[nodeNum].numTris = numTris;
+		return;
+	}
+
+	const int half = numTris / 2;
+	int *tris = &tree.tris[0];
+	std::nth_element(tris + first, tris + first + half, tris + first + numTris,
+		[&centers, axis](int a, int b) { return centers[a * 3 + axis] < centers[b * 3 + axis]; });
+
+	const int left = (int)tree.nodes.size();
+	tree.nodes.resize(left + 2);
+	tree.nodes[nodeNum].first = left;
+	tree.nodes[nodeNum].numTris = 0;
+
+	G2_BuildTreeNode(tree, left, centers, first, half);
+	G2_BuildTreeNode(tree, left + 1, centers, first + half, numTris - half);
+}
+
+// fit the boxes to the vertexes - children always come after their parent, so walking backwards has them done first
+static void G2_RefitTriTree(g2TriTree_t &tree, const mdxmSurface_t *surface, const float *verts)
+{
+	const mdxmTriangle_t *tris = (const mdxmTriangle_t *)((const byte *)surface + surface->ofsTriangles);
+	const vec3_t grow = { G2_TREE_EPSILON, G2_TREE_EPSILON, G2_TREE_EPSILON };
+	int i, j, k;
+
+	for (i = (int)tree.nodes.size() - 1; i >= 0; i--)
+	{
+		g2TreeNode_t &node = tree.nodes[i];
+
+		if (node.numTris)
+		{
+			ClearBounds(node.mins, node.maxs);
+			for (j = node.first; j < node.first + node.numTris; j++)
+			{
+				for (k = 0; k < 3; k++)
+				{
+					AddPointToBounds(G2_TreeTriVert(tris, verts, tree.tris[j], k), node.mins, node.maxs);
+				}
+			}
+			VectorSubtract(node.mins, grow, node.mins);
+			VectorAdd(node.maxs, grow, node.maxs);
+		}
+		else
+		{
+			const g2TreeNode_t &left = tree.nodes[node.first];
+			const g2TreeNode_t &right = tree.nodes[node.first + 1];
+
+			for (k = 0; k < 3; k++)
+			{
+				node.mins[k] = Q_min(left.mins[k], right.mins[k]);
+				node.maxs[k] = Q_max(left.maxs[k], right.maxs[k]);
+			}
+		}
+	}
+}
+
+static void G2_BuildTriTree(g2TriTree_t &tree, const mdxmSurface_t *surface, const float *verts)
+{
+	const mdxmTriangle_t	*tris = (const mdxmTriangle_t *)((const byte *)surface + surface->ofsTriangles);
+	const int				numTris = surface->numTriangles;
+	vector<float>			centers(numTris * 3);
+	int						i, k;
+
+	tree.tris.resize(numTris);
+	for (i = 0; i < numTris; i++)
+	{
+		tree.tris[i] = i;
+		for (k = 0; k < 3; k++)
+		{
+			centers[i * 3 + k] = (G2_TreeTriVert(tris, verts, i, 0)[k] + G2_TreeTriVert(tris, verts, i, 1)[k] +
+				G2_TreeTriVert(tris, verts, i, 2)[k]) * (1.0f / 3.0f);
+		}
+	}
+
+	tree.nodes.clear();
+	tree.nodes.resize(1);
+	G2_BuildTreeNode(tree, 0, centers, 0, numTris);
+	G2_RefitTriTree(tree, surface, verts);
+}
+
+// the tree of a surface, fit to the vertexes of this frame - NULL to test every triangle
+static const g2TriTree_t *G2_SurfaceTriTree(CTraceSurface &TS, const mdxmSurface_t *surface)
+{
+	g2CollisionModel_t	*cm = TS.collModel;
+	const float			*verts = (const float *)TS.TransformedVertsArray[surface->thisSurfaceIndex];
+
+	if (!cm || cm->lod != TS.lod || !verts || surface->numTriangles < G2_TREE_MIN_TRIS ||
+		surface->thisSurfaceIndex >= (int)cm->trees.size())
+	{
+		return NULL;
+	}
+
+	g2TriTree_t &tree = cm->trees[surface->thisSurfaceIndex];
+	if (tree.nodes.empty())
+	{
+		G2_BuildTriTree(tree, surface, verts);
+	}
+	else if (tree.generation != cm->generation)
+	{
+		G2_RefitTriTree(tree, surface, verts);
+	}
+	tree.generation = cm->generation;
+
+	return &tree;
+}
+
+static qboolean G2_SegmentCrossesBox(const vec3_t start, const vec3_t dir, const vec3_t mins, const vec3_t maxs)
+{
+	float	enter = 0.0f, leave = 1.0f;
+	int		i;
+
+	for (i = 0; i < 3; i++)
+	{
+		if (fabsf(dir[i]) < 1e-8f)
+		{
+			if (start[i] < mins[i] || start[i] > maxs[i])
+			{
+				return qfalse;
+			}
+			continue;
+		}
+
+		float t1 = (mins[i] - start[i]) / dir[i];
+		float t2 = (maxs[i] - start[i]) / dir[i];
+		if (t1 > t2)
+		{
+			float t = t1;
+			t1 = t2;
+			t2 = t;
+		}
+		enter = Q_max(enter, t1);
+		leave = Q_min(leave, t2);
+		if (enter > leave)
+		{
+			return qfalse;
+		}
+	}
+	return qtrue;
+}
+
+// gather the triangles whose boxes the segment crosses into g2TraceTris, in the order of the surface so the hits
+// are found in the same order as when testing every triangle
+static int G2_TraceTriTree(const g2TriTree_t &tree, const vec3_t start, const vec3_t end)
+{
+	int		stack[64];
+	int		numStack = 0;
+	vec3_t	dir;
+
+	g2TraceTris.clear();
+	VectorSubtract(end, start, dir);
+
+	stack[numStack++] = 0;
+	while (numStack)
+	{
+		const g2TreeNode_t &node = tree.nodes[stack[--numStack]];
+
+		if (!G2_SegmentCrossesBox(start, dir, node.mins, node.maxs))
+		{
+			continue;
+		}
+		if (node.numTris)
+		{
+			g2TraceTris.insert(g2TraceTris.end(), tree.tris.begin() + node.first, tree.tris.begin() + node.first + node.numTris);
+		}
+		else if (numStack + 2 <= (int)ARRAY_LEN(stack))
+		{
+			stack[numStack++] = node.first + 1;
+			stack[numStack++] = node.first;
+		}
+	}
+
+	std::sort(g2TraceTris.begin(), g2TraceTris.end());
+	return (int)g2TraceTris.size();
+}
+
+
 // work out how much space a triangle takes
 static float	G2_AreaOfTri(const vec3_t A, const vec3_t B, const vec3_t C)
 {
@@ -846,17 +1293,27 @@ static bool G2_RadiusTracePolys( const mdxmSurface_t *surface, const vec3_t rayS
 }
 
 // now we're at poly level, check each model space transformed poly against the model world transfomed ray
-bool G2_TracePolys( const mdxmSurface_t *surface, const vec3_t rayStart, const vec3_t rayEnd, CollisionRecord_t *collRecMap, int entNum, int modelIndex, const skin_t *skin, const shader_t *cust_shader, const mdxmSurfHierarchy_t *surfInfo, size_t *TransformedVertsArray, int traceFlags)
+bool G2_TracePolys( const mdxmSurface_t *surface, const vec3_t rayStart, const vec3_t rayEnd, CollisionRecord_t *collRecMap, int entNum, int modelIndex, const skin_t *skin, const shader_t *cust_shader, const mdxmSurfHierarchy_t *surfInfo, size_t *TransformedVertsArray, int traceFlags, const g2TriTree_t *tree)
 {
-	int		j, numTris;
+	int			j, n, numTris;
+	const int	*triList = NULL;
 
 	// whip through and actually transform each vertex
 	const mdxmTriangle_t *tris = (const mdxmTriangle_t *) ((const byte *)surface + surface->ofsTriangles);
 	const float *verts = (float *)TransformedVertsArray[surface->thisSurfaceIndex];
 	numTris = surface->numTriangles;
 
-	for ( j = 0; j < numTris; j++ )
+	// with a tree only the triangles near the ray need testing
+	if (tree)
 	{
+		numTris = G2_TraceTriTree(*tree, rayStart, rayEnd);
+		triList = numTris ? &g2TraceTris[0] : NULL;
+	}
+
+	for ( n = 0; n < numTris; n++ )
+	{
+		j = triList ? triList[n] : n;
+
 		float			face;
 		vec3_t	hitPoint, normal;
 		// determine actual coords for this triangle
@@ -1020,7 +1477,7 @@ void G2_TraceSurfaces(CTraceSurface &TS)
 #endif
 		{
 			// go away and trace the polys in this surface
-			if (G2_TracePolys(surface, TS.rayStart, TS.rayEnd, TS.collRecMap, TS.entNum, TS.modelIndex, TS.skin, TS.cust_shader, surfInfo, TS.TransformedVertsArray, TS.traceFlags) && (TS.traceFlags & G2_RETURNONHIT))
+			if (G2_TracePolys(surface, TS.rayStart, TS.rayEnd, TS.collRecMap, TS.entNum, TS.modelIndex, TS.skin, TS.cust_shader, surfInfo, TS.TransformedVertsArray, TS.traceFlags, G2_SurfaceTriTree(TS, surface)) && (TS.traceFlags & G2_RETURNONHIT))
 			{
 				// ok, we hit one, *and* we want to return instantly because the returnOnHit is set
 				// so indicate we've hit one, so other surfaces don't get hit and return
@@ -1045,7 +1502,7 @@ void G2_TraceSurfaces(CTraceSurface &TS)
 
 }
 
-void G2_TraceModels(CGhoul2Info_v &ghoul2, const vec3_t rayStart, const vec3_t rayEnd, CollisionRecord_t *collRecMap, int entNum, int traceFlags, int useLod, float fRadius)
+void G2_TraceModels(CGhoul2Info_v &ghoul2, const vec3_t rayStart, const vec3_t rayEnd, CollisionRecord_t *collRecMap, int entNum, int traceFlags, int useLod, float fRadius, CG2CollisionCache *cache)
 {
 	int				lod;
 	model_t			*currentModel;
@@ -1110,7 +1567,7 @@ void G2_TraceModels(CGhoul2Info_v &ghoul2, const vec3_t rayStart, const vec3_t r
 		lod = G2_DecideTraceLod(ghoul2[i],useLod, currentModel);
 #endif
 
-		CTraceSurface TS(ghoul2[i].mSurfaceRoot, ghoul2[i].mSlist,  currentModel, lod, rayStart, rayEnd, collRecMap, entNum, i, skin, cust_shader, ghoul2[i].mTransformedVertsArray, traceFlags, fRadius);
+		CTraceSurface TS(ghoul2[i].mSurfaceRoot, ghoul2[i].mSlist,  currentModel, lod, rayStart, rayEnd, collRecMap, entNum, i, skin, cust_shader, ghoul2[i].mTransformedVertsArray, traceFlags, fRadius, cache ? &cache->models[i] : NULL);
 		// start the surface recursion loop
 		G2_TraceSurfaces(TS);
 
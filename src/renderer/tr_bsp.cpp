@@ -1606,6 +1606,17 @@ static	void R_LoadShaders( lump_t *l ) {
 		out[i].surfaceFlags = LittleLong( out[i].surfaceFlags );
 		out[i].contentFlags = LittleLong( out[i].contentFlags );
 	}
+
+	// start inflating the images of shaders without a script, in the
+	// order R_LoadImage tries the extensions
+	for ( i=0 ; i<count ; i++ ) {
+		char	name[MAX_QPATH];
+
+		COM_StripExtension( out[i].shader, name, sizeof( name ) );
+		if ( !ri.FS_PrefetchFile( va( "%s.jpg", name ) ) && !ri.FS_PrefetchFile( va( "%s.png", name ) ) ) {
+			ri.FS_PrefetchFile( va( "%s.tga", name ) );
+		}
+	}
 }
 
 
@@ -14,6 +14,7 @@
 #endif
 
 #include "../ghoul2/G2_local.h"
+#include "../rd-common/mdx_simd.h"
 #endif
 
 
@@ -168,6 +169,9 @@ Ghoul2 Insert Start
 */
 
 cvar_t	*r_noServerGhoul2;
+cvar_t	*r_ghoul2Threads;
+cvar_t	*r_ghoul2Simd;
+cvar_t	*r_ghoul2TraceCache;
 cvar_t	*r_Ghoul2AnimSmooth=0;
 cvar_t	*r_Ghoul2UnSqashAfterSmooth=0;
 //cvar_t	*r_Ghoul2UnSqash;
@@ -1197,6 +1201,15 @@ Ghoul2 Insert Start
 
 	r_Ghoul2AnimSmooth = ri.Cvar_Get( "r_ghoul2animsmooth", ".3", 0 );
 	r_Ghoul2UnSqashAfterSmooth = ri.Cvar_Get( "r_ghoul2unsqashaftersmooth", "1", 0 );
+	r_ghoul2Threads = ri.Cvar_Get( "r_ghoul2Threads", "0", CVAR_ARCHIVE | CVAR_GLOBAL );
+	r_ghoul2Simd = ri.Cvar_Get( "r_ghoul2Simd", "1", CVAR_ARCHIVE | CVAR_GLOBAL );
+#ifdef DEDICATED
+	// FMA results depend on the CPU, server-side bolts and traces must not
+	MDX_SelectKernels( Q_min( r_ghoul2Simd->integer, (int)MDX_SIMD_SSE2 ) );
+#else
+	MDX_SelectKernels( r_ghoul2Simd->integer );
+#endif
+	r_ghoul2TraceCache = ri.Cvar_Get( "r_ghoul2TraceCache", "1", CVAR_ARCHIVE | CVAR_GLOBAL );
 /*
 Ghoul2 Insert End
 */
@@ -1217,6 +1230,8 @@ Ghoul2 Insert End
 #endif
 	ri.Cmd_AddCommand("modellist", R_Modellist_f);
 	ri.Cmd_AddCommand( "modelcacheinfo", RE_RegisterModels_Info_f);
+	ri.Cmd_AddCommand( "ghoul2bench", R_Ghoul2Bench_f );
+	ri.Cmd_AddCommand( "ghoul2tracebench", R_Ghoul2TraceBench_f );
 
 	r_screenshotJpegQuality = ri.Cvar_Get("r_screenshotJpegQuality", "95", CVAR_ARCHIVE | CVAR_GLOBAL);
 
@@ -1345,6 +1360,10 @@ void RE_Shutdown( qboolean destroyWindow ) {
 
 	ri.Cmd_RemoveCommand ("modellist");
 	ri.Cmd_RemoveCommand ("modelcacheinfo");
+	ri.Cmd_RemoveCommand ("ghoul2bench");
+	ri.Cmd_RemoveCommand ("ghoul2tracebench");
+
+	G2_FreeCollisionCaches();
 
 
 #ifndef DEDICATED
@@ -1403,6 +1422,7 @@ void RE_Shutdown( qboolean destroyWindow ) {
 			R_DeleteTextures();		// only do this for vid_restart now, not during things like map load
 		}
 	}
+	R_FreeGhoulSkins();
 
 	// shut down platform specific OpenGL stuff
 	if ( destroyWindow ) {
@@ -1302,6 +1302,9 @@ extern	cvar_t	*r_loadSkinsJKA;
 Ghoul2 Insert Start
 */
 extern	cvar_t	*r_noServerGhoul2;
+extern	cvar_t	*r_ghoul2Threads;
+extern	cvar_t	*r_ghoul2Simd;
+extern	cvar_t	*r_ghoul2TraceCache;
 /*
 Ghoul2 Insert End
 */
@@ -1700,22 +1703,37 @@ void RB_SurfaceAnim( md4Surface_t *surfType );
 Ghoul2 Insert Start
 */
 
+// a surface skinned on the job threads, shared by all the CRenderableSurfaces added for it
+typedef struct g2Skin_s {
+	const mdxmSurface_t	*surface;
+	const mdxaBone_v	*bonePtr;
+	vec4_t				*xyz;			// surface->numVerts positions followed by as many normals
+} g2Skin_t;
+
 class CRenderableSurface
 {
 public:
 	const int		ident;			// ident of this surface - required so the materials renderer knows what sort of surface this refers to
 	void			*boneList;		// pointer to transformed bone list for this surface - required client side for rendering DONOT USE IN GAME	SIDE
 	mdxmSurface_t	*surfaceData;	// pointer to surface data loaded into file - only used by client renderer DO NOT USE IN GAME SIDE - if there is a vid restart this will be out of wack on the game
+	g2Skin_t		*skin;			// already skinned vertexes for this frame, NULL to skin in the back end
 
 CRenderableSurface():
 	ident(SF_MDX),
 	boneList(0),
-	surfaceData(0)
+	surfaceData(0),
+	skin(0)
 	{}
 };
 
 void R_AddGhoulSurfaces( trRefEntity_t *ent );
 void RB_SurfaceGhoul( CRenderableSurface *surface );
+void R_BuildGhoulSkeletons( void );
+void R_SkinGhoulSurfaces( void );
+void R_ResetGhoulSkins( void );
+void R_FreeGhoulSkins( void );
+void R_Ghoul2Bench_f( void );
+void R_Ghoul2TraceBench_f( void );
 /*
 Ghoul2 Insert End
 */
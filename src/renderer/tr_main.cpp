@@ -1161,6 +1161,8 @@ void R_AddEntitySurfaces (void) {
 		return;
 	}
 
+	R_BuildGhoulSkeletons();
+
 	for ( tr.currentEntityNum = 0;
 	      tr.currentEntityNum < tr.refdef.num_entities;
 		  tr.currentEntityNum++ ) {
@@ -1264,6 +1266,7 @@ Ghoul2 Insert End
 		}
 	}
 
+	R_SkinGhoulSurfaces();
 }
 
 
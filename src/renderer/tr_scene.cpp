@@ -46,6 +46,8 @@ void R_InitNextFrame(void) {
 	r_firstScenePoly = 0;
 
 	r_numpolyverts = 0;
+
+	R_ResetGhoulSkins();
 }
 
 /*
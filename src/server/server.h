@@ -30,7 +30,6 @@ typedef struct svEntity_s {
 	int			clusternums[MAX_ENT_CLUSTERS];
 	int			lastCluster;		// if all the clusters don't fit in clusternums
 	int			areanum, areanum2;
-	int			snapshotCounter;	// used to prevent double adding from portal views
 } svEntity_t;
 
 typedef enum {
@@ -45,7 +44,6 @@ typedef struct {
 	int				serverId;			// changes each server start
 	int				restartedServerId;	// serverId before a map_restart
 	int				checksumFeed;		//
-	int				snapshotCounter;	// incremented for each snapshot built
 	int				timeResidual;		// <= 1000 / sv_frame->value
 	int				nextFrameTime;		// when time > nextFrameTime, process world
 	struct cmodel_s	*models[MAX_MODELS];
@@ -119,6 +117,15 @@ typedef struct leakyBucket_s {
 	unsigned short		burst;
 } leakyBucket_t;
 
+// lookup counters of the address keyed tables used for connectionless packets
+typedef struct {
+	unsigned			lookups;
+	unsigned			probes;				// slots looked at over all lookups
+	int					maxProbes;
+	unsigned			inserts;
+	unsigned			evictions;			// live entries thrown out to make room
+} adrTableStats_t;
+
 typedef struct client_s {
 	clientState_t	state;
 	char			userinfo[MAX_INFO_STRING];		// name, etc
@@ -183,7 +190,10 @@ typedef struct client_s {
 // Allow a certain amount of challenges to have the same IP address
 // to make it a bit harder to DOS one single IP address from connecting
 // while not allowing a single ip to grab all challenge resources
-#define MAX_CHALLENGES_MULTI (MAX_CHALLENGES / 2)
+#define MAX_CHALLENGES_MULTI 16
+
+// open addressing index from address to challenge, kept at most half full
+#define	CHALLENGE_INDEX_SIZE	(MAX_CHALLENGES * 2)
 
 typedef struct challenge_s {
 	netadr_t	adr;
@@ -213,6 +223,8 @@ typedef struct {
 	entityState_t	*snapshotEntities;		// [numSnapshotEntities]
 	int			nextHeartbeatTime;
 	challenge_t	challenges[MAX_CHALLENGES];	// to prevent invalid IPs from connecting
+	short		challengeIndex[CHALLENGE_INDEX_SIZE];	// challenge number + 1, 0 when empty
+	int			nextChallenge;				// challenges are recycled oldest first
 	netadr_t	redirectAddress;			// for rcon return messages
 
 	struct {
@@ -268,6 +280,12 @@ extern	cvar_t	*mv_apiConnectionless;
 extern	cvar_t	*sv_pingFix;
 extern	cvar_t	*sv_autoWhitelist;
 extern	cvar_t	*sv_dynamicSnapshots;
+extern	cvar_t	*sv_snapshotThreads;
+extern	cvar_t	*sv_traceThreads;
+extern	cvar_t	*sv_botThreads;
+extern	cvar_t	*sv_snapshotVisSets;
+extern	cvar_t	*sv_snapshotDeltaCache;
+extern	cvar_t	*sv_maxOOBAddresses;
 
 // toggleable fixes
 extern	cvar_t	*mv_fixnamecrash;
@@ -305,6 +323,9 @@ qboolean MVAPI_DisableStructConversion(qboolean disable);
 extern qboolean mvStructConversionDisabled;
 
 qboolean SVC_RateLimit(leakyBucket_t *bucket, int burst, int period, int now);
+unsigned SVC_HashAddress(netadr_t adr, qboolean withPort);
+void SVC_OOBStats_f( void );
+extern adrTableStats_t	svc_challengeStats;
 void SVC_LoadWhitelist( void );
 void SVC_WhitelistAdr( netadr_t adr );
 
@@ -362,6 +383,8 @@ void SV_WriteFrameToClient (client_t *client, msg_t *msg);
 void SV_SendMessageToClient( msg_t *msg, client_t *client );
 void SV_SendClientMessages( void );
 void SV_SendClientSnapshot( client_t *client );
+void SV_SnapshotStats_f( void );
+void SV_SnapshotVisBench_f( void );
 
 //
 // sv_game.c
@@ -391,6 +414,9 @@ void		SV_BotFreeClient( int clientNum );
 void		SV_BotInitCvars(void);
 int			SV_BotLibSetup( void );
 int			SV_BotLibShutdown( void );
+void		SV_BotCalcReachability_f( void );
+void		SV_BotAIBatch( mvbotai_t *requests, int numRequests );
+void		SV_BotAIStats_f( void );
 int			SV_BotGetSnapshotEntity( int client, int ent );
 qboolean	SV_BotGetConsoleMessage( int client, char *buf, int size );
 
@@ -440,6 +466,8 @@ int SV_PointContents( const vec3_t p, int passEntityNum );
 
 
 void SV_Trace( trace_t *results, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, qboolean capsule, int traceFlags, int useLod );
+void SV_TraceBatch( trace_t *results, const mvtrace_t *traces, int numTraces );
+void SV_TraceStats_f( void );
 // mins and maxs are relative
 
 // if the entire move stays in a solid volume, trace.allsolid will be set,
@@ -2,6 +2,10 @@
 
 #include "server.h"
 #include "../game/botlib.h"
+#include "../game/be_ai_goal.h"
+#include "../game/be_ai_move.h"
+
+#include <mutex>
 
 typedef struct bot_debugpoly_s
 {
@@ -17,6 +21,31 @@ int bot_maxdebugpolys;
 extern botlib_export_t	*botlib_export;
 int	bot_enable;
 
+#define MAX_BOTAI_COMMANDS	64
+#define MAX_BOTAI_PRINT		4096
+
+// bot AI running on the job threads, see SV_BotAIBatch
+static struct {
+	qboolean	active;
+	std::mutex	mutex;				// guards the commands and the exit message
+	int			numCommands;
+	int			commandClients[MAX_BOTAI_COMMANDS];
+	char		commands[MAX_BOTAI_COMMANDS][MAX_STRING_CHARS];
+	char		exit[MAX_STRING_CHARS];
+
+	// prints of every job thread, flushed on the main thread after the batch
+	char		prints[MAX_JOB_THREADS][MAX_BOTAI_PRINT];
+	int			printLength[MAX_JOB_THREADS];
+	int			printsDropped[MAX_JOB_THREADS];
+
+	int64_t		batches[2];			// serial, threaded
+	int64_t		requests[2];
+	int64_t		usec[2];
+} botAI;
+
+static_assert( sizeof( mvbotgoal_t ) == sizeof( bot_goal_t ), "mvbotgoal_t doesn't match bot_goal_t" );
+static_assert( sizeof( mvbotmoveresult_t ) == sizeof( bot_moveresult_t ), "mvbotmoveresult_t doesn't match bot_moveresult_t" );
+
 
 /*
 ==================
@@ -107,6 +136,66 @@ void BotDrawDebugPolygons(void (*drawPoly)(int color, int numPoints, float *poin
 	}
 }
 
+/*
+==================
+SV_BotPrint
+
+Prints right away, or into the buffer of the job thread while the bot AI
+runs on the job threads
+==================
+*/
+ __attribute__ ((format (printf, 1, 2)))
+static void SV_BotPrint( const char *fmt, ... ) {
+	va_list	ap;
+	int		thread, len;
+	char	*buf;
+
+	if ( !botAI.active ) {
+		char str[2048];
+
+		va_start( ap, fmt );
+		Q_vsnprintf( str, sizeof( str ), fmt, ap );
+		va_end( ap );
+		Com_Printf( "%s", str );
+		return;
+	}
+
+	thread = Com_JobThreadNum();
+	buf = botAI.prints[thread];
+	va_start( ap, fmt );
+	len = Q_vsnprintf( buf + botAI.printLength[thread], MAX_BOTAI_PRINT - botAI.printLength[thread], fmt, ap );
+	va_end( ap );
+
+	if ( len < 0 || botAI.printLength[thread] + len >= MAX_BOTAI_PRINT ) {
+		buf[botAI.printLength[thread]] = '\0';
+		botAI.printsDropped[thread]++;
+		return;
+	}
+	botAI.printLength[thread] += len;
+}
+
+/*
+==================
+SV_BotFlushPrints
+
+Prints what the job threads printed during the batch
+==================
+*/
+static void SV_BotFlushPrints( void ) {
+	int		i;
+
+	for ( i = 0 ; i < MAX_JOB_THREADS ; i++ ) {
+		if ( botAI.printLength[i] ) {
+			Com_Printf( "%s", botAI.prints[i] );
+			botAI.printLength[i] = 0;
+		}
+		if ( botAI.printsDropped[i] ) {
+			Com_Printf( S_COLOR_YELLOW "Warning: %i bot AI prints of job thread %i dropped\n", botAI.printsDropped[i], i );
+			botAI.printsDropped[i] = 0;
+		}
+	}
+}
+
 /*
 ==================
 BotImport_Print
@@ -122,29 +211,38 @@ void QDECL BotImport_Print(int type, char *fmt, ...)
 	Q_vsnprintf(str, sizeof(str), fmt, ap);
 	va_end(ap);
 
+	if (type == PRT_EXIT) {
+		if (!botAI.active) {
+			Com_Error(ERR_DROP, S_COLOR_RED "Exit: %s", str);
+		}
+
+		// the error is raised on the main thread after the batch
+		std::lock_guard<std::mutex> lock(botAI.mutex);
+		if (!botAI.exit[0]) {
+			Q_strncpyz(botAI.exit, str, sizeof(botAI.exit));
+		}
+		return;
+	}
+
 	switch(type) {
 		case PRT_MESSAGE: {
-			Com_Printf("%s", str);
+			SV_BotPrint("%s", str);
 			break;
 		}
 		case PRT_WARNING: {
-			Com_Printf(S_COLOR_YELLOW "Warning: %s", str);
+			SV_BotPrint(S_COLOR_YELLOW "Warning: %s", str);
 			break;
 		}
 		case PRT_ERROR: {
-			Com_Printf(S_COLOR_RED "Error: %s", str);
+			SV_BotPrint(S_COLOR_RED "Error: %s", str);
 			break;
 		}
 		case PRT_FATAL: {
-			Com_Printf(S_COLOR_RED "Fatal: %s", str);
-			break;
-		}
-		case PRT_EXIT: {
-			Com_Error(ERR_DROP, S_COLOR_RED "Exit: %s", str);
+			SV_BotPrint(S_COLOR_RED "Fatal: %s", str);
 			break;
 		}
 		default: {
-			Com_Printf("unknown print type\n");
+			SV_BotPrint("unknown print type\n");
 			break;
 		}
 	}
@@ -438,9 +536,131 @@ SV_BotClientCommand
 ==================
 */
 void BotClientCommand( int client, const char *command ) {
+	if ( botAI.active ) {
+		// the game module runs on the main thread only, keep the command for after the batch
+		std::lock_guard<std::mutex> lock( botAI.mutex );
+
+		if ( botAI.numCommands < MAX_BOTAI_COMMANDS ) {
+			botAI.commandClients[botAI.numCommands] = client;
+			Q_strncpyz( botAI.commands[botAI.numCommands], command, sizeof( botAI.commands[0] ) );
+			botAI.numCommands++;
+		}
+		return;
+	}
+
 	SV_ExecuteClientCommand( &svs.clients[client], command, qtrue );
 }
 
+/*
+==================
+SV_BotAIBatch
+
+Runs independent move and goal requests of several bots for the game
+module. With sv_botThreads > 1 botlib spreads them over the job threads:
+every bot only changes its own state and input, the AAS world is only read
+and the routing cache can be added to from several threads. The job threads
+don't print or allocate: prints are kept per thread and new routing cache
+comes from a pool botlib fills before the batch. The prints and the commands
+the bots send meanwhile are handled after the batch.
+==================
+*/
+void SV_BotAIBatch( mvbotai_t *requests, int numRequests ) {
+	bot_airequest_t	batch[MAX_BOTAIREQUESTS];
+	mvbotai_t		*req;
+	int64_t			start;
+	int				numThreads;
+	int				first, num;
+	int				i;
+
+	if ( !requests || numRequests <= 0 || !bot_enable || !botlib_export ) {
+		return;
+	}
+
+	numThreads = sv_botThreads->integer;
+	if ( numThreads > CM_NumThreads() ) {
+		numThreads = CM_NumThreads();
+	}
+
+	start = Sys_Microseconds();
+	for ( first = 0 ; first < numRequests ; first += num ) {
+		num = numRequests - first;
+		if ( num > MAX_BOTAIREQUESTS ) {
+			num = MAX_BOTAIREQUESTS;
+		}
+
+		for ( i = 0, req = requests + first ; i < num ; i++, req++ ) {
+			batch[i].type = req->type;
+			batch[i].handle = req->handle;
+			batch[i].travelflags = req->travelflags;
+			batch[i].maxtime = req->maxtime;
+			batch[i].origin = req->origin;
+			batch[i].inventory = (const int *)req->inventory;
+			batch[i].goal = (const bot_goal_t *)&req->goal;
+			batch[i].moveresult = (bot_moveresult_t *)&req->moveresult;
+			batch[i].result = 0;
+		}
+
+		botAI.active = (qboolean)( numThreads > 1 );
+		botlib_export->ai.BotAIBatch( batch, num, numThreads );
+		botAI.active = qfalse;
+		SV_BotFlushPrints();
+
+		if ( botAI.exit[0] ) {
+			char	str[MAX_STRING_CHARS];
+
+			Q_strncpyz( str, botAI.exit, sizeof( str ) );
+			botAI.exit[0] = '\0';
+			botAI.numCommands = 0;
+			Com_Error( ERR_DROP, S_COLOR_RED "Exit: %s", str );
+		}
+
+		for ( i = 0, req = requests + first ; i < num ; i++, req++ ) {
+			req->result = batch[i].result;
+		}
+
+		for ( i = 0 ; i < botAI.numCommands ; i++ ) {
+			SV_ExecuteClientCommand( &svs.clients[botAI.commandClients[i]], botAI.commands[i], qtrue );
+		}
+		botAI.numCommands = 0;
+	}
+
+	i = numThreads > 1 ? 1 : 0;
+	botAI.batches[i]++;
+	botAI.requests[i] += numRequests;
+	botAI.usec[i] += Sys_Microseconds() - start;
+}
+
+/*
+==================
+SV_BotAIStats_f
+
+Shows the average cost of a batched bot AI request with and without threads
+==================
+*/
+void SV_BotAIStats_f( void ) {
+	static const char	*modes[2] = { "serial", "threaded" };
+	int					i;
+
+	if ( Cmd_Argc() > 1 && !Q_stricmp( Cmd_Argv(1), "reset" ) ) {
+		for ( i = 0 ; i < 2 ; i++ ) {
+			botAI.batches[i] = botAI.requests[i] = botAI.usec[i] = 0;
+		}
+		return;
+	}
+
+	for ( i = 0 ; i < 2 ; i++ ) {
+		if ( !botAI.requests[i] ) {
+			Com_Printf( "%-8s: no batches\n", modes[i] );
+			continue;
+		}
+		Com_Printf( "%-8s: %lli batches, %lli requests, %.1f requests/batch, %.2f usec/request\n", modes[i],
+			(long long)botAI.batches[i], (long long)botAI.requests[i],
+			(double)botAI.requests[i] / botAI.batches[i],
+			(double)botAI.usec[i] / botAI.requests[i] );
+	}
+	Com_Printf( "sv_botThreads %i, %i job threads\n", sv_botThreads->integer, Com_JobMaxThreads() );
+}
+
 /*
 ==================
 SV_BotFrame
@@ -468,6 +688,8 @@ int SV_BotLibSetup( void ) {
 		return -1;
 	}
 
+	botlib_export->BotLibVarSet( "precomputeroutingcache", Cvar_VariableString( "bot_precomputeroutingcache" ) );
+
 	return botlib_export->BotLibSetup();
 }
 
@@ -488,6 +710,94 @@ int SV_BotLibShutdown( void ) {
 	return botlib_export->BotLibShutdown();
 }
 
+// every bot frame calculates reachability for at least one area, so a map
+// that takes more frames than this isn't going to finish
+#define	MAX_REACHABILITY_FRAMES		(1 << 20)
+
+extern qboolean CM_DeleteCachedMap( qboolean bGuaranteedOkToDelete );
+
+/*
+==================
+SV_BotCalcReachability_f
+
+Loads a map's collision and bot navigation data without starting a level,
+calculates the reachability again on the job threads, writes the .aas file
+and shows how long it took. Only runs on a dedicated server that has no
+level loaded, as it clears the hunk.
+==================
+*/
+void SV_BotCalcReachability_f( void ) {
+	char	mapname[MAX_QPATH];
+	int		start, reachStart, checksum, err, frames;
+
+	if ( Cmd_Argc() != 2 ) {
+		Com_Printf( "usage: bot_calcreachability <mapname>\n" );
+		return;
+	}
+
+	if ( !com_dedicated->integer ) {
+		Com_Printf( "bot_calcreachability only runs on a dedicated server\n" );
+		return;
+	}
+
+	if ( com_sv_running->integer ) {
+		Com_Printf( "bot_calcreachability can't run while a level is loaded, use killserver first\n" );
+		return;
+	}
+
+	// bot_enable is otherwise only picked up when the game starts
+	bot_enable = Cvar_VariableIntegerValue( "bot_enable" );
+	if ( !bot_enable || !botlib_export ) {
+		Com_Printf( "Bots are not enabled.\n" );
+		return;
+	}
+
+	Q_strncpyz( mapname, Cmd_Argv( 1 ), sizeof( mapname ) );
+	if ( strchr( mapname, '\\' ) || FS_ReadFile( va( "maps/%s.bsp", mapname ), NULL ) == -1 ) {
+		Com_Printf( "Can't find map maps/%s.bsp\n", mapname );
+		return;
+	}
+
+	start = Sys_Milliseconds();
+
+	// the same setup SV_SpawnServer and the game do, minus the game
+	CM_ClearMap();
+	Hunk_Clear();
+	CM_LoadMap( va( "maps/%s.bsp", mapname ), qfalse, &checksum );
+	SV_ClearWorld();
+
+	err = SV_BotLibSetup();
+	if ( err == BLERR_NOERROR ) {
+		botlib_export->BotLibVarSet( "sv_mapChecksum", va( "%i", checksum ) );
+		botlib_export->BotLibVarSet( "forcereachability", "1" );
+		err = botlib_export->BotLibLoadMap( mapname );
+	}
+
+	reachStart = Sys_Milliseconds();
+	frames = 0;
+	if ( err == BLERR_NOERROR ) {
+		// the map is initialized step by step at the start of every bot frame
+		while ( !botlib_export->aas.AAS_Initialized() && frames < MAX_REACHABILITY_FRAMES ) {
+			botlib_export->BotLibStartFrame( 0 );
+			frames++;
+		}
+	}
+
+	if ( err != BLERR_NOERROR ) {
+		Com_Printf( S_COLOR_RED "Error: bot_calcreachability couldn't load the navigation data for %s\n", mapname );
+	} else if ( !botlib_export->aas.AAS_Initialized() ) {
+		Com_Printf( S_COLOR_RED "Error: bot_calcreachability: %s wasn't initialized after %i bot frames\n", mapname, frames );
+	} else {
+		Com_Printf( "bot_calcreachability: %s done in %i msec, %i msec reachability on %i job threads\n", mapname,
+			Sys_Milliseconds() - start, Sys_Milliseconds() - reachStart, Com_JobMaxThreads() );
+	}
+
+	SV_BotLibShutdown();
+	CM_ClearMap();
+	CM_DeleteCachedMap( qtrue );	// kept for the renderer otherwise
+	Hunk_Clear();
+}
+
 /*
 ==================
 SV_BotInitCvars
@@ -507,6 +817,7 @@ void SV_BotInitCvars(void) {
 	Cvar_Get("bot_forcewrite", "0", 0);					//force writing aas file
 	Cvar_Get("bot_aasoptimize", "0", 0);				//no aas file optimisation
 	Cvar_Get("bot_saveroutingcache", "0", 0);			//save routing cache
+	Cvar_Get("bot_precomputeroutingcache", "0", 0);	//compute the routing cache file if missing
 	Cvar_Get("bot_thinktime", "100", CVAR_CHEAT);		//msec the bots thinks
 	Cvar_Get("bot_reloadcharacters", "0", 0);			//reload the bot characters each time
 	Cvar_Get("bot_testichat", "0", 0);					//test ichats
@@ -596,6 +907,8 @@ void SV_BotInitBotLib(void) {
 	botlib_import.FS_Write = BotImport_FS_Write;
 	botlib_import.FS_FCloseFile = BotImport_FS_FCloseFile;
 	botlib_import.FS_Seek = BotImport_FS_Seek;
+	botlib_import.FS_MapFile = FS_MapFile;
+	botlib_import.FS_UnmapFile = FS_UnmapFile;
 
 	//debug lines
 	botlib_import.DebugLineCreate = BotImport_DebugLineCreate;
@@ -608,6 +921,9 @@ void SV_BotInitBotLib(void) {
 
 	botlib_import.BSPNumInlineModels = BotImport_BSPNumInlineModels;
 
+	botlib_import.ParallelFor = Com_ParallelFor;
+	botlib_import.MaxJobThreads = Com_JobMaxThreads;
+
 	botlib_export = (botlib_export_t *)GetBotLibAPI( BOTLIB_API_VERSION, &botlib_import );
 	assert(botlib_export);	// bk001129 - somehow we end up with a zero import.
 }
@@ -864,6 +864,117 @@ static void SV_WhitelistIP_f( void ) {
 	}
 }
 
+// what the game frames VM_Bench runs change on the engine side
+static struct {
+	sharedEntity_t		*gentities;
+	int					gentitySize;
+	int					num_entities;
+	void				*gameClients;
+	int					gameClientSize;
+	mvsharedEntity_t	*gentitiesMV;
+	int					gentitySizeMV;
+	int					reliableSequence[MAX_CLIENTS];
+	const char			*configstrings[MAX_CONFIGSTRINGS];
+} sv_vmBench;
+
+static void SV_VMBenchFreeConfigstrings( void ) {
+	int		i;
+
+	for ( i = 0 ; i < MAX_CONFIGSTRINGS ; i++ ) {
+		if ( sv_vmBench.configstrings[i] ) {
+			Z_Free( (void *)sv_vmBench.configstrings[i] );
+			sv_vmBench.configstrings[i] = NULL;
+		}
+	}
+}
+
+/*
+=================
+SV_VMBenchRestore
+
+Called by VM_Bench after it put the game's memory back. The reliable
+commands and configstrings the frame sent are dropped, clients never saw
+them, and the world is relinked to match the entities. Botlib state and
+cvars the game sets are not rolled back.
+=================
+*/
+static void SV_VMBenchRestore( void ) {
+	sharedEntity_t	*ent;
+	int				i;
+
+	sv.gentities = sv_vmBench.gentities;
+	sv.gentitySize = sv_vmBench.gentitySize;
+	sv.num_entities = sv_vmBench.num_entities;
+	sv.gameClients = sv_vmBench.gameClients;
+	sv.gameClientSize = sv_vmBench.gameClientSize;
+	sv.gentitiesMV = sv_vmBench.gentitiesMV;
+	sv.gentitySizeMV = sv_vmBench.gentitySizeMV;
+
+	for ( i = 0 ; i < sv_maxclients->integer ; i++ ) {
+		svs.clients[i].reliableSequence = sv_vmBench.reliableSequence[i];
+	}
+
+	for ( i = 0 ; i < MAX_CONFIGSTRINGS ; i++ ) {
+		if ( sv_vmBench.configstrings[i] && strcmp( sv.configstrings[i], sv_vmBench.configstrings[i] ) ) {
+			Z_Free( (void *)sv.configstrings[i] );
+			sv.configstrings[i] = CopyString( sv_vmBench.configstrings[i] );
+		}
+	}
+
+	for ( i = 0 ; i < MAX_GENTITIES ; i++ ) {
+		ent = SV_GentityNum( i );
+		if ( i < sv.num_entities && ent->r.linked ) {
+			SV_LinkEntity( ent );
+		} else if ( sv.svEntities[i].worldSector ) {
+			SV_UnlinkEntity( ent );
+		}
+	}
+}
+
+/*
+=================
+SV_VMBench_f
+
+Times the next game frame on the interpreter and every compiler tier of
+the game qvm, the game is left in the state it was in
+=================
+*/
+static void SV_VMBench_f( void ) {
+	int		frames;
+	int		i;
+
+	if ( sv.state != SS_GAME || !gvm ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	frames = Cmd_Argc() > 1 ? atoi( Cmd_Argv(1) ) : 100;
+	if ( frames < 1 ) {
+		frames = 1;
+	}
+
+	SV_VMBenchFreeConfigstrings();
+	sv_vmBench.gentities = sv.gentities;
+	sv_vmBench.gentitySize = sv.gentitySize;
+	sv_vmBench.num_entities = sv.num_entities;
+	sv_vmBench.gameClients = sv.gameClients;
+	sv_vmBench.gameClientSize = sv.gameClientSize;
+	sv_vmBench.gentitiesMV = sv.gentitiesMV;
+	sv_vmBench.gentitySizeMV = sv.gentitySizeMV;
+	for ( i = 0 ; i < sv_maxclients->integer ; i++ ) {
+		sv_vmBench.reliableSequence[i] = svs.clients[i].reliableSequence;
+	}
+	for ( i = 0 ; i < MAX_CONFIGSTRINGS ; i++ ) {
+		if ( sv.configstrings[i] ) {
+			sv_vmBench.configstrings[i] = CopyString( sv.configstrings[i] );
+		}
+	}
+
+	VM_Bench( gvm, frames, GAME_RUN_FRAME, sv.time + 1000 / sv_fps->integer, SV_VMBenchRestore );
+
+	SV_VMBenchFreeConfigstrings();
+}
+
 //===========================================================
 
 /*
@@ -898,6 +1009,13 @@ void SV_AddOperatorCommands( void ) {
 	Cmd_AddCommand ("dumpuser", SV_DumpUser_f);
 	Cmd_AddCommand ("map_restart", SV_MapRestart_f);
 	Cmd_AddCommand ("sectorlist", SV_SectorList_f);
+	Cmd_AddCommand ("snapshotstats", SV_SnapshotStats_f);
+	Cmd_AddCommand ("snapshotvisbench", SV_SnapshotVisBench_f);
+	Cmd_AddCommand ("oobstats", SVC_OOBStats_f);
+	Cmd_AddCommand ("tracestats", SV_TraceStats_f);
+	Cmd_AddCommand ("vmbench", SV_VMBench_f);
+	Cmd_AddCommand ("bot_calcreachability", SV_BotCalcReachability_f);
+	Cmd_AddCommand ("botaistats", SV_BotAIStats_f);
 	Cmd_AddCommand ("map", SV_Map_f);
 	Cmd_SetCommandCompletionFunc( "map", SV_CompleteMapName );
 	Cmd_AddCommand ("devmap", SV_Map_f);
@@ -5,6 +5,111 @@
 
 #include <mv_setup.h>
 
+/*
+=================
+SV_ChallengeSlot
+
+Index slot the probe for an address starts at
+=================
+*/
+static int SV_ChallengeSlot( netadr_t adr ) {
+	if ( adr.type != NA_IP ) {
+		// NET_CompareAdr ignores the rest for loopback
+		adr.ipi = 0;
+		adr.port = 0;
+	}
+
+	return SVC_HashAddress( adr, qtrue ) & ( CHALLENGE_INDEX_SIZE - 1 );
+}
+
+/*
+=================
+SV_LinkChallenge
+=================
+*/
+static void SV_LinkChallenge( int num ) {
+	int		slot;
+
+	slot = SV_ChallengeSlot( svs.challenges[num].adr );
+	while ( svs.challengeIndex[slot] ) {
+		slot = ( slot + 1 ) & ( CHALLENGE_INDEX_SIZE - 1 );
+	}
+
+	svs.challengeIndex[slot] = num + 1;
+	svc_challengeStats.inserts++;
+}
+
+/*
+=================
+SV_UnlinkChallenge
+
+Shifts the following entries back into the hole instead of leaving a
+tombstone, so probes can always stop at the first empty slot
+=================
+*/
+static void SV_UnlinkChallenge( int num ) {
+	const int	mask = CHALLENGE_INDEX_SIZE - 1;
+	int			hole, slot, home;
+
+	if ( svs.challenges[num].adr.type == NA_BAD ) {
+		return;		// never handed out
+	}
+
+	hole = SV_ChallengeSlot( svs.challenges[num].adr );
+	while ( svs.challengeIndex[hole] != num + 1 ) {
+		if ( !svs.challengeIndex[hole] ) {
+			return;
+		}
+		hole = ( hole + 1 ) & mask;
+	}
+
+	for ( slot = ( hole + 1 ) & mask; svs.challengeIndex[slot]; slot = ( slot + 1 ) & mask ) {
+		home = SV_ChallengeSlot( svs.challenges[svs.challengeIndex[slot] - 1].adr );
+
+		// move the entry unless its home lies between the hole and itself
+		if ( ( ( slot - home ) & mask ) >= ( ( slot - hole ) & mask ) ) {
+			svs.challengeIndex[hole] = svs.challengeIndex[slot];
+			hole = slot;
+		}
+	}
+
+	svs.challengeIndex[hole] = 0;
+}
+
+/*
+=================
+SV_FindChallenges
+
+Fills found with the numbers of the challenges handed out to an address
+and returns how many there are
+=================
+*/
+static int SV_FindChallenges( netadr_t adr, int *found, int maxFound ) {
+	int		slot, num;
+	int		numFound, probes;
+
+	slot = SV_ChallengeSlot( adr );
+	numFound = 0;
+
+	for ( probes = 1; svs.challengeIndex[slot]; probes++ ) {
+		num = svs.challengeIndex[slot] - 1;
+
+		if ( NET_CompareAdr( adr, svs.challenges[num].adr ) && numFound < maxFound ) {
+			found[numFound++] = num;
+		}
+
+		slot = ( slot + 1 ) & ( CHALLENGE_INDEX_SIZE - 1 );
+	}
+
+	svc_challengeStats.lookups++;
+	svc_challengeStats.probes += probes;
+	if ( probes > svc_challengeStats.maxProbes ) {
+		svc_challengeStats.maxProbes = probes;
+	}
+
+	return numFound;
+}
+
 /*
 =================
 SV_GetChallenge
@@ -18,47 +123,42 @@ challenge, they must give a valid IP address.
 =================
 */
 void SV_GetChallenge( netadr_t from ) {
-	int		i;
-	int		oldest;
-	int		oldestTime;
-	int		oldestClientTime;
+	int		found[MAX_CHALLENGES_MULTI];
+	int		numFound;
+	int		i, num;
 	int		clientChallenge;
 	challenge_t	*challenge;
-	qboolean wasfound = qfalse;
 
-	oldest = 0;
-	oldestClientTime = oldestTime = 0x7fffffff;
-
-	// see if we already have a challenge for this ip
-	challenge = &svs.challenges[0];
 	clientChallenge = atoi(Cmd_Argv(1));
 
-	for (i = 0; i < MAX_CHALLENGES; i++, challenge++) {
-		if (!challenge->connected && NET_CompareAdr(from, challenge->adr)) {
-			wasfound = qtrue;
-
-			if (challenge->time < oldestClientTime)
-				oldestClientTime = challenge->time;
+	// see if we already have a challenge for this ip
+	numFound = SV_FindChallenges( from, found, MAX_CHALLENGES_MULTI );
+
+	if ( numFound == MAX_CHALLENGES_MULTI ) {
+		// don't let a single address cycle out everyone else, reuse its oldest one
+		num = found[0];
+		for ( i = 1; i < numFound; i++ ) {
+			if ( svs.challenges[found[i]].time < svs.challenges[num].time ) {
+				num = found[i];
+			}
 		}
+	} else {
+		// this is a new client or one that is trying again, recycle the oldest challenge
+		num = svs.nextChallenge;
+		svs.nextChallenge = ( svs.nextChallenge + 1 ) % MAX_CHALLENGES;
 
-		if (wasfound && i >= MAX_CHALLENGES_MULTI) {
-			i = MAX_CHALLENGES;
-			break;
+		if ( svs.challenges[num].adr.type != NA_BAD ) {
+			svc_challengeStats.evictions++;
 		}
+		SV_UnlinkChallenge( num );
 
-		if ( challenge->time < oldestTime ) {
-			oldestTime = challenge->time;
-			oldest = i;
-		}
+		svs.challenges[num].adr = from;
+		SV_LinkChallenge( num );
 	}
 
-	if (i == MAX_CHALLENGES) {
-		// this is the first time this client has asked for a challenge
-		challenge = &svs.challenges[oldest];
-		challenge->clientChallenge = clientChallenge;
-		challenge->adr = from;
-		challenge->connected = qfalse;
-	}
+	challenge = &svs.challenges[num];
+	challenge->clientChallenge = clientChallenge;
+	challenge->connected = qfalse;
 
 	// always generate a new challenge number, so the client cannot circumvent sv_maxping
 	challenge->challenge = ((rand() << 16) ^ rand()) ^ svs.time;
@@ -156,20 +256,22 @@ void SV_DirectConnect( netadr_t from ) {
 	// see if the challenge is valid (LAN clients don't need to challenge)
 	if ( !NET_IsLocalAddress (from) ) {
 		int		ping;
+		int		found[MAX_CHALLENGES_MULTI];
+		int		numFound;
 		challenge_t *challengeptr;
 
-		for (i=0 ; i<MAX_CHALLENGES ; i++) {
-			if (NET_CompareAdr(from, svs.challenges[i].adr)) {
-				if ( challenge == svs.challenges[i].challenge ) {
-					break;		// good
-				}
+		numFound = SV_FindChallenges( from, found, MAX_CHALLENGES_MULTI );
+		for (i=0 ; i<numFound ; i++) {
+			if ( challenge == svs.challenges[found[i]].challenge ) {
+				break;		// good
 			}
 		}
-		if (i == MAX_CHALLENGES) {
+		if (i == numFound) {
 			NET_OutOfBandPrint( NS_SERVER, from, "print\nNo or bad challenge for address.\n" );
 			return;
 		}
 
+		i = found[i];
 		challengeptr = &svs.challenges[i];
 		if (challengeptr->wasrefused) {
 			// Return silently, so that error messages written by the server keep being displayed.
@@ -361,7 +463,6 @@ or crashing -- SV_FinalMessage() will handle that
 */
 void SV_DropClient( client_t *drop, const char *reason ) {
 	int		i;
-	challenge_t	*challenge;
 
 	if ( drop->state == CS_ZOMBIE ) {
 		return;		// already dropped
@@ -369,25 +470,16 @@ void SV_DropClient( client_t *drop, const char *reason ) {
 
 	if (drop->netchan.remoteAddress.type != NA_BOT) {
 		// see if we already have a challenge for this ip
-		challenge = &svs.challenges[0];
-
-		for (i = 0; i < MAX_CHALLENGES; i++, challenge++) {
-			if (NET_CompareAdr(drop->netchan.remoteAddress, challenge->adr)) {
-				Com_Memset(challenge, 0, sizeof(*challenge));
-				break;
-			}
+		if ( SV_FindChallenges( drop->netchan.remoteAddress, &i, 1 ) ) {
+			SV_UnlinkChallenge( i );
+			Com_Memset( &svs.challenges[i], 0, sizeof( svs.challenges[i] ) );
 		}
 	}
 
 	if ( !drop->gentity || !(drop->gentity->r.svFlags & SVF_BOT) ) {
 		// see if we already have a challenge for this ip
-		challenge = &svs.challenges[0];
-
-		for (i = 0 ; i < MAX_CHALLENGES ; i++, challenge++) {
-			if ( NET_CompareAdr( drop->netchan.remoteAddress, challenge->adr ) ) {
-				challenge->connected = qfalse;
-				break;
-			}
+		if ( SV_FindChallenges( drop->netchan.remoteAddress, &i, 1 ) ) {
+			svs.challenges[i].connected = qfalse;
 		}
 	}
 
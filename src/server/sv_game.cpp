@@ -351,6 +351,74 @@ void SV_GetUsercmd( int clientNum, usercmd_t *cmd ) {
 
 //==============================================
 
+// argument x of a fast path syscall, see SV_GameFastSystemCalls
+#define FASTARG(x, type, num)	((type *) VM_SegmentArg(dataBase, dataMask, args[0], args[x], sizeof(type) * (int64_t)(num)))
+
+/*
+====================
+SV_GameFastSystemCalls
+
+The syscalls a qvm makes the most of every frame. They get the data segment
+once and check their arguments inline, instead of going through VM_ArgPtr
+for each of them, and skip the ghoul2 context switch where they don't need
+it. Returns qfalse for everything else and for dll modules.
+====================
+*/
+static qboolean SV_GameFastSystemCalls( intptr_t *args, intptr_t *result ) {
+	byte		*dataBase;
+	uint32_t	dataMask;
+
+	switch( args[0] ) {
+	case G_TRACE:
+	case G_TRACECAPSULE:
+	case G_ENTITIES_IN_BOX:
+	case G_ENTITY_CONTACT:
+	case G_ENTITY_CONTACTCAPSULE:
+	case G_POINT_CONTENTS:
+	case G_IN_PVS:
+	case G_GET_USERCMD:
+		break;
+	default:
+		return qfalse;
+	}
+
+	dataBase = VM_DataSegment( gvm, &dataMask );
+	if ( !dataBase ) {
+		return qfalse;
+	}
+
+	*result = 0;
+
+	switch( args[0] ) {
+	case G_TRACE:
+	case G_TRACECAPSULE:
+		// ghoul2 collision needs the server context
+		re->G2API_RicksCrazyOnServer( true );
+		SV_Trace( FASTARG(1, trace_t, 1), FASTARG(2, const vec_t, 3), FASTARG(3, const vec_t, 3), FASTARG(4, const vec_t, 3),
+			FASTARG(5, const vec_t, 3), args[6], args[7], (qboolean)( args[0] == G_TRACECAPSULE ), args[8], args[9] );
+		break;
+	case G_ENTITIES_IN_BOX:
+		*result = SV_AreaEntities( FASTARG(1, const vec_t, 3), FASTARG(2, const vec_t, 3), FASTARG(3, int, args[4]), args[4] );
+		break;
+	case G_ENTITY_CONTACT:
+	case G_ENTITY_CONTACTCAPSULE:
+		*result = SV_EntityContact( FASTARG(1, const vec_t, 3), FASTARG(2, const vec_t, 3), FASTARG(3, const sharedEntity_t, 1),
+			(qboolean)( args[0] == G_ENTITY_CONTACTCAPSULE ) );
+		break;
+	case G_POINT_CONTENTS:
+		*result = SV_PointContents( FASTARG(1, const vec_t, 3), args[2] );
+		break;
+	case G_IN_PVS:
+		*result = SV_inPVS( FASTARG(1, const vec_t, 3), FASTARG(2, const vec_t, 3) );
+		break;
+	case G_GET_USERCMD:
+		SV_GetUsercmd( args[1], FASTARG(2, usercmd_t, 1) );
+		break;
+	}
+
+	return qtrue;
+}
+
 /*
 ====================
 SV_GameSystemCalls
@@ -360,6 +428,8 @@ The module is making a system call
 */
 
 intptr_t SV_GameSystemCalls( intptr_t *args ) {
+	intptr_t	result;
+
 	// fix syscalls from 1.02 to match 1.04
 	// this is a mess... can it be done better?
 	if (VM_GetGameversion(gvm) == VERSION_1_02) {
@@ -368,6 +438,10 @@ intptr_t SV_GameSystemCalls( intptr_t *args ) {
 		}
 	}
 
+	if ( SV_GameFastSystemCalls( args, &result ) ) {
+		return result;
+	}
+
 	// set game ghoul2 context
 	re->G2API_RicksCrazyOnServer( true );
 
@@ -1112,6 +1186,12 @@ intptr_t SV_GameSystemCalls( intptr_t *args ) {
 		case MVAPI_PRINT:
 			Com_Printf_MV( args[1], "%s", VMAS(2) );
 			return 0;
+		case G_MVAPI_TRACE_BATCH:
+			SV_TraceBatch( VMAA(1, trace_t, args[3]), VMAA(2, const mvtrace_t, args[3]), args[3] );
+			return 0;
+		case G_MVAPI_BOTAI_BATCH:
+			SV_BotAIBatch( VMAA(1, mvbotai_t, args[2]), args[2] );
+			return 0;
 		}
 	}
 
@@ -596,6 +596,10 @@ Ghoul2 Insert End
 	FS_PureServerSetReferencedPaks("", "");
 	FS_Restart( sv.checksumFeed );
 
+	// inflate the game module while the collision map is loaded
+	FS_PrefetchFile( va("maps/%s.bsp", server) );
+	FS_PrefetchFile( "vm/jk2mpgame.qvm" );
+
 	CM_LoadMap( va("maps/%s.bsp", server), qfalse, &checksum );
 
 	SV_SendMapChange();
@@ -728,6 +732,9 @@ Ghoul2 Insert End
 	SV_SetConfigstring( CS_SERVERINFO, Cvar_InfoString( CVAR_SERVERINFO ) );
 	cvar_modifiedFlags &= ~CVAR_SERVERINFO;
 
+	// drop whatever was prefetched but not loaded
+	FS_FlushAsyncReads();
+
 	// any media configstring setting now should issue a warning
 	// and any configstring changes should be reliably transmitted
 	// to all clients
@@ -842,6 +849,9 @@ static void SV_InitRef( void ) {
 	ri.Error = Com_Error;
 	ri.OPrintf = Com_OPrintf;
 	ri.Milliseconds = Sys_Milliseconds2; //FIXME: unix+mac need this
+	ri.Microseconds = Sys_Microseconds;
+	ri.ParallelFor = Com_ParallelFor;
+	ri.JobMaxThreads = Com_JobMaxThreads;
 	ri.Hunk_AllocateTempMemory = Hunk_AllocateTempMemory;
 	ri.Hunk_FreeTempMemory = Hunk_FreeTempMemory;
 //	ri.Hunk_Alloc = Hunk_Alloc;
@@ -873,6 +883,7 @@ static void SV_InitRef( void ) {
 	ri.FS_FOpenFileWrite = FS_FOpenFileWrite_RI;
 //	ri.FS_FOpenFileByMode = FS_FOpenFileByMode;
 	ri.FS_FileExists = FS_FileExists;
+	ri.FS_PrefetchFile = FS_PrefetchFile;
 	ri.FS_FileIsInPAK = FS_FileIsInPAK;
 	ri.FS_ListFiles = FS_ListFiles;
 //	ri.FS_Write = FS_Write;
@@ -1037,6 +1048,12 @@ void SV_Init (void) {
 	sv_pingFix = Cvar_Get("sv_pingFix", "1", CVAR_ARCHIVE);
 	sv_autoWhitelist = Cvar_Get("sv_autoWhitelist", "1", CVAR_ARCHIVE | CVAR_GLOBAL);
 	sv_dynamicSnapshots = Cvar_Get("sv_dynamicSnapshots", "1", CVAR_ARCHIVE);
+	sv_snapshotThreads = Cvar_Get("sv_snapshotThreads", "0", CVAR_ARCHIVE);
+	sv_traceThreads = Cvar_Get("sv_traceThreads", "0", CVAR_ARCHIVE);
+	sv_botThreads = Cvar_Get("sv_botThreads", "0", CVAR_ARCHIVE);
+	sv_snapshotVisSets = Cvar_Get("sv_snapshotVisSets", "1", CVAR_ARCHIVE);
+	sv_snapshotDeltaCache = Cvar_Get("sv_snapshotDeltaCache", "1", CVAR_ARCHIVE);
+	sv_maxOOBAddresses = Cvar_Get("sv_maxOOBAddresses", "16384", CVAR_ARCHIVE | CVAR_GLOBAL);
 
 	SP_Register("str_server",SP_REGISTER_REQUIRED);
 
@@ -43,6 +43,12 @@ cvar_t	*mv_apiConnectionless;
 cvar_t	*sv_pingFix;
 cvar_t	*sv_autoWhitelist;
 cvar_t	*sv_dynamicSnapshots;
+cvar_t	*sv_snapshotThreads;
+cvar_t	*sv_traceThreads;
+cvar_t	*sv_botThreads;
+cvar_t	*sv_snapshotVisSets;
+cvar_t	*sv_snapshotDeltaCache;
+cvar_t	*sv_maxOOBAddresses;
 
 // jk2mv's toggleable fixes
 cvar_t	*mv_fixnamecrash;
@@ -308,6 +314,88 @@ CONNECTIONLESS COMMANDS
 ==============================================================================
 */
 
+/*
+================
+SVC_HashAddress
+
+Seeded so that spoofed floods can't pick addresses that collide on purpose
+================
+*/
+unsigned SVC_HashAddress(netadr_t adr, qboolean withPort) {
+	static unsigned	seed;
+	unsigned		h;
+
+	if (!seed) {
+		seed = ((((unsigned)rand() << 16) ^ rand()) ^ Com_Milliseconds()) | 1;
+	}
+
+	h = (unsigned)adr.ipi ^ seed;
+	if (withPort) {
+		h ^= (unsigned)adr.port * 0x45d9f3bu;
+	}
+
+	h *= 0x9e3779b1u;
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+
+	return h;
+}
+
+/*
+==============================================================================
+
+Per address leaky buckets live in an open addressing table sized by
+sv_maxOOBAddresses. An address is only ever stored within OOB_BUCKET_PROBES
+slots of its hash, slots are never emptied again, and a new address takes
+the first empty or expired slot, so a lookup can stop at the first empty
+slot. When the whole window is in use the least recently used bucket is
+evicted, which keeps both lookup and eviction O(1) under spoofed floods.
+
+==============================================================================
+*/
+
+#define	OOB_BUCKET_PROBES	16
+
+typedef struct {
+	int32_t			ip;
+	leakyBucket_t	bucket;
+	qboolean		used;
+} oobBucket_t;
+
+static struct {
+	oobBucket_t		*slots;
+	int				mask;
+	adrTableStats_t	stats;
+} oobBuckets;
+
+adrTableStats_t		svc_challengeStats;
+
+static unsigned		svc_droppedAdr;				// totals for oobstats
+static unsigned		svc_droppedCmd;
+
+/*
+================
+SVC_AllocBuckets
+================
+*/
+static void SVC_AllocBuckets(void) {
+	int		size;
+
+	size = 1024;
+	while (size < sv_maxOOBAddresses->integer && size < (1 << 20)) {
+		size <<= 1;
+	}
+
+	if (oobBuckets.slots) {
+		Z_Free(oobBuckets.slots);
+	}
+
+	oobBuckets.slots = (oobBucket_t *)Z_Malloc(size * sizeof(oobBucket_t), TAG_GENERAL, qtrue);
+	oobBuckets.mask = size - 1;
+	sv_maxOOBAddresses->modified = qfalse;
+}
+
 /*
 ================
 SVC_BucketForAddress
@@ -315,33 +403,74 @@ SVC_BucketForAddress
 Find or allocate a bucket for an address
 ================
 */
-#include <map>
-
 static leakyBucket_t *SVC_BucketForAddress(netadr_t address, int burst, int period, int now) {
-	static std::map<int, leakyBucket_t> bucketMap;
-	static unsigned int	callCounter = 0;
+	oobBucket_t		*slot, *slotFree, *slotOldest;
+	unsigned		h;
+	int				i;
 
 	if (address.type != NA_IP) {
 		return NULL;
 	}
 
-	callCounter++;
+	if (!oobBuckets.slots || sv_maxOOBAddresses->modified) {
+		SVC_AllocBuckets();
+	}
+
+	h = SVC_HashAddress(address, qfalse);
+	slotFree = NULL;
+	slotOldest = NULL;
+	oobBuckets.stats.lookups++;
 
-	if ((callCounter & 0xffffu) == 0) {
-		auto it = bucketMap.begin();
+	for (i = 0; i < OOB_BUCKET_PROBES; i++) {
+		slot = &oobBuckets.slots[(h + i) & oobBuckets.mask];
 
-		while (it != bucketMap.end()) {
-			int interval = now - it->second.lastTime;
+		if (!slot->used) {
+			if (!slotFree) {
+				slotFree = slot;
+			}
+			break;
+		}
 
-			if (interval > it->second.burst * period || interval < 0) {
-				it = bucketMap.erase(it);
-			} else {
-				++it;
+		if (slot->ip == address.ipi) {
+			oobBuckets.stats.probes += i + 1;
+			if (i + 1 > oobBuckets.stats.maxProbes) {
+				oobBuckets.stats.maxProbes = i + 1;
 			}
+			return &slot->bucket;
 		}
+
+		if (!slotFree) {
+			int interval = now - slot->bucket.lastTime;
+
+			// SVC_RateLimit would reset an expired bucket anyway
+			if (interval > slot->bucket.burst * period || interval < 0) {
+				slotFree = slot;
+			} else if (!slotOldest || slot->bucket.lastTime - slotOldest->bucket.lastTime < 0) {
+				slotOldest = slot;
+			}
+		}
+	}
+
+	if (i < OOB_BUCKET_PROBES) {
+		i++;	// count the empty slot too
+	}
+	oobBuckets.stats.probes += i;
+	if (i > oobBuckets.stats.maxProbes) {
+		oobBuckets.stats.maxProbes = i;
 	}
+	oobBuckets.stats.inserts++;
+
+	if (!slotFree) {
+		slotFree = slotOldest;
+		oobBuckets.stats.evictions++;
+	}
+
+	slotFree->ip = address.ipi;
+	slotFree->used = qtrue;
+	slotFree->bucket.lastTime = now;
+	slotFree->bucket.burst = 0;
 
-	return &bucketMap[address.ipi];
+	return &slotFree->bucket;
 }
 
 /*
@@ -390,39 +519,89 @@ static qboolean SVC_RateLimitAddress(netadr_t from, int burst, int period, int n
 	return SVC_RateLimit(bucket, burst, period, now);
 }
 
+/*
+==============================================================================
+
+getstatus and getinfo responses only change with cvars, the client list and
+scores, so everything but the challenge is built once and reused until one
+of those changes. The challenge is spliced in where Info_SetValueForKey
+would have left it. Requests whose challenge Info_SetValueForKey would refuse
+or that could overflow the info string take the uncached path, so the
+replies stay byte for byte the same.
+
+==============================================================================
+*/
+
+typedef struct {
+	qboolean	active;
+	int			score;
+	int			ping;
+	char		name[MAX_NAME_LENGTH];
+} statusClient_t;
+
+static struct {
+	qboolean		valid;
+	int				cvarCount;					// cvar_modificationCount when built
+	char			info[MAX_INFO_STRING];		// serverinfo without the challenge
+	int				challengeOfs;				// where the challenge goes into info, -1 if it can't be spliced
+	int				maxLength;					// longest the info gets while it is built, minus the challenge
+	unsigned		hits, misses;
+
+	qboolean		playersValid;
+	statusClient_t	clients[MAX_CLIENTS];
+	char			players[MAX_MSGLEN];
+	unsigned		playerHits, playerMisses;
+} statusCache;
+
+static struct {
+	qboolean		valid;
+	int				cvarCount;
+	int				count;
+	int				httpPort;
+	char			info[MAX_INFO_STRING];		// everything put in front of the challenge
+	unsigned		hits, misses;
+} infoCache;
+
+/*
+================
+SVC_ChallengeCacheable
+
+True if Info_SetValueForKey would accept the challenge without a complaint
+================
+*/
+static qboolean SVC_ChallengeCacheable(const char *challenge) {
+	return (qboolean)!strpbrk(challenge, "\\;\"");
+}
+
 /*
 ================
-SVC_Status
+SVC_ChallengePair
+================
+*/
+static int SVC_ChallengePair(char *pair, int size, const char *challenge) {
+	if (!challenge[0]) {
+		pair[0] = 0;
+		return 0;
+	}
 
-Responds with all the info that qplug or qspy can see about the server
-and all connected players.  Used for getting detailed information after
-the simple info query.
+	Com_sprintf(pair, size, "\\challenge\\%s", challenge);
+	return strlen(pair);
+}
+
+/*
+================
+SVC_StatusPlayers
+
+Fills status with one line per connected client
 ================
 */
-void SVC_Status( netadr_t from ) {
+static void SVC_StatusPlayers(char *status, size_t size) {
 	char	player[1024];
-	char	status[MAX_MSGLEN];
 	int		i;
 	client_t	*cl;
 	playerState_t	*ps;
 	size_t	statusLength;
 	size_t	playerLength;
-	char	infostring[MAX_INFO_STRING];
-
-	strcpy( infostring, Cvar_InfoString( CVAR_SERVERINFO ) );
-
-	// echo back the parameter to status. so master servers can use it as a challenge
-	// to prevent timed spoofed reply packets that add ghost servers
-	Info_SetValueForKey( infostring, "challenge", Cmd_Argv(1) );
-
-	// add "demo" to the sv_keywords if restricted
-	if ( Cvar_VariableValue( "fs_restrict" ) ) {
-		char	keywords[MAX_INFO_STRING];
-
-		Com_sprintf( keywords, sizeof( keywords ), "demo %s",
-			Info_ValueForKey( infostring, "sv_keywords" ) );
-		Info_SetValueForKey( infostring, "sv_keywords", keywords );
-	}
 
 	status[0] = 0;
 	statusLength = 0;
@@ -434,49 +613,165 @@ void SVC_Status( netadr_t from ) {
 			Com_sprintf (player, sizeof(player), "%i %i \"%s\"\n",
 				ps->persistant[PERS_SCORE], cl->ping, cl->name);
 			playerLength = strlen(player);
-			if (statusLength + playerLength >= sizeof(status) ) {
+			if (statusLength + playerLength >= size ) {
 				break;		// can't hold any more
 			}
 			strcpy (status + statusLength, player);
 			statusLength += playerLength;
 		}
 	}
+}
+
+/*
+================
+SVC_StatusChanged
+
+Compares what the player lines are made of against the cached response
+and remembers the new state
+================
+*/
+static qboolean SVC_StatusChanged(void) {
+	statusClient_t	*sc;
+	client_t		*cl;
+	qboolean		changed;
+	int				i, score;
+
+	changed = (qboolean)!statusCache.playersValid;
+
+	for (i = 0; i < MAX_CLIENTS; i++) {
+		sc = &statusCache.clients[i];
+
+		if (i >= sv_maxclients->integer || svs.clients[i].state < CS_CONNECTED) {
+			if (sc->active) {
+				sc->active = qfalse;
+				changed = qtrue;
+			}
+			continue;
+		}
+
+		cl = &svs.clients[i];
+		score = SV_GameClientNum(i)->persistant[PERS_SCORE];
+
+		if (!sc->active || sc->score != score || sc->ping != cl->ping || strcmp(sc->name, cl->name)) {
+			sc->active = qtrue;
+			sc->score = score;
+			sc->ping = cl->ping;
+			Q_strncpyz(sc->name, cl->name, sizeof(sc->name));
+			changed = qtrue;
+		}
+	}
+
+	return changed;
+}
+
+/*
+================
+SVC_BuildStatus
+
+Serverinfo part of a status response, made the same way it always was
+================
+*/
+static void SVC_BuildStatus(char *infostring, const char *challenge) {
+	strcpy( infostring, Cvar_InfoString( CVAR_SERVERINFO ) );
+
+	// echo back the parameter to status. so master servers can use it as a challenge
+	// to prevent timed spoofed reply packets that add ghost servers
+	Info_SetValueForKey( infostring, "challenge", challenge );
+
+	// add "demo" to the sv_keywords if restricted
+	if ( Cvar_VariableValue( "fs_restrict" ) ) {
+		char	keywords[MAX_INFO_STRING];
+
+		Com_sprintf( keywords, sizeof( keywords ), "demo %s",
+			Info_ValueForKey( infostring, "sv_keywords" ) );
+		Info_SetValueForKey( infostring, "sv_keywords", keywords );
+	}
 
 	Info_SetValueForKey(infostring, "version", com_version->string);
+}
+
+/*
+================
+SVC_BuildStatusCache
+================
+*/
+static void SVC_BuildStatusCache(void) {
+	char	prefix[MAX_INFO_STRING * 2];
+	char	*info = statusCache.info;
+
+	SVC_BuildStatus( info, "" );
+
+	// Info_SetValueForKey puts keys in front, so the ones set after the
+	// challenge end up ahead of it
+	Com_sprintf( prefix, sizeof( prefix ), "\\version\\%s", com_version->string );
+	if ( Cvar_VariableValue( "fs_restrict" ) ) {
+		Q_strcat( prefix, sizeof( prefix ), va( "\\sv_keywords\\%s", Info_ValueForKey( info, "sv_keywords" ) ) );
+	}
+
+	statusCache.challengeOfs = strlen( prefix );
+	if ( strncmp( info, prefix, statusCache.challengeOfs ) ) {
+		statusCache.challengeOfs = -1;	// some key didn't fit
+	}
 
-	NET_OutOfBandPrint( NS_SERVER, from, "statusResponse\n%s\n%s", infostring, status );
+	// the keys removed again were still there while the prefix was added
+	statusCache.maxLength = strlen( Cvar_InfoString( CVAR_SERVERINFO ) ) + strlen( prefix );
+	statusCache.cvarCount = cvar_modificationCount;
+	statusCache.valid = qtrue;
 }
 
 /*
 ================
-SVC_Info
+SVC_Status
 
-Responds with a short info message that should be enough to determine
-if a user is interested in a server to do a full status
+Responds with all the info that qplug or qspy can see about the server
+and all connected players.  Used for getting detailed information after
+the simple info query.
 ================
 */
-void SVC_Info( netadr_t from ) {
-	int		i, count, wDisable;
-	const char *gamedir;
+void SVC_Status( netadr_t from ) {
 	char	infostring[MAX_INFO_STRING];
+	char	pair[MAX_INFO_STRING];
+	const char	*challenge = Cmd_Argv(1);
+	int		pairLength;
 
-	// q3infoboom exploit
-	if (strlen(Cmd_Argv(1)) > 128)
-		return;
+	if ( !statusCache.valid || statusCache.cvarCount != cvar_modificationCount ) {
+		SVC_BuildStatusCache();
+		statusCache.misses++;
+	} else {
+		statusCache.hits++;
+	}
 
-	// don't count privateclients
-	count = 0;
-	for ( i = sv_privateClients->integer ; i < sv_maxclients->integer ; i++ ) {
-		if ( svs.clients[i].state >= CS_CONNECTED ) {
-			count++;
-		}
+	if ( SVC_StatusChanged() ) {
+		SVC_StatusPlayers( statusCache.players, sizeof( statusCache.players ) );
+		statusCache.playersValid = qtrue;
+		statusCache.playerMisses++;
+	} else {
+		statusCache.playerHits++;
 	}
 
-	infostring[0] = 0;
+	pairLength = SVC_ChallengePair( pair, sizeof( pair ), challenge );
 
-	// echo back the parameter to status. so servers can use it as a challenge
-	// to prevent timed spoofed reply packets that add ghost servers
-	Info_SetValueForKey( infostring, "challenge", Cmd_Argv(1) );
+	if ( statusCache.challengeOfs < 0 || !SVC_ChallengeCacheable( challenge ) ||
+		statusCache.maxLength + pairLength >= MAX_INFO_STRING ) {
+		SVC_BuildStatus( infostring, challenge );
+	} else {
+		Com_sprintf( infostring, sizeof( infostring ), "%.*s%s%s", statusCache.challengeOfs,
+			statusCache.info, pair, statusCache.info + statusCache.challengeOfs );
+	}
+
+	NET_OutOfBandPrint( NS_SERVER, from, "statusResponse\n%s\n%s", infostring, statusCache.players );
+}
+
+/*
+================
+SVC_BuildInfo
+
+Everything in an info response but the challenge
+================
+*/
+static void SVC_BuildInfo(char *infostring, int count) {
+	int		wDisable;
+	const char *gamedir;
 
 	Info_SetValueForKey( infostring, "protocol", va("%i", MV_GetCurrentProtocol()) );
 	Info_SetValueForKey( infostring, "hostname", sv_hostname->string );
@@ -519,10 +814,122 @@ void SVC_Info( netadr_t from ) {
 			Info_SetValueForKey(infostring, "mvhttp", va("%i", sv.http_port));
 		}
 	}
+}
+
+/*
+================
+SVC_Info
+
+Responds with a short info message that should be enough to determine
+if a user is interested in a server to do a full status
+================
+*/
+void SVC_Info( netadr_t from ) {
+	int		i, count;
+	const char	*challenge = Cmd_Argv(1);
+	char	infostring[MAX_INFO_STRING];
+	char	pair[MAX_INFO_STRING];
+	int		pairLength;
+
+	// q3infoboom exploit
+	if (strlen(challenge) > 128)
+		return;
+
+	// don't count privateclients
+	count = 0;
+	for ( i = sv_privateClients->integer ; i < sv_maxclients->integer ; i++ ) {
+		if ( svs.clients[i].state >= CS_CONNECTED ) {
+			count++;
+		}
+	}
+
+	if ( !infoCache.valid || infoCache.cvarCount != cvar_modificationCount ||
+		infoCache.count != count || infoCache.httpPort != sv.http_port ) {
+		infoCache.info[0] = 0;
+		SVC_BuildInfo( infoCache.info, count );
+		infoCache.cvarCount = cvar_modificationCount;
+		infoCache.count = count;
+		infoCache.httpPort = sv.http_port;
+		infoCache.valid = qtrue;
+		infoCache.misses++;
+	} else {
+		infoCache.hits++;
+	}
+
+	pairLength = SVC_ChallengePair( pair, sizeof( pair ), challenge );
+
+	if ( !SVC_ChallengeCacheable( challenge ) || pairLength + strlen( infoCache.info ) >= MAX_INFO_STRING ) {
+		infostring[0] = 0;
+
+		// echo back the parameter to status. so servers can use it as a challenge
+		// to prevent timed spoofed reply packets that add ghost servers
+		Info_SetValueForKey( infostring, "challenge", challenge );
+		SVC_BuildInfo( infostring, count );
+	} else {
+		Com_sprintf( infostring, sizeof( infostring ), "%s%s", infoCache.info, pair );
+	}
 
 	NET_OutOfBandPrint( NS_SERVER, from, "infoResponse\n%s", infostring );
 }
 
+/*
+================
+SVC_PrintTableStats
+================
+*/
+static void SVC_PrintTableStats(const char *name, int used, int size, const adrTableStats_t *stats) {
+	Com_Printf("%-10s %6i/%-7i %10u %8.2f %5i %9u %9u\n", name, used, size, stats->lookups,
+		stats->lookups ? (double)stats->probes / stats->lookups : 0.0, stats->maxProbes,
+		stats->inserts, stats->evictions);
+}
+
+/*
+================
+SVC_OOBStats_f
+
+Shows how the connectionless packet address tables and response caches
+hold up
+================
+*/
+void SVC_OOBStats_f(void) {
+	int		i, used;
+
+	if (Cmd_Argc() > 1 && !Q_stricmp(Cmd_Argv(1), "reset")) {
+		Com_Memset(&oobBuckets.stats, 0, sizeof(oobBuckets.stats));
+		Com_Memset(&svc_challengeStats, 0, sizeof(svc_challengeStats));
+		svc_droppedAdr = 0;
+		svc_droppedCmd = 0;
+		statusCache.hits = statusCache.misses = 0;
+		statusCache.playerHits = statusCache.playerMisses = 0;
+		infoCache.hits = infoCache.misses = 0;
+		Com_Printf("OOB stats reset.\n");
+		return;
+	}
+
+	Com_Printf("table           used/size    lookups avg/max probes   inserts evictions\n");
+	Com_Printf("---------- -------------- ---------- -------------- --------- ---------\n");
+
+	used = 0;
+	if (oobBuckets.slots) {
+		for (i = 0; i <= oobBuckets.mask; i++) {
+			used += oobBuckets.slots[i].used;
+		}
+	}
+	SVC_PrintTableStats("buckets", used, oobBuckets.slots ? oobBuckets.mask + 1 : 0, &oobBuckets.stats);
+
+	used = 0;
+	for (i = 0; i < CHALLENGE_INDEX_SIZE; i++) {
+		used += svs.challengeIndex[i] != 0;
+	}
+	SVC_PrintTableStats("challenges", used, CHALLENGE_INDEX_SIZE, &svc_challengeStats);
+
+	Com_Printf("dropped: %u by address, %u by command rate\n", svc_droppedAdr, svc_droppedCmd);
+	Com_Printf("reused responses: getstatus serverinfo %u/%u, players %u/%u, getinfo %u/%u\n",
+		statusCache.hits, statusCache.hits + statusCache.misses,
+		statusCache.playerHits, statusCache.playerHits + statusCache.playerMisses,
+		infoCache.hits, infoCache.hits + infoCache.misses);
+}
+
 /*
 ================
 SVC_FlushRedirect
@@ -752,6 +1159,7 @@ void SV_ConnectionlessPacket( netadr_t from, msg_t *msg ) {
 			Com_DPrintf("SV_ConnectionlessPacket: rate limit from %s exceeded, dropping request\n", NET_AdrToString(from));
 		}
 		droppedAdr++;
+		svc_droppedAdr++;
 		return;
 	}
 
@@ -786,6 +1194,7 @@ void SV_ConnectionlessPacket( netadr_t from, msg_t *msg ) {
 
 	if (SVC_RateLimit(&bucket[cmd], burst, period, now)) {
 		dropped[cmd]++;
+		svc_droppedCmd++;
 		return;
 	}
 
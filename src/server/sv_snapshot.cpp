@@ -1,4 +1,5 @@
 
+#include <atomic>
 #include "server.h"
 
 
@@ -24,6 +25,183 @@ A normal server packet will look like:
 =============================================================================
 */
 
+/*
+=============================================================================
+
+Delta entity cache
+
+Many clients need the same entity delta in a frame, e.g. from its baseline or
+from the state they all acknowledged last. The huffman coded bits of a delta
+don't depend on where they end up in the message, so every delta is encoded
+once per frame and copied into the other messages. Entries keep full copies
+of both states, so a hit always produces exactly the bits a fresh encode
+would. Snapshot jobs share the cache: a slot is claimed with an atomic before
+it gets filled and only entries of the current frame are ever read, while
+only entries of older frames are ever replaced.
+
+=============================================================================
+*/
+
+#define	DELTA_CACHE_SLOTS		1024		// must be a power of two
+#define	DELTA_CACHE_PROBES		8
+#define	DELTA_CACHE_MAX_BYTES	512
+
+#define	DELTA_SLOT_BUSY			-1
+
+typedef struct {
+	std::atomic<int>	frame;		// deltaCache.frame it was written in or DELTA_SLOT_BUSY
+	unsigned			hash;
+	qboolean			force;
+	int					bits;
+	entityState_t		from;
+	entityState_t		to;
+	byte				data[DELTA_CACHE_MAX_BYTES];
+} deltaCacheSlot_t;
+
+typedef struct {
+	int					frame;		// 0 until the first frame, so no slot starts out valid
+	deltaCacheSlot_t	slots[DELTA_CACHE_SLOTS];
+
+	std::atomic<int>	hits;
+	std::atomic<int>	misses;
+	std::atomic<int>	uncached;	// too large, no free slot or no room left in the message
+} deltaCache_t;
+
+static deltaCache_t		deltaCache;
+
+/*
+=============
+SV_DeltaCacheNewFrame
+
+Invalidates all entries, entity states may change between frames
+=============
+*/
+static void SV_DeltaCacheNewFrame( void ) {
+	int		i;
+
+	if ( deltaCache.frame == INT_MAX ) {
+		// about to wrap, old entries could look current again
+		for ( i = 0; i < DELTA_CACHE_SLOTS; i++ ) {
+			deltaCache.slots[i].frame.store( 0, std::memory_order_relaxed );
+		}
+		deltaCache.frame = 0;
+	}
+
+	deltaCache.frame++;
+}
+
+/*
+=============
+SV_DeltaCacheHash
+=============
+*/
+static unsigned SV_DeltaCacheHash( const entityState_t *from, const entityState_t *to, qboolean force ) {
+	const unsigned	*f = (const unsigned *)from;
+	const unsigned	*t = (const unsigned *)to;
+	unsigned		hash = 2166136261u ^ force;
+	int				i;
+
+	for ( i = 0; i < (int)(sizeof( entityState_t ) / 4); i++ ) {
+		hash = (hash ^ f[i]) * 16777619u;
+		hash = (hash ^ t[i]) * 16777619u;
+	}
+
+	return hash;
+}
+
+/*
+=============
+SV_WriteDeltaEntityCached
+
+Same as MSG_WriteDeltaEntity( msg, from, to, force ) for entities that
+aren't removed
+=============
+*/
+static void SV_WriteDeltaEntityCached( msg_t *msg, entityState_t *from, entityState_t *to, qboolean force ) {
+	byte				buf[DELTA_CACHE_MAX_BYTES + 64];	// MSG_WriteBits may go a bit past maxsize
+	msg_t				deltaMsg;
+	deltaCacheSlot_t	*slot, *freeSlot;
+	unsigned			hash;
+	int					frame, slotFrame;
+	int					bytes;
+	int					i;
+
+	if ( !sv_snapshotDeltaCache->integer ) {
+		MSG_WriteDeltaEntity( msg, from, to, force );
+		return;
+	}
+
+	// nothing would be written, not worth a lookup
+	if ( !force && !memcmp( from, to, sizeof( *from ) ) ) {
+		return;
+	}
+
+	frame = deltaCache.frame;
+	hash = SV_DeltaCacheHash( from, to, force );
+	freeSlot = NULL;
+
+	for ( i = 0; i < DELTA_CACHE_PROBES; i++ ) {
+		slot = &deltaCache.slots[(hash + i) & (DELTA_CACHE_SLOTS - 1)];
+		slotFrame = slot->frame.load( std::memory_order_acquire );
+
+		if ( slotFrame != frame ) {
+			if ( slotFrame != DELTA_SLOT_BUSY && !freeSlot ) {
+				freeSlot = slot;
+			}
+			continue;
+		}
+
+		if ( slot->hash != hash || slot->force != force ||
+			memcmp( &slot->to, to, sizeof( *to ) ) || memcmp( &slot->from, from, sizeof( *from ) ) ) {
+			continue;
+		}
+
+		// writing the delta again keeps the exact overflow behavior
+		// of MSG_WriteBits when the message is almost full
+		if ( msg->maxsize - msg->cursize - ((slot->bits + 7) >> 3) < 4 ) {
+			deltaCache.uncached.fetch_add( 1, std::memory_order_relaxed );
+			MSG_WriteDeltaEntity( msg, from, to, force );
+			return;
+		}
+
+		deltaCache.hits.fetch_add( 1, std::memory_order_relaxed );
+		MSG_CopyBits( msg, slot->data, slot->bits );
+		return;
+	}
+
+	MSG_Init( &deltaMsg, buf, DELTA_CACHE_MAX_BYTES + 4 );
+	MSG_WriteDeltaEntity( &deltaMsg, from, to, force );
+	bytes = (deltaMsg.bit + 7) >> 3;
+
+	if ( deltaMsg.overflowed || bytes > DELTA_CACHE_MAX_BYTES ||
+		msg->maxsize - msg->cursize - bytes < 4 ) {
+		deltaCache.uncached.fetch_add( 1, std::memory_order_relaxed );
+		MSG_WriteDeltaEntity( msg, from, to, force );
+		return;
+	}
+
+	deltaCache.misses.fetch_add( 1, std::memory_order_relaxed );
+	MSG_CopyBits( msg, buf, deltaMsg.bit );
+
+	// another job may have claimed the slot since it was probed
+	if ( !freeSlot ) {
+		return;
+	}
+	slotFrame = freeSlot->frame.load( std::memory_order_relaxed );
+	if ( slotFrame == frame || slotFrame == DELTA_SLOT_BUSY ||
+		!freeSlot->frame.compare_exchange_strong( slotFrame, DELTA_SLOT_BUSY, std::memory_order_acquire ) ) {
+		return;
+	}
+
+	freeSlot->hash = hash;
+	freeSlot->force = force;
+	freeSlot->bits = deltaMsg.bit;
+	freeSlot->from = *from;
+	freeSlot->to = *to;
+	Com_Memcpy( freeSlot->data, buf, bytes );
+	freeSlot->frame.store( frame, std::memory_order_release );
+}
+
 /*
 =============
 SV_EmitPacketEntities
@@ -67,7 +245,7 @@ static void SV_EmitPacketEntities( clientSnapshot_t *from, clientSnapshot_t *to,
 			// delta update from old position
 			// because the force parm is qfalse, this will not result
 			// in any bytes being emited if the entity has not changed at all
-			MSG_WriteDeltaEntity (msg, oldent, newent, qfalse );
+			SV_WriteDeltaEntityCached (msg, oldent, newent, qfalse );
 			oldindex++;
 			newindex++;
 			continue;
@@ -75,7 +253,7 @@ static void SV_EmitPacketEntities( clientSnapshot_t *from, clientSnapshot_t *to,
 
 		if ( newnum < oldnum ) {
 			// this is a new entity, send it from the baseline
-			MSG_WriteDeltaEntity (msg, &sv.svEntities[newnum].baseline, newent, qtrue );
+			SV_WriteDeltaEntityCached (msg, &sv.svEntities[newnum].baseline, newent, qtrue );
 			newindex++;
 			continue;
 		}
@@ -95,42 +273,57 @@ static void SV_EmitPacketEntities( clientSnapshot_t *from, clientSnapshot_t *to,
 
 /*
 ==================
-SV_WriteSnapshotToClient
+SV_SnapshotDeltaFrame
+
+Picks the previous frame to delta compress the snapshot being created
+against. Returns NULL and a lastframe of 0 for a full snapshot.
 ==================
 */
-static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg ) {
-	clientSnapshot_t	*frame, *oldframe;
-	int					lastframe;
-	int					i;
-	int					snapFlags;
-
-	// this is the snapshot we are creating
-	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
+static clientSnapshot_t *SV_SnapshotDeltaFrame( client_t *client, int *lastframe ) {
+	clientSnapshot_t	*oldframe;
 
 	// try to use a previous frame as the source for delta compressing the snapshot
 	if ( client->deltaMessage <= 0 || client->state != CS_ACTIVE ) {
 		// client is asking for a retransmit
 		oldframe = NULL;
-		lastframe = 0;
+		*lastframe = 0;
 	} else if ( client->netchan.outgoingSequence - client->deltaMessage
 		>= (PACKET_BACKUP - 3) ) {
 		// client hasn't gotten a good message through in a long time
 		Com_DPrintf ("%s: Delta request from out of date packet.\n", client->name);
 		oldframe = NULL;
-		lastframe = 0;
+		*lastframe = 0;
 	} else {
 		// we have a valid snapshot to delta from
 		oldframe = &client->frames[ client->deltaMessage & PACKET_MASK ];
-		lastframe = client->netchan.outgoingSequence - client->deltaMessage;
+		*lastframe = client->netchan.outgoingSequence - client->deltaMessage;
 
 		// the snapshot's entities may still have rolled off the buffer, though
 		if ( oldframe->first_entity <= svs.nextSnapshotEntities - svs.numSnapshotEntities ) {
 			Com_DPrintf ("%s: Delta request from out of date entities.\n", client->name);
 			oldframe = NULL;
-			lastframe = 0;
+			*lastframe = 0;
 		}
 	}
 
+	return oldframe;
+}
+
+/*
+==================
+SV_WriteSnapshotToClient
+
+Only writes to msg, so it can run on a job thread
+==================
+*/
+static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg, clientSnapshot_t *oldframe, int lastframe ) {
+	clientSnapshot_t	*frame;
+	int					i;
+	int					snapFlags;
+
+	// this is the snapshot we are creating
+	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
+
 	MSG_WriteByte (msg, svc_snapshot);
 
 	// NOTE, MRE: now sent at the start of every message from server to client
@@ -229,6 +422,8 @@ Build a client snapshot structure
 typedef struct {
 	int		numSnapshotEntities;
 	int		snapshotEntities[MAX_SNAPSHOT_ENTITIES];
+	byte	added[MAX_GENTITIES/8];		// used to prevent double adding from portal views
+	const char	*error;					// set instead of calling Com_Error, which job threads must not do
 } snapshotEntityNumbers_t;
 
 /*
@@ -242,8 +437,9 @@ static int QDECL SV_QsortEntityNumbers( const void *a, const void *b ) {
 	ea = (const int *)a;
 	eb = (const int *)b;
 
+	// duplicates are caught after sorting, see SV_BuildClientSnapshotEntities
 	if ( *ea == *eb ) {
-		Com_Error( ERR_DROP, "SV_QsortEntityStates: duplicated entity" );
+		return 0;
 	}
 
 	if ( *ea < *eb ) {
@@ -259,12 +455,14 @@ static int QDECL SV_QsortEntityNumbers( const void *a, const void *b ) {
 SV_AddEntToSnapshot
 ===============
 */
-static void SV_AddEntToSnapshot( svEntity_t *svEnt, sharedEntity_t *gEnt, snapshotEntityNumbers_t *eNums ) {
+static void SV_AddEntToSnapshot( sharedEntity_t *gEnt, snapshotEntityNumbers_t *eNums ) {
+	int		num = gEnt->s.number;
+
 	// if we have already added this entity to this snapshot, don't add again
-	if ( svEnt->snapshotCounter == sv.snapshotCounter ) {
+	if ( eNums->added[num >> 3] & (1 << (num & 7)) ) {
 		return;
 	}
-	svEnt->snapshotCounter = sv.snapshotCounter;
+	eNums->added[num >> 3] |= 1 << (num & 7);
 
 	// if we are full, silently discard entities
 	if ( eNums->numSnapshotEntities == MAX_SNAPSHOT_ENTITIES ) {
@@ -275,6 +473,191 @@ static void SV_AddEntToSnapshot( svEntity_t *svEnt, sharedEntity_t *gEnt, snapsh
 	eNums->numSnapshotEntities++;
 }
 
+/*
+=============================================================================
+
+Per-frame visibility sets
+
+Linked entities are grouped by the clusters they touch once per frame, so a
+snapshot only has to look at the entities in the clusters its PVS covers
+instead of testing every entity for every client. The candidates still go
+through the full set of tests in entity number order, which keeps the result
+identical to a scan over all entities.
+
+=============================================================================
+*/
+
+typedef struct {
+	qboolean	valid;						// built for the current SV_SendClientMessages
+	int			numClusters;
+	int			maxClusters;				// allocated size of clusterFirst
+	int			*clusterFirst;				// [numClusters + 1] offsets into clusterEntities
+	int			clusterEntities[MAX_GENTITIES * MAX_ENT_CLUSTERS];
+	byte		always[MAX_GENTITIES/8];	// entities that can't be found through their clusters
+} snapshotVisSets_t;
+
+static snapshotVisSets_t	visSets;
+
+/*
+=======================
+SV_FixSnapshotEntityNumbers
+
+SV_AddEntitiesVisibleFromPoint repairs bad entity numbers as it goes, which
+isn't safe once snapshots are built from shared per-frame data
+=======================
+*/
+static void SV_FixSnapshotEntityNumbers( void ) {
+	sharedEntity_t	*ent;
+	int				e;
+
+	for ( e = 0 ; e < sv.num_entities ; e++ ) {
+		ent = SV_GentityNum(e);
+
+		if ( ent->r.linked && ent->s.number != e ) {
+			Com_DPrintf ("FIXING ENT->S.NUMBER!!!\n");
+			ent->s.number = e;
+		}
+	}
+}
+
+/*
+=======================
+SV_SnapshotEntityAlwaysChecked
+
+Entities that may be sent no matter what the PVS says, or whose overflowing
+cluster list can't be bucketed
+=======================
+*/
+static qboolean SV_SnapshotEntityAlwaysChecked( sharedEntity_t *ent, svEntity_t *svEnt, int e ) {
+	int		i;
+
+	if ( ent->r.svFlags & SVF_BROADCAST ) {
+		return qtrue;
+	}
+
+	for ( i = 0 ; i < (int)ARRAY_LEN( ent->r.broadcastClients ) ; i++ ) {
+		if ( ent->r.broadcastClients[i] ) {
+			return qtrue;
+		}
+	}
+
+	if ( svEnt->lastCluster ) {
+		return qtrue;
+	}
+
+	if ( sv.gentitiesMV != NULL && sv.gentitySizeMV > 0 ) {
+		mvsharedEntity_t *mvEnt = MV_EntityNum(e);
+
+		for ( i = 0 ; i < (int)sizeof( mvEnt->snapshotEnforce ) ; i++ ) {
+			if ( mvEnt->snapshotEnforce[i] ) {
+				return qtrue;
+			}
+		}
+	}
+
+	return qfalse;
+}
+
+/*
+=======================
+SV_BuildSnapshotVisSets
+=======================
+*/
+static void SV_BuildSnapshotVisSets( void ) {
+	sharedEntity_t	*ent;
+	svEntity_t		*svEnt;
+	int				*count;
+	int				e, i, c;
+
+	visSets.valid = qfalse;
+	visSets.numClusters = CM_NumClusters();
+
+	if ( visSets.numClusters + 1 > visSets.maxClusters ) {
+		if ( visSets.clusterFirst ) {
+			Z_Free( visSets.clusterFirst );
+		}
+		visSets.maxClusters = visSets.numClusters + 1;
+		visSets.clusterFirst = (int *)Z_Malloc( visSets.maxClusters * sizeof( *visSets.clusterFirst ), TAG_GENERAL );
+	}
+
+	// count the entities per cluster, shifted by one so the
+	// prefix sum below turns the counts into start offsets
+	count = visSets.clusterFirst;
+	Com_Memset( count, 0, (visSets.numClusters + 1) * sizeof( *count ) );
+	Com_Memset( visSets.always, 0, sizeof( visSets.always ) );
+
+	for ( e = 0 ; e < sv.num_entities ; e++ ) {
+		ent = SV_GentityNum(e);
+		if ( !ent->r.linked ) {
+			continue;
+		}
+
+		svEnt = SV_SvEntityForGentity( ent );
+		if ( SV_SnapshotEntityAlwaysChecked( ent, svEnt, e ) ) {
+			visSets.always[e >> 3] |= 1 << (e & 7);
+			continue;
+		}
+
+		for ( i = 0 ; i < svEnt->numClusters ; i++ ) {
+			count[svEnt->clusternums[i] + 1]++;
+		}
+	}
+
+	for ( c = 0 ; c < visSets.numClusters ; c++ ) {
+		count[c + 1] += count[c];
+	}
+
+	// fill in the buckets, moving each start offset to its end
+	for ( e = 0 ; e < sv.num_entities ; e++ ) {
+		ent = SV_GentityNum(e);
+		if ( !ent->r.linked || (visSets.always[e >> 3] & (1 << (e & 7))) ) {
+			continue;
+		}
+
+		svEnt = SV_SvEntityForGentity( ent );
+		for ( i = 0 ; i < svEnt->numClusters ; i++ ) {
+			visSets.clusterEntities[visSets.clusterFirst[svEnt->clusternums[i]]++] = e;
+		}
+	}
+
+	// and shift the offsets back to the starts
+	for ( c = visSets.numClusters ; c > 0 ; c-- ) {
+		visSets.clusterFirst[c] = visSets.clusterFirst[c - 1];
+	}
+	visSets.clusterFirst[0] = 0;
+
+	visSets.valid = qtrue;
+}
+
+/*
+=======================
+SV_GatherSnapshotCandidates
+
+Marks all entities that are in a cluster set in the PVS or always have to
+be checked
+=======================
+*/
+static void SV_GatherSnapshotCandidates( const byte *pvs, byte *candidates ) {
+	int		c, i, e;
+
+	Com_Memcpy( candidates, visSets.always, sizeof( visSets.always ) );
+
+	for ( c = 0 ; c < visSets.numClusters ; c++ ) {
+		if ( !pvs[c >> 3] ) {
+			c |= 7;		// skip the whole byte
+			continue;
+		}
+		if ( !(pvs[c >> 3] & (1 << (c & 7))) ) {
+			continue;
+		}
+
+		for ( i = visSets.clusterFirst[c] ; i < visSets.clusterFirst[c + 1] ; i++ ) {
+			e = visSets.clusterEntities[i];
+			candidates[e >> 3] |= 1 << (e & 7);
+		}
+	}
+}
+
 /*
 ===============
 SV_AddEntitiesVisibleFromPoint
@@ -291,6 +674,7 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 	int		c_fullsend;
 	byte	*clientpvs;
 	byte	*bitvector;
+	byte	candidates[MAX_GENTITIES/8];
 
 	// during an error shutdown message we may need to transmit
 	// the shutdown message after the server has shutdown, so
@@ -310,7 +694,18 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 
 	c_fullsend = 0;
 
+	if ( visSets.valid ) {
+		SV_GatherSnapshotCandidates( clientpvs, candidates );
+	}
+
 	for ( e = 0 ; e < sv.num_entities ; e++ ) {
+		if ( visSets.valid && !(candidates[e >> 3] & (1 << (e & 7))) ) {
+			if ( !candidates[e >> 3] ) {
+				e |= 7;		// skip the whole byte
+			}
+			continue;
+		}
+
 		ent = SV_GentityNum(e);
 
 		// never send entities that aren't linked in
@@ -350,7 +745,7 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 			if ( mvEnt->snapshotIgnore[frame->ps.clientNum] ) continue;
 			else if ( mvEnt->snapshotEnforce[frame->ps.clientNum] )
 			{
-				SV_AddEntToSnapshot( svEnt, ent, eNums );
+				SV_AddEntToSnapshot( ent, eNums );
 				continue;
 			}
 		}
@@ -374,14 +769,14 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 		}
 
 		// don't double add an entity through portals
-		if ( svEnt->snapshotCounter == sv.snapshotCounter ) {
+		if ( eNums->added[e >> 3] & (1 << (e & 7)) ) {
 			continue;
 		}
 
 		// broadcast entities are always sent, and so is the main player so we don't see noclip weirdness
 		if ( ent->r.svFlags & SVF_BROADCAST || (e == frame->ps.clientNum) || (ent->r.broadcastClients[frame->ps.clientNum/32] & (1<<(frame->ps.clientNum%32))))
 		{
-			SV_AddEntToSnapshot( svEnt, ent, eNums );
+			SV_AddEntToSnapshot( ent, eNums );
 			continue;
 		}
 
@@ -427,7 +822,7 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 		}
 
 		// add it
-		SV_AddEntToSnapshot( svEnt, ent, eNums );
+		SV_AddEntToSnapshot( ent, eNums );
 
 		// if its a portal entity, add everything visible from its camera position
 		if ( ent->r.svFlags & SVF_PORTAL ) {
@@ -446,7 +841,20 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 
 /*
 =============
-SV_BuildClientSnapshot
+SV_CheckSnapshotEntities
+
+Raises the error SV_BuildClientSnapshotEntities ran into, on the main thread
+=============
+*/
+static void SV_CheckSnapshotEntities( const snapshotEntityNumbers_t *entityNumbers ) {
+	if ( entityNumbers->error ) {
+		Com_Error( ERR_DROP, "%s", entityNumbers->error );
+	}
+}
+
+/*
+=============
+SV_BuildClientSnapshotEntities
 
 Decides which entities are going to be visible to the client, and
 copies off the playerstate and areabits.
@@ -455,34 +863,33 @@ This properly handles multiple recursive portals, but the render
 currently doesn't.
 
 For viewing through other player's eyes, clent can be something other than client->gentity
+
+Only writes to the client's own frame and entityNumbers, so it can run on
+a job thread. Returns qfalse if the client has no entity to build from, or
+with entityNumbers->error set if the snapshot is broken.
 =============
 */
-static void SV_BuildClientSnapshot( client_t *client ) {
+static qboolean SV_BuildClientSnapshotEntities( client_t *client, snapshotEntityNumbers_t *entityNumbers ) {
 	vec3_t						org;
 	clientSnapshot_t			*frame;
-	snapshotEntityNumbers_t		entityNumbers;
 	int							i;
-	sharedEntity_t				*ent;
-	entityState_t				*state;
-	svEntity_t					*svEnt;
 	sharedEntity_t				*clent;
 	playerState_t				*ps;
 
-	// bump the counter used to prevent double adding
-	sv.snapshotCounter++;
-
 	// this is the frame we are creating
 	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
 
 	// clear everything in this snapshot
-	entityNumbers.numSnapshotEntities = 0;
+	entityNumbers->numSnapshotEntities = 0;
+	entityNumbers->error = NULL;
+	Com_Memset( entityNumbers->added, 0, sizeof( entityNumbers->added ) );
 	Com_Memset( frame->areabits, 0, sizeof( frame->areabits ) );
 
 	frame->num_entities = 0;
 
 	clent = client->gentity;
 	if ( !clent || client->state == CS_ZOMBIE ) {
-		return;
+		return qfalse;
 	}
 
 	// grab the current playerState_t
@@ -503,10 +910,10 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 	// be regenerated from the playerstate
 	clientNum = frame->ps.clientNum;
 	if ( clientNum < 0 || clientNum >= MAX_GENTITIES ) {
-		Com_Error( ERR_DROP, "SV_SvEntityForGentity: bad gEnt" );
+		entityNumbers->error = "SV_SvEntityForGentity: bad gEnt";
+		return qfalse;
 	}
-	svEnt = &sv.svEntities[ clientNum ];
-	svEnt->snapshotCounter = sv.snapshotCounter;
+	entityNumbers->added[clientNum >> 3] |= 1 << (clientNum & 7);
 
 
 	// find the client's viewpoint
@@ -515,14 +922,20 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 
 	// add all the entities directly visible to the eye, which
 	// may include portal entities that merge other viewpoints
-	SV_AddEntitiesVisibleFromPoint( org, frame, &entityNumbers, qfalse );
+	SV_AddEntitiesVisibleFromPoint( org, frame, entityNumbers, qfalse );
 
 	// if there were portals visible, there may be out of order entities
 	// in the list which will need to be resorted for the delta compression
 	// to work correctly.  This also catches the error condition
 	// of an entity being included twice.
-	qsort( entityNumbers.snapshotEntities, entityNumbers.numSnapshotEntities,
-		sizeof( entityNumbers.snapshotEntities[0] ), SV_QsortEntityNumbers );
+	qsort( entityNumbers->snapshotEntities, entityNumbers->numSnapshotEntities,
+		sizeof( entityNumbers->snapshotEntities[0] ), SV_QsortEntityNumbers );
+	for ( i = 1 ; i < entityNumbers->numSnapshotEntities ; i++ ) {
+		if ( entityNumbers->snapshotEntities[i] == entityNumbers->snapshotEntities[i - 1] ) {
+			entityNumbers->error = "SV_QsortEntityStates: duplicated entity";
+			return qfalse;
+		}
+	}
 
 	// now that all viewpoint's areabits have been OR'd together, invert
 	// all of them to make it a mask vector, which is what the renderer wants
@@ -530,11 +943,31 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 		((int *)frame->areabits)[i] = ((int *)frame->areabits)[i] ^ -1;
 	}
 
+	return qtrue;
+}
+
+/*
+=============
+SV_StoreClientSnapshotEntities
+
+Copies the entity states out into the shared svs.snapshotEntities ring.
+Must be called in client order to keep the ring layout independent of
+sv_snapshotThreads.
+=============
+*/
+static void SV_StoreClientSnapshotEntities( client_t *client, const snapshotEntityNumbers_t *entityNumbers ) {
+	clientSnapshot_t			*frame;
+	int							i;
+	sharedEntity_t				*ent;
+	entityState_t				*state;
+
+	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
+
 	// copy the entity states out
 	frame->num_entities = 0;
 	frame->first_entity = svs.nextSnapshotEntities;
-	for ( i = 0 ; i < entityNumbers.numSnapshotEntities ; i++ ) {
-		ent = SV_GentityNum(entityNumbers.snapshotEntities[i]);
+	for ( i = 0 ; i < entityNumbers->numSnapshotEntities ; i++ ) {
+		ent = SV_GentityNum(entityNumbers->snapshotEntities[i]);
 		state = &svs.snapshotEntities[svs.nextSnapshotEntities % svs.numSnapshotEntities];
 		*state = ent->s;
 		svs.nextSnapshotEntities++;
@@ -546,6 +979,21 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 	}
 }
 
+/*
+=============
+SV_BuildClientSnapshot
+=============
+*/
+static void SV_BuildClientSnapshot( client_t *client ) {
+	snapshotEntityNumbers_t		entityNumbers;
+
+	if ( SV_BuildClientSnapshotEntities( client, &entityNumbers ) ) {
+		SV_StoreClientSnapshotEntities( client, &entityNumbers );
+	} else {
+		SV_CheckSnapshotEntities( &entityNumbers );
+	}
+}
+
 
 /*
 ====================
@@ -631,6 +1079,69 @@ void SV_SendMessageToClient( msg_t *msg, client_t *client ) {
 }
 
 
+/*
+=======================
+SV_BeginClientSnapshotMessage
+
+Starts a message with the reliable commands the client hasn't acknowledged
+yet. Returns qfalse if they didn't all fit, in which case the message has to
+be sent as is, without a snapshot.
+=======================
+*/
+static qboolean SV_BeginClientSnapshotMessage( client_t *client, msg_t *msg, byte *msg_buf ) {
+	MSG_Init (msg, msg_buf, MAX_MSGLEN);
+	msg->allowoverflow = qtrue;
+
+	// NOTE, MRE: all server->client messages now acknowledge
+	// let the client know which reliable clientCommands we have received
+	MSG_WriteLong( msg, client->lastClientCommand );
+
+	// (re)send any reliable server commands
+	return SV_UpdateServerCommandsToClient(client, msg, qtrue);
+}
+
+/*
+=======================
+SV_FinishClientSnapshotMessage
+
+Adds any download data to a message holding a snapshot and sends it.
+msgBak is the state of the message from before the snapshot was written.
+=======================
+*/
+static void SV_FinishClientSnapshotMessage( client_t *client, msg_t *msg, msg_t *msgBak ) {
+	if ( sv_dynamicSnapshots->integer && msg->overflowed && !msgBak->overflowed ) {
+		// The entity states were too much and the message overflowed. So send
+		// the old state of the message from before we tried to append the
+		// entity states. As the net code doesn't send the msg_buf content after
+		// the current size of the message we don't have to clear anything and
+		// we can just use the old msg values (which point to the updated buffer).
+		SV_SendMessageToClient( msgBak, client );
+		return;
+	}
+
+	// Backup the msg state in case the download would overflow it
+	memcpy( msgBak, msg, sizeof(*msgBak) );
+
+	// Add any download data if the client is downloading
+	SV_WriteDownloadToClient( client, msg );
+
+	if ( sv_dynamicSnapshots->integer && msg->overflowed && !msgBak->overflowed ) {
+		// Downloads usually don't happen in situations that are likely to have
+		// message overflows, but let's make sure and apply the same logic we
+		// used for the entity states.
+		SV_SendMessageToClient( msgBak, client );
+		return;
+	}
+
+	// check for overflow
+	if ( msg->overflowed ) {
+		Com_Printf ("WARNING: msg overflowed for %s\n", client->name);
+		MSG_Clear (msg);
+	}
+
+	SV_SendMessageToClient( msg, client );
+}
+
 /*
 =======================
 SV_SendClientSnapshot
@@ -640,9 +1151,11 @@ Also called by SV_FinalMessage
 =======================
 */
 void SV_SendClientSnapshot( client_t *client ) {
-	byte		msg_buf[MAX_MSGLEN];
-	msg_t		msg;
-	msg_t		msgBak;
+	byte				msg_buf[MAX_MSGLEN];
+	msg_t				msg;
+	msg_t				msgBak;
+	clientSnapshot_t	*oldframe;
+	int					lastframe;
 
 	// build the snapshot
 	SV_BuildClientSnapshot( client );
@@ -653,15 +1166,7 @@ void SV_SendClientSnapshot( client_t *client ) {
 		return;
 	}
 
-	MSG_Init (&msg, msg_buf, sizeof(msg_buf));
-	msg.allowoverflow = qtrue;
-
-	// NOTE, MRE: all server->client messages now acknowledge
-	// let the client know which reliable clientCommands we have received
-	MSG_WriteLong( &msg, client->lastClientCommand );
-
-	// (re)send any reliable server commands
-	if ( !SV_UpdateServerCommandsToClient(client, &msg, qtrue) ) {
+	if ( !SV_BeginClientSnapshotMessage( client, &msg, msg_buf ) ) {
 		// If we can't fit all commands in a single message send what we got and
 		// don't even try to send entities
 		SV_SendMessageToClient( &msg, client );
@@ -673,41 +1178,191 @@ void SV_SendClientSnapshot( client_t *client ) {
 
 	// send over all the relevant entityState_t
 	// and the playerState_t
-	SV_WriteSnapshotToClient( client, &msg );
+	oldframe = SV_SnapshotDeltaFrame( client, &lastframe );
+	SV_WriteSnapshotToClient( client, &msg, oldframe, lastframe );
 
-	if ( sv_dynamicSnapshots->integer && msg.overflowed && !msgBak.overflowed ) {
-		// The entity states were too much and the message overflowed. So send
-		// the old state of the message from before we tried to append the
-		// entity states. As the net code doesn't send the msg_buf content after
-		// the current size of the message we don't have to clear anything and
-		// we can just use the old msg values (which point to the updated buffer).
-		SV_SendMessageToClient( &msgBak, client );
-		return;
-	}
+	SV_FinishClientSnapshotMessage( client, &msg, &msgBak );
+}
 
-	// Backup the msg state in case the download would overflow it
-	memcpy( &msgBak, &msg, sizeof(msgBak) );
+/*
+=============================================================================
 
-	// Add any download data if the client is downloading
-	SV_WriteDownloadToClient( client, &msg );
+Threaded snapshots
 
-	if ( sv_dynamicSnapshots->integer && msg.overflowed && !msgBak.overflowed ) {
-		// Downloads usually don't happen in situations that are likely to have
-		// message overflows, but let's make sure and apply the same logic we
-		// used for the entity states.
-		SV_SendMessageToClient( &msgBak, client );
-		return;
+With sv_snapshotThreads > 1 the visibility checks and the delta and huffman
+encoding for all clients due for a snapshot are spread over job threads.
+Everything touching shared state (the snapshotEntities ring, reliable
+commands, downloads and the network) stays on the main thread and runs in
+client order, so the resulting packets are identical to the serial path.
+
+=============================================================================
+*/
+
+typedef struct {
+	client_t				*client;
+	qboolean				fragment;	// only send the next fragment of the last message
+	qboolean				built;		// SV_BuildClientSnapshotEntities succeeded
+	qboolean				send;		// not a bot and all reliable commands fit
+	clientSnapshot_t		*oldframe;
+	int						lastframe;
+	snapshotEntityNumbers_t	entityNumbers;
+	msg_t					msg;
+	msg_t					msgBak;
+	byte					msgBuf[MAX_MSGLEN];
+} snapshotJob_t;
+
+static snapshotJob_t	snapshotJobs[MAX_CLIENTS];
+
+typedef struct {
+	int			frames;
+	int			snapshots;
+	int64_t		usec;
+} snapshotTiming_t;
+
+static snapshotTiming_t	snapshotTiming[2];		// serial, threaded
+
+/*
+=======================
+SV_BuildSnapshotJob
+
+Errors are left in entityNumbers for the main thread. SV_SvEntityForGentity
+can't fail here, SV_FixSnapshotEntityNumbers has run first.
+=======================
+*/
+static void SV_BuildSnapshotJob( void *data, int index, int threadNum ) {
+	snapshotJob_t	*job = (snapshotJob_t *)data + index;
+
+	if ( !job->fragment ) {
+		job->built = SV_BuildClientSnapshotEntities( job->client, &job->entityNumbers );
+	}
+}
+
+/*
+=======================
+SV_WriteSnapshotJob
+=======================
+*/
+static void SV_WriteSnapshotJob( void *data, int index, int threadNum ) {
+	snapshotJob_t	*job = (snapshotJob_t *)data + index;
+
+	if ( job->send ) {
+		SV_WriteSnapshotToClient( job->client, &job->msg, job->oldframe, job->lastframe );
 	}
+}
 
-	// check for overflow
-	if ( msg.overflowed ) {
-		Com_Printf ("WARNING: msg overflowed for %s\n", client->name);
-		MSG_Clear (&msg);
+/*
+=======================
+SV_SnapshotJobFirstEntity
+
+The oldest entry of the snapshotEntities ring the job still has to read
+from, or -1 if it reads none
+=======================
+*/
+static int SV_SnapshotJobFirstEntity( const snapshotJob_t *job ) {
+	const clientSnapshot_t	*frame;
+
+	if ( !job->send ) {
+		return -1;
+	}
+	if ( job->oldframe ) {
+		return job->oldframe->first_entity;
 	}
 
-	SV_SendMessageToClient( &msg, client );
+	frame = &job->client->frames[ job->client->netchan.outgoingSequence & PACKET_MASK ];
+	return frame->first_entity;
 }
 
+/*
+=======================
+SV_SendClientSnapshotsThreaded
+=======================
+*/
+static void SV_SendClientSnapshotsThreaded( int numJobs, int numThreads ) {
+	snapshotJob_t	*job;
+	client_t		*c;
+	int				i;
+	int				firstUnwritten;		// the first job whose snapshot isn't encoded yet
+	int				oldestEntity;		// oldest ring entry those jobs read from, -1 for none
+	int				first;
+
+	// find the visible entities of all clients
+	Com_ParallelFor( numJobs, numThreads, SV_BuildSnapshotJob, snapshotJobs );
+
+	for ( i = 0, job = snapshotJobs ; i < numJobs ; i++, job++ ) {
+		if ( !job->fragment && !job->built ) {
+			SV_CheckSnapshotEntities( &job->entityNumbers );
+		}
+	}
+
+	// copy the entity states out in client order and start the messages
+	firstUnwritten = 0;
+	oldestEntity = -1;
+	for ( i = 0, job = snapshotJobs ; i < numJobs ; i++, job++ ) {
+		c = job->client;
+		job->send = qfalse;
+
+		if ( job->fragment ) {
+			continue;
+		}
+
+		if ( job->built ) {
+			// the serial path encodes every snapshot before the next client's
+			// entities go into the ring, so encode the waiting ones first if
+			// these would overwrite anything they still have to read
+			if ( oldestEntity >= 0 && svs.nextSnapshotEntities + job->entityNumbers.numSnapshotEntities -
+				svs.numSnapshotEntities > oldestEntity ) {
+				Com_ParallelFor( i - firstUnwritten, numThreads, SV_WriteSnapshotJob, snapshotJobs + firstUnwritten );
+				firstUnwritten = i;
+				oldestEntity = -1;
+			}
+
+			SV_StoreClientSnapshotEntities( c, &job->entityNumbers );
+		}
+
+		// bots need to have their snapshots build, but
+		// the query them directly without needing to be sent
+		if ( c->gentity && c->gentity->r.svFlags & SVF_BOT ) {
+			continue;
+		}
+
+		if ( !SV_BeginClientSnapshotMessage( c, &job->msg, job->msgBuf ) ) {
+			continue;
+		}
+
+		// Backup the msg state in case the snapshot would overflow it
+		memcpy( &job->msgBak, &job->msg, sizeof(job->msgBak) );
+
+		// must be picked right after storing this client's entities, like
+		// the serial path does, as it depends on svs.nextSnapshotEntities
+		job->oldframe = SV_SnapshotDeltaFrame( c, &job->lastframe );
+		job->send = qtrue;
+
+		first = SV_SnapshotJobFirstEntity( job );
+		if ( oldestEntity < 0 || first < oldestEntity ) {
+			oldestEntity = first;
+		}
+	}
+
+	// delta and huffman encode the snapshots
+	Com_ParallelFor( numJobs - firstUnwritten, numThreads, SV_WriteSnapshotJob, snapshotJobs + firstUnwritten );
+
+	// send everything in client order
+	for ( i = 0, job = snapshotJobs ; i < numJobs ; i++, job++ ) {
+		c = job->client;
+
+		if ( job->fragment ) {
+			c->nextSnapshotTime = svs.time +
+				SV_RateMsec( c, c->netchan.unsentLength - c->netchan.unsentFragmentStart );
+			SV_Netchan_TransmitNextFragment( &c->netchan );
+		} else if ( job->send ) {
+			SV_FinishClientSnapshotMessage( c, &job->msg, &job->msgBak );
+		} else if ( !(c->gentity && c->gentity->r.svFlags & SVF_BOT) ) {
+			// If we can't fit all commands in a single message send what we got and
+			// don't even try to send entities
+			SV_SendMessageToClient( &job->msg, c );
+		}
+	}
+}
 
 /*
 =======================
@@ -717,6 +1372,33 @@ SV_SendClientMessages
 void SV_SendClientMessages( void ) {
 	int			i;
 	client_t	*c;
+	int			numThreads;
+	int			numJobs;
+	int			numSnapshots;
+	int64_t		start;
+	snapshotTiming_t	*timing;
+
+	start = Sys_Microseconds();
+
+	SV_DeltaCacheNewFrame();
+
+	// hand all snapshots to the system at once
+	Sys_BeginPacketBatch();
+
+	// the game module may change entities for every single player
+	// snapshot, so they can't be built ahead of time
+	numThreads = sv.vmPlayerSnapshots ? 1 : sv_snapshotThreads->integer;
+	numJobs = 0;
+	numSnapshots = 0;
+
+	if ( sv.state && (numThreads > 1 || sv_snapshotVisSets->integer) ) {
+		SV_FixSnapshotEntityNumbers();
+	}
+
+	// the same goes for grouping entities by cluster
+	if ( sv.state && sv_snapshotVisSets->integer && !sv.vmPlayerSnapshots ) {
+		SV_BuildSnapshotVisSets();
+	}
 
 	// send a message to each connected client
 	for (i=0, c = svs.clients ; i < sv_maxclients->integer ; i++, c++) {
@@ -731,6 +1413,13 @@ void SV_SendClientMessages( void ) {
 		// send additional message fragments if the last message
 		// was too large to send at once
 		if ( c->netchan.unsentFragments ) {
+			if ( numThreads > 1 ) {
+				// keep the packets in client order
+				snapshotJobs[numJobs].client = c;
+				snapshotJobs[numJobs].fragment = qtrue;
+				numJobs++;
+				continue;
+			}
 			c->nextSnapshotTime = svs.time +
 				SV_RateMsec( c, c->netchan.unsentLength - c->netchan.unsentFragmentStart );
 			SV_Netchan_TransmitNextFragment( &c->netchan );
@@ -741,12 +1430,184 @@ void SV_SendClientMessages( void ) {
 			continue;
 		}
 
+		numSnapshots++;
+
+		if ( numThreads > 1 ) {
+			snapshotJobs[numJobs].client = c;
+			snapshotJobs[numJobs].fragment = qfalse;
+			numJobs++;
+			continue;
+		}
+
 		// generate and send a new message
 		SV_SendClientSnapshot( c );
 	}
 
+	if ( numJobs ) {
+		SV_SendClientSnapshotsThreaded( numJobs, numThreads );
+	}
+
+	Sys_FlushPacketBatch();
+
+	visSets.valid = qfalse;
+
 	if ( sv.vmPlayerSnapshots ) {
 		VM_Call( gvm, GAME_MVAPI_PLAYERSNAPSHOT, -1 );
 	}
+
+	if ( numSnapshots ) {
+		timing = &snapshotTiming[numThreads > 1];
+		timing->frames++;
+		timing->snapshots += numSnapshots;
+		timing->usec += Sys_Microseconds() - start;
+	}
 }
 
+/*
+=======================
+SV_SnapshotStats_f
+
+Compares the time spent in SV_SendClientMessages with and without
+sv_snapshotThreads and shows how many entity deltas came from the cache
+=======================
+*/
+void SV_SnapshotStats_f( void ) {
+	static const char	*modeNames[2] = { "serial", "threaded" };
+	snapshotTiming_t	*timing;
+	double				snapUsec[2];
+	int					hits, misses, uncached;
+	int					i;
+
+	if ( Cmd_Argc() > 1 && !Q_stricmp( Cmd_Argv(1), "reset" ) ) {
+		Com_Memset( snapshotTiming, 0, sizeof( snapshotTiming ) );
+		deltaCache.hits = 0;
+		deltaCache.misses = 0;
+		deltaCache.uncached = 0;
+		Com_Printf( "Snapshot timings reset.\n" );
+		return;
+	}
+
+	Com_Printf( "mode     frames    snaps/frame  usec/frame  usec/snap\n" );
+	Com_Printf( "-------- --------- ------------ ----------- ----------\n" );
+	for ( i = 0; i < 2; i++ ) {
+		timing = &snapshotTiming[i];
+		snapUsec[i] = 0.0;
+
+		if ( !timing->frames ) {
+			Com_Printf( "%-8s %9i\n", modeNames[i], 0 );
+			continue;
+		}
+
+		snapUsec[i] = (double)timing->usec / timing->snapshots;
+		Com_Printf( "%-8s %9i %12.1f %11.1f %10.1f\n", modeNames[i], timing->frames,
+			(double)timing->snapshots / timing->frames, (double)timing->usec / timing->frames,
+			snapUsec[i] );
+	}
+
+	if ( snapUsec[0] > 0.0 && snapUsec[1] > 0.0 ) {
+		Com_Printf( "speedup per snapshot: %.2fx (sv_snapshotThreads %i)\n", snapUsec[0] / snapUsec[1], sv_snapshotThreads->integer );
+	}
+
+	hits = deltaCache.hits;
+	misses = deltaCache.misses;
+	uncached = deltaCache.uncached;
+	if ( hits + misses + uncached ) {
+		Com_Printf( "delta cache: %i hits, %i misses, %i uncached (%.1f%% hit rate)\n", hits, misses, uncached,
+			100.0 * hits / (hits + misses + uncached) );
+	}
+}
+
+/*
+=======================
+SV_SnapshotVisBench_f
+
+Times finding the visible entities of all clients with a scan over all
+entities against the per-frame visibility sets and checks that both give
+the same result
+=======================
+*/
+void SV_SnapshotVisBench_f( void ) {
+	static snapshotEntityNumbers_t	scanNumbers, setNumbers;
+	clientSnapshot_t	frameBackup;
+	clientSnapshot_t	*frame;
+	client_t			*c;
+	int64_t				scanUsec, setUsec, buildUsec, start;
+	int					iterations;
+	int					numClients, mismatches;
+	int					i, n;
+
+	if ( sv.state != SS_GAME ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	iterations = Cmd_Argc() > 1 ? atoi( Cmd_Argv(1) ) : 100;
+	if ( iterations < 1 ) {
+		iterations = 1;
+	}
+
+	SV_FixSnapshotEntityNumbers();
+
+	scanUsec = setUsec = buildUsec = 0;
+	numClients = mismatches = 0;
+
+	for ( n = 0 ; n < iterations ; n++ ) {
+		start = Sys_Microseconds();
+		SV_BuildSnapshotVisSets();
+		buildUsec += Sys_Microseconds() - start;
+
+		for ( i = 0, c = svs.clients ; i < sv_maxclients->integer ; i++, c++ ) {
+			if ( c->state < CS_PRIMED || !c->gentity ) {
+				continue;
+			}
+
+			// the frame about to be built is used as scratch space
+			frame = &c->frames[ c->netchan.outgoingSequence & PACKET_MASK ];
+			frameBackup = *frame;
+
+			visSets.valid = qfalse;
+			start = Sys_Microseconds();
+			SV_BuildClientSnapshotEntities( c, &scanNumbers );
+			scanUsec += Sys_Microseconds() - start;
+
+			visSets.valid = qtrue;
+			start = Sys_Microseconds();
+			SV_BuildClientSnapshotEntities( c, &setNumbers );
+			setUsec += Sys_Microseconds() - start;
+
+			*frame = frameBackup;
+
+			SV_CheckSnapshotEntities( &scanNumbers );
+			SV_CheckSnapshotEntities( &setNumbers );
+
+			if ( scanNumbers.numSnapshotEntities != setNumbers.numSnapshotEntities ||
+				memcmp( scanNumbers.snapshotEntities, setNumbers.snapshotEntities,
+					scanNumbers.numSnapshotEntities * sizeof( scanNumbers.snapshotEntities[0] ) ) ) {
+				mismatches++;
+			}
+
+			if ( n == 0 ) {
+				numClients++;
+			}
+		}
+	}
+
+	visSets.valid = qfalse;
+
+	if ( !numClients ) {
+		Com_Printf( "No clients to build snapshots for.\n" );
+		return;
+	}
+
+	Com_Printf( "%i clients, %i entities, %i clusters, %i iterations\n", numClients, sv.num_entities, visSets.numClusters, iterations );
+	Com_Printf( "entity scan:     %8.1f usec/frame\n", (double)scanUsec / iterations );
+	Com_Printf( "visibility sets: %8.1f usec/frame (%.1f usec building the sets)\n", (double)(setUsec + buildUsec) / iterations, (double)buildUsec / iterations );
+	if ( setUsec + buildUsec > 0 ) {
+		Com_Printf( "speedup: %.2fx\n", (double)scanUsec / (setUsec + buildUsec) );
+	}
+	if ( mismatches ) {
+		Com_Printf( S_COLOR_RED "%i snapshots differ between both paths!\n", mismatches );
+	} else {
+		Com_Printf( "Both paths produced identical snapshots.\n" );
+	}
+}
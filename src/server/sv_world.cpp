@@ -371,6 +371,9 @@ typedef struct {
 	int			count, maxcount;
 } areaParms_t;
 
+// overflows on the job threads, printed by SV_TraceBatch as jobs must not print
+static int	areaEntitiesOverflows[MAX_JOB_THREADS];
+
 
 /*
 ====================
@@ -400,7 +403,13 @@ void SV_AreaEntities_r( worldSector_t *node, areaParms_t *ap ) {
 		}
 
 		if ( ap->count >= ap->maxcount ) {
-			Com_Printf ("SV_AreaEntities: MAXCOUNT\n");
+			int threadNum = Com_JobThreadNum();
+
+			if ( threadNum ) {
+				areaEntitiesOverflows[threadNum]++;
+			} else {
+				Com_Printf ("SV_AreaEntities: MAXCOUNT\n");
+			}
 			return;
 		}
 
@@ -759,6 +768,109 @@ Ghoul2 Insert End
 	*results = clip.trace;
 }
 
+typedef struct {
+	trace_t			*results;
+	const mvtrace_t	*traces;
+} traceBatch_t;
+
+static struct {
+	int64_t		batches[2];		// serial, threaded
+	int64_t		traces[2];
+	int64_t		usec[2];
+} traceStats;
+
+/*
+==================
+SV_TraceBatchJob
+==================
+*/
+static void SV_TraceBatchJob( void *data, int index, int threadNum ) {
+	traceBatch_t	*batch = (traceBatch_t *)data;
+	const mvtrace_t	*t = &batch->traces[index];
+
+	SV_Trace( &batch->results[index], t->start, t->mins, t->maxs, t->end, t->passEntityNum,
+		t->contentmask, (qboolean)!!t->capsule, t->traceFlags, t->useLod );
+}
+
+/*
+==================
+SV_TraceBatch
+
+Runs numTraces independent SV_Trace calls for the game module. With
+sv_traceThreads > 1 they are spread over the job threads: the clip map
+has a box hull and check marks per thread and the entity links are not
+touched while the batch runs.
+==================
+*/
+void SV_TraceBatch( trace_t *results, const mvtrace_t *traces, int numTraces ) {
+	traceBatch_t	batch;
+	int64_t			start;
+	int				numThreads;
+	int				i;
+
+	if ( !results || !traces || numTraces <= 0 ) {
+		return;
+	}
+
+	// bad entity numbers have to be dropped from the main thread
+	for ( i = 0 ; i < numTraces ; i++ ) {
+		if ( traces[i].passEntityNum >= 0 && traces[i].passEntityNum != ENTITYNUM_NONE ) {
+			SV_GentityNum( traces[i].passEntityNum );
+		}
+	}
+
+	numThreads = sv_traceThreads->integer;
+	if ( numThreads > CM_NumThreads() ) {
+		numThreads = CM_NumThreads();
+	}
+
+	batch.results = results;
+	batch.traces = traces;
+
+	start = Sys_Microseconds();
+	Com_ParallelFor( numTraces, numThreads, SV_TraceBatchJob, &batch );
+
+	for ( i = 1 ; i < MAX_JOB_THREADS ; i++ ) {
+		for ( ; areaEntitiesOverflows[i] ; areaEntitiesOverflows[i]-- ) {
+			Com_Printf ("SV_AreaEntities: MAXCOUNT\n");
+		}
+	}
+
+	i = numThreads > 1 ? 1 : 0;
+	traceStats.batches[i]++;
+	traceStats.traces[i] += numTraces;
+	traceStats.usec[i] += Sys_Microseconds() - start;
+}
+
+/*
+==================
+SV_TraceStats_f
+
+Shows the average cost of a batched trace with and without threads
+==================
+*/
+void SV_TraceStats_f( void ) {
+	static const char	*modes[2] = { "serial", "threaded" };
+	int					i;
+
+	if ( Cmd_Argc() > 1 && !Q_stricmp( Cmd_Argv(1), "reset" ) ) {
+		Com_Memset( &traceStats, 0, sizeof( traceStats ) );
+		return;
+	}
+
+	for ( i = 0 ; i < 2 ; i++ ) {
+		if ( !traceStats.traces[i] ) {
+			Com_Printf( "%-8s: no batches\n", modes[i] );
+			continue;
+		}
+		Com_Printf( "%-8s: %lli batches, %lli traces, %.1f traces/batch, %.2f usec/trace\n", modes[i],
+			(long long)traceStats.batches[i], (long long)traceStats.traces[i],
+			(double)traceStats.traces[i] / traceStats.batches[i],
+			(double)traceStats.usec[i] / traceStats.traces[i] );
+	}
+	Com_Printf( "sv_traceThreads %i, %i clip map threads\n", sv_traceThreads->integer, CM_NumThreads() );
+}
+
 
 
 /*
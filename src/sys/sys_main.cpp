@@ -3,6 +3,7 @@
 #include <cstdarg>
 #include <cstdio>
 #include <sys/stat.h>
+#include <chrono>
 #define __STDC_FORMAT_MACROS
 #if (defined(_MSC_VER) && _MSC_VER < 1800)
 #include <stdint.h>
@@ -296,19 +297,48 @@ void Q_NORETURN Sys_Quit(void) {
 	Sys_Exit(0);
 }
 
+/*
+================
+Sys_Microseconds
+
+Monotonic high resolution clock, only meant for profiling
+================
+*/
+int64_t Sys_Microseconds(void) {
+	static const std::chrono::steady_clock::time_point sys_baseTime = std::chrono::steady_clock::now();
+
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - sys_baseTime).count();
+}
+
+/*
+================
+Sys_Nanoseconds
+
+Same clock as Sys_Microseconds, for timing short calls
+================
+*/
+int64_t Sys_Nanoseconds(void) {
+	static const std::chrono::steady_clock::time_point sys_baseTime = std::chrono::steady_clock::now();
+
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - sys_baseTime).count();
+}
+
 /*
 ============
 Sys_FileTime
 
-returns -1 if not present
+returns -1 if not present, optionally returns the size too
 ============
 */
-time_t Sys_FileTime(const char *path) {
+time_t Sys_FileTime(const char *path, int64_t *size) {
 	struct stat buf;
 
 	if (stat(path, &buf) == -1)
 		return -1;
 
+	if (size)
+		*size = buf.st_size;
+
 	return buf.st_mtime;
 }
 
@@ -94,6 +94,8 @@ void CON_DeleteConsoleWindow(void);
 // any game related timing information should come from event timestamps
 int		Sys_Milliseconds (bool baseTime = false);
 int		Sys_Milliseconds2(void);
+int64_t	Sys_Microseconds(void);
+int64_t	Sys_Nanoseconds(void);
 void	Sys_Sleep( int msec );
 
 extern "C" void	Sys_SnapVector( float *v );
@@ -103,6 +105,8 @@ bool Sys_RandomBytes( byte *string, int len );
 void	Sys_SetErrorText( const char *text );
 
 void	Sys_SendPacket( int length, const void *data, netadr_t to );
+void	Sys_BeginPacketBatch( void );
+void	Sys_FlushPacketBatch( void );
 
 qboolean	Sys_StringToAdr( const char *s, netadr_t *a );
 //Does NOT parse port numbers, only base addresses.
@@ -132,13 +136,15 @@ const char **Sys_ListFiles( const char *directory, const char *extension, char *
 void	Sys_FreeFileList( const char **fileList );
 //rwwRMG - changed to fileList to not conflict with list type
 
-time_t Sys_FileTime( const char *path );
+time_t Sys_FileTime( const char *path, int64_t *size = NULL );
 
 qboolean Sys_LowPhysicalMemory();
 
 void Sys_SetProcessorAffinity( void );
 
 int Sys_FLock(int fd, flockCmd_t cmd, qboolean nb);
+void *Sys_MapFile(int fd, int len);
+void Sys_UnmapFile(void *ptr, int len);
 void Sys_PrintBacktrace(void);
 
 const char *Sys_ResolvePath( const char *path );
@@ -659,6 +659,20 @@ int Sys_FLock(int fd, flockCmd_t cmd, qboolean nb) {
 	return fcntl(fd, nb ? F_SETLK : F_SETLKW, &l);
 }
 
+void *Sys_MapFile(int fd, int len) {
+	void *ptr = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	if (ptr == MAP_FAILED) {
+		return NULL;
+	}
+
+	return ptr;
+}
+
+void Sys_UnmapFile(void *ptr, int len) {
+	munmap(ptr, len);
+}
+
 static int Sys_Backtrace(void **buffer, int size);
 void Sys_PrintBacktrace(void) {
 #define BT_LEN 20
@@ -436,6 +436,31 @@ int Sys_FLock(int fd, flockCmd_t cmd, qboolean nb) {
 	return res ? 0 : -1;
 }
 
+void *Sys_MapFile(int fd, int len) {
+	HANDLE h = (HANDLE) _get_osfhandle(fd);
+	HANDLE mapping;
+	void *ptr;
+
+	if (h == INVALID_HANDLE_VALUE) {
+		return NULL;
+	}
+
+	mapping = CreateFileMapping(h, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mapping) {
+		return NULL;
+	}
+
+	// the view keeps the mapping alive
+	ptr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, len);
+	CloseHandle(mapping);
+
+	return ptr;
+}
+
+void Sys_UnmapFile(void *ptr, int len) {
+	UnmapViewOfFile(ptr);
+}
+
 void Sys_PrintBacktrace(void) {}
 
 void Sys_PlatformExit(void)
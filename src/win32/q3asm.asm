@@ -65,6 +65,10 @@ IFDEF ARCH_X86_64
 		push rsi					; push non-volatile registers to stack
 		push rdi
 		push rbx
+		push r12					; used by the optimizing vm compiler
+		push r13
+		push r14
+		push r15
 		push rcx					; need to save pointer in rcx so we can write back the programData value to caller
 
 		; registers r8 and r9 have correct value already thanx to __fastcall
@@ -79,6 +83,10 @@ IFDEF ARCH_X86_64
 		mov dword ptr [rcx], esi	; write back the programStack value
 		mov al, bl					; return opStack offset
 
+		pop r15
+		pop r14
+		pop r13
+		pop r12
 		pop rbx
 		pop rdi
 		pop rsi